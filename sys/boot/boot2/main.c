@@ -42,6 +42,7 @@
 #include <elf_loader.h>
 #include <elf.h>
 #include <asm_subroutines.h>
+#include <boottime.h>
 
 #ifdef DIVERSITY
 #include <sha256.h>
@@ -60,8 +61,10 @@
  */
 #ifdef KBOOT
 #define BINARYTE "/kernel"
+#define STAGE "kboot2: "		/* boot timeline marks */
 #else
 #define BINARYTE "/binaryte"
+#define STAGE "boot2: "
 #endif
 
 extern int read(FIL *, FILINFO *, uint64_t *);
@@ -189,7 +192,9 @@ static Proc_t *load_elf_bin( uint64_t fs_offset ) {
   proc->file->num_diversity_units++;
 
   /* diversify the process! */
+  boottime_mark(STAGE "diversify");
   diversify( proc, &ctx );
+  boottime_mark(STAGE "handoff");
   sha256_final(&ctx, hash);
   print_hash(hash);                                                        
   kfree(stackunit->hdr);
@@ -227,20 +232,25 @@ void start() {
 #ifdef ENABLE_SMP
   if(bsp_ready == 1)
     {
-      asm volatile("movq $0x7bf8,%%rsp\n\t"
-		   "movq %0,%%rbx \n\t"
+      /* an AP, on the stack the trampoline or the hypervisor gave it */
+      asm volatile("movq %0,%%rbx \n\t"
 		   "jmp *%%rbx"
 		   :: "p"(core_boot_ptr));
     }
   bsp_ready = 1;
+#endif
+#ifndef KBOOT			/* kboot2's was copied in by the hypervisor */
+  boottime_init();
 #endif
   kprintf("[Boot2]\n");
 #ifdef DEBUG
   kputs("[Boot] Entered C entry routine.");
 #endif
 
+  boottime_mark(STAGE "bootmemory_init");
   bootmemory_init();
 
+  boottime_mark(STAGE "vmem_init");
   vmem_init();
 
   /* Load the hypervisor into memory, start using it. */
@@ -256,6 +266,7 @@ void start() {
 #ifdef DEBUG
   kprintf("[Boot] Filesystem Offset is %d\n", fs_offset);
 #endif
+  boottime_mark(STAGE "load " BINARYTE);
   proc = load_elf_bin(fs_offset);
 
 #ifdef DEBUG
@@ -33,10 +33,31 @@
 #include <vk.h>
 #include <kvmem.h>
 #include <vmx_utils.h>
+#include <tsc.h>
 
 extern struct RSDPDescriptor20 rsdpdesc;
 static int first = 1;
 
+/* Cache of recently walked leaf tables, so that ept_walk does not have to go
+ * through the PML4T, PDPT and PD every time. Each entry covers the 2MB of
+ * guest-physical memory mapped by one page table. Tables are only freed by
+ * destroy_ept, which empties the cache.
+ */
+struct ept_cache_entry {
+  uint64_t eptp;                       /* PML4T address, flags masked off */
+  uint64_t region;                     /* guest_paddr >> 21 */
+  struct page_directory_pointer_table *pdpt;
+  struct page_directory *pd;
+  struct page_table *pt;
+};
+
+static struct ept_cache_entry ept_cache[EPT_CACHE_SIZE];
+static uint64_t ept_cache_hits;
+static uint64_t ept_cache_misses;
+
+#define ept_cache_slot(eptp, region)				\
+  (&ept_cache[((region) ^ ((eptp) >> 12)) % EPT_CACHE_SIZE])
+
 #define VIRT    1
 #define PHYS    0
 #define CACHE   1
@@ -101,6 +122,12 @@ void create_ept(vproc_t *vp) {
   kprintf("     [vproc] Creating EPT tables pml4t = 0x%x\n", pml4t);
 #endif
 
+  /* Set the extended page table pointer. */
+  vp->peptp = virt2phys(pml4t);             /* The PML4T */
+  vp->peptp |= (3 << 3);                    /* Page-walk length */
+  vp->peptp |= 6;                           /* Make EPT structures cacheable*/
+
+#ifdef EPT_EAGER
   /* Set initial values so that the first elements of the page-table chain
    * will be created upon loop entry. */
   pml4t_idx = -1;
@@ -171,6 +198,24 @@ void create_ept(vproc_t *vp) {
       
     pt_idx++;
   }
+  vp->ept_frames = vp->memsz / PAGE_SIZE;
+#else
+  /* Guest RAM is backed on first touch (see ept_fault). The only page we 
+   * need now is the one the memory map lives in, since we fill it in below.
+   */
+  paddr = ept_populate(vp, MEMORY_MAP);
+  vaddr = vkmalloc(vk_heap, 1);
+  attach_page(vaddr, paddr, PG_RW);
+  vp->memmap = (struct memmap *)(vaddr + (MEMORY_MAP % PAGE_SIZE));
+  vp->memmap_entries = (uint16_t*)(vaddr + (MEMORY_MAP_ENTRIES % PAGE_SIZE));
+  *(vp->memmap_entries) = 0x0;
+
+  /* The ramdisk and ACPI tables are mapped just above guest RAM. */
+  pml4t_idx = virt2pml4t(vp->memsz);
+  pdpt_idx = virt2pdpt(vp->memsz);
+  pd_idx = virt2pd(vp->memsz);
+  pt_idx = virt2pt(vp->memsz);
+#endif
 
   /* this giant chunk will be added to the memmap as two regions:
      1: unusable low memory where "boot1" (in our case the hypv pretending
@@ -303,7 +348,7 @@ void create_ept(vproc_t *vp) {
      point to the new block we will add to the ept, which contains the mappings
      to the ACPI tables. */
   vaddr = vkmalloc(vk_heap, 1);
-  paddr = ept_walk(0x9fc00, (uint64_t)virt2phys(pml4t), 0, 0, 0);
+  paddr = ept_populate(vp, 0x9fc00);
 
   attach_page(vaddr, paddr, PG_RW);
 
@@ -385,11 +430,6 @@ void create_ept(vproc_t *vp) {
   /* we need to add this to the memmap */
   add_to_memmap(vp, vp->memsz+RAMDISK_SIZE, acpi_end - acpi_start, 3);
 
-  /* Set the extended page table pointer. */
-  vp->peptp = virt2phys(pml4t);             /* The PML4T */
-  vp->peptp |= (3 << 3);                    /* Page-walk length */
-  vp->peptp |= 6;                           /* Make EPT structures cacheable*/
-  
 #ifdef DEBUG
   kprintf("Finished creating EPT structures vp->ept 0x%x\n",vp->peptp);
 #endif
@@ -421,6 +461,22 @@ uint64_t ept_walk(uint64_t guest_paddr,
   struct page_directory_pointer_table *_pdpt;
   struct page_directory *_pd;
   struct page_table *_pt;
+  struct ept_cache_entry *ce;
+  uint64_t eptp = peptp & ~((uint64_t)0xFFF);
+  uint64_t region = guest_paddr >> 21;
+
+  ce = ept_cache_slot(eptp, region);
+  if ( ce->pt != NULL && ce->eptp == eptp && ce->region == region ) {
+    ept_cache_hits++;
+    if ( pdpt )
+      *pdpt = ce->pdpt;
+    if ( pd )
+      *pd = ce->pd;
+    if ( pt )
+      *pt = ce->pt;
+    return TABLE2ADDR(ce->pt->ept_entries[pt_idx].addr);
+  }
+  ept_cache_misses++;
   
   if ( EPT_PRESENT(pml4t->ept_entries[pml4t_idx].bits) ) {
     _pdpt = (struct page_directory_pointer_table *)
@@ -441,6 +497,12 @@ uint64_t ept_walk(uint64_t guest_paddr,
 	  phys2virt(TABLE2ADDR(_pd->ept_entries[pd_idx].addr));
 	if(pt != NULL)
 	  *pt = _pt;
+
+	ce->eptp = eptp;
+	ce->region = region;
+	ce->pdpt = _pdpt;
+	ce->pd = _pd;
+	ce->pt = _pt;
 	
 	return TABLE2ADDR(_pt->ept_entries[pt_idx].addr);
       }
@@ -514,7 +576,7 @@ void ept_map_page(uint64_t peptp, uint64_t gpaddr,
 	framearray[TABLE2ADDR(pt->ept_entries[virt2pt(gpaddr)].addr)
 		   /PAGE_SIZE].free  = 0x1;
 	framearray[TABLE2ADDR(pt->ept_entries[virt2pt(gpaddr)].addr)
-		   /PAGE_SIZE].proc  = 0x0;
+		   /PAGE_SIZE].refs  = 0x0;
     }
 
     init_ept_page(&pt->ept_entries[virt2pt(gpaddr)], paddr, PHYS, 
@@ -524,6 +586,81 @@ void ept_map_page(uint64_t peptp, uint64_t gpaddr,
   return;
 }
 
+uint64_t ept_populate(vproc_t *vp, uint64_t gpaddr) {
+  struct page_table *pt;
+  uint64_t paddr;
+
+  if ( vp->ept_owner != NULL )
+    vp = vp->ept_owner;
+
+  paddr = ept_walk(gpaddr, vp->peptp, NULL, NULL, &pt);
+  if ( pt != NULL && EPT_PRESENT(pt->ept_entries[virt2pt(gpaddr)].bits) )
+    return paddr;
+
+  /* Only guest RAM is backed on demand; the address may come from the guest */
+  if ( gpaddr >= vp->memsz )
+    return 0;
+
+  /* Like the eager path, frames are handed to the guest as they are. */
+  paddr = get_free_frame();
+  ept_map_page(vp->peptp, gpaddr & ~((uint64_t)PAGE_SIZE - 1), paddr, 
+	       EPT_TYPE_CACHEABLE_WB);
+  vp->ept_frames++;
+
+  return paddr;
+}
+
+int ept_fault(vproc_t *vp, uint64_t gpaddr) {
+  struct page_table *pt;
+  uint64_t base, end;
+
+  /* Guest APs share the EPT (and its accounting) of the vproc they joined */
+  if ( vp->ept_owner != NULL )
+    vp = vp->ept_owner;
+
+  if ( gpaddr >= vp->memsz )
+    return 1;
+
+  /* Anything already backed faulted for some other reason, e.g. xonly */
+  ept_walk(gpaddr, vp->peptp, NULL, NULL, &pt);
+  if ( pt != NULL && EPT_PRESENT(pt->ept_entries[virt2pt(gpaddr)].bits) )
+    return 1;
+
+  base = gpaddr & ~((uint64_t)EPT_FAULT_PAGES*PAGE_SIZE - 1);
+  end = base + EPT_FAULT_PAGES*PAGE_SIZE;
+  if ( end > vp->memsz )
+    end = vp->memsz;
+
+  /* Not-present entries are never cached by the cpu, so no INVEPT needed */
+  for ( ; base < end; base += PAGE_SIZE )
+    ept_populate(vp, base);
+  vp->ept_faults++;
+
+  return 0;
+}
+
+void ept_cache_flush() {
+  kmemset(ept_cache, 0, sizeof(ept_cache));
+  return;
+}
+
+void ept_print_stats(vproc_t *vp) {
+  uint64_t ms;
+
+  ms = get_tsc_freq() / 1000;
+  if ( ms == 0 )
+    ms = 1000000;                 /* no ratio MSRs, assume 1GHz */
+
+  kprintf("[Hypv] vproc %d: created in %d ms, booted in %d ms\n",
+	  vp->vproc_id, vp->create_tsc / ms, (readtsc() - vp->launch_tsc) / ms);
+  kprintf("[Hypv] vproc %d: %d of %d guest frames resident (%d KB), %d EPT faults\n",
+	  vp->vproc_id, vp->ept_frames, vp->memsz / PAGE_SIZE,
+	  vp->ept_frames * (PAGE_SIZE / 1024), vp->ept_faults);
+  kprintf("[Hypv] EPT walk cache: %d hits, %d misses\n",
+	  ept_cache_hits, ept_cache_misses);
+  return;
+}
+
 void ept_free_pml4t(struct page_map_level_4_table *pml4t) {
   int i;
   union ept_pt_entry *pml4te;
@@ -584,7 +721,7 @@ void ept_free_pt(struct page_table *pt) {
     if (EPT_PRESENT(page->bits)){
       framearray[TABLE2ADDR(page->addr)/PAGE_SIZE].vaddr = 0x0;
       framearray[TABLE2ADDR(page->addr)/PAGE_SIZE].free  = 0x1;
-      framearray[TABLE2ADDR(page->addr)/PAGE_SIZE].proc  = 0x0;
+      framearray[TABLE2ADDR(page->addr)/PAGE_SIZE].refs  = 0x0;
     }
   }
 
@@ -637,6 +774,7 @@ void destroy_ept(vproc_t *vp) {
   vkfreedirty(vk_heap);
   flush_tlb(0);
 
+  ept_cache_flush();
   ept_free_pml4t(pml4t);
 }
 
@@ -44,9 +44,12 @@
 #include <apic.h>
 #include <smp.h>
 #include <vproc.h>
+#include <vsched.h>
 #include <kvmem.h>
 #include <vmexit.h>
 #include <vmx_utils.h>
+#include <boottime.h>
+#include <ktrace.h>
 
 extern void systick_asm();
 extern void keyboard_asm();
@@ -95,7 +98,7 @@ void hentry() {
 		 "movq %%rsp,%%rbp   \n\t"
 		 "movq %1,%%rax      \n\t"
 		 "jmp *%%rax"
-		 ::"p"(system_stack_base),
+		 ::"r"(smp_ap_stack()),
 		  "p"(hypv_ap_core_init));
   }
 
@@ -121,6 +124,7 @@ void hentry() {
   asm volatile("movq %%r11, %0" : "=r"(heap_start));
   asm volatile("movq %%r12, %0" : "=r"(system_stack_base));
 
+  boottime_mark("hypv: seed_vmem_layer");
   seed_vmem_layer( frame_array_address, heap_start );
 
   if(!kheapcheck(0,"hypv main")) {
@@ -160,19 +164,20 @@ void hentry() {
 
 #ifdef ENABLE_SMP
 void hypv_ap_core_init(void){
-  asm volatile("movq %0,%%rsp" : :"r"(temp_stack));  
 
-  vcpu_ptr_array[this_cpu()]->stack = (uint64_t)temp_stack;
+  vcpu_ptr_array[this_cpu()]->stack = (uint64_t)smp_ap_stack();
 
 #ifdef DEBUG
-  kprintf("[SMP] core %d initializing at stack 0x%x\n",this_cpu(), temp_stack);
+  kprintf("[SMP] core %d initializing at stack 0x%x\n",this_cpu(), 
+	  smp_ap_stack());
 #endif
 
+  smp_ap_lock();
   pes_init();
-
   init_new_gdt(); 
-  lapic_init();
   ap_lidt();		 /* loads idt and then loads new tss into gdt*/
+  smp_ap_unlock();
+  lapic_init();
 
 #ifdef DEBUG
   kprintf("[HYPV SMP] application core init done\n");
@@ -202,18 +207,13 @@ void ap_join_guest(){
   kprintf("[HYPV SMP] ap core %d initiliazing\n", this_cpu());
 #endif
 
-  /*Init the vmxon_region for each core and store it in the vcpu_t structure*/
-  vcpu_ptr_array[this_cpu()]->vmxon_region_virt =(uint64_t)vkmalloc(vk_heap,1);
-  
-  vmem_alloc((uint64_t*)vcpu_ptr_array[this_cpu()]->vmxon_region_virt, 
-	     PAGE_SIZE, PG_RW | PG_GLOBAL);
- 
-  /*This does some vmx support tests and calls vmxon */
-  hypv_entry(vcpu_ptr_array[this_cpu()]->vmxon_region_virt);
+  /*Allocate this core's vmxon region and turn on VMX operation */
+  hypv_core_vmxon();
 
   vcpu_ptr_array[this_cpu()]->assigned = 1;
 
   vp = join_to_vproc(SIPI_vp);
+  vsched_add(vp, VSCHED_WEIGHT_DEFAULT, this_cpu());
 
 #ifdef DEBUG_SMP  
   kprintf("[HYPV SMP] ap VMCS initialized\n");
@@ -248,6 +248,9 @@ void ap_join_guest(){
 static void hinit() {
   int rc, i;
   vproc_t *vp;
+#ifdef HYPV_MULTI_GUEST
+  vproc_t *vp2;
+#endif
 
 #ifdef ENABLE_SMP   
   sem_hypv = create_semaphore( 0 );
@@ -257,6 +260,7 @@ static void hinit() {
   release_lock(sem_mult_vm);
 #endif
 
+  boottime_mark("hypv: acpi, apic");
   scan_rsdp();
   Scan_ACPI();
 #ifdef DEBUG
@@ -282,6 +286,8 @@ static void hinit() {
     }  
   ioapic_init();
   hypv_intr_init();
+  kprintf_ring_start(0);	/* drained on vmexits, see vmexit_handler */
+  ktrace_init();
 	
   intr_update_idtentry(0x20, INTR64_ON, (uint64_t)systick_asm);
 #ifdef ENABLE_SMP
@@ -302,20 +308,16 @@ static void hinit() {
    /*no guests are swapped accross cores and each core can maintain it's own */
    /*fiefdom for book keeping                                                */
    vcpu_ptr_array[i] = (vcpu_t*)kmalloc_track(HYPV_SITE, sizeof(vcpu_t));
+   kmemset(vcpu_ptr_array[i], 0, sizeof(vcpu_t));
    vcpu_ptr_array[i]->reg_storage.sse = pes_new_save(); 
 
    /*By default we assign the BSP to the first guest */
    vcpu_ptr_array[i]->assigned = (this_cpu() == i ? 1 : 0); 
  }
 
- /*Init the vmxon_region for each core and store it in the vcpu_t structure*/
- vcpu_ptr_array[this_cpu()]->vmxon_region_virt =(uint64_t)vkmalloc(vk_heap,1);
-
- vmem_alloc((uint64_t*)vcpu_ptr_array[this_cpu()]->vmxon_region_virt, 
-	    PAGE_SIZE, PG_RW | PG_GLOBAL);
-  
  vcpu_ptr_array[this_cpu()]->stack = system_stack_base;
   /* Scan the PCI bus, then init disk driver */
+  boottime_mark("hypv: pci, file_init");
   pci_init();
 	
 #ifdef DEBUG
@@ -333,10 +335,11 @@ static void hinit() {
   kprintf("[Hypervisor] Enabling virtualization features\n");
 #endif
 
+  boottime_mark("hypv: vmxon");
   init_vmcs_defaults();
 
-  /*This does some vmx support tests and calls vmxon */
-  hypv_entry(vcpu_ptr_array[this_cpu()]->vmxon_region_virt);
+  /*Allocate this core's vmxon region and turn on VMX operation */
+  hypv_core_vmxon();
 	
 #ifdef DEBUG
   kprintf("[Hypervisor] Virtualization features setup successful\n");
@@ -344,8 +347,10 @@ static void hinit() {
 
   /* open queues for maintaining the vprocs. */
   setup_vproc_management();
+  vsched_init();
 
 #ifdef ENABLE_SMP
+  boottime_mark("hypv: smp_boot_aps");
   smp_boot_aps();
 #endif
 
@@ -355,6 +360,15 @@ static void hinit() {
 #endif
 
   vp = create_vproc("kboot2");
+  vsched_add(vp, VSCHED_WEIGHT_DEFAULT, this_cpu());
+
+#ifdef HYPV_MULTI_GUEST
+  /* A second, independent guest sharing the boot core. The two are time */
+  /* sliced by vsched; the second first runs when the first is preempted. */
+  vp2 = create_vproc("kboot2");
+  vsched_add(vp2, VSCHED_WEIGHT_DEFAULT, this_cpu());
+  kprintf("[Hypervisor] started second guest, vproc %d\n", vp2->vproc_id);
+#endif
 
   load_vproc(vp); 
   
@@ -38,12 +38,14 @@
 #include <vmexit.h>
 #include <vmx_utils.h>
 #include <vproc.h>
+#include <vsched.h>
+#include <ktrace.h>
 
 //#define APIC_DEBUG 1 /*Debug flag for APIC in this file */
 /*This is for joining cores to another guest. The  Intel startup algorithem */
-/*uses three ipis. We count the three ipis and then join the other core to  */
-/*the guest.                                                                */
-int count_startup_ipis = 0;
+/*uses three ipis: INIT, SIPI, SIPI. The guest sends each to all its cores  */
+/*at once, so we join a core on the first SIPI to its APIC id, and keep    */
+/*track per guest in vp->ap_joined.                                        */
 
 uint64_t time;
 
@@ -133,28 +135,27 @@ static void save_gpregs(vproc_t *vp) {
 
 void start_vp(){
   vproc_t* vp;
-  uint64_t vpid;
   int rc;
 
   acquire_lock(sem_hypv);
 
-  kprintf("[%d] hypv lock\n", this_cpu());
-
   lapic_eoi();
 
-  /*This does some vmx support tests and calls vmxon */
-  hypv_entry(vcpu_ptr_array[this_cpu()]->vmxon_region_virt);
-
-  kprintf("this %d got start ipi\n");
+  /*Allocate this core's vmxon region and turn on VMX operation */
+  hypv_core_vmxon();
+  vcpu_ptr_array[this_cpu()]->assigned = 1;
 
-  if( this_cpu() == 0 )
-    vpid = 1;
-  else
-    vpid = 2;
-
-  vp = vproc_get(vpid);
+  vp = vsched_next(NULL);
+  if(vp == NULL) {
+    kprintf("[Hypv] core %d started with no vprocs\n", this_cpu());
+    release_lock(sem_hypv);
+    asm volatile("hlt");
+    return;
+  }
   
-  kprintf("launching vproc with id %d",vp->vproc_id);
+#ifdef DEBUG
+  kprintf("[Hypv] core %d launching vproc %d\n", this_cpu(), vp->vproc_id);
+#endif
   restore_gpregs(vp);
   rc =  launch_vproc(vp);
   
@@ -208,6 +209,9 @@ static void external_interrupt_handler( vproc_t *old_vp, uint64_t int_info ) {
   uint64_t exe_control_bits;
   uint8_t vec;
   waiting_interrupt_t  pending_int;
+#ifdef HYPV_MULTI_GUEST
+  vproc_t *vp_join;
+#endif
 
   vec = int_info & 0xFF;
 		
@@ -216,9 +220,9 @@ static void external_interrupt_handler( vproc_t *old_vp, uint64_t int_info ) {
     if(guest_interruptable())   
       inject_event( 0x20, 0);
   }
-  if(vec == 0x21){
+  if(vec == 0x21 || vec == 0x24){	/* keyboard, COM1 */
     if(guest_interruptable()){
-      inject_event( 0x21, 0);
+      inject_event( vec, 0);
     }
     else{
       /*save the vector */
@@ -232,7 +236,27 @@ static void external_interrupt_handler( vproc_t *old_vp, uint64_t int_info ) {
   }
   if(vec == 0x2b)
     kprintf("unhandled hypervisor external interrupt %x \n", vec);
-				
+
+#ifdef HYPV_MULTI_GUEST
+  /* With external interrupt exiting on, the IPIs the hypervisor sends   */
+  /* itself arrive here when the core is busy running some other guest.  */
+  if(vec == HYPV_PSEUDO_SIPI){
+    vp_join = join_to_vproc(SIPI_vp);
+    load_vproc(vp_join);
+    vsched_add(vp_join, VSCHED_WEIGHT_DEFAULT, this_cpu());
+  }
+  else if(vec != HYPV_START_VP && vec != 0x20 && vec != 0x21 && vec != 0x24){
+    if(guest_interruptable())
+      inject_event(vec, 0);
+    else{
+      pending_int.vector = vec; 
+      vector_push(&old_vp->pending_interrupts_vec, &pending_int);
+      vmread( CPU_BASED_VM_EXEC_CONTROL, &exe_control_bits);
+      exe_control_bits |= (1<<2);
+      vmwrite(CPU_BASED_VM_EXEC_CONTROL, exe_control_bits);
+    }
+  }
+#endif
 				
   lapic_eoi();
   restore_gpregs(old_vp);
@@ -256,23 +280,31 @@ static void interrupt_window_exiting_handler( vproc_t *old_vp ) {
     if(guest_interruptable()){
 			
       vector_pop(&old_vp->pending_interrupts_vec, &pending_int);
-      kprintf("itnerrupting! %d \n ", pending_int.vector);
+#ifdef DEBUG
+      kprintf("interrupting %d \n ", pending_int.vector);
+#endif
       inject_event(pending_int.vector, 0); 		
     }
     else{
+#ifdef DEBUG
       kprintf("NOT interrupting \n  ");
+#endif
       restore_gpregs(old_vp);
       launch_vproc(old_vp);	
     }		
   }	
   /*if the vector isn't empty leave window exiting on until the next exit*/
   if( vector_size(&old_vp->pending_interrupts_vec)/sizeof(waiting_interrupt_t)){
+#ifdef DEBUG
     kprintf(" leaving window exiting on\n  ");
+#endif
     restore_gpregs(old_vp);
     launch_vproc(old_vp);
   }
   else{
+#ifdef DEBUG
     kprintf("window off \n  ");
+#endif
     vmread( CPU_BASED_VM_EXEC_CONTROL, &exe_control_bits);
     clear_bit(&exe_control_bits, 2);
     vmwrite(CPU_BASED_VM_EXEC_CONTROL, exe_control_bits);
@@ -285,7 +317,8 @@ static void interrupt_window_exiting_handler( vproc_t *old_vp ) {
 
 static void cpuid_handler( vproc_t *vp ){
   
-  uint64_t ins_len, RIP;
+  uint64_t ins_len, RIP, secondary;
+  uint32_t eax, ebx, ecx, edx;
 
   /* Take care of the fact that we need move past the instruction that
      caused a vmexit in the first place. In this case it is the size of
@@ -296,11 +329,25 @@ static void cpuid_handler( vproc_t *vp ){
 
   kprintf("cpuid handler\nfeatures to be checked = 0x%x\n", vp->reg_storage.rax);
  
-  /* cpuid returns values in both ECX and EDX. Rather than figure out
-     what bear wanted with its cpuid wrapper function we will just 
-     return both by modifying the guest registers here. */
-  vp->reg_storage.rcx = cpuid( vp->reg_storage.rax, CPUID_ECX );
-  vp->reg_storage.rdx = cpuid( vp->reg_storage.rax, CPUID_EDX );
+  /* cpuid returns values in all four registers, and some leaves (7 for 
+     one) take a subleaf in ECX. Rather than figure out what bear wanted 
+     with its cpuid wrapper function we will just run the guest's cpuid 
+     and hand it everything by modifying the guest registers here. */
+  eax = (uint32_t)vp->reg_storage.rax;
+  ecx = (uint32_t)vp->reg_storage.rcx;
+  asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+  /* INVPCID faults in the guest unless we let it through (vmx_utils.c) */
+  if ( vp->reg_storage.rax == 7 ) {
+    vmread(SECONDARY_VM_EXEC_CONTROL, &secondary);
+    if ( !(secondary & (1 << PROC_SEC_ENABLE_INVPCID)) )
+      ebx &= ~CPUID_FEATURE_INVPCID;
+  }
+
+  vp->reg_storage.rax = eax;
+  vp->reg_storage.rbx = ebx;
+  vp->reg_storage.rcx = ecx;
+  vp->reg_storage.rdx = edx;
 
   /* relaunch the guest */
   restore_gpregs(vp);
@@ -337,6 +384,36 @@ static void switch_vproc(int vpid, vproc_t *old_vp){
   asm volatile("hlt");  
 }   
 
+/* 
+ * vmcall 43: the tracepoints, see ktrace.h. KTRACE_OP_* in RSI; a read
+ * leaves a Ktrace_batch_t in the guest physical page in RDX.
+ */
+static void trace_vmcall( vproc_t *vp ){
+  Ktrace_batch_t *batch;
+  uint64_t vaddr, paddr;
+  int n;
+
+  if(vp->reg_storage.rsi != KTRACE_OP_READ) {
+    ktrace_enable(vp->reg_storage.rsi == KTRACE_OP_ON);
+    return;
+  }
+
+  paddr = ept_populate(vp, vp->reg_storage.rdx & ~(uint64_t)(PAGE_SIZE - 1));
+  if(paddr == 0)
+    return;
+  vaddr = (uint64_t)vkmalloc(vk_heap, 1);
+  attach_page(vaddr, paddr, PG_RW);
+
+  batch = (Ktrace_batch_t *)vaddr;
+  batch->lost = 0;
+  n = ktrace_read(batch->recs, KTRACE_BATCH, &batch->lost);
+  batch->ok = (n >= 0);
+  batch->n = (n >= 0) ? n : 0;
+
+  vmem_free_temp((uint64_t*)vaddr, PAGE_SIZE);
+  vkdirty(vk_heap, (void*)vaddr, 1);
+}
+
 static void vmcall_handler( vproc_t *vp ){
   
   uint64_t ins_len, RIP, vmcall_option;
@@ -372,12 +449,33 @@ static void vmcall_handler( vproc_t *vp ){
     kprintf("request to enable interrupt %d \n", vp->reg_storage.rsi);
     ioapicenable(	vp->reg_storage.rsi, 0);
   }
+  if(vmcall_option == 41){
+    vsched_print_stats();
+  }
+  if(vmcall_option == 42){
+    ept_print_stats(vp->ept_owner ? vp->ept_owner : vp);
+  }
+  if(vmcall_option == 43){
+    trace_vmcall(vp);
+  }
   restore_gpregs(vp);
   launch_vproc(vp);
      
   return;
 }
 
+/* The guest named a region outside its memory: VMfailInvalid, carry set */
+static void vmfail_invalid( vproc_t* vp, uint64_t rflags ){
+
+  rflags &= ~(1 << 6);
+  rflags |= 1;
+  vp->reg_storage.eflags = rflags;
+  vmwrite(GUEST_RFLAGS, rflags);
+
+  restore_gpregs(vp);
+  launch_vproc(vp);
+}
+
 static void vmclear_handler( vproc_t* vp ){
   uint64_t ins_len, vp_RIP, rflags, vaddr;
 
@@ -399,7 +497,11 @@ static void vmclear_handler( vproc_t* vp ){
   /* also save the host physical address that is associated with the guest */
   /* physical address for any other acounting needs later                  */
   vp->vmcs_shadow.guest_vmcs_ptr_phys = vp->reg_storage.rdi;
-  vp->vmcs_shadow.host_vmcs_ptr_phys = ept_walk(vp->reg_storage.rdi, vp->peptp, NULL, NULL, NULL);
+  vp->vmcs_shadow.host_vmcs_ptr_phys = ept_populate(vp, vp->reg_storage.rdi);
+  if(vp->vmcs_shadow.host_vmcs_ptr_phys == 0) {
+    vmfail_invalid(vp, rflags);
+    return;
+  }
   kprintf("guest phsycial vmclear region = 0x%x\n", vp->vmcs_shadow.guest_vmcs_ptr_phys);
   kprintf("host physcial vmclear region = 0x%x\n", vp->vmcs_shadow.host_vmcs_ptr_phys);
 
@@ -451,7 +553,12 @@ static void vmlaunch_handler( vproc_t* vp ){
 
   vmread(EPT_POINTER,&guest_peptp);
   
-  vmcs_shadow_host_guest_peptp = ept_walk(guest_peptp, vp->peptp, NULL, NULL, NULL);
+  vmcs_shadow_host_guest_peptp = ept_populate(vp, guest_peptp);
+  if(vmcs_shadow_host_guest_peptp == 0) {
+    kprintf("[VMEXIT] guest EPT pointer 0x%x is outside guest memory\n",
+	    guest_peptp);
+    return;
+  }
 
   kprintf("guest_peptp = 0x%x\n", guest_peptp);
   kprintf("vmcs_shadow_host_guest_peptp = 0x%x\n", vmcs_shadow_host_guest_peptp);
@@ -631,7 +738,11 @@ static void vmxon_handler( vproc_t* vp ){
   /* also save the host physical address that is associated with the guest */
   /* physical address for any other acounting needs later                  */
   vp->vmcs_shadow.guest_vmxon_region_phys = vp->reg_storage.rdi;
-  vp->vmcs_shadow.host_vmxon_region_phys = ept_walk(vp->reg_storage.rdi, vp->peptp, NULL, NULL, NULL);
+  vp->vmcs_shadow.host_vmxon_region_phys = ept_populate(vp, vp->reg_storage.rdi);
+  if(vp->vmcs_shadow.host_vmxon_region_phys == 0) {
+    vmfail_invalid(vp, rflags);
+    return;
+  }
   kprintf("guest phsycial vmxon region = 0x%x\n", vp->vmcs_shadow.guest_vmxon_region_phys);
   kprintf("host physcial vmxon region = 0x%x\n", vp->vmcs_shadow.host_vmxon_region_phys);
 
@@ -770,6 +881,54 @@ static void rdmsr_handler( vproc_t *vp ){
   return;
 }
 
+/* 
+ * The guest owns the performance counters of its cores (kprof.c), so
+ * writes to them go through: as many general purpose ones as the cpu has
+ * (CPUID.0AH:EAX[15:8]), and the controls. IA32_PERF_GLOBAL_STATUS is 
+ * read only. Other MSRs stay the hypervisor's.
+ */
+static int guest_msr(uint32_t msr) {
+  static int npmc = -1;
+  uint32_t eax, ebx, ecx, edx;
+
+  if(npmc < 0) {
+    eax = 0xA;
+    ecx = 0;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    npmc = (eax >> 8) & 0xFF;
+  }
+
+  return (msr >= IA32_PMC0 && msr < IA32_PMC0 + npmc) ||
+    (msr >= IA32_PERFEVTSEL0 && msr < IA32_PERFEVTSEL0 + npmc) ||
+    (msr >= IA32_FIXED_CTR0 && msr < IA32_FIXED_CTR0 + 3) ||
+    msr == IA32_FIXED_CTR_CTRL || msr == IA32_PERF_GLOBAL_CTRL ||
+    msr == IA32_PERF_GLOBAL_OVF_CTRL;
+}
+
+static void wrmsr_handler( vproc_t *vp ){
+  uint64_t ins_len, vp_RIP;
+  uint32_t msr;
+
+  vmread(VM_EXIT_INSTRUCTION_LEN, &ins_len);
+  vmread(GUEST_RIP, &vp_RIP);
+  vmwrite(GUEST_RIP, vp_RIP + ins_len);
+
+  /* The msr is in the guest RCX, the value in EDX:EAX */
+  msr = (uint32_t)vp->reg_storage.rcx;
+  if(guest_msr(msr))
+    write_msr(msr, (vp->reg_storage.rdx << 32) | 
+	      (vp->reg_storage.rax & 0xFFFFFFFF));
+#ifdef DEBUG
+  else
+    kprintf("[VMEXIT] guest wrmsr 0x%x ignored\n", msr);
+#endif
+
+  restore_gpregs(vp);
+  launch_vproc(vp);
+
+  return;
+}
+
 static void vm_guest_state_handler( uint64_t qualification ){
 
   uint64_t rflags;
@@ -801,6 +960,13 @@ static void ept_violation_handler( uint64_t qualification, vproc_t *vp){
 
   uint64_t address, RIP;
 
+  /* First touch of guest RAM that has not been backed yet */
+  vmread(GUEST_PHYSICAL_ADDRESS, &address);
+  if(ept_fault(vp, address) == 0) {
+    restore_gpregs(vp);
+    launch_vproc(vp);
+  }
+
   if(qualification & 0x1)
     kprintf("violation was EPT read\n");
   if(qualification & 0x2)
@@ -829,6 +995,7 @@ static void ept_violation_handler( uint64_t qualification, vproc_t *vp){
 /* to debug your code effectively                                          */
 static void apic_access_handler( vproc_t *vp ){
   uint64_t qualification, ins_len, vp_RIP;
+  uint32_t target;
 
   /* Take care of the fact that we need move past the instruction that
      caused a vmexit in the first place. In this case it is the size of
@@ -879,37 +1046,30 @@ static void apic_access_handler( vproc_t *vp ){
       kprintf("[HYPV APIC] core to write to in APIC_ICRH 0x%x\n", 
       	      lapic_read(APIC_ICRH));
 #endif
-      /* If it is an init signal start the count for joining a core*/
+      /* The core is joined on the SIPI; nothing to do for the INIT */
       if( vp->reg_storage.rsi == APIC_INIT){
 
 #ifdef APIC_DEBUG
 	kprintf("[HYPV APIC] caught INIT signal\n");
 #endif
 
-	count_startup_ipis++;	
-      }/* We received a SIPI count the first*/
+      }/* A SIPI: join the core on the first one */
       else if( (vp->reg_storage.rsi & 0xf00) == APIC_STARTUP){
 
 #ifdef APIC_DEBUG
 	kprintf("[HYPV APIC] caught SIPI signal\n");
 #endif
 
-	count_startup_ipis++;
-
-#ifdef APIC_DEBUG
-	kprintf("[HYPV APIC] number of signals %d\n",count_startup_ipis);
-#endif
-	/*Second SIPI received time to join a core to the guest */
-	if(count_startup_ipis == 3){
+	target = lapic_read(APIC_ICRH) >> 24;
+	if(target < 32 && !(vp->ap_joined & (1U << target))){
 
 #ifdef DEBUG_SMP
 	  kprintf("[HYPV APIC] send ipi\n");
 #endif
-	  count_startup_ipis = 0;
+	  vp->ap_joined |= 1U << target;
 
 #ifdef APIC_DEBUG
-	  kprintf("[HYPV APIC] whom to send ipi to 0x%x\n", 
-		  lapic_read(APIC_ICRH) >> 24);
+	  kprintf("[HYPV APIC] whom to send ipi to 0x%x\n", target);
 #endif
 	  /*IPI's don't have a lot of room for data. So, we use a global  */
 	  /*vproc pointer to keep track of who we are joining to          */
@@ -917,7 +1077,7 @@ static void apic_access_handler( vproc_t *vp ){
 	  /*send the ipi to the guest the core wants to start             */
 	  /*This is neat as we can read the previous ICRH write to figure */
 	  /*out who we are trying to message                              */
-	  send_ipi((lapic_read(APIC_ICRH) >> 24), HYPV_PSEUDO_SIPI);
+	  send_ipi(target, HYPV_PSEUDO_SIPI);
 
 	  /*wait for the core we are starting to acknowledge the IPI      */
 	  while(lapic_read(APIC_ICRL) & APIC_DELIVS);
@@ -927,6 +1087,10 @@ static void apic_access_handler( vproc_t *vp ){
 		  lapic_read(APIC_ICRL) & APIC_DELIVS);
 #endif
 	}
+      }/* A fixed IPI between guest cores (TLB shootdowns); ICRH already
+	  went through, so send it as is */
+      else if( (vp->reg_storage.rsi & 0x700) == 0 ){
+	lapic_write(APIC_ICRL, vp->reg_storage.rsi);
       }
     }
     else{/*write everything else to the APIC*/
@@ -956,8 +1120,15 @@ static void ept_misconfiguration_handler( vproc_t *old_vp ){
 }
 
 static void vmx_preemption_handler( vproc_t *old_vp ){
+  vproc_t *next;
 
-  switch_vprocs();
+  /* The guest's slice ran out; it is already charged in vsched_exit. */
+  next = vsched_next(old_vp);
+  if(next == NULL)
+    next = old_vp;
+
+  restore_gpregs(next);
+  launch_vproc(next);
 
   /* Does not return */
 }
@@ -972,9 +1143,12 @@ void vmexit_handler() {
   uint64_t old_vmcs_ptr;	
   uint64_t vectoring_info;
 
+  kprintf_drain();
+
   (void)vmptrst(&old_vmcs_ptr);
   vp = vproc_getby_vmcs(old_vmcs_ptr);
   save_gpregs(vp);
+  vsched_exit(vp);
   /* Save stack and instruction pointers, in case we need to modify them. */
   vmread(GUEST_RIP, &vp->reg_storage.rip);
   vmread(GUEST_RSP, &vp->reg_storage.rsp);
@@ -988,6 +1162,7 @@ void vmexit_handler() {
     kputs("VM-entry failure!");
     exit_reason &= ~(1 << 31);
   }
+  KTRACE_BEGIN(KT_VMEXIT, vp->vproc_id, exit_reason);
 
   switch(exit_reason) {
     case 0:  /* Exception or NMI */
@@ -1053,6 +1228,10 @@ void vmexit_handler() {
       break;
     case 31: /* rdmsr */
       rdmsr_handler( vp );
+      break;
+    case 32: /* wrmsr */
+      wrmsr_handler( vp );
+      break;
     case 33: /* VM entry failure guest state */
       vm_guest_state_handler( qualification );
       break;
@@ -58,7 +58,13 @@ static int is_supported_nic(Pci_dev_t *dev);
  */
 struct vmcs vmcs_default __attribute__ ((section (".data"))) = {
 
+#ifdef HYPV_MULTI_GUEST
+  /* Guests share cores, so interrupts must come to the hypervisor first. */
+  .PIN_BASED_VM_EXEC_CONTROL = (1 << PIN_NMI_EXITING) | 
+                               (1 << PIN_EXT_INT_EXITING),
+#else
   .PIN_BASED_VM_EXEC_CONTROL = (1 << PIN_NMI_EXITING),
+#endif
 
   .SECONDARY_VM_EXEC_CONTROL = (1 << PROC_SEC_ENABLE_EPT) | 
                                (1 << PROC_SEC_ENABLE_RDTSCP) | 
@@ -217,6 +223,30 @@ void hypv_entry(uint64_t vmxon_region) {
   panic();
 }
 
+/* 
+ * Turn on VMX operation for the calling core, allocating its vmxon region on
+ * first use. Safe to call more than once; a core only executes VMXON once.
+ */
+void hypv_core_vmxon() {
+  vcpu_t *vcpu;
+
+  vcpu = vcpu_ptr_array[this_cpu()];
+  if(vcpu->vmx_on)
+    return;
+
+  if(vcpu->vmxon_region_virt == 0) {
+    vcpu->vmxon_region_virt = (uint64_t)vkmalloc(vk_heap,1);
+    vmem_alloc((uint64_t*)vcpu->vmxon_region_virt, 
+	       PAGE_SIZE, PG_RW | PG_GLOBAL);
+  }
+
+  /*This does some vmx support tests and calls vmxon */
+  hypv_entry(vcpu->vmxon_region_virt);
+  vcpu->vmx_on = 1;
+
+  return;
+}
+
 /* Create a new VMCS and get it ready for launching. */
 #define checkstatus if(status) goto error
 #define write(field, value)			\
@@ -437,10 +467,12 @@ void map_dma_to_guest(void *guest_vp) {
   target_guest = vp->reg_storage.rdx;
   
   /*host physical frame to write the repsonse in */
-  paddr = ept_walk( target_guest, vp->peptp, 0, 0, 0 );
+  paddr = ept_populate( vp, target_guest );
+  if ( paddr == 0 )
+    return;
 	
-  /*host physical of DMA target */
-  host_phys_dma = ept_walk(guest_phys_dma, vp->peptp, 0, 0, 0);
+  /*host physical of DMA target, 0 if it is not guest memory */
+  host_phys_dma = ept_populate(vp, guest_phys_dma);
 
   /*need a virtual addr in the hypv so we can write the response 
     in w/o it faulting*/
@@ -50,12 +50,16 @@
 #include <fatfs.h>
 #include <ept.h>
 #include <vproc.h>
+#include <vsched.h>
 #include <ept.h>
 #include <kvmem.h>
 #include <vmexit.h>
 #include <apic.h>
 #include <vmx_utils.h>
 #include <smp.h>
+#include <tsc.h>
+#include <boottime.h>
+#include <ktrace.h>
 #include <../hypv/asm.h>
 
 hashtable_t *vprocs;		/* hash table of vprocs               */
@@ -75,7 +79,8 @@ int get_vpid_cnt()
 
 /* Internal helper functions. */
 static void copy_bootstuff(vproc_t *);
-static void create_guest_pagetables(uint64_t);
+static void copy_timeline(vproc_t *);
+static void create_guest_pagetables(vproc_t *);
 
 vproc_t *create_vproc(char *file) {
   vproc_t *vp;
@@ -85,7 +90,9 @@ vproc_t *create_vproc(char *file) {
   int status; 
   FILINFO stat;
   uint64_t entry_point;
+  uint64_t start_tsc;
 
+  start_tsc = readtsc();
   vp = kmalloc_track(VPROC_SITE,sizeof(vproc_t));
   kmemset(vp, 0, sizeof(vproc_t));
   vp->running = 0;
@@ -95,13 +102,14 @@ vproc_t *create_vproc(char *file) {
   br[0].start = MEMORY_MAP_ENTRIES;
   br[0].end = br[0].start + sizeof(uint16_t) + sizeof(struct memmap);
 
+  boottime_mark("hypv: create_ept");
   create_ept(vp);
   
   /* Copy the basic segmentation info. */
   copy_bootstuff(vp);
   
   /* Develop the (guest) page tables. */
-  create_guest_pagetables(vp->peptp);
+  create_guest_pagetables(vp);
 
   /* Reposition the duals for what should correspond to the console (video)
    * memory in the guest -- in terms of guest-physical or hypervisor-linear,
@@ -121,6 +129,7 @@ vproc_t *create_vproc(char *file) {
 #endif
 
   /* Load the file. */
+  boottime_mark("hypv: load kboot2");
   file_ctx = alloc_elf_ctx(file_read, file_seek, file_error_check);
   f_stat(file, &stat);
   file_ctx->file_ctx = file_open(file);
@@ -131,7 +140,7 @@ vproc_t *create_vproc(char *file) {
 
   vaddr = vkmalloc(vk_heap, (stat.fsize / PAGE_SIZE) + 1);
   for(i = 0; i < ((stat.fsize / PAGE_SIZE) + 1); i++) {
-    paddr = ept_walk(entry_point + (i*PAGE_SIZE), vp->peptp, 0, 0, 0);
+    paddr = ept_populate(vp, entry_point + (i*PAGE_SIZE));
     attach_page(vaddr + i*PAGE_SIZE, paddr, PG_RW);
   }
 
@@ -223,6 +232,11 @@ vproc_t *create_vproc(char *file) {
   /* Add it to the vproc table. */
   vproc_put_all(vp);
 
+  vp->create_tsc = readtsc() - start_tsc;
+
+  /* As late as possible, so the guest sees all of our marks */
+  boottime_mark("hypv: launch");
+  copy_timeline(vp);
   return vp;
 }
 
@@ -239,6 +253,8 @@ vproc_t *join_to_vproc(vproc_t *vp_to_join) {
   vp->active = 0;
   vp->launched = 0;
   vp->peptp = vp_to_join->peptp;
+  vp->memsz = vp_to_join->memsz;
+  vp->ept_owner = vp_to_join->ept_owner ? vp_to_join->ept_owner : vp_to_join;
 
   /* As defined in boot1.S - DISKLABEL + SIZE OF BOOT1 - MEM_BASE */
   entry_point = *(uint64_t*)0x7e28 + 0x7e00 - 0x200;
@@ -261,7 +277,7 @@ vproc_t *join_to_vproc(vproc_t *vp_to_join) {
   kprintf("[HYPV] vmcs vpid is %d \n",   vp->vmcs.VIRTUAL_PROCESSOR_ID);
 #endif
   vp->vmcs.GUEST_RIP = entry_point;
-  vp->vmcs.GUEST_RSP = 0x7BF8;
+  vp->vmcs.GUEST_RSP = AP_BOOT_STACK(this_cpu()); /* cores join together */
   vp->vmcs.GUEST_CR3 = INIT_PAGE_PML4T;
   vp->vmcs.EPT_POINTER = vp_to_join->vmcs.EPT_POINTER;
   vp->vmcs.EPT_POINTER_HIGH = vp_to_join->vmcs.EPT_POINTER_HIGH;
@@ -300,6 +316,8 @@ vproc_t *join_to_vproc(vproc_t *vp_to_join) {
 
 void destroy_vproc(vproc_t *vp) {
   vproc_remove(vprocs_all, vp->vproc_id);	/* Take out of vproc table  */
+  if(vp->weight)
+    vsched_remove(vp);                 /* Take off its run queue   */
   free_elf_ctx(vp->file);	       /* Free the elf context info*/
   pes_free_save(vp->reg_storage.sse);/* Free extended state save */
   vmem_free(vp->vmcs_ptr, PAGE_SIZE);  /* Free vmcs region         */
@@ -325,7 +343,7 @@ static void copy_bootstuff(vproc_t *vp) {
   asm("sgdt %0" : "=m"(gdt));
 
   vaddr = vkmalloc(vk_heap,1);
-  paddr = ept_walk(gdt.base, vp->peptp, NULL, NULL, NULL);
+  paddr = ept_populate(vp, gdt.base);
   attach_page(vaddr, paddr, PG_RW);
 
   kmemcpy((void*)(vaddr + (gdt.base % PAGE_SIZE)), 
@@ -337,7 +355,7 @@ static void copy_bootstuff(vproc_t *vp) {
   vkdirty(vk_heap, (void*)vaddr, 1);
 
   vaddr = vkmalloc(vk_heap, 1);
-  paddr = ept_walk(SLICE_OFFSET, vp->peptp, NULL, NULL, NULL);
+  paddr = ept_populate(vp, SLICE_OFFSET);
   attach_page(vaddr, paddr, PG_RW);  
 
   /* Information for filesystem setup. */
@@ -355,7 +373,7 @@ static void copy_bootstuff(vproc_t *vp) {
 #endif
 
   vaddr = vkmalloc(vk_heap, 1);
-  paddr = ept_walk(SLICE_MBR_START, vp->peptp, NULL, NULL, NULL);
+  paddr = ept_populate(vp, SLICE_MBR_START);
   attach_page(vaddr, paddr, PG_RW);  
 
   kmemcpy((void*)(vaddr + (SLICE_MBR_START % PAGE_SIZE)),
@@ -373,7 +391,23 @@ static void copy_bootstuff(vproc_t *vp) {
  * created for the hypervisor by boot1 (and the kernel by the
  * bootloader, if you aren't using the hypervisor).
  */
-static void create_guest_pagetables(uint64_t peptp) {
+/* The boot timeline, which kboot2 and the kernel carry on */
+static void copy_timeline(vproc_t *vp) {
+  uint64_t vaddr, paddr;
+
+  vaddr = vkmalloc(vk_heap, 1);
+  paddr = ept_populate(vp, BOOT_TIMELINE);
+  attach_page(vaddr, paddr, PG_RW);
+
+  kmemcpy((void*)(vaddr + (BOOT_TIMELINE % PAGE_SIZE)),
+	  (void *)BOOT_TIMELINE,
+	  sizeof(Boottime_t));
+
+  vmem_free_temp((uint64_t*)vaddr, PAGE_SIZE);
+  vkdirty(vk_heap, (void*)vaddr, 1);
+}
+
+static void create_guest_pagetables(vproc_t *vp) {
   struct page_map_level_4_table *pml4t;
   struct page_directory_pointer_table *pdpt;
   struct page_directory *pd;
@@ -386,7 +420,7 @@ static void create_guest_pagetables(uint64_t peptp) {
   /* Just like the bootloader, set 0x1000 to be the PML4T, 0x2000 the PDPT,
    * 0x3000 the PDT, and 0x4000 the PT. */
   pml4t = (struct page_map_level_4_table *)vkmalloc(vk_heap, 4);
-  paddr = ept_walk(INIT_PAGE_PML4T, peptp, 0, 0, 0);
+  paddr = ept_populate(vp, INIT_PAGE_PML4T);
   attach_page((uint64_t)pml4t, paddr, PG_RW);
   kmemset(pml4t, 0, PAGE_SIZE);
   entry = &(pml4t->entries[0]);
@@ -403,7 +437,7 @@ static void create_guest_pagetables(uint64_t peptp) {
   entry->addr = ADDR2TABLE(INIT_PAGE_PML4T);	
 
   pdpt = (struct page_directory_pointer_table*)((uint64_t)pml4t + PAGE_SIZE);
-  paddr = ept_walk(INIT_PAGE_PDPT, peptp, 0, 0, 0);
+  paddr = ept_populate(vp, INIT_PAGE_PDPT);
   attach_page((uint64_t)pdpt, paddr, PG_RW);
   kmemset(pdpt, 0, PAGE_SIZE);
   entry = &(pdpt->entries[0]);
@@ -413,7 +447,7 @@ static void create_guest_pagetables(uint64_t peptp) {
   entry->addr = ADDR2TABLE(INIT_PAGE_PDT);
 
   pd = (struct page_directory *)((uint64_t)pdpt + PAGE_SIZE);
-  paddr = ept_walk(INIT_PAGE_PDT, peptp, 0, 0, 0);
+  paddr = ept_populate(vp, INIT_PAGE_PDT);
   attach_page((uint64_t)pd, paddr, PG_RW);
   kmemset(pd, 0, PAGE_SIZE);
   entry = &(pd->entries[0]);
@@ -423,7 +457,7 @@ static void create_guest_pagetables(uint64_t peptp) {
   entry->addr = ADDR2TABLE(INIT_PAGE_PT);
 
   pt = (struct page_table*)((uint64_t)pd + PAGE_SIZE);
-  paddr = ept_walk(INIT_PAGE_PT, peptp, 0, 0, 0);
+  paddr = ept_populate(vp, INIT_PAGE_PT);
   attach_page((uint64_t)pt, paddr, PG_RW);
   kmemset(pt, 0, PAGE_SIZE);
   for(i = 0; i < 512; i++) {
@@ -441,12 +475,6 @@ static void create_guest_pagetables(uint64_t peptp) {
   return;
 }
 
-/* TODO MO: This is very broken */
-void switch_vprocs() {
-
-  return;
-}
-
 int load_vproc(vproc_t *vm) {
   int rc;
 
@@ -484,6 +512,10 @@ uint64_t launch_vproc(vproc_t *vm) {
   }
 
   vmwrite(HOST_RSP,  vcpu_ptr_array[this_cpu()]->stack);
+  KTRACE_END(KT_VMEXIT);
+  vsched_enter(vm);
+  if(vm->launch_tsc == 0)
+    vm->launch_tsc = vm->entry_tsc;
 
   run_vproc(&(vm->launched));
 
@@ -0,0 +1,226 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/******************************************************************************
+ * Filename: vsched.c
+ *
+ * Description:
+ * The hypervisor vCPU scheduler. Every vproc is bound to one physical core
+ * and sits in that core's run queue. A core with a single vproc runs it with
+ * no scheduling overhead at all. A core with several vprocs arms the VMX
+ * preemption timer on every vm entry; when the slice runs out the guest
+ * exits (reason 52) and vsched_next picks the vproc with the least weighted
+ * run time. Guest time is measured from vm entry to vmexit, so time spent in
+ * the hypervisor is never charged to a guest.
+ *
+ * All of this runs with the hypervisor lock (sem_hypv) held.
+ *****************************************************************************/
+
+#include <constants.h>
+#include <stdint.h>
+#include <kmalloc.h>
+#include <kqueue.h>
+#include <kstdio.h>
+#include <kstring.h>
+#include <smp.h>
+#include <apic.h>
+#include <tsc.h>
+#include <vmx.h>
+#include <vmx_utils.h>
+#include <vproc.h>
+#include <vsched.h>
+
+/* Per-core scheduling state */
+typedef struct vsched_cpu {
+  void *runq;                /* vprocs bound to this core            */
+  int nr_running;            /* number of vprocs in runq             */
+  uint64_t min_vruntime;     /* starting vruntime for new arrivals   */
+  uint64_t switches;         /* times the core changed vprocs        */
+} vsched_cpu_t;
+
+/* Used to find the vproc with the smallest vruntime on a run queue */
+typedef struct vsched_pick {
+  vproc_t *vp;
+} vsched_pick_t;
+
+static vsched_cpu_t *vcpus;  /* one per core, indexed by this_cpu()  */
+static uint64_t tsc_hz;      /* TSC ticks per second                 */
+static uint64_t slice_tsc;   /* length of a full slice in TSC ticks  */
+static int preempt_ok;       /* the cpu has a VMX preemption timer   */
+static int preempt_shift;    /* timer ticks once every 2^shift TSCs  */
+
+static int is_vproc(void *ep, const void *kp) {
+  return ep == kp;
+}
+
+static void pick_min_vruntime(void *arg, void *ep) {
+  vsched_pick_t *pick = (vsched_pick_t *)arg;
+  vproc_t *vp = (vproc_t *)ep;
+
+  if(pick->vp == NULL || vp->vruntime < pick->vp->vruntime)
+    pick->vp = vp;
+}
+
+static void print_vproc(void *ep) {
+  vproc_t *vp = (vproc_t *)ep;
+
+  kprintf("[vsched]   vproc %d: weight %d, %d ms, %d slices, %d exits\n",
+	  vp->vproc_id, vp->weight, vp->run_tsc / (tsc_hz / 1000),
+	  vp->nslices, vp->nexits);
+}
+
+void vsched_init() {
+  int i;
+
+  vcpus = (vsched_cpu_t*)kmalloc_track(VSCHED_SITE,
+				       smp_num_cpus*sizeof(vsched_cpu_t));
+  kmemset(vcpus, 0, smp_num_cpus*sizeof(vsched_cpu_t));
+  for(i = 0; i < smp_num_cpus; i++)
+    vcpus[i].runq = qopen();
+
+  tsc_hz = get_tsc_freq();
+  if(tsc_hz == 0)               /* no ratio MSRs (e.g. under an emulator) */
+    tsc_hz = 1000UL * 1000 * 1000;
+  slice_tsc = (tsc_hz / 1000000) * VSCHED_SLICE_US;
+
+  /* Allowed-1 settings of the pin-based controls live in the high dword, */
+  /* and IA32_VMX_MISC[4:0] gives the timer rate relative to the TSC.     */
+  preempt_ok = (vmx_msrs.MSR_IA32_VMX_PINBASED_CTLS >> 32) & 
+    (1 << PIN_ACTIVATE_PREEMPT_TIMER);
+  preempt_shift = vmx_msrs.MSR_IA32_VMX_MISC & 0x1F;
+
+  if(!preempt_ok)
+    kprintf("[vsched] no VMX preemption timer; guests will not be sliced\n");
+}
+
+/* Bind a vproc to a core's run queue. */
+void vsched_add(vproc_t *vp, uint32_t weight, int cpu) {
+
+  vp->cpu = cpu;
+  vp->weight = weight ? weight : VSCHED_WEIGHT_DEFAULT;
+  /* Start level with the core rather than at zero, so a newcomer does not */
+  /* monopolise the core until it has caught up with everyone else.        */
+  vp->vruntime = vcpus[cpu].min_vruntime;
+  vp->slice_used = 0;
+  vp->preempt_armed = 0;
+
+  qput(vcpus[cpu].runq, vp);
+  vcpus[cpu].nr_running++;
+
+#ifdef DEBUG
+  kprintf("[vsched] vproc %d bound to core %d weight %d\n",
+	  vp->vproc_id, cpu, vp->weight);
+#endif
+}
+
+void vsched_remove(vproc_t *vp) {
+
+  if(qremove(vcpus[vp->cpu].runq, is_vproc, vp) != NULL)
+    vcpus[vp->cpu].nr_running--;
+}
+
+/* 
+ * Choose the vproc this core runs next; curr is what was running (or NULL
+ * when the core was idle). The caller restores its registers and launches 
+ * it. Returns NULL if nothing is bound to this core.
+ */
+vproc_t *vsched_next(vproc_t *curr) {
+  vsched_cpu_t *vc;
+  vsched_pick_t pick;
+
+  vc = &vcpus[this_cpu()];
+  pick.vp = NULL;
+  qapply2(vc->runq, &pick, pick_min_vruntime);
+  if(pick.vp == NULL)
+    return NULL;
+
+  vc->min_vruntime = pick.vp->vruntime;
+  if(pick.vp != curr)
+    vc->switches++;
+
+  pick.vp->slice_used = 0;
+  pick.vp->nslices++;
+
+  return pick.vp;
+}
+
+/* 
+ * Called by launch_vproc with the vproc's VMCS current. Arms (or disarms)
+ * the preemption timer for whatever is left of the vproc's slice.
+ */
+void vsched_enter(vproc_t *vp) {
+  uint64_t pin, left;
+  int sliced;
+
+  if(vcpus == NULL) {
+    vp->entry_tsc = readtsc();
+    return;
+  }
+
+  sliced = preempt_ok && vcpus[vp->cpu].nr_running > 1;
+  if(sliced != vp->preempt_armed) {
+    vmread(PIN_BASED_VM_EXEC_CONTROL, &pin);
+    if(sliced)
+      pin |= (1 << PIN_ACTIVATE_PREEMPT_TIMER);
+    else
+      clear_bit(&pin, PIN_ACTIVATE_PREEMPT_TIMER);
+    vmwrite(PIN_BASED_VM_EXEC_CONTROL, pin);
+    vp->preempt_armed = sliced;
+  }
+
+  if(sliced) {
+    left = vp->slice_used < slice_tsc ? slice_tsc - vp->slice_used : 0;
+    vmwrite(VMX_PREEMPTION_TIMER_VALUE, left >> preempt_shift);
+  }
+
+  vp->entry_tsc = readtsc();
+}
+
+/* Called on every vmexit; charges the guest for the time it just ran. */
+void vsched_exit(vproc_t *vp) {
+  uint64_t delta;
+
+  delta = readtsc() - vp->entry_tsc;
+
+  vp->run_tsc += delta;
+  vp->slice_used += delta;
+  vp->nexits++;
+  if(vp->weight)
+    vp->vruntime += (delta * VSCHED_WEIGHT_DEFAULT) / vp->weight;
+}
+
+int vsched_nr_running(int cpu) {
+  return vcpus[cpu].nr_running;
+}
+
+void vsched_print_stats() {
+  int i;
+
+  for(i = 0; i < smp_num_cpus; i++) {
+    if(vcpus[i].nr_running == 0)
+      continue;
+    kprintf("[vsched] core %d: %d vprocs, %d switches\n",
+	    i, vcpus[i].nr_running, vcpus[i].switches);
+    qapply(vcpus[i].runq, print_vproc);
+  }
+}
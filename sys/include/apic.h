@@ -66,6 +66,10 @@ uint64_t ioapicaddr;
 #define HYPV_PSEUDO_SIPI 0x8C
 /* Interrupt vector to start a vproc on a different core */
 #define HYPV_START_VP 0x8D
+/* Interrupt vector for TLB shootdowns between kernel cores, see ktlb.c */
+#define TLB_SHOOTDOWN_VEC 0x8E
+/* Interrupt vector for performance counter overflows, see kprof.c */
+#define PROF_PMI_VEC 0x8F
 
 /*Some APIC masks for the hypervisor*/
 #define APIC_FIELD_MASK 0xfff
@@ -144,7 +148,6 @@ void ioapicdisable(uint32_t irq, uint32_t cpunum);
 void ioapicwrite(uint32_t reg, uint64_t data);
 uint64_t cpuGetAPICBase();
 uint32_t this_cpu();
-void lapic_start_aps(uint8_t apicid, uint32_t addr);
 void lapic_eoi(void);
 int calibrate_apic_timer(void);
 
@@ -49,3 +49,5 @@ void panic();
 /* CPUID features enumeration */
 #define CPUID_FEATURE_VMX (1 << 5)
 #define CPUID_FEATURE_APIC (1 << 9)
+#define CPUID_FEATURE_PCID (1 << 17)    /* leaf 1, ecx */
+#define CPUID_FEATURE_INVPCID (1 << 10) /* leaf 7, ebx */
@@ -0,0 +1,81 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#pragma once
+/******************************************************************************
+ * Filename: boottime.h
+ *
+ * Description:
+ *  The boot timeline. boot2, the hypervisor and the kernel stamp the TSC at
+ *  the start of each boot phase. The stamps live at a fixed address in low
+ *  memory, which every stage can reach: the hypervisor copies it into the
+ *  guest before the launch, and the kernel moves it into its own memory on
+ *  entry. The first shell prompt closes it and the kernel prints the table;
+ *  the boottime program gets it with SC_BOOTTIME.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+
+/* The second half of the boot scratch page (BOOT_SCRATCH_BEGIN). The MBR
+ * stamps the first mark before anything else runs (mbr.S has a copy) */
+#define BOOT_TIMELINE     0x5800
+#define BOOT_TIMELINE_MBR (BOOT_TIMELINE + 8)  /* marks[0].tsc */
+
+#define BOOTTIME_MAGIC  0x454d4954             /* "TIME" */
+#define BOOTTIME_MAX    63                     /* marks in the page */
+#define BOOTTIME_NAMESZ 24                     /* bytes of a mark's name */
+
+typedef struct {
+  uint64_t tsc;                                /* the phase started */
+  char name[BOOTTIME_NAMESZ];
+} Boottime_mark_t;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t n;                                  /* marks so far */
+  uint16_t closed;                             /* the last phase ended */
+  Boottime_mark_t marks[BOOTTIME_MAX];
+} Boottime_t;
+
+/* boot2: start the timeline, keeping the MBR's stamp. kboot2 and the
+ * hypervisor find it already started */
+void boottime_init();
+
+/* A phase called name starts now. Ignored once the timeline is full or
+ * closed, or if it was never started */
+void boottime_mark(char *name);
+
+/* Kernel entry: take the timeline out of low memory, which becomes the
+ * processes' */
+void boottime_save();
+
+/* Boot is over: the last mark, name (the first prompt), closes the
+ * timeline. Returns -1 if it was closed already */
+int boottime_close(char *name);
+
+/* The timeline, or NULL if there is none */
+Boottime_t *boottime_get();
+
+/* Print the table: each phase, when it started, and how long it took */
+void boottime_print();
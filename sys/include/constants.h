@@ -85,7 +85,14 @@
 /* -------------------------------- MSRs ---------------------------------- */
 #define IA32_TIME_STAMP_COUNTER         0x10
 #define IA32_FEATURE_CONTROL            0x3a
+#define IA32_PMC0                       0xC1    /* general purpose counters */
 #define IA32_PLATFORM_INFO 		0xCE
+#define IA32_PERFEVTSEL0                0x186   /* and their event selects */
+#define IA32_FIXED_CTR0                 0x309
+#define IA32_FIXED_CTR_CTRL             0x38D
+#define IA32_PERF_GLOBAL_STATUS         0x38E
+#define IA32_PERF_GLOBAL_CTRL           0x38F
+#define IA32_PERF_GLOBAL_OVF_CTRL       0x390
 #define IA32_VMX_BASIC                  0x480
 #define IA32_VMX_PINBASED_CTLS          0x481
 #define IA32_VMX_PROCBASED_CTLS         0x482
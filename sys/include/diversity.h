@@ -34,16 +34,24 @@ uint64_t kplt;
 #endif
 
 
-/* static partition structure definition */
+/* a partition of free virtual space, a node of an AVL tree by start */
 struct partition_type {
   uint64_t start;
   uint64_t end;
-  struct partition_type *next;
-  struct partition_type *prev;
+  struct partition_type *left;
+  struct partition_type *right;
+  int height;
+  uint64_t bytes;               /* free bytes in this subtree */
+  uint64_t max;                 /* longest partition in this subtree */
 };
 
 typedef struct partition_type partition_t;
 
+typedef struct {
+  partition_t *root;
+  uint64_t n;                   /* number of partitions */
+} partitions_t;
+
 
 /* A similar function given to the diversifier by the kernel or hypervisor. It
  * clones a page from the given (v)proc's address space into the new 
@@ -72,9 +80,10 @@ void replicate(void *, diversity_page_copier);
 /* access module that can profile all of memory and let you find random 
    pieces of memory for diversity-type reasons. */
 
-uint64_t pick_random_place(partition_t *parts, uint64_t size, 
+uint64_t pick_random_place(partitions_t *parts, uint64_t size, 
 			   uint64_t align, partition_t **p);
-partition_t *init_partitions(void);
-void free_partitions(partition_t *parts);
-void split_partition(partition_t *part, uint64_t start, uint64_t end);
-void add_to_partitions(partition_t *parts, uint64_t start, uint64_t size);
+partitions_t *init_partitions(void);
+void free_partitions(partitions_t *parts);
+void split_partition(partitions_t *parts, partition_t *part, 
+		     uint64_t start, uint64_t end);
+void add_to_partitions(partitions_t *parts, uint64_t start, uint64_t size);
@@ -64,6 +64,12 @@ struct elf_ctx {
   struct Elf_Sym *symtab;
   int num_syms;
 
+  /* Index over symtab, built on the first lookup; see elf_symtab.c */
+  int *symhash;                 /* by name: symtab indices, -1 if empty */
+  int symhash_size;             /* a power of two */
+  int *symaddr;                 /* symtab indices of functions, by address */
+  int num_symaddr;
+
   /* Diversity units; aka, code blocks we can relocate. */
   struct list_head diversity_units;
   /* Map from a section header to its associated diversity unit. The pointer
@@ -263,9 +269,21 @@ int elf_load_metadata(struct elf_ctx *ctx);
 char *read_string_table(void *file_ctx);
 char *read_section_table(void *file_ctx);
 
+/* Symbol lookups (elf_symtab.c). The symbol table must have been loaded, by
+ * elf_load_metadata() or elf_load_symbols(); the first lookup indexes it. 
+ * NULL if there is no such symbol. */
+struct Elf_Sym *elf_sym_by_name(struct elf_ctx *ctx, const char *name);
+/* The function addr is in (or the last one before it, if it has no size) */
+struct Elf_Sym *elf_sym_by_addr(struct elf_ctx *ctx, uint64_t addr);
+void elf_free_symindex(struct elf_ctx *ctx);
+
+/* Load just what the lookups need: headers, string tables and symtab */
+int elf_load_symbols(struct elf_ctx *ctx);
+
+/* Name of the function at address in the named file, in a string the caller 
+ * frees with kfree_track(ELF_LOADER_SITE, ...); NULL if none. */
 char * search_symbol_name(uint64_t address, char *file_name);
 
-uint64_t* symbol_addr_list(void *file_ctx, int *sym_count);
 char * get_section_name( uint64_t offset, char * string_table);
-char *get_symbol_name( void *file_ctx, uint64_t address, char* string_table);
-uint64_t get_symbol_addr(void* file_ctx, char* sym_name, char * string_table);
+char *get_symbol_name(struct elf_ctx *ctx, uint64_t address);
+uint64_t get_symbol_addr(struct elf_ctx *ctx, char* sym_name);
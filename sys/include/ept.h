@@ -34,6 +34,16 @@
 
 
 
+/* Guest memory is backed by host frames the first time the guest touches it
+ * (unless built with EPT_EAGER). An EPT violation on unbacked guest RAM backs
+ * EPT_FAULT_PAGES pages around the faulting address; 512 fills a whole 2MB
+ * leaf table at a time.
+ */
+#define EPT_FAULT_PAGES 1
+
+/* Number of recently walked leaf tables remembered by ept_walk. */
+#define EPT_CACHE_SIZE  16
+
 void create_ept(vproc_t *vp);
 
 
@@ -56,6 +66,21 @@ union ept_page *virt2ept_pt_entry(uint64_t eptp, uint64_t);
 void ept_map_page(uint64_t eptp, uint64_t gpaddr,
 		  uint64_t paddr, uint8_t cache_type);
 
+/* Host-physical frame behind a guest-physical address, backing it first if
+ * the guest has never touched it. Use this rather than ept_walk whenever the
+ * hypervisor itself reads or writes guest RAM. Returns 0 if gpaddr is neither
+ * mapped nor guest RAM.
+ */
+uint64_t ept_populate(vproc_t *vp, uint64_t gpaddr);
+
+/* Called on an EPT violation; returns 0 if the fault was on unbacked guest
+ * RAM and has been fixed up, nonzero if it was a genuine violation.
+ */
+int ept_fault(vproc_t *vp, uint64_t gpaddr);
+
+void ept_cache_flush();
+void ept_print_stats(vproc_t *vp);
+
 void ept_free_pml4t(struct page_map_level_4_table *pml4t);
 void ept_free_pdpt(struct page_directory_pointer_table *pdpt);
 void ept_free_pd(struct page_directory *pd);
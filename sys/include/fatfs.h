@@ -205,8 +205,10 @@ typedef enum {
 FRESULT f_mount (BYTE, FATFS*);						/* Mount/Unmount a logical drive */
 FRESULT f_mount_offset(BYTE, FATFS*, uint64_t);     /* Same, but partition is at an offset instead of in MBR */
 FRESULT f_open (FIL*, const TCHAR*, BYTE);			/* Open or create a file */
+FRESULT f_open_clust (FIL*, DWORD, DWORD);		/* Open a file by start cluster */
 FRESULT f_read (FIL*, void*, UINT, UINT*);			/* Read data from a file */
 FRESULT f_lseek (FIL*, DWORD);						/* Move file pointer of a file object */
+FRESULT f_runmap (FIL*, DWORD, DWORD*, DWORD*);	/* Map a file offset to contiguous sectors */
 FRESULT f_close (FIL*);								/* Close an open file object */
 FRESULT f_opendir (DIR*, const TCHAR*);				/* Open an existing directory */
 FRESULT f_readdir (DIR*, FILINFO*);					/* Read a directory item */
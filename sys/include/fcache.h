@@ -0,0 +1,57 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#pragma once
+/* fcache.h -- kernel cache of file lookups on the ramdisk.
+ *
+ * Maps a path to the file's start cluster, size and cluster link map, so 
+ * that opening the same file again -- every exec of a program, say -- does 
+ * not walk the directory and the FAT a sector at a time through the FatFs 
+ * window. Entries are recycled least recently used first.
+ */
+#include <fatfs.h>
+
+#define FCACHE_ENTRIES 64		/* Files remembered */
+#define FCACHE_NAME_SZ 64		/* Longest path cached, with the NUL */
+#define FCACHE_CLMT_LEN 32		/* Link map entries kept per file */
+
+typedef struct fcache_ent {
+  char path[FCACHE_NAME_SZ];
+  DWORD sclust;			/* Start cluster */
+  DWORD fsize;			/* File size */
+  uint64_t stamp;		/* Lookup clock at the last hit */
+  DWORD clmt[FCACHE_CLMT_LEN];	/* Link map, clmt[0]==0 if it did not fit */
+} fcache_ent_t;
+
+void fcache_init();
+
+/* Returns the entry for path, looking it up on the ramdisk if need be, or 
+ * NULL (with *rc set) if the file cannot be opened. The entry is only good
+ * until the next call.
+ */
+fcache_ent_t *fcache_lookup(char *path, FRESULT *rc);
+
+/* Forget everything -- for when the filesystem has been written. */
+void fcache_flush();
+
+void fcache_print_stats();
@@ -20,10 +20,14 @@
 /  data transfer. This reduces memory consumption 512 bytes each file object. */
 
 
+#ifndef _FS_READONLY
 #define _FS_READONLY	1	/* 0:Read/Write or 1:Read only */
+#endif
 /* Setting _FS_READONLY to 1 defines read only configuration. This removes
 /  writing functions, f_write, f_sync, f_unlink, f_mkdir, f_chmod, f_rename,
-/  f_truncate and useless f_getfree. */
+/  f_truncate and useless f_getfree. 
+/  Bear: the boot loaders, hypervisor and kernel only ever read the ramdisk. 
+/  The ramdisk server (usr/sbin/ramfsd) is built with -D_FS_READONLY=0. */
 
 
 #define _FS_MINIMIZE	0	/* 0 to 3 */
@@ -48,7 +52,7 @@
 /* To enable f_forward function, set _USE_FORWARD to 1 and set _FS_TINY to 1. */
 
 
-#define	_USE_FASTSEEK	0	/* 0:Disable or 1:Enable */
+#define	_USE_FASTSEEK	1	/* 0:Disable or 1:Enable */
 /* To enable fast seek feature, set _USE_FASTSEEK to 1. */
 
 
@@ -52,6 +52,16 @@
  *             Arg 2: Where in the file to seek to.
  * FAT_error_check -- Arg 1: A pointer to a FAT_ctx structure.
  *                    Returns: The return code of any previous functions.
+ * FAT_stat -- Arg 1: A filename string.
+ *             Arg 2: Set to the size of the file, if not NULL.
+ *             Returns: 0 if the file can be opened, else a FatFs error code.
+ * FAT_map -- Arg 1: A pointer to a FAT_ctx structure.
+ *            Arg 2: Offset in the file.
+ *            Arg 3: Set to the number of bytes readable from the pointer.
+ *            Returns: Pointer to the file's data in the ramdisk, or NULL.
+ * FAT_offset -- Returns: Byte offset of the filesystem in the ramdisk.
+ * FAT_sync -- Rereads filesystem state after the ramdisk was written behind
+ *             our back (by ramfsd).
  *
  * None of these functions are available in the bootloader, which does not have
  * the necessary machinery for running this kind of abstraction.
@@ -64,6 +74,10 @@ void FAT_close(void *);
 void FAT_read(void *, void *, size_t);
 void FAT_seek(void *, size_t);
 int FAT_error_check(void *);
+void *FAT_map(void *, uint64_t, uint64_t *);
+int FAT_stat(char *, size_t *);
+uint64_t FAT_offset();
+void FAT_sync();
 
 void *mem_open();
 void mem_close(void*);
@@ -77,3 +91,5 @@ int mem_error_check(void*);
 #define file_read FAT_read
 #define file_seek FAT_seek
 #define file_error_check FAT_error_check
+#define file_map FAT_map
+#define file_stat FAT_stat
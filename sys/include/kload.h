@@ -26,3 +26,4 @@
 
 int load_elf_proc(void);
 void kload_daemon(char *dname,int dpid, int ioflags);
+void kload_print_stats();
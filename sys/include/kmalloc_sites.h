@@ -48,8 +48,10 @@
 #define PES_SITE 23      	 /* utils/pes.c */
 #define KSCHED_SITE 24      	 /* utils/ksched.c */
 #define KLOAD_SITE 25      	 /* kernel/kload.c */
+#define VSCHED_SITE 26      	 /* hypv/vsched.c */
+#define KSHM_SITE 27      	 /* kernel/kshm.c */
 
-#define NUMSITES 26
+#define NUMSITES 28
 
 
 #ifdef KMALLOC_TRACKING
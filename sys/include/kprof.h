@@ -0,0 +1,60 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+
+#pragma once
+/******************************************************************************
+ * Filename: kprof.h
+ *
+ * Description:
+ *  Sampling profiler. The performance counters of every core interrupt
+ *  every period events (PROF_EV_*), and the interrupt records where the
+ *  process was and its pid; without a PMU the systick takes the samples.
+ *  SC_PROF starts and stops it and reads the samples back as a flat
+ *  profile, named from the programs' ELF symbols.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <proc.h>
+#include <syscall.h>
+
+#define KPROF_SAMPLES  4096		/* per core */
+#define KPROF_PERIOD   1000000		/* default events per sample */
+
+/* Find the PMU and hook the PMI and the systick. Once, after the lapic */
+void kprof_init();
+
+/* Start sampling on event; the cores join on their next systick. Returns
+ * the event sampled on, which is PROF_EV_TIMER without a PMU, or -1 if
+ * the profiler is running already */
+int kprof_start(int event, uint64_t period);
+
+/* Stop sampling; the samples stay until the next start */
+int kprof_stop();
+
+/* The flat profile, from line first on */
+void kprof_read(int first, Prof_resp_t *resp);
+
+/* load_elf_proc is done with p's ELF: keep the symbols while profiling */
+void kprof_exec(Proc_t *p);
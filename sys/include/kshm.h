@@ -0,0 +1,67 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#pragma once
+/******************************************************************************
+ * Filename: kshm.h
+ *
+ * Description:
+ *  Shared memory regions between user processes.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <proc.h>
+#include <memory.h>
+
+/* Is vaddr in the window where shared memory regions are mapped? */
+#define KSHM_ADDR(vaddr) ((uint64_t)(vaddr) >= SHM_MEM_START &&		\
+			  (uint64_t)(vaddr) < SHM_MEM_START + SHM_MEM_SIZE)
+
+/* Init function */
+void kshm_init();
+
+/* Create a region mapped into p; returns its id or -1. With SHM_CONTIG the
+ * frames are physically contiguous and the first goes in *paddrp */
+int kshm_create(Proc_t *p, uint64_t size, int flags, int *grants, int ngrants,
+		uint64_t *vaddrp, uint64_t *paddrp);
+
+/* Map region id into p if p created it or was granted it; the creator goes 
+ * in *ownerp */
+int kshm_map(Proc_t *p, int id, uint64_t *vaddrp, uint64_t *sizep,
+	     pid_t *ownerp);
+
+/* Grant region id to pid as well; p must be allowed to map it */
+int kshm_grant(Proc_t *p, int id, pid_t pid);
+
+/* Unmap the region at vaddr from p, which must be the current process */
+int kshm_unmap(Proc_t *p, uint64_t vaddr);
+
+/* Called whenever a process is forked; the child shares the parent's regions */
+void kshm_fork(Proc_t *parent, Proc_t *child);
+
+/* Called whenever a process exits or execs; drops its mappings */
+void kshm_purge(Proc_t *p);
+
+/* Called by the reaper for each shared frame still mapped by a dead process */
+void kshm_put_frame(uint64_t paddr);
@@ -30,3 +30,10 @@ void kprintf(const char *, ...);
 /* To "stdout" */
 int kputchar(int);
 void kputs(const char *);
+
+/* Buffered serial output, see kstdio.c */
+void kprintf_ring_start(int intr);
+void kprintf_drain(void);
+void kprintf_intr(unsigned int vec, void *arg);
+void kprintf_flush(void);
+void kprintf_panic(void);
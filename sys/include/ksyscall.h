@@ -43,6 +43,7 @@ void systask_do_gettime       (Systask_msg_t*, Msg_status_t*);
 void systask_do_umalloc       (Systask_msg_t*, Msg_status_t*);
 void systask_do_pci_set_config(Systask_msg_t*, Msg_status_t*);
 void systask_do_poll          (Systask_msg_t*, Msg_status_t*);
+void systask_do_pollpost      (Systask_msg_t*, Msg_status_t*);
 void systask_do_get_core      (Systask_msg_t*, Msg_status_t*);
 void systask_do_invalid       (Systask_msg_t*, Msg_status_t*);
 void systask_do_ps            (Systask_msg_t*, Msg_status_t*);
@@ -54,6 +55,11 @@ void systask_do_alarm         (Systask_msg_t*, Msg_status_t*);
 void systask_do_eoi           (Systask_msg_t*, Msg_status_t*);
 void systask_do_map_dma       (Systask_msg_t*, Msg_status_t*);
 void systask_do_msi           (Systask_msg_t*, Msg_status_t*);
+void systask_do_ramdisk       (Systask_msg_t*, Msg_status_t*);
+void systask_do_shm           (Systask_msg_t*, Msg_status_t*);
+void systask_do_boottime      (Systask_msg_t*, Msg_status_t*);
+void systask_do_trace         (Systask_msg_t*, Msg_status_t*);
+void systask_do_prof          (Systask_msg_t*, Msg_status_t*);
 #ifdef KERNEL_DEBUG
 void systask_do_kprintint     (Systask_msg_t *, Msg_status_t *);
 void systask_do_kprintstr     (Systask_msg_t *, Msg_status_t *);
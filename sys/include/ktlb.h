@@ -0,0 +1,80 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+
+#pragma once
+/******************************************************************************
+ * Filename: ktlb.h
+ *
+ * Description:
+ *  Process context identifiers. Every process gets its own PCID, so loading
+ *  its CR3 need not throw away the TLB entries of the others. Also keeps the
+ *  other cores' TLBs coherent when a mapping changes (shootdowns).
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <proc.h>
+
+#define CR4_PCIDE     (1 << 17)
+#define CR3_NOFLUSH   ((uint64_t)1 << 63)  /* keep the pcid's entries */
+#define CR3_PCID_MASK ((uint64_t)0xfff)
+
+#define PCID_COUNT    4096                 /* pcid 0 is the boot tables' */
+
+/* Shootdowns: a batch lists at most TLB_RANGES runs of pages, and no more
+ * than TLB_BATCH_PAGES pages; past that the targets flush everything */
+#define TLB_RANGES      16
+#define TLB_BATCH_PAGES 64
+
+/* Turn on PCIDs if the cpu has them; called on every core, with its lapic
+ * mapped. Until the first call there is one core and flushes stay local. */
+void ktlb_init();
+
+/* Give p a pcid, or take it back; the process is new or dying */
+void ktlb_new(Proc_t *p);
+void ktlb_free(Proc_t *p);
+
+/* Set p->cr3_load for restore_kernel_proc(), which is about to run p here */
+void ktlb_switch(Proc_t *p);
+
+/* 
+ * The pte for vaddr changed, in p's tables (NULL for the ones this core is
+ * on) or, if global, in the kernel mappings all address spaces share. This
+ * core drops the entry now; the others are sent a shootdown at the end of
+ * the batch, if one is open, or at once.
+ */
+void ktlb_flush_page(Proc_t *p, uint64_t vaddr, int global);
+
+/* As above, for everything: paging structures went away */
+void ktlb_flush_all(Proc_t *p, int global);
+
+/* Collect the flushes of one operation into a single shootdown */
+void ktlb_batch_begin();
+void ktlb_batch_end();
+
+/* The shootdown IPI, and acquire_lock() while it spins */
+void ktlb_shootdown();
+
+/* Shootdowns since boot, for ps */
+void ktlb_print_stats();
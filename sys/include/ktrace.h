@@ -0,0 +1,98 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab;
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#pragma once
+/******************************************************************************
+ * Filename: ktrace.h
+ *
+ * Description:
+ *  Tracepoints. Each core writes binary records (usr/include/sys/ktrace.h)
+ *  into a ring of its own, with no locks and no output, so a trace costs a
+ *  few stores and an rdtsc. The kernel reads its rings, and the
+ *  hypervisor's with vmcall 43, for SC_TRACE. Build with KTRACE; without
+ *  it the tracepoints are compiled out.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <sys/ktrace.h>
+
+#define KTRACE_BATCH 64			/* records per read */
+
+/* Operations, for SC_TRACE and vmcall 43 */
+#define KTRACE_OP_ON   1
+#define KTRACE_OP_OFF  2
+#define KTRACE_OP_READ 3
+
+/* What vmcall 43 leaves in the guest page it is given */
+typedef struct {
+  uint32_t n;				/* records */
+  uint32_t ok;				/* the hypervisor has tracepoints */
+  uint64_t lost;
+  Ktrace_rec_t recs[KTRACE_BATCH];
+} Ktrace_batch_t;
+
+#if defined(KTRACE) && (defined(KERNEL) || defined(HYPV))
+
+extern volatile int ktrace_on;
+
+/* A point event */
+#define KTRACE_POINT(ev, pid, arg) do {					\
+    if(ktrace_on)							\
+      ktrace_point((ev), (pid), (uint64_t)(arg));			\
+  } while(0)
+
+/* A span: BEGIN and END on the same core; END records it */
+#define KTRACE_BEGIN(ev, pid, arg) do {					\
+    if(ktrace_on)							\
+      ktrace_begin((ev), (pid), (uint64_t)(arg));			\
+  } while(0)
+
+#define KTRACE_END(ev) do {						\
+    if(ktrace_on)							\
+      ktrace_end(ev);							\
+  } while(0)
+
+#else
+
+#define KTRACE_POINT(ev, pid, arg) do { } while(0)
+#define KTRACE_BEGIN(ev, pid, arg) do { } while(0)
+#define KTRACE_END(ev) do { } while(0)
+
+#endif
+
+void ktrace_point(int ev, int pid, uint64_t arg);
+void ktrace_begin(int ev, int pid, uint64_t arg);
+void ktrace_end(int ev);
+
+/* Once this_cpu() works. Tracing starts off */
+void ktrace_init();
+
+/* Turn tracing on or off. Returns whether it was on, or -1 if it is not
+ * built in */
+int ktrace_enable(int on);
+
+/* Take up to max of the unread records, oldest first on each core.
+ * Records overwritten before they could be read are added to *lost.
+ * Returns how many, or -1 if tracing is not built in */
+int ktrace_read(Ktrace_rec_t *recs, int max, uint64_t *lost);
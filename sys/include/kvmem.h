@@ -30,8 +30,9 @@
 #include <pci.h>
 
 /* 
- * TLB sections to flush (only TLB_ALL currently implemented).
- * The real solution is PCID...
+ * TLB sections to flush. TLB_PL3 and TLB_SCRATCH are the current process's 
+ * own mappings; the rest take the global kernel mappings, and every pcid's
+ * entries, with them. Single pages are flushed where they are unmapped.
  */
 #define TLB_PL0     0
 #define TLB_PL1     1
@@ -40,6 +41,8 @@
 #define TLB_SCRATCH 4
 #define TLB_ALL     5
 
+#define CR4_PGE     (1 << 7)
+
 /* Size of every buffer doled out by dmapool_alloc() */
 #define DMAPOOL_BUF_SIZE  (2048)
 
@@ -77,6 +80,7 @@ int  attach_page  (uint64_t vaddr, uint64_t paddr, uint64_t ptflags);
 /* Allocating/mapping/unmapping memory for peripheral device communication */
 uint64_t kvmem_map_mmio(Proc_t *p, uint64_t virt_addr, Pci_bar_t *bar);
 uint64_t kvmem_map_dma_region(Proc_t *p, uint64_t virt_addr, uint64_t pages);
+uint64_t kvmem_map_ramdisk(Proc_t *p, uint64_t virt_addr);
 void     kvmem_unmap_devmem(Proc_t *p);
 
 
@@ -49,6 +49,13 @@
  */
 #define DRIVER_MEM_START (0x80000000000UL)
 
+/* 
+ * Shared memory regions (kernel/kshm.c) are mapped into user processes in 
+ * this window; fork shares the pages here rather than copying them.
+ */
+#define SHM_MEM_START (0xA0000000000UL)
+#define SHM_MEM_SIZE  (0x1000000000UL)
+
 /* Size of stack */
 #define USR_STACK_PAGES 8 
 
@@ -181,7 +188,7 @@ struct frame_array_entry_t{
   uint64_t *vaddr;
   uint16_t free;
   uint16_t type;
-  uint32_t proc;
+  uint32_t refs;         /* mappings of a shared memory frame (kshm.c) */
 } __attribute__ ((packed));
 
 /* Layout of an entry in the page table. */
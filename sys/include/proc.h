@@ -74,6 +74,9 @@ typedef struct _proc {
                                  for lateral move to next process   */
   /* THIS MUST BE THIRD */
   struct page_map_level_4_table *cr3_target;   /* physical location of processes PML4T */
+  /* THIS MUST BE FOURTH */
+  uint64_t cr3_load;          /* CR3 restore_kernel_proc loads, 0 for none
+                                 -- set by ktlb_switch()                    */
   
   /* Privilege Info */
   pid_t pid;                  /* Process ID                                 */
@@ -83,6 +86,8 @@ typedef struct _proc {
   /* TODO: erase these 2 */
   union pt_entry *pml4t_entry;
   struct page_directory_pointer_table *pdpt;
+  uint16_t pcid;              /* tags its TLB entries, see ktlb.c           */
+  uint32_t tlb_cpus;          /* cores that may hold TLB entries for it     */
   
   /* virtual memory spaces */
   queue_t *mapped_memory_regions;
@@ -110,6 +115,14 @@ typedef struct _proc {
      is when I'll check the tag */
   unsigned int search_tag;
 
+  /* poll() -- see systask_do_poll */
+  unsigned int poll_tag;      /* the poll() under way, 0 if none            */
+  int poll_owed;              /* arms whose POLL_DONE_FD has not come       */
+  int poll_wait;              /* POLL_WAIT is waiting for its answer        */
+  int poll_now;               /* ... which goes as soon as the arms are done */
+  int poll_nev;               /* events kept for it                         */
+  Poll_event_t poll_ev[POLL_MAXEV];
+
   /* this func is called at end of wait   */
   void (*cb_func)(struct _proc*,int,int,unsigned int);
 
@@ -28,6 +28,7 @@
 
 #define RAMDISK         0x5010   /* Variable for location of ramdisk in phys memory */
 #define RAMDISK_SIZE    0xA00000
+#define RAMDISK_MAP     0x200000 /* Where the ramdisk is mapped in virtual memory */
 
 /* Status of Disk Functions */
 typedef BYTE    DSTATUS;
@@ -46,6 +47,9 @@ typedef enum {
  */
 DRESULT ramdisk_read( BYTE drive, BYTE *read_buf, DWORD LBA, BYTE count);
 
+/* Address of a sector in the ramdisk, for reading it in place */
+void *ramdisk_ptr(DWORD LBA);
+
 DRESULT user_ramdisk_read(BYTE drive, BYTE *read_buf, DWORD LBA, BYTE count);
 
 /* For compatibility resons -- Not used though */
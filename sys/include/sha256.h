@@ -47,8 +47,22 @@ typedef struct {
    uint state[8];
 } SHA256_CTX;
 
+/* compression engines, see sha256.c */
+#define SHA256_BEST -1
+#define SHA256_SW    0
+#define SHA256_NI    1
+
+/* Use engine if the cpu has it, the plain C one if not; returns the one in
+   use. Otherwise the best is picked by the first sha256_init. */
+int sha256_select(int engine);
+const char *sha256_engine_name(void);
+
 void sha256_init(SHA256_CTX *ctx);
 
 void sha256_update(SHA256_CTX *ctx, uchar data[], uint len);
 
 void sha256_final(SHA256_CTX *ctx, uchar hash[]);
+
+/* hash[i] = SHA-256 of len[i] bytes at data[i], for n messages; four at a
+   time in the SSE lanes when there are no SHA extensions */
+void sha256_multi(uchar *data[], uint len[], int n, uchar hash[][32]);
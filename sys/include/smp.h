@@ -40,7 +40,17 @@ semaphore_t *sem_kernel;
 semaphore_t *sem_hypv;
 semaphore_t *sem_mult_vm;
 
-uint8_t* temp_stack;
+/* where the APs start, in real mode */
+#define AP_TRAMPOLINE 0x6000
+
+/* Each AP's stack from the trampoline until it switches to smp_ap_stack(),
+   below the boot stack and above the trampoline's page. trampoline.S 
+   computes this too. */
+#define AP_BOOT_STACK_SIZE 0x170
+#define AP_BOOT_STACK(id) (0x7bf8 - (id) * AP_BOOT_STACK_SIZE)
 
 void smp_boot_aps(); /*function to start all ap cores*/
 void set_running(); /*function to signal bsp an ap core started*/
+uint8_t *smp_ap_stack(); /*the stack smp_boot_aps allocated this ap*/
+void smp_ap_lock(); /*serialize the parts of ap setup that allocate*/
+void smp_ap_unlock();
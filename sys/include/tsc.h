@@ -25,5 +25,6 @@
 
 
 uint64_t get_tsc_freq();
+void tsc_udelay(uint64_t us);
 inline uint64_t readtsc();
 inline uint64_t readtscp();
@@ -72,6 +72,7 @@
 #define PROC_SEC_UNRESTRICTED           7
 #define PROC_SEC_APIC_REGISTER_VIRT     8
 #define PROC_SEC_VIRT_INT_DELIVERY      9 
+#define PROC_SEC_ENABLE_INVPCID         12
 
 
 /* Set up the various VMCS stuff.
@@ -634,6 +635,7 @@ typedef struct waiting_interrupts_t{
 } waiting_interrupt_t;
 
 void hypv_entry(uint64_t );
+void hypv_core_vmxon();
 void init_vmcs_defaults();
 void write_vmcs(vmcs_t *vmcs);
 void hypv_map_bce_mmio(void *varg, void *vdev);
@@ -67,6 +67,7 @@ typedef struct vcpu_t{
   uint32_t assigned;
   uint64_t vmxon_region_virt;
   uint64_t stack;
+  uint32_t vmx_on;                /* VMXON done on this core */
 } __attribute__ ((packed)) vcpu_t; 
 
 vcpu_t *vcpu_get_last();
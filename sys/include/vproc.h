@@ -66,7 +66,27 @@ typedef struct vproc {
   struct mcontext reg_storage;
   struct memmap* memmap;          /* BIOS memmap created by hypv */
   uint16_t* memmap_entries;       /* Number of entries in memmap */
-  shadow_vmcs_t vmcs_shadow;      /* for nesting shadow the vmcs */ 
+  shadow_vmcs_t vmcs_shadow;      /* for nesting shadow the vmcs */
+
+  /* Scheduling state -- see vsched.c */
+  int cpu;                        /* Core this vproc is bound to */
+  int preempt_armed;              /* Preemption timer enabled in VMCS */
+  uint32_t weight;                /* Relative share of the core */
+  uint64_t vruntime;              /* Weighted guest run time (TSC) */
+  uint64_t entry_tsc;             /* TSC at the last vm entry */
+  uint64_t slice_used;            /* TSC consumed of the current slice */
+  uint64_t run_tsc;               /* Total guest run time (TSC) */
+  uint64_t nslices;               /* Number of slices handed out */
+  uint64_t nexits;                /* Number of vmexits */
+
+  /* Memory accounting -- see ept.c */
+  struct vproc *ept_owner;        /* Vproc whose EPT we share, or NULL */
+  uint64_t ept_frames;            /* Guest frames backed by host frames */
+  uint64_t ept_faults;            /* EPT violations that backed memory */
+  uint64_t create_tsc;            /* TSC spent in create_vproc */
+  uint64_t launch_tsc;            /* TSC at first vm entry */
+
+  uint32_t ap_joined;             /* APIC ids joined by a SIPI, vmexit.c */
 } vproc_t;
 #endif
 
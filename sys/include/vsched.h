@@ -0,0 +1,47 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#pragma once
+#include <stdint.h>
+#include <vproc.h>
+
+/* 
+ * vsched -- the hypervisor vCPU scheduler. Each physical core keeps a run
+ * queue of the vprocs bound to it. Cores with more than one vproc are time
+ * sliced with the VMX preemption timer; the next vproc is the one with the
+ * least weighted run time (vruntime), so each vproc gets a share of its core
+ * proportional to its weight. Every vproc carries its own VPID, so a switch
+ * is just a vmptrld -- the TLB does not need to be flushed.
+ */
+
+#define VSCHED_WEIGHT_DEFAULT 1024     /* weight of a "normal" guest         */
+#define VSCHED_SLICE_US       10000    /* length of a full slice (10ms)      */
+
+void     vsched_init();                /* set up run queues, after smp boot  */
+void     vsched_add(vproc_t *vp, uint32_t weight, int cpu); /* bind to core */
+void     vsched_remove(vproc_t *vp);   /* take a vproc off its core          */
+vproc_t *vsched_next(vproc_t *curr);   /* choose what this core runs next    */
+void     vsched_enter(vproc_t *vp);    /* called just before vm entry        */
+void     vsched_exit(vproc_t *vp);     /* called just after a vmexit         */
+int      vsched_nr_running(int cpu);   /* number of vprocs bound to a core   */
+void     vsched_print_stats();         /* per-guest cpu accounting           */
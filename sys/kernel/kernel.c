@@ -57,6 +57,8 @@
 #include <file_abstraction.h>
 #include <kvmem.h>
 #include <kwait.h>
+#include <kshm.h>
+#include <ktlb.h>
 #include <kmsg.h>
 #include <msg_types.h>
 #include <proc.h>
@@ -73,6 +75,9 @@
 #include <network.h>
 
 #include <kload.h>
+#include <boottime.h>
+#include <ktrace.h>
+#include <kprof.h>
 
 //smp related includes
 #include <smp.h>
@@ -151,7 +156,7 @@ void kentry() {
 		 "movq %%rsp,%%rbp   \n\t"
 		 "movq %1,%%rax      \n\t"
 		 "jmp *%%rax"
-		 ::"p"(system_stack_base),
+		 ::"r"(smp_ap_stack()),
 		  "p"(ap_core_init));
   }
 #ifdef DEBUG_SMP
@@ -162,6 +167,10 @@ void kentry() {
   bsp_ready_kernel = 1;
 #endif
 
+  /* Before the boot timeline's low memory goes to the processes */
+  boottime_save();
+  boottime_mark("kernel: kentry");
+
   scan_rsdp();
 
   /*Enable global pages for the kernel */
@@ -185,6 +194,7 @@ void kentry() {
   asm volatile("movq %%r13, %0" : "=r"(kplt));
 #endif
 
+  boottime_mark("kernel: kvmem_init");
   kvmem_init( frame_array_address, heap_start );
 
   if(!kheapcheck(0,"kernel entry"))
@@ -211,14 +221,16 @@ Proc_t* gp;
 
 #ifdef ENABLE_SMP
 static void ap_core_init() {
-  asm volatile("movq %0,%%rsp" : :"r"(temp_stack));
 #ifdef DEBUG_SMP
   kprintf("[SMP] core %d initializing\n",this_cpu());
 #endif
+  smp_ap_lock();
   pes_init();
   init_new_gdt();
-  lapic_init();
   ap_lidt();		 /* loads idt and then loads new tss into gdt*/
+  smp_ap_unlock();
+  ktlb_init();
+  lapic_init();		 /* calibrates the APIC timer, alongside the others */
 #ifdef DEBUG_SMP
   kprintf("[SMP] application core init done\n");
 #endif
@@ -233,6 +245,7 @@ static void ap_core_init() {
 
   gp = ksched_schedule();
 
+  ktlb_switch(gp);
   restore_kernel_proc(gp);
 }
 #endif
@@ -260,6 +273,7 @@ static void kinit() {
   acquire_lock(sem_kernel);
 #endif /* ENABLE_SMP */
 
+  boottime_mark("kernel: kinit");
   Scan_ACPI();
 
   /* The GDT holds pointers to the code,data,stack,+other segments.
@@ -290,12 +304,20 @@ static void kinit() {
   if( attach_page(lapicaddr,lapicaddr, KMEM_IO_FLAGS | PG_GLOBAL) )
     kpanic("[SMP] failed to add page location of APIC");
   lapic_init();
+  ktlb_init();			/* needs this_cpu(), so the lapic */
 
   print_debug("IO_APIC initialization");
   if( attach_page(ioapicaddr,ioapicaddr, KMEM_IO_FLAGS | PG_GLOBAL) )
     kpanic("[SMP] IOAPIC failed to add page location of IOAPIC");
   ioapic_init();
 
+  /* kprintf goes through per-cpu rings from here on, drained by COM1 */
+  kprintf_ring_start(1);
+  ktrace_init();
+  kprof_init();
+  ioapicenable(4, 0);
+  systick_hook_add(kprintf_drain);
+
   /*** KERNEL MODULES ***/
 
   /*
@@ -303,6 +325,7 @@ static void kinit() {
    * Must be done before devices that use PCI (i.e. disk and NIC).
    */
   print_debug("PCI initialization");
+  boottime_mark("kernel: pci_init");
   pci_init();
 
   /* Init process creation module Must be done before creating processes */
@@ -317,8 +340,13 @@ static void kinit() {
   print_debug("Kwait initialization");
   kwait_init();
 
+  /* Init shared memory regions. Must be done before creating procs */
+  print_debug("Shared memory initialization");
+  kshm_init();
+
   /* Get the filesystem ready for use. */
   print_debug("FS initialization ");
+  boottime_mark("kernel: file_init");
   file_init();
 
   /* Initialize watchdog timer module. Must be done before networking */
@@ -341,10 +369,12 @@ static void kinit() {
   srandom(readtsc());
 
 #ifdef ENABLE_SMP
+  boottime_mark("kernel: smp_boot_aps");
   smp_boot_aps();
 #endif
 
   /*** SYSTEM PROCESSES ***/
+  boottime_mark("kernel: kload_daemon");
   kload_daemon("vgad",VGAD, PL_0 /* IO_FLAGS_ENABLED */);	/* VGAD = -5 */
   kload_daemon("kbd",KBD, PL_0 /* IO_FLAGS_ENABLED */);	/* KBD = -6 */
   ioapicenable(1, 0); /*enables the keyboard interrupt*/
@@ -355,6 +385,11 @@ static void kinit() {
   print_debug("PIPED Initialization\n");
   kload_daemon("piped",PIPED, PL_3 /* IO_FLAGS_DISABLED */);  /* PIPED = -12 */
 
+#ifdef STANDALONE
+  print_debug("RAMFSD Initialization\n");
+  kload_daemon("ramfsd",RAMFSD, PL_3 /* IO_FLAGS_DISABLED */);  /* RAMFSD = -14 */
+#endif
+
   /* 
    * Load the hypervisor shim that enables execute-only
    * memory for the kernel.
@@ -374,13 +409,18 @@ static void kinit() {
 #endif	/* HYPV_SHIM */
 
   print_debug("Wall Clock initialization");
+  boottime_mark("kernel: init_time");
   init_time();
   localtime(system_time, &boot_time);
 
   kprintf("[Kernel] Initialization Complete");
   kprintf(" (%d:%d:%d)\n", boot_time.tm_hour-1, boot_time.tm_min, 
 	  boot_time.tm_sec);
+#if defined(HYPV_STATS) && !defined(HYPV_SHIM)
+  kvmcall(42, (uint64_t)NULL, NULL);	/* hypv reports boot time & memory */
+#endif
 
+  boottime_mark("kernel: run daemons");	/* until sysd marks */
   ksched_yield();
 
   /** On start up ksched init will create the idle proc. the ksched yield above
@@ -395,6 +435,7 @@ static void kinit() {
 void kpanic(char *error_str) {
   /* No more interrupts. */
   asm volatile("cli");
+  kprintf_panic();
 
   /* Print then halt */
   kputs("\n[Kernel] PANIC!");
@@ -529,6 +570,7 @@ void interrupt(unsigned int vec, void *varg) {
   Proc_t *dst_p;
   int code, val;
   pid = (pid_t)(intptr_t)varg;
+  KTRACE_POINT(KT_INTR, pid, vec);
 
   dst_p = pid_to_addr(pid);
   if (dst_p == NULL) {
@@ -554,6 +596,7 @@ void interrupt(unsigned int vec, void *varg) {
   msg.status = NULL;
   msg.buf = &hwmsg;
   hwmsg.type = HARD_INT;	/* msg type 0 in /usr/include syscall.h */
+  hwmsg.tsc = readtsc();
 
   /*
    * HACK: Mask out the card interrupts until they're handled by the
@@ -602,6 +645,7 @@ void kernel_syscall(unsigned int vec, void *varg) {
        * NOTE: compiler generates jump table -- do not optimize
        */
       msgtype = (int*)(mp->buf);	/* get message type */
+      KTRACE_BEGIN(KT_SYSCALL, cp->pid, *msgtype);
       switch(*msgtype) {		/* which system call? */
       case SC_FORK:
 	systask_do_fork(msg,&status);
@@ -648,6 +692,9 @@ void kernel_syscall(unsigned int vec, void *varg) {
       case SC_POLL:
 	systask_do_poll(msg,&status);
 	break;
+      case SC_POLLPOST:
+	systask_do_pollpost(msg,&status);
+	break;
       case SC_CORE:
 	systask_do_get_core(msg,&status);
 	break;
@@ -686,10 +733,29 @@ void kernel_syscall(unsigned int vec, void *varg) {
 	    case SC_MSI_EN:
 	systask_do_msi(msg, &status);
 	break;
+      case SC_RAMDISK:
+	systask_do_ramdisk(msg, &status);
+	break;
+      case SC_SHM_CREATE:
+      case SC_SHM_MAP:
+      case SC_SHM_UNMAP:
+      case SC_SHM_GRANT:
+	systask_do_shm(msg, &status);
+	break;
+      case SC_BOOTTIME:
+	systask_do_boottime(msg, &status);
+	break;
+      case SC_TRACE:
+	systask_do_trace(msg, &status);
+	break;
+      case SC_PROF:
+	systask_do_prof(msg, &status);
+	break;
       default:
 	kprintf("%d: Invalid system call - %d\n",cp->pid,fn);
 	break;
       }
+      KTRACE_END(KT_SYSCALL);
     }
     else {		       /* send to a process */
       mp->src = cp->pid;       /* record sending process in message */
@@ -701,6 +767,7 @@ void kernel_syscall(unsigned int vec, void *varg) {
 
 /* Interrupt handlers */
 extern void poke_vmm();
+extern void tlb_shootdown_asm();
 static void add_all_intr_handlers() {
 
   flip = 0;
@@ -711,8 +778,12 @@ static void add_all_intr_handlers() {
   /* Now turn on the interrupts. Args are always passed as void* */
   intr_add_handler(0x20, &systick_handler, NULL); /* APIC timer */
   intr_add_handler(0x21, &interrupt, (void*)KBD); /* kbd hardware */
+  intr_add_handler(0x24, &kprintf_intr, NULL);    /* COM1 transmitter */
   intr_add_handler(0x80, &kernel_syscall, NULL);  /* system call */
 
+  /* Shootdowns must not wait for the kernel lock; see ktlb.c */
+  intr_update_idtentry(TLB_SHOOTDOWN_VEC, INTR64_ON, (uint64_t)tlb_shootdown_asm);
+
 
   return;
 }
@@ -35,6 +35,8 @@
 #include <apic.h>
 #include <kmalloc.h>
 #include <kmalloc_sites.h>
+#include <tsc.h>
+#include <kprof.h>
 
 #ifdef DIVERSITY
 #include <diversity.h>
@@ -65,6 +67,31 @@ static void print_hash(char *name, unsigned char hash[]) {
 #endif
 
 
+/* exec latency: TSC spent in load_elf_proc, and in diversify within it */
+static uint64_t exec_count;
+static uint64_t exec_tsc;
+static uint64_t exec_max;
+#ifdef DIVERSITY
+static uint64_t exec_div_tsc;
+#endif
+
+void kload_print_stats() {
+  uint64_t hz, avg;
+
+  hz = get_tsc_freq();
+  avg = exec_count ? exec_tsc / exec_count : 0;
+  kprintf("[exec] %d loads, %d cycles (%d us) avg, %d cycles max, diversity ",
+	  (int)exec_count, (int)avg, (int)(hz ? avg * 1000000 / hz : 0),
+	  (int)exec_max);
+#ifdef DIVERSITY
+  kprintf("on, %d cycles avg in diversify, sha256 %s\n",
+	  (int)(exec_count ? exec_div_tsc / exec_count : 0),
+	  sha256_engine_name());
+#else
+  kprintf("off\n");
+#endif
+}
+
 void kload_daemon(char *dname,int dpid, int ioflags) {
   Proc_t *dp;
 
@@ -93,12 +120,15 @@ int load_elf_proc(void) {
   int i;
 
   uint64_t env_ptr, argv_ptr_array;
+  uint64_t start;
 
 #ifdef DIVERSITY
   SHA256_CTX ctx;
   unsigned char hash[32];
+  uint64_t div_start;
 #endif
 
+  start = readtsc();
     proc = ksched_get_last();
 
   /* Open file */
@@ -211,7 +241,9 @@ int load_elf_proc(void) {
   list_add_tail(&proc->file->diversity_units, &heapunit->list);
   proc->file->num_diversity_units++;
 
+  div_start = readtsc();
   diversify(proc, &ctx);
+  exec_div_tsc += readtsc() - div_start;
   sha256_final(&ctx, hash);
   print_hash(proc->procnm, hash);
   kprintf(" @ %x\n",proc->mc.rip);
@@ -227,7 +259,8 @@ int load_elf_proc(void) {
     mem_close(proc->file->file_ctx);
   }
 
-  /* free up the elf meta data */
+  /* free up the elf meta data, but for the symbols the profiler keeps */
+  kprof_exec(proc);
   free_elf_ctx(proc->file);
 
   proc->mc.rsp -= PAGE_SIZE;
@@ -275,6 +308,11 @@ int load_elf_proc(void) {
   *(uint64_t*)proc->mc.rsp = 0x0;
   proc->mc.rbp = proc->mc.rsp;     /* new base is after the argv stuff */
 
+  start = readtsc() - start;
+  exec_tsc += start;
+  if ( start > exec_max )
+    exec_max = start;
+  exec_count++;
   
   return 0;
 }
@@ -46,6 +46,7 @@
 /* 20131212 JMD: Added so system calls can be managed directly from within kmsg handling */
 #include <ksyscall.h>
 #include <syscall.h>
+#include <ktrace.h>
 
 /* PRIVATE DECLARATIONS */
 
@@ -110,6 +111,7 @@ void kmsg_send(Message_t *mp) {
   int(*search_fn)(void *,const void *);  
   
   search_fn = is_waiting_for;
+  KTRACE_POINT(KT_MSG_SEND, mp->src, mp->dst);
   
   /* look to see if receiving process is waiting for the message */
   mh.destpid = mp->dst;
@@ -170,6 +172,7 @@ int kmsg_recv(Proc_t *p, Message_t *mp, int from) {
   int(*search_fn)(void *,const void *);
 
   search_fn = is_msg;
+  KTRACE_POINT(KT_MSG_RECV, p->pid, from);
 
   /* look to see if sender sent a message  */
   mh.destpid=p->pid;
@@ -38,6 +38,8 @@
 #include <kstring.h>
 #include <file_abstraction.h>     /* hack for now           */
 #include <kvmem.h>                /* For paging protections */
+#include <kshm.h>                 /* For shared memory regions */
+#include <ktlb.h>                 /* For pcids              */
 #include <kmalloc.h>              /* For malloc             */
 #include <kqueue.h>                /* For qput qget qopen    */
 #include <elf_loader.h>           /* For elf_load_file()    */
@@ -175,6 +177,7 @@ Proc_t *new_kernel_proc(uint64_t code_pointer, pid_t pid) {
   //  p->kmc.sse = pes_new_save(&(p->pes_hack_kernel));
 
   new_cr3_target(p, 0);
+  ktlb_new(p);
 
   return p;
 }
@@ -296,6 +299,9 @@ Proc_t *new_proc(uint64_t code_pointer, int pl, pid_t pid, Proc_t *parent) {
   sigemptyset(&(p->sigdispatch));
 
   new_cr3_target(p, clone);
+  ktlb_new(p);
+  if ( clone )
+    kshm_fork(parent, p);
 
   update_proc_status(p,0,CONTINUED);
   update_proc_status(p,0,0);
@@ -331,6 +337,7 @@ static void new_cr3_target(Proc_t *p, int clone) {
   uint64_t frame_phys, frame_virt;
 
   int pml4t_idx, pdpt_idx, pd_idx, pt_idx;
+  int shared;
 
 #ifdef KPLT
   queue_t *todo_q;
@@ -345,7 +352,8 @@ static void new_cr3_target(Proc_t *p, int clone) {
   uint64_t remainder;
   unsigned char jmp[20];  
   uint64_t searchval, ptsearchval;
-  partition_t *parts, *part;
+  partitions_t *parts;
+  partition_t *part;
 #endif
   
   parent = p->parent;
@@ -422,6 +430,7 @@ static void new_cr3_target(Proc_t *p, int clone) {
 	      continue;
 	    
 	    /* generate page of memory for new proc */
+	    shared = 0;
 	    if ( !((union page*)PTE2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx))->global ) {
 
 	      if ( !((union pt_entry*)PTE2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx))->us ) {
@@ -429,6 +438,10 @@ static void new_cr3_target(Proc_t *p, int clone) {
 		TEMP_MAP(frame_phys, frame_virt, idx2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx));
 		kmemset((void*)frame_virt, 0, PAGE_SIZE);
 	      }
+	      else if ( clone == 1 && KSHM_ADDR(idx2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx)) ) {
+		/* shared memory region: the clone maps the same frame (see kshm_fork) */
+		shared = 1;
+	      }
 	      else if ( clone == 1 ) {
 		/* it is user space and we are making a clone, make new memory and copy contents over */
 		TEMP_MAP(frame_phys, frame_virt, idx2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx));
@@ -453,8 +466,8 @@ static void new_cr3_target(Proc_t *p, int clone) {
 	    }
 	    
 	    /* place newly generated memory page into paging structs */
-	    if ( ((union page*)PTE2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx))->global )
-	      /* if it is global, copy the mapping to one common global page. */
+	    if ( ((union page*)PTE2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx))->global || shared )
+	      /* if it is global or shared, copy the mapping to the same page. */
 	      *(uint64_t*)(pt_virt + (sizeof(union pt_entry)*pt_idx)) = 
 		*(uint64_t*)PTE2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx);  
 	    else {
@@ -529,7 +542,7 @@ static void new_cr3_target(Proc_t *p, int clone) {
       /* now, find a new function addr */
       rand_fn_addr = pick_random_place(parts, fn_size, PAGE_SIZE, &part);
       rand_fn_addr |= (fn_addr & 0xfff); /* make sure the last bits match on all addrs for a given function. */
-      split_partition(part, rand_fn_addr, rand_fn_addr + fn_size);
+      split_partition(parts, part, rand_fn_addr, rand_fn_addr + fn_size);
 
       /* REBUILD */
 
@@ -687,11 +700,11 @@ static void new_cr3_target(Proc_t *p, int clone) {
 #undef TEMP_MAP
 
     /* the TLB still has those temporary mappings. Get rid of them. */
-    flush_tlb(TLB_ALL);
+    flush_tlb(TLB_SCRATCH);
   }
   else{ /* idle proc is the "init" proc so it has the original cr3 target */
     first = 0;
-    p->cr3_target = (struct page_map_level_4_table*)read_cr3();
+    p->cr3_target = (struct page_map_level_4_table*)(read_cr3() & ~CR3_PCID_MASK);
   }
 }
 
@@ -768,6 +781,8 @@ void destroy_proc(Proc_t *p, int estatus) {
 
   /* Paging and memory */
   kvmem_unmap_devmem(p);           /* Unmap MMIO so it doesn't get freed */
+  kshm_purge(p);                   /* Reaper frees shared frames last out */
+  ktlb_free(p);                    /* Its pcid can go to the next proc */
  
   if ( p->pes_hack_user ) 
     kfree_track(PROCMAN_SITE, (void*)p->pes_hack_user);
@@ -0,0 +1,477 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/*
+ * kprof.c -- sampling profiler, see kprof.h.
+ *
+ * Two general purpose counters count the event on every core, PMC0 in
+ * user mode and PMC1 in the kernel, each preset to -period so that it
+ * overflows into the PMI (PROF_PMI_VEC on the lapic's performance LVT).
+ * The kernel runs with interrupts off, so a PMI that comes due in it is
+ * taken on the way back out to a process: a kernel sample carries no
+ * address, only the pid it was taken against. The cores arm and disarm
+ * their own counters from the systick; without a PMU the systick samples
+ * the process it interrupted, so only user time is seen.
+ *
+ * Diversity moves a program's functions when it is loaded, so the
+ * symbols of programs exec'd while profiling are kept, with their moved
+ * addresses, until the next start. Programs that were already running
+ * are named from their files when the system is built without
+ * diversity, and by address when it is not.
+ */
+#include <stdint.h>
+#include <constants.h>
+#include <asm_subroutines.h>
+#include <kstdio.h>
+#include <kstring.h>
+#include <kmalloc.h>
+#include <memory.h>
+#include <kvmem.h>
+#include <vk.h>
+#include <apic.h>
+#include <smp.h>
+#include <kernel.h>
+#include <interrupts.h>
+#include <proc.h>
+#include <procman.h>
+#include <ksched.h>
+#include <elf_loader.h>
+#include <file_abstraction.h>
+#include <kprof.h>
+
+#define KPROF_USER 0			/* counter for user mode */
+#define KPROF_KERN 1			/* counter for the kernel */
+
+#define KPROF_PROGS 64			/* programs whose symbols are kept */
+#define KPROF_LINES 1024		/* distinct lines in a profile */
+#define KPROF_SLOTS (2 * KPROF_LINES)	/* hash slots, a power of two */
+
+/* IA32_PERFEVTSELx */
+#define EVTSEL_USR (1 << 16)
+#define EVTSEL_OS  (1 << 17)
+#define EVTSEL_INT (1 << 20)
+#define EVTSEL_EN  (1 << 22)
+
+/* The architectural events: umask and event select, and the bit of
+ * CPUID.0AH:EBX that is set when the core does not have it */
+static const struct {
+  uint32_t sel;
+  int absent;
+} kprof_events[PROF_EV_TIMER] = {
+  { 0x003C, 0 },			/* unhalted core cycles */
+  { 0x00C0, 1 },			/* instructions retired */
+  { 0x412E, 4 },			/* LLC misses */
+};
+
+typedef struct {
+  uint64_t rip;				/* 0 for the kernel */
+  int32_t pid;
+  uint32_t kernel;
+} Kprof_sample_t;
+
+/* Symbols of a program; pid is -1 for those read from the file */
+typedef struct {
+  int pid;
+  char procnm[MAX_FNAME_SZ];
+  struct elf_ctx *syms;
+} Kprof_prog_t;
+
+static int pmu_version;
+static int pmu_counters;
+static uint64_t pmu_mask;		/* of the counter width */
+static uint32_t pmu_absent;
+
+static volatile int running;
+static int event = PROF_EV_TIMER;
+static uint64_t period;
+static uint64_t epoch;			/* starts so far */
+static uint64_t armed[MAX_CORES];	/* the start a core is armed for */
+
+static Kprof_sample_t *samples;		/* KPROF_SAMPLES per core */
+static int nsamples[MAX_CORES];
+static uint64_t dropped;
+
+static Kprof_prog_t progs[KPROF_PROGS];
+static int nprogs;
+
+static Prof_line_t *lines;		/* the last profile built */
+static int *slots;
+static int nlines;
+
+static void kprof_cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx) {
+  uint32_t ecx, edx;
+
+  *eax = leaf;
+  ecx = 0;
+  asm volatile("cpuid" : "+a"(*eax), "=b"(*ebx), "+c"(ecx), "=d"(edx));
+}
+
+static int pmu_has(int ev) {
+
+  return ev < PROF_EV_TIMER && pmu_version >= 1 && pmu_counters >= 2 &&
+    !(pmu_absent & (1 << kprof_events[ev].absent));
+}
+
+/* Preset a counter to overflow after period events */
+static void pmu_preset(int ctr) {
+
+  write_msr(IA32_PMC0 + ctr, (0 - period) & pmu_mask);
+}
+
+static void pmu_disarm() {
+
+  if(pmu_version >= 2)
+    write_msr(IA32_PERF_GLOBAL_CTRL, read_msr(IA32_PERF_GLOBAL_CTRL) & ~3ULL);
+  write_msr(IA32_PERFEVTSEL0 + KPROF_USER, 0);
+  write_msr(IA32_PERFEVTSEL0 + KPROF_KERN, 0);
+  lapic_write(APIC_LVT_PERF, APIC_NMI);	/* as lapic_init left it */
+}
+
+static void pmu_arm() {
+  uint64_t sel;
+
+  pmu_disarm();
+  pmu_preset(KPROF_USER);
+  pmu_preset(KPROF_KERN);
+  lapic_write(APIC_LVT_PERF, PROF_PMI_VEC);
+  sel = kprof_events[event].sel | EVTSEL_INT | EVTSEL_EN;
+  write_msr(IA32_PERFEVTSEL0 + KPROF_USER, sel | EVTSEL_USR);
+  write_msr(IA32_PERFEVTSEL0 + KPROF_KERN, sel | EVTSEL_OS);
+  if(pmu_version >= 2) {
+    write_msr(IA32_PERF_GLOBAL_OVF_CTRL, 3);
+    write_msr(IA32_PERF_GLOBAL_CTRL, read_msr(IA32_PERF_GLOBAL_CTRL) | 3);
+  }
+}
+
+static void kprof_sample(uint32_t cpu, Proc_t *p, int kernel) {
+  Kprof_sample_t *s;
+
+  if(nsamples[cpu] == KPROF_SAMPLES) {
+    dropped++;
+    return;
+  }
+  s = &samples[cpu * KPROF_SAMPLES + nsamples[cpu]++];
+  s->rip = kernel ? 0 : p->mc.rip;
+  s->pid = p->pid;
+  s->kernel = kernel;
+}
+
+/* A counter has overflowed when it is no longer negative */
+static void kprof_pmi(unsigned int vec, void *arg) {
+  uint32_t cpu;
+  int ctr;
+
+  cpu = this_cpu();
+  if(cpu >= MAX_CORES || pmu_version == 0)
+    return;
+  for(ctr = KPROF_USER; ctr <= KPROF_KERN; ctr++) {
+    if(read_msr(IA32_PMC0 + ctr) & ((pmu_mask >> 1) + 1))
+      continue;
+    if(running && armed[cpu] == epoch)
+      kprof_sample(cpu, ksched_get_last(), ctr == KPROF_KERN);
+    pmu_preset(ctr);
+  }
+  if(pmu_version >= 2)
+    write_msr(IA32_PERF_GLOBAL_OVF_CTRL, 3);
+  lapic_write(APIC_LVT_PERF, PROF_PMI_VEC);	/* delivery masked it */
+}
+
+/* Every core, every systick: catch up with the last start or stop */
+static void kprof_tick() {
+  uint32_t cpu;
+
+  cpu = this_cpu();
+  if(cpu >= MAX_CORES)
+    return;
+  if(running && armed[cpu] != epoch) {
+    if(pmu_has(event))
+      pmu_arm();
+    else if(pmu_version)
+      pmu_disarm();
+    armed[cpu] = epoch;
+  }
+  else if(!running && armed[cpu]) {
+    if(pmu_version)
+      pmu_disarm();
+    armed[cpu] = 0;
+  }
+  if(running && event == PROF_EV_TIMER)
+    kprof_sample(cpu, ksched_get_last(), 0);
+}
+
+void kprof_init() {
+  uint32_t eax, ebx;
+
+  kprof_cpuid(0, &eax, &ebx);
+  if(eax >= 0xA) {
+    kprof_cpuid(0xA, &eax, &ebx);
+    pmu_version = eax & 0xFF;
+    pmu_counters = (eax >> 8) & 0xFF;
+    pmu_mask = ((1ULL << ((eax >> 16) & 0xFF)) - 1) | 0xFFFFFFFFULL;
+    pmu_absent = ebx;
+  }
+  intr_add_handler(PROF_PMI_VEC, &kprof_pmi, NULL);
+  systick_hook_add(kprof_tick);
+}
+
+/* Drop the kept symbols and the last profile */
+static void kprof_forget() {
+  int i;
+
+  for(i = 0; i < nprogs; i++)
+    if(progs[i].syms)
+      free_elf_ctx(progs[i].syms);
+  nprogs = 0;
+  nlines = 0;
+}
+
+int kprof_start(int ev, uint64_t per) {
+  uint64_t pages;
+
+  if(running)
+    return -1;
+  if(samples == NULL) {
+    pages = (MAX_CORES * KPROF_SAMPLES * sizeof(Kprof_sample_t) +
+	     PAGE_SIZE - 1) / PAGE_SIZE;
+    samples = (Kprof_sample_t *)vkmalloc(vk_heap, pages);
+    vmem_alloc((uint64_t *)samples, pages * PAGE_SIZE, PG_RW | PG_NX);
+  }
+  kprof_forget();
+  kmemset(nsamples, 0, sizeof(nsamples));
+  dropped = 0;
+
+  if(ev < 0 || ev > PROF_EV_TIMER)
+    ev = PROF_EV_CYCLES;
+  event = pmu_has(ev) ? ev : PROF_EV_TIMER;
+  period = per ? per : KPROF_PERIOD;
+  if(period > 0x7FFFFFFF)		/* a counter write is 32 bits */
+    period = 0x7FFFFFFF;
+  if(event == PROF_EV_TIMER)
+    period = 1;
+  epoch++;
+  running = 1;
+  return event;
+}
+
+int kprof_stop() {
+
+  if(!running)
+    return -1;
+  running = 0;
+  return 0;
+}
+
+void kprof_exec(Proc_t *p) {
+  struct elf_ctx *ctx;
+  Kprof_prog_t *prog;
+
+  if(!running || nprogs == KPROF_PROGS || p->file == NULL ||
+     !p->file->num_syms || !p->file->strtab_loaded)
+    return;
+
+  /* Take the tables over; free_elf_ctx leaves them to us */
+  ctx = alloc_elf_ctx(NULL, NULL, NULL);
+  ctx->symtab = p->file->symtab;
+  ctx->num_syms = p->file->num_syms;
+  ctx->strtab = p->file->strtab;
+  ctx->strtab_loaded = 1;
+  p->file->num_syms = 0;
+  p->file->strtab_loaded = 0;
+  elf_free_symindex(p->file);		/* the addresses may have moved */
+
+  prog = &progs[nprogs++];
+  prog->pid = p->pid;
+  kstrncpy(prog->procnm, p->procnm, MAX_FNAME_SZ);
+  prog->procnm[MAX_FNAME_SZ - 1] = '\0';
+  prog->syms = ctx;
+}
+
+/* The symbols in a program's file. Not with diversity: the file's
+ * addresses are not the ones the program runs at */
+static struct elf_ctx *kprof_file(char *procnm) {
+#ifndef DIVERSITY
+  struct elf_ctx *ctx;
+
+  ctx = alloc_elf_ctx(file_read, file_seek, file_error_check);
+  ctx->file_ctx = file_open(procnm);
+  if(file_error_check(ctx->file_ctx)) {
+    free_elf_ctx(ctx);
+    return NULL;
+  }
+  if(elf_load_symbols(ctx)) {
+    file_close(ctx->file_ctx);
+    free_elf_ctx(ctx);
+    return NULL;
+  }
+  file_close(ctx->file_ctx);
+  return ctx;
+#else
+  return NULL;
+#endif
+}
+
+/* The symbols for pid: kept at its exec, the latest if it exec'd twice,
+ * or else those of its file, looked up once */
+static struct elf_ctx *kprof_syms(int pid, char *procnm) {
+  Kprof_prog_t *prog;
+  int i;
+
+  for(i = nprogs - 1; i >= 0; i--)
+    if(progs[i].pid == pid)
+      return progs[i].syms;
+  if(procnm == NULL)
+    return NULL;
+  for(i = 0; i < nprogs; i++)
+    if(progs[i].pid == -1 && kstreq(progs[i].procnm, procnm))
+      return progs[i].syms;
+  if(nprogs == KPROF_PROGS)
+    return NULL;
+
+  prog = &progs[nprogs++];
+  prog->pid = -1;
+  kstrncpy(prog->procnm, procnm, MAX_FNAME_SZ);
+  prog->procnm[MAX_FNAME_SZ - 1] = '\0';
+  prog->syms = kprof_file(procnm);	/* NULL is remembered too */
+  return prog->syms;
+}
+
+/* The name a kept program had, for a pid that has exited since */
+static char *kprof_procnm(int pid) {
+  int i;
+
+  for(i = nprogs - 1; i >= 0; i--)
+    if(progs[i].pid == pid)
+      return progs[i].procnm;
+  return NULL;
+}
+
+static void kprof_name(char *dst, const char *src) {
+
+  kstrncpy(dst, src, MAX_PROF_NAME);
+  dst[MAX_PROF_NAME - 1] = '\0';
+}
+
+/* Add a sample to its line: the function it was in, or its address */
+static void kprof_add(Kprof_sample_t *s) {
+  struct elf_ctx *syms;
+  struct Elf_Sym *sym;
+  Prof_line_t *l;
+  Proc_t *p;
+  char *procnm;
+  uint64_t addr, h;
+  int i;
+
+  p = (s->pid == IDLE_PROC) ? NULL : pid_to_addr(s->pid);
+  procnm = p ? p->procnm : kprof_procnm(s->pid);
+  sym = NULL;
+  syms = NULL;
+  addr = s->rip;
+  if(!s->kernel && s->pid != IDLE_PROC &&
+     (syms = kprof_syms(s->pid, procnm)) != NULL &&
+     (sym = elf_sym_by_addr(syms, s->rip)) != NULL)
+    addr = sym->st_value;
+
+  h = (addr >> 4) ^ ((uint64_t)s->pid * 0x9E3779B1) ^ s->kernel;
+  for(i = h & (KPROF_SLOTS - 1); slots[i] >= 0; i = (i + 1) & (KPROF_SLOTS - 1)) {
+    l = &lines[slots[i]];
+    if(l->addr == addr && l->pid == s->pid && l->kernel == s->kernel) {
+      l->count++;
+      return;
+    }
+  }
+  if(nlines == KPROF_LINES)
+    return;				/* still in the total */
+
+  slots[i] = nlines;
+  l = &lines[nlines++];
+  l->count = 1;
+  l->addr = addr;
+  l->pid = s->pid;
+  l->kernel = s->kernel;
+  if(s->pid == IDLE_PROC)
+    kprof_name(l->proc, "idle");
+  else if(procnm)
+    kprof_name(l->proc, procnm);
+  else
+    kprof_name(l->proc, "?");
+  if(s->kernel)
+    kprof_name(l->func, "[kernel]");
+  else if(sym)
+    kprof_name(l->func, ELF_SYMNAME(*sym, syms->strtab));
+  else
+    l->func[0] = '\0';
+}
+
+/* Count the samples into lines, the busiest first */
+static void kprof_build() {
+  Prof_line_t l;
+  uint64_t pages;
+  int cpu, i, j;
+
+  if(lines == NULL) {
+    pages = (KPROF_LINES * sizeof(Prof_line_t) + KPROF_SLOTS * sizeof(int) +
+	     PAGE_SIZE - 1) / PAGE_SIZE;
+    lines = (Prof_line_t *)vkmalloc(vk_heap, pages);
+    vmem_alloc((uint64_t *)lines, pages * PAGE_SIZE, PG_RW | PG_NX);
+    slots = (int *)&lines[KPROF_LINES];
+  }
+  for(i = 0; i < KPROF_SLOTS; i++)
+    slots[i] = -1;
+  nlines = 0;
+  for(cpu = 0; cpu < MAX_CORES; cpu++)
+    for(i = 0; i < nsamples[cpu]; i++)
+      kprof_add(&samples[cpu * KPROF_SAMPLES + i]);
+
+  for(i = 1; i < nlines; i++) {
+    l = lines[i];
+    for(j = i; j > 0 && lines[j - 1].count < l.count; j--)
+      lines[j] = lines[j - 1];
+    lines[j] = l;
+  }
+}
+
+void kprof_read(int first, Prof_resp_t *resp) {
+  int cpu;
+
+  resp->event = event;
+  resp->period = period;
+  resp->samples = 0;
+  resp->n = 0;
+  if(samples == NULL) {
+    resp->dropped = 0;
+    resp->lines = 0;
+    return;
+  }
+
+  /* Afresh for the first batch; the rest come from the same profile */
+  if(first == 0 || nlines == 0)
+    kprof_build();
+  for(cpu = 0; cpu < MAX_CORES; cpu++)
+    resp->samples += nsamples[cpu];
+  resp->dropped = dropped;
+  resp->lines = nlines;
+  if(first < 0)
+    first = 0;
+  for(; first < nlines && resp->n < MAX_PROF_SZ; first++)
+    resp->line[resp->n++] = lines[first];
+}
@@ -42,6 +42,8 @@
 #include <kmalloc.h>
 #include <interrupts.h>
 #include <khash.h>
+#include <ktlb.h>
+#include <ktrace.h>
 
 extern void idle(uint64_t*);          /* asm func to make CPU idle           */
 
@@ -138,6 +140,7 @@ Proc_t *ksched_schedule() {
 
   /* Update our state variable indicating what is about to run. */
   ksched_set_next(next);
+  KTRACE_POINT(KT_SCHED, next ? next->pid : IDLE_PROC, 0);
 
   if(next                   && 
      next->pid != IDLE_PROC && 
@@ -319,6 +322,7 @@ void ksched_yield(/**DO NOT ADD ARGUMENTS*/){
   curr_p->kmc.rsp = (reg_t)((uint64_t)curr_p->kmc.rbp+16);
   curr_p->kmc.rbp = *(uint64_t*)((uint64_t)curr_p->kmc.rbp); 
 
+  ktlb_switch(next_p);
   restore_kernel_proc(next_p);
   kpanic("[KERNEL] Panic - Yield should not reach this!");
 }
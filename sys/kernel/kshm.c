@@ -0,0 +1,399 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/******************************************************************************
+ * Filename: kshm.c
+ *
+ * Description:
+ *  Shared memory regions between user processes. A region is a set of frames 
+ *  created by one process and mapped, in the SHM_MEM_START window, into it 
+ *  and into any process it granted the region to. Children forked afterwards
+ *  share the mappings of their parent. Exec drops them; a process that may 
+ *  map the region can grant it to another pid, e.g. to one that exec'd.
+ *
+ *  Each frame of a region counts its mappings in the frame array, plus one 
+ *  held by the region itself while any process has it mapped. A process that
+ *  dies still has its mappings in its page tables; destroy_proc() drops its 
+ *  records here and the reaper drops the frame counts as it walks the tables.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <constants.h>
+#include <kqueue.h>
+#include <kmalloc.h>
+#include <kstring.h>
+#include <kstdio.h>
+#include <memory.h>
+#include <proc.h>
+#include <procman.h>		/* pid_to_addr */
+#include <kvmem.h>
+#include <syscall.h>		/* SHM_MAX_GRANTS, SHM_MAX_SIZE */
+#include <kshm.h>
+
+typedef struct {
+  int id;
+  pid_t owner;			/* creator */
+  int ngrants;
+  pid_t grants[SHM_MAX_GRANTS];	/* others allowed to map it */
+  int npages;
+  int maps;			/* mappings of the region by any process */
+  uint64_t *frames;		/* physical address of each page */
+} Shm_region_t;
+
+typedef struct {
+  pid_t pid;
+  uint64_t vaddr;
+  Shm_region_t *region;
+} Shm_mapping_t;
+
+/* A run of npages pages at vaddr in pid's address space */
+typedef struct {
+  pid_t pid;
+  uint64_t vaddr;
+  int npages;
+} Shm_range_t;
+
+/* Mappings being copied from a parent to its child */
+typedef struct {
+  pid_t parent;
+  pid_t child;
+  queue_t *childq;
+} Shm_fork_t;
+
+static queue_t *regions;	/* every region that is mapped somewhere */
+static queue_t *mappings;	/* every mapping of a region */
+static int next_id;
+
+/******************************************************************************
+ **************************** PRIVATE DECLARATIONS ****************************
+ *****************************************************************************/
+
+static int  may_map(Proc_t *p, Shm_region_t *r);
+static int  region_matches_id(void *elementp, const void *keyp);
+static int  mapping_matches_pid(void *elementp, const void *keyp);
+static int  mapping_matches_addr(void *elementp, const void *keyp);
+static int  mapping_overlaps(void *elementp, const void *keyp);
+static void copy_mapping(void *argp, void *elementp);
+static uint64_t find_vaddr(pid_t pid, int npages);
+static int  map_region(Proc_t *p, Shm_region_t *r, uint64_t vaddr);
+static void release_region(Shm_region_t *r);
+
+/******************************************************************************
+ ****************************** PUBLIC FUNCTIONS ******************************
+ *****************************************************************************/
+
+/* init function */
+void kshm_init() {
+
+  regions = qopen();
+  mappings = qopen();
+  next_id = 1;
+}
+
+int kshm_create(Proc_t *p, uint64_t size, int flags, int *grants, int ngrants,
+		uint64_t *vaddrp, uint64_t *paddrp) {
+  Shm_region_t *r;
+  uint64_t vaddr, paddr;
+  int i;
+
+  if (size == 0 || size > SHM_MAX_SIZE || ngrants < 0 || 
+      ngrants > SHM_MAX_GRANTS)
+    return -1;
+
+  r = kmalloc_track(KSHM_SITE, sizeof(Shm_region_t));
+  if (r == NULL)
+    return -1;
+  r->npages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+  r->frames = kmalloc_track(KSHM_SITE, r->npages * sizeof(uint64_t));
+  if (r->frames == NULL) {
+    kfree_track(KSHM_SITE, r);
+    return -1;
+  }
+
+  vaddr = find_vaddr(p->pid, r->npages);
+  if (vaddr == 0) {
+    kfree_track(KSHM_SITE, r->frames);
+    kfree_track(KSHM_SITE, r);
+    return -1;
+  }
+
+  r->id = next_id++;
+  r->owner = p->pid;
+  r->ngrants = ngrants;
+  for (i = 0; i < ngrants; i++)
+    r->grants[i] = grants[i];
+  r->maps = 0;
+
+  /* the region holds every frame until its last mapping goes */
+  paddr = 0;
+  if (flags & SHM_CONTIG)
+    paddr = get_contiguous_frames((uint64_t)r->npages * PAGE_SIZE);
+  for (i = 0; i < r->npages; i++) {
+    if (flags & SHM_CONTIG)
+      r->frames[i] = paddr + (uint64_t)i * PAGE_SIZE;
+    else
+      r->frames[i] = get_free_frame();
+    framearray[r->frames[i] / PAGE_SIZE].refs = 1;
+  }
+  qput(regions, r);
+
+  /* with no mappings, taking the first one away frees the region */
+  if (map_region(p, r, vaddr) < 0) {
+    r->maps = 1;
+    release_region(r);
+    return -1;
+  }
+  kmemset((void*)vaddr, 0, r->npages * PAGE_SIZE);
+
+  *vaddrp = vaddr;
+  *paddrp = paddr;
+  return r->id;
+}
+
+int kshm_map(Proc_t *p, int id, uint64_t *vaddrp, uint64_t *sizep,
+	     pid_t *ownerp) {
+  Shm_region_t *r;
+  uint64_t vaddr;
+
+  r = (Shm_region_t*)qsearch(regions, region_matches_id, &id);
+  if (r == NULL)
+    return -1;
+
+  if (!may_map(p, r))
+    return -1;
+
+  vaddr = find_vaddr(p->pid, r->npages);
+  if (vaddr == 0)
+    return -1;
+
+  if (map_region(p, r, vaddr) < 0)
+    return -1;
+
+  *vaddrp = vaddr;
+  *sizep = (uint64_t)r->npages * PAGE_SIZE;
+  *ownerp = r->owner;
+  return 0;
+}
+
+int kshm_grant(Proc_t *p, int id, pid_t pid) {
+  Shm_region_t *r;
+  int i;
+
+  r = (Shm_region_t*)qsearch(regions, region_matches_id, &id);
+  if (r == NULL || !may_map(p, r))
+    return -1;
+
+  if (pid == r->owner)
+    return 0;
+  for (i = 0; i < r->ngrants; i++)
+    if (r->grants[i] == pid)
+      return 0;
+
+  /* a free slot, else the slot of a pid that has gone */
+  if (r->ngrants < SHM_MAX_GRANTS)
+    i = r->ngrants++;
+  else
+    for (i = 0; i < r->ngrants && pid_to_addr(r->grants[i]) != NULL; i++)
+      ;
+  if (i == SHM_MAX_GRANTS)
+    return -1;
+  r->grants[i] = pid;
+  return 0;
+}
+
+int kshm_unmap(Proc_t *p, uint64_t vaddr) {
+  Shm_mapping_t key, *m;
+  int i;
+
+  key.pid = p->pid;
+  key.vaddr = vaddr;
+  m = (Shm_mapping_t*)qremove(mappings, mapping_matches_addr, &key);
+  if (m == NULL)
+    return -1;
+
+  /* we are running in p's address space */
+  vmem_free_temp((uint64_t*)vaddr, m->region->npages * PAGE_SIZE);
+
+  for (i = 0; i < m->region->npages; i++)
+    kshm_put_frame(m->region->frames[i]);
+  release_region(m->region);
+  kfree_track(KSHM_SITE, m);
+
+  return 0;
+}
+
+/* The pages were shared by new_cr3_target(); account for the child here */
+void kshm_fork(Proc_t *parent, Proc_t *child) {
+  Shm_fork_t fork;
+
+  fork.parent = parent->pid;
+  fork.child = child->pid;
+  fork.childq = qopen();
+  qapply2(mappings, &fork, copy_mapping);
+  qconcat(mappings, fork.childq);
+}
+
+void kshm_purge(Proc_t *p) {
+  Shm_mapping_t *m;
+
+  while ((m = (Shm_mapping_t*)qremove(mappings, mapping_matches_pid, 
+				      &(p->pid))) != NULL) {
+    release_region(m->region);
+    kfree_track(KSHM_SITE, m);
+  }
+}
+
+void kshm_put_frame(uint64_t paddr) {
+  struct frame_array_entry_t *f;
+
+  f = &framearray[paddr / PAGE_SIZE];
+  if (f->refs == 0)
+    return;
+  if (--f->refs == 0) {
+    f->vaddr = 0x0;
+    f->free = 0x1;
+  }
+}
+
+/************************* PRIVATE FUNCTIONS *********************************/
+
+/* only the creator and the pids granted the region */
+static int may_map(Proc_t *p, Shm_region_t *r) {
+  int i;
+
+  if (r->owner == p->pid)
+    return 1;
+  for (i = 0; i < r->ngrants; i++)
+    if (r->grants[i] == p->pid)
+      return 1;
+  return 0;
+}
+
+static int region_matches_id(void *elementp, const void *keyp) {
+
+  return ((Shm_region_t*)elementp)->id == *(int*)keyp;
+}
+
+static int mapping_matches_pid(void *elementp, const void *keyp) {
+
+  return ((Shm_mapping_t*)elementp)->pid == *(pid_t*)keyp;
+}
+
+static int mapping_matches_addr(void *elementp, const void *keyp) {
+  Shm_mapping_t *m, *key;
+
+  m = (Shm_mapping_t*)elementp;
+  key = (Shm_mapping_t*)keyp;
+  return m->pid == key->pid && m->vaddr == key->vaddr;
+}
+
+static int mapping_overlaps(void *elementp, const void *keyp) {
+  Shm_mapping_t *m;
+  Shm_range_t *key;
+
+  m = (Shm_mapping_t*)elementp;
+  key = (Shm_range_t*)keyp;
+  return m->pid == key->pid && 
+    m->vaddr < key->vaddr + (uint64_t)key->npages * PAGE_SIZE &&
+    key->vaddr < m->vaddr + (uint64_t)m->region->npages * PAGE_SIZE;
+}
+
+static void copy_mapping(void *argp, void *elementp) {
+  Shm_fork_t *fork;
+  Shm_mapping_t *m, *cm;
+  int i;
+
+  fork = (Shm_fork_t*)argp;
+  m = (Shm_mapping_t*)elementp;
+  if (m->pid != fork->parent)
+    return;
+
+  cm = kmalloc_track(KSHM_SITE, sizeof(Shm_mapping_t));
+  if (cm == NULL) {
+    kprintf("%s:%d :: Could not allocate a mapping object\n", __FILE__, __LINE__);
+    return;
+  }
+  cm->pid = fork->child;
+  cm->vaddr = m->vaddr;
+  cm->region = m->region;
+  cm->region->maps++;
+  for (i = 0; i < cm->region->npages; i++)
+    framearray[cm->region->frames[i] / PAGE_SIZE].refs++;
+  qput(fork->childq, cm);
+}
+
+/* First fit in the shared memory window of pid; 0 if there is no room */
+static uint64_t find_vaddr(pid_t pid, int npages) {
+  Shm_range_t key;
+  Shm_mapping_t *m;
+
+  key.pid = pid;
+  key.vaddr = SHM_MEM_START;
+  key.npages = npages;
+  while ((m = (Shm_mapping_t*)qsearch(mappings, mapping_overlaps, &key)) != NULL)
+    key.vaddr = m->vaddr + (uint64_t)m->region->npages * PAGE_SIZE;
+
+  if (key.vaddr + (uint64_t)npages * PAGE_SIZE > SHM_MEM_START + SHM_MEM_SIZE)
+    return 0;
+  return key.vaddr;
+}
+
+/* p must be the current process */
+static int map_region(Proc_t *p, Shm_region_t *r, uint64_t vaddr) {
+  Shm_mapping_t *m;
+  int i;
+
+  m = kmalloc_track(KSHM_SITE, sizeof(Shm_mapping_t));
+  if (m == NULL) {
+    kprintf("%s:%d :: Could not allocate a mapping object\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  for (i = 0; i < r->npages; i++) {
+    attach_page(vaddr + (uint64_t)i * PAGE_SIZE, r->frames[i], 
+		UMEM_IO_FLAGS | PG_NX);
+    framearray[r->frames[i] / PAGE_SIZE].refs++;
+  }
+
+  m->pid = p->pid;
+  m->vaddr = vaddr;
+  m->region = r;
+  r->maps++;
+  qput(mappings, m);
+  return 0;
+}
+
+/* A mapping went away; the last one frees the region */
+static void release_region(Shm_region_t *r) {
+  int i;
+
+  if (--r->maps > 0)
+    return;
+
+  qremove(regions, region_matches_id, &(r->id));
+  for (i = 0; i < r->npages; i++)
+    kshm_put_frame(r->frames[i]);
+  kfree_track(KSHM_SITE, r->frames);
+  kfree_track(KSHM_SITE, r);
+}
@@ -29,6 +29,7 @@
 #include <ksyscall.h>
 #include <constants.h>
 #include <kvmem.h>              /* For paging flags and MMIO calls */
+#include <kshm.h>               /* For shared memory regions */
 #include <procman.h>
 #include <kmalloc.h>
 #include <kqueue.h>
@@ -39,6 +40,15 @@
 #include <ktime.h>
 #include <syscall.h>
 #include <fatfs.h>
+#include <file_abstraction.h>
+#include <fcache.h>
+#include <ktlb.h>
+#include <kload.h>
+#include <boottime.h>
+#include <tsc.h>
+#include <ktrace.h>
+#include <kprof.h>
+#include <vk.h>
 #include <kwait.h>
 #include <pio.h>
 #include <msg.h>
@@ -71,6 +81,18 @@ static int  _do_kill(Proc_t*, int);
 /* wakes a process after sleeping */
 static void systask_unsleep(void*);        
 
+/* ends a poll() whose timeout expired */
+static void systask_poll_expire(void*);
+
+/* answers a poll() with the events kept for it */
+static void systask_poll_answer(Proc_t*);
+
+/* an armed poll() timeout; the process may be gone when it goes off */
+typedef struct {
+  pid_t pid;
+  unsigned int tag;
+} Poll_timer_t;
+
 /* Wakes proc after waiting    */ 
 static void systask_unwait(Proc_t*, int, int,unsigned int); 
 
@@ -168,9 +190,8 @@ void systask_do_exec(Systask_msg_t *msg, Msg_status_t *status) {
   /* Race in elf_load at end? req->fname not valid when we reach there... */
   kstrncpy(fname, req->fname, MAX_FNAME_SZ);
 
-  FILINFO ramstatus;
   /* go to the ram disk */
-  if(f_stat(fname,&ramstatus)!=0) {
+  if(file_stat(fname, NULL) != FR_OK) {
     resp.type = SC_EXEC;
     resp.ret = -1;
     systask_msgsend(p->pid, &resp, sizeof(Exec_resp_t));
@@ -336,7 +357,10 @@ void systask_do_kill(Systask_msg_t *msg, Msg_status_t *status) {
   /* build response */
   resp.type    = SC_KILL;
   resp.tag = req->tag;
-  resp.ret_val = ( _do_kill(p, signo) < 0 ? -1 : 0 );
+  if ( signo == 0 )		/* only asks whether the process exists */
+    resp.ret_val = ( p == NULL ? -1 : 0 );
+  else
+    resp.ret_val = ( _do_kill(p, signo) < 0 ? -1 : 0 );
 
   /* send response to calling proc */
   systask_msgsend(status->src, &resp, sizeof(Kill_resp_t));
@@ -601,33 +625,353 @@ void systask_do_map_dma(Systask_msg_t *msg, Msg_status_t *status){
   return;
 }
 
+/* 
+ * The ramdisk server maps the whole ramdisk and serves files from it. When it
+ * has written to the filesystem it asks us to sync, so that exec sees the 
+ * change. Nobody else gets at the ramdisk.
+ */
+void systask_do_ramdisk(Systask_msg_t *msg, Msg_status_t *status) {
+  Ramdisk_req_t *req;
+  Ramdisk_resp_t resp;
+  uint64_t size;
+
+  req = (Ramdisk_req_t *)msg;
+
+  resp.type = SC_RAMDISK;
+  resp.tag = req->tag;
+  resp.ret = -1;
+  resp.virt_addr = NULL;
+  resp.size = 0;
+  resp.fs_offset = 0;
+
+  if(status->src != RAMFSD) {
+    systask_msgsend(status->src, &resp, sizeof(Ramdisk_resp_t));
+    return;
+  }
+
+  switch(req->op) {
+  case RAMDISK_OP_MAP:
+    size = kvmem_map_ramdisk(ksched_get_last(), 
+			     DRIVER_MEM_START+driver_mem_current);
+    if(size == 0)
+      break;
+    resp.virt_addr = (uint64_t *)(DRIVER_MEM_START+driver_mem_current);
+    resp.size = size;
+    resp.fs_offset = FAT_offset();
+    resp.ret = 0;
+    driver_mem_current += size;
+    break;
+  case RAMDISK_OP_SYNC:
+    FAT_sync();
+    resp.ret = 0;
+    break;
+  }
+
+  systask_msgsend(status->src, &resp, sizeof(Ramdisk_resp_t));
+
+  return;
+}
+
+/* 
+ * Shared memory regions -- see kshm.c. Any process may create a region; only
+ * the pids it names, or that are granted it later, may map it.
+ */
+void systask_do_shm(Systask_msg_t *msg, Msg_status_t *status) {
+  Shm_create_req_t *creq;
+  Shm_map_req_t *mreq;
+  Shm_unmap_req_t *ureq;
+  Shm_grant_req_t *greq;
+  Shm_resp_t resp;
+  Proc_t *p;
+  uint64_t vaddr, size, paddr;
+  pid_t owner;
+
+  p = ksched_get_last();
+
+  resp.type = *(int*)msg;
+  resp.tag = ((Shm_map_req_t*)msg)->tag;
+  resp.ret = -1;
+  resp.id = 0;
+  resp.vaddr = NULL;
+  resp.size = 0;
+  resp.paddr = 0;
+  resp.owner = 0;
+
+  switch(resp.type) {
+  case SC_SHM_CREATE:
+    creq = (Shm_create_req_t *)msg;
+    resp.id = kshm_create(p, creq->size, creq->flags, creq->grants, 
+			  creq->ngrants, &vaddr, &paddr);
+    if(resp.id < 0)
+      break;
+    resp.vaddr = (void*)vaddr;
+    resp.paddr = paddr;
+    resp.size = ((creq->size + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
+    resp.ret = 0;
+    break;
+  case SC_SHM_MAP:
+    mreq = (Shm_map_req_t *)msg;
+    if(kshm_map(p, mreq->id, &vaddr, &size, &owner) < 0)
+      break;
+    resp.id = mreq->id;
+    resp.vaddr = (void*)vaddr;
+    resp.size = size;
+    resp.owner = owner;
+    resp.ret = 0;
+    break;
+  case SC_SHM_UNMAP:
+    ureq = (Shm_unmap_req_t *)msg;
+    resp.ret = kshm_unmap(p, (uint64_t)ureq->vaddr);
+    break;
+  case SC_SHM_GRANT:
+    greq = (Shm_grant_req_t *)msg;
+    resp.ret = kshm_grant(p, greq->id, greq->pid);
+    break;
+  }
+
+  systask_msgsend(status->src, &resp, sizeof(Shm_resp_t));
+
+  return;
+}
+
+/* 
+ * The boot timeline -- see boottime.c. The mark that closes it also prints
+ * it on the console.
+ */
+void systask_do_boottime(Systask_msg_t *msg, Msg_status_t *status) {
+  Boottime_req_t *req;
+  Boottime_resp_t resp;
+  Boottime_t *tl;
+  int i;
+
+  req = (Boottime_req_t *)msg;
+  req->name[MAX_BOOTTIME_NAME - 1] = '\0';
+
+  resp.type = SC_BOOTTIME;
+  resp.tag = req->tag;
+  resp.ret = 0;
+  resp.entries = 0;
+  resp.closed = 0;
+  resp.tsc_hz = 0;
+
+  switch(req->op) {
+  case BOOTTIME_OP_MARK:
+    if((tl = boottime_get()) == NULL || tl->closed)
+      resp.ret = -1;
+    else
+      boottime_mark(req->name);
+    break;
+  case BOOTTIME_OP_CLOSE:
+    if((resp.ret = boottime_close(req->name)) == 0)
+      boottime_print();
+    break;
+  }
+
+  /* Every reply carries the timeline */
+  if((tl = boottime_get()) != NULL) {
+    resp.entries = tl->n;
+    resp.closed = tl->closed;
+    resp.tsc_hz = get_tsc_freq();
+    for(i = 0; i < tl->n; i++) {
+      resp.tsc[i] = tl->marks[i].tsc;
+      kmemcpy(resp.name[i], tl->marks[i].name, MAX_BOOTTIME_NAME);
+    }
+  }
+  else if(req->op == BOOTTIME_OP_GET)
+    resp.ret = -1;
+
+  systask_msgsend(status->src, &resp, sizeof(Boottime_resp_t));
+
+  return;
+}
+
+/*
+ * systask_do_trace -- turns the tracepoints on or off, in the kernel and
+ * the hypervisor together, or reads a batch of records. The hypervisor
+ * leaves its batch in a page of ours, given to vmcall 43 by its physical
+ * address.
+ */
+void systask_do_trace(Systask_msg_t *msg, Msg_status_t *status) {
+  static Ktrace_batch_t *hbatch;
+  Trace_req_t *req;
+  Trace_resp_t resp;
+
+  req = (Trace_req_t *)msg;
+
+  resp.type = SC_TRACE;
+  resp.tag = req->tag;
+  resp.ret = 0;
+  resp.n = 0;
+  resp.lost = 0;
+  resp.tsc_hz = get_tsc_freq();
+
+  switch(req->op) {
+  case TRACE_OP_ON:
+  case TRACE_OP_OFF:
+    if((resp.ret = ktrace_enable(req->op == TRACE_OP_ON)) >= 0)
+      kvmcall(43, req->op, NULL);
+    break;
+  case TRACE_OP_READ:
+    if(req->src == KTRACE_SRC_KERNEL) {
+      if((resp.n = ktrace_read(resp.recs, MAX_TRACE_SZ, &resp.lost)) < 0) {
+	resp.ret = -1;
+	resp.n = 0;
+      }
+      break;
+    }
+    if(hbatch == NULL) {
+      hbatch = (Ktrace_batch_t *)vkmalloc(vk_heap, 1);
+      vmem_alloc((uint64_t *)hbatch, PAGE_SIZE, PG_RW | PG_NX);
+    }
+    hbatch->n = 0;
+    hbatch->ok = 0;
+    kvmcall(43, KTRACE_OP_READ, (void *)virt2phys(hbatch));
+    if(!hbatch->ok)
+      resp.ret = -1;
+    resp.n = (hbatch->n < MAX_TRACE_SZ) ? hbatch->n : MAX_TRACE_SZ;
+    resp.lost = hbatch->lost;
+    kmemcpy(resp.recs, hbatch->recs, resp.n * sizeof(Ktrace_rec_t));
+    break;
+  default:
+    resp.ret = -1;
+  }
+
+  systask_msgsend(status->src, &resp, sizeof(Trace_resp_t));
+
+  return;
+}
+
+/*
+ * systask_do_prof -- starts or stops the profiler, or reads the profile
+ * MAX_PROF_SZ lines at a time.
+ */
+void systask_do_prof(Systask_msg_t *msg, Msg_status_t *status) {
+  Prof_req_t *req;
+  Prof_resp_t resp;
+
+  req = (Prof_req_t *)msg;
+
+  kmemset(&resp, 0, sizeof(Prof_resp_t) - sizeof(resp.line));
+  resp.type = SC_PROF;
+  resp.tag = req->tag;
+
+  switch(req->op) {
+  case PROF_OP_START:
+    if((resp.ret = kprof_start(req->event, req->period)) >= 0)
+      resp.event = resp.ret;
+    break;
+  case PROF_OP_STOP:
+    resp.ret = kprof_stop();
+    break;
+  case PROF_OP_READ:
+    kprof_read(req->first, &resp);
+    break;
+  default:
+    resp.ret = -1;
+  }
+
+  systask_msgsend(status->src, &resp, sizeof(Prof_resp_t));
+
+  return;
+}
+
+/*
+ * systask_do_poll -- starts a poll(), or waits for its events. The fds
+ * are watched by the daemons that own them, which post what they see
+ * with poll_post(); the process' events are kept here, so poll() only
+ * ever receives from SYS. Posts for any other poll() are dropped.
+ */
 void systask_do_poll(Systask_msg_t *msg, Msg_status_t *status) {
   Poll_req_t *req;
   Poll_resp_t resp;
+  Poll_timer_t *tmr;
   Proc_t *p;
   
   p = pid_to_addr(status->src);
   req = (Poll_req_t *)msg;
   
-  if( (req->timeout = -1) ) {
-    /* Process did not specify a timeout
-     * Sleep and wait indefinitely for some action
-     */
-    ktimer_new_alarm(7500, systask_unsleep,(void*)p);
+  if ( req->op == POLL_BEGIN ) {
+    /* before the arms go out, so that none of the posts is dropped */
+    p->poll_tag = req->tag;
+    p->poll_owed = 0;
+    p->poll_wait = 0;
+    p->poll_nev = 0;
+    return;
+  }
+
+  if ( req->tag != p->poll_tag || p->poll_wait ) {
+    resp.type = SC_POLL;
+    resp.tag = req->tag;
+    resp.ret_val = -1;
+    systask_msgsend(status->src, &resp, sizeof(Poll_resp_t));
+    return;
+  }
+
+  /* posts can be here before the wait: owed may go below zero */
+  p->poll_owed += req->owed;
+  p->poll_wait = 1;
+  p->poll_now = (req->timeout == 0);
+  if ( p->poll_owed <= 0 && (p->poll_nev || p->poll_now) ) {
+    systask_poll_answer(p);
+    return;
+  }
+
+  if ( req->timeout > 0 ) {
+    tmr = (Poll_timer_t*)kmalloc_track(SYS_TASK_SITE, sizeof(Poll_timer_t));
+    if ( tmr == NULL ) {
+      /* no timer to end it: answer now, as if it had timed out */
+      kprintf("%s: Could not allocate a poll timer\n", __FUNCTION__);
+      systask_poll_answer(p);
+      return;
+    }
+    tmr->pid = p->pid;
+    tmr->tag = req->tag;
+    ktimer_new_alarm(req->timeout, systask_poll_expire, (void*)tmr);
   }
+
+  /* No message back from here; a post or the timer answers */
+}
+
+/*
+ * systask_do_pollpost -- a daemon saw fd become ready for a poll(). The
+ * events of one fd are merged; past POLL_MAXEV fds the rest wait for the
+ * next poll(), which finds them ready again. Only the daemons that serve
+ * poll() may post.
+ */
+void systask_do_pollpost(Systask_msg_t *msg, Msg_status_t *status) {
+  Poll_post_req_t *req;
+  Poll_post_resp_t resp;
+  Proc_t *p;
+  int i;
+
+  req = (Poll_post_req_t *)msg;
+  p = NULL;
+  if ( status->src == NETD || status->src == PIPED || status->src == KBD )
+    p = pid_to_addr(req->pid);
+
+  resp.type = SC_POLLPOST;
+  resp.tag = req->tag;
+  resp.ret_val = ( p == NULL ) ? -1 : 0;
+  systask_msgsend(status->src, &resp, sizeof(Poll_post_resp_t));
+
+  if ( p == NULL || p->poll_tag == 0 || req->ptag != p->poll_tag )
+    return;
+
+  if ( req->ev.fd == POLL_DONE_FD )
+    p->poll_owed--;
   else {
-    /* Process specified a timeout period 
-     * Schedule alarm accordingly 
-     */
-    ktimer_new_alarm(req->timeout, systask_unsleep,(void*)p);
-    
+    for ( i = 0; i < p->poll_nev && p->poll_ev[i].fd != req->ev.fd; i++ )
+      ;
+    if ( i < p->poll_nev )
+      p->poll_ev[i].revents |= req->ev.revents;
+    else if ( i < POLL_MAXEV ) {
+      p->poll_ev[i] = req->ev;
+      p->poll_nev++;
+    }
   }
-  
-  /* Send a message back to the process informing it that I/O is available */
-  resp.ret_val=0;
-  systask_msgsend(status->src, &resp, sizeof(Poll_resp_t));
 
-  return;
+  if ( p->poll_wait && p->poll_owed <= 0 && (p->poll_nev || p->poll_now) )
+    systask_poll_answer(p);
 }
 
 void systask_do_msi(Systask_msg_t *msg, Msg_status_t *status) {
@@ -708,6 +1052,10 @@ void systask_do_ps(Systask_msg_t *msg, Msg_status_t *status) {
   kprintf("\n");
 #endif 
 
+  fcache_print_stats();		/* ramdisk lookups since boot */
+  ktlb_print_stats();		/* shootdowns since boot */
+  kload_print_stats();		/* exec latency since boot */
+
   rp=&resp;
   kprintf("S  PID\tCMD\t\tParent\tChildren ; Zombies\n");
   resp.entries=0;
@@ -1087,6 +1435,47 @@ static void systask_unsleep(void *pproc) {
   kmsg_send(&msg);
 }
 
+/* The timeout of a poll() ran out; the process may have gone since */
+static void systask_poll_expire(void *ptmr) {
+  Poll_timer_t *tmr;
+  Proc_t *dst_p;
+
+  tmr = (Poll_timer_t *)ptmr;
+  dst_p = pid_to_addr(tmr->pid);
+
+  /* Already answered, or a later poll() is under way */
+  if ( dst_p != NULL && dst_p->poll_wait && dst_p->poll_tag == tmr->tag )
+    systask_poll_answer(dst_p);
+
+  kfree_track(SYS_TASK_SITE, tmr);
+}
+
+/* Answer the waiting poll() with its events; the poll() is then over */
+static void systask_poll_answer(Proc_t *dst_p) {
+  Message_t msg;
+  Poll_resp_t resp;
+  int i;
+
+  resp.type = SC_POLL;
+  resp.tag = dst_p->poll_tag;
+  resp.ret_val = dst_p->poll_nev;
+  for ( i = 0; i < dst_p->poll_nev; i++ )
+    resp.ev[i] = dst_p->poll_ev[i];
+
+  dst_p->poll_tag = 0;
+  dst_p->poll_wait = 0;
+  dst_p->poll_nev = 0;
+
+  /* If message-passing ever changes, this will break. */
+  msg.src = SYS;
+  msg.dst = dst_p->pid;
+  msg.len = sizeof(Poll_resp_t);
+  msg.status = NULL;
+  msg.buf = &resp;
+
+  kmsg_send(&msg);
+}
+
 /*
  * systask_unwait(Proc_t*, Message_t*)
  *
@@ -0,0 +1,401 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+
+/******************************************************************************
+ * Filename: ktlb.c
+ *
+ * Description:
+ *  Process context identifiers. Each process has a pcid that tags its TLB 
+ *  entries, so restore_kernel_proc() loads CR3 with the no-flush bit and a 
+ *  process that comes back to a core finds its translations still there.
+ *  Reloading the CR3 a core already holds is skipped altogether.
+ *
+ *  tlb_cpus is the set of cores that may hold entries for a process. A core
+ *  is added when the process runs there and dropped once its entries are
+ *  known stale, in which case it flushes them the next time the process runs
+ *  there. Without PCIDs every CR3 load flushes anyway and only the skip is 
+ *  left.
+ *
+ *  Shootdowns. When a pte changes, the cores that have the tables loaded 
+ *  right now are sent TLB_SHOOTDOWN_VEC; those that only ran the process 
+ *  before just lose their bit. A kernel mapping (global) is in every address
+ *  space and goes to every core. The flushes of one operation (a vmem_free, 
+ *  a permission change) are collected into a batch, a list of page ranges, 
+ *  and sent as one IPI per target when the batch ends. The sender holds the 
+ *  kernel lock and waits for every target to flush, so cores spinning on that
+ *  lock with interrupts off check for a shootdown as they spin.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <constants.h>
+#include <asm_subroutines.h>
+#include <memory.h>
+#include <kvmem.h>
+#include <kstdio.h>
+#include <kstring.h>
+#include <tsc.h>
+#include <apic.h>
+#include <smp.h>
+#include <proc.h>
+#include <ktlb.h>
+
+/* INVPCID types */
+#define INVPCID_ADDR 0          /* one address in one pcid */
+
+typedef struct {
+  uint64_t pcid;
+  uint64_t addr;
+} Invpcid_desc_t;
+
+typedef struct {
+  uint64_t start;
+  uint64_t npages;
+} Tlb_range_t;
+
+/* The flushes the other cores owe for the current operation */
+typedef struct {
+  int cpu;                      /* the core building it                       */
+  int global;                   /* kernel mappings changed                    */
+  int all;                      /* too many pages: flush everything           */
+  int nranges;
+  int npages;
+  uint32_t targets;             /* cores to send it to                        */
+  Tlb_range_t ranges[TLB_RANGES];
+} Tlb_batch_t;
+
+static int pcid_on;             /* CR4.PCIDE is set                           */
+static int invpcid_on;          /* and the cpu has INVPCID                    */
+static uint64_t pcid_used[PCID_COUNT / 64];
+static int pcid_next = 1;       /* where the allocator looks first            */
+static Proc_t *loaded[MAX_CORES]; /* whose tables each core's CR3 holds       */
+
+static volatile uint32_t tlb_online;  /* cores that have run ktlb_init        */
+static volatile uint32_t tlb_pending; /* targets yet to flush the batch       */
+static Tlb_batch_t batch;
+static int batch_depth;
+
+/* statistics, for ps */
+static uint64_t tlb_start_tsc;
+static uint64_t tlb_shootdowns;
+static uint64_t tlb_ipis;
+static uint64_t tlb_pages;
+static uint64_t tlb_fulls;
+static uint64_t tlb_wait_tsc;
+static uint64_t tlb_wait_max;
+
+/* cpuid() only hands back ecx or edx; we need eax and ebx */
+static void ktlb_cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx) {
+  uint32_t ecx, edx;
+
+  *eax = leaf;
+  ecx = 0;
+  asm volatile("cpuid" : "+a"(*eax), "=b"(*ebx), "+c"(ecx), "=d"(edx));
+}
+
+static void invpcid(uint64_t type, uint64_t pcid, uint64_t addr) {
+  Invpcid_desc_t desc;
+
+  desc.pcid = pcid;
+  desc.addr = addr;
+  asm volatile("invpcid %0, %1" :: "m"(desc), "r"(type) : "memory");
+}
+
+/* Flush this core: global entries too, or just those of the current pcid */
+static void ktlb_flush_local(int global) {
+  uint64_t cr4;
+
+  if ( global ) {
+    cr4 = read_cr4();
+    write_cr4(cr4 ^ CR4_PGE);
+    write_cr4(cr4);
+  }
+  else
+    write_cr3(read_cr3());
+}
+
+void ktlb_init() {
+  uint32_t max, ebx;
+
+  __sync_fetch_and_or(&tlb_online, (uint32_t)1 << this_cpu());
+  if ( !tlb_start_tsc )
+    tlb_start_tsc = readtsc();
+
+  if ( !(cpuid(1, CPUID_ECX) & CPUID_FEATURE_PCID) )
+    return;
+
+  /* CR3 still holds the boot tables, with pcid 0 */
+  write_cr4(read_cr4() | CR4_PCIDE);
+  pcid_on = 1;
+  pcid_used[0] |= 1;
+
+  ktlb_cpuid(0, &max, &ebx);
+  if ( max >= 7 ) {
+    ktlb_cpuid(7, &max, &ebx);
+    invpcid_on = (ebx & CPUID_FEATURE_INVPCID) ? 1 : 0;
+  }
+}
+
+void ktlb_new(Proc_t *p) {
+  int i, id;
+
+  p->pcid = 0;
+  p->tlb_cpus = 0;
+  if ( !pcid_on )
+    return;
+
+  for ( i = 1; i < PCID_COUNT; i++ ) {
+    id = pcid_next;
+    pcid_next = pcid_next % (PCID_COUNT - 1) + 1;
+    if ( !(pcid_used[id / 64] & ((uint64_t)1 << (id % 64))) ) {
+      pcid_used[id / 64] |= (uint64_t)1 << (id % 64);
+      p->pcid = id;
+      return;
+    }
+  }
+  /* all taken: p shares pcid 0, which is flushed on every load */
+}
+
+/* 
+ * No shootdown: the pcid is flushed wherever it is next used, since its 
+ * new owner starts with no tlb_cpus.
+ */
+void ktlb_free(Proc_t *p) {
+  int i;
+
+  if ( p->pcid )
+    pcid_used[p->pcid / 64] &= ~((uint64_t)1 << (p->pcid % 64));
+  for ( i = 0; i < MAX_CORES; i++ )
+    if ( loaded[i] == p )
+      loaded[i] = NULL;
+  p->pcid = 0;
+  p->tlb_cpus = 0;
+}
+
+void ktlb_switch(Proc_t *p) {
+  uint64_t cr3;
+  uint32_t bit;
+  int cpu;
+
+  cpu = this_cpu();
+  bit = (uint32_t)1 << cpu;
+  if ( loaded[cpu] == p && (p->tlb_cpus & bit) ) {
+    p->cr3_load = 0;            /* already there */
+    return;
+  }
+
+  cr3 = (uint64_t)p->cr3_target;
+  if ( pcid_on && p->pcid ) {
+    cr3 |= p->pcid;
+    if ( p->tlb_cpus & bit )
+      cr3 |= CR3_NOFLUSH;
+  }
+  p->tlb_cpus |= bit;
+  p->cr3_load = cr3;
+  loaded[cpu] = p;
+}
+
+/* 
+ * The other cores that must flush now: all of them for a global mapping,
+ * else those on p's tables. The rest that held p's entries are dropped from
+ * tlb_cpus instead.
+ */
+static uint32_t ktlb_targets(Proc_t *p, int global) {
+  uint32_t others, targets;
+  int i;
+
+  others = tlb_online & ~((uint32_t)1 << batch.cpu);
+  if ( global )
+    return others;
+  if ( p == NULL )
+    return 0;
+
+  targets = 0;
+  for ( i = 0; i < MAX_CORES; i++ ) {
+    if ( !(others & p->tlb_cpus & ((uint32_t)1 << i)) )
+      continue;
+    if ( loaded[i] == p )
+      targets |= (uint32_t)1 << i;
+    else
+      p->tlb_cpus &= ~((uint32_t)1 << i);
+  }
+  return targets;
+}
+
+/* Add a page to the batch, merging it into the last range if it follows */
+static void ktlb_batch_add(uint64_t vaddr, uint32_t targets, int global) {
+  Tlb_range_t *r;
+
+  batch.targets |= targets;
+  batch.global |= global;
+  if ( batch.all )
+    return;
+
+  r = batch.nranges ? &batch.ranges[batch.nranges - 1] : NULL;
+  if ( r && vaddr == r->start + r->npages * PAGE_SIZE )
+    r->npages++;
+  else if ( batch.nranges < TLB_RANGES ) {
+    r = &batch.ranges[batch.nranges++];
+    r->start = vaddr;
+    r->npages = 1;
+  }
+  else
+    batch.all = 1;
+
+  if ( ++batch.npages > TLB_BATCH_PAGES )
+    batch.all = 1;
+}
+
+/* Send the batch and wait for every target to have flushed */
+static void ktlb_post(uint32_t targets) {
+  uint64_t start, wait;
+  int i;
+
+  start = readtsc();
+  tlb_pending = targets;
+  __sync_synchronize();
+  for ( i = 0; i < MAX_CORES; i++ )
+    if ( targets & ((uint32_t)1 << i) ) {
+      send_ipi(i, TLB_SHOOTDOWN_VEC);
+      tlb_ipis++;
+    }
+  while ( tlb_pending )
+    asm volatile("pause");
+
+  wait = readtsc() - start;
+  tlb_shootdowns++;
+  tlb_wait_tsc += wait;
+  if ( wait > tlb_wait_max )
+    tlb_wait_max = wait;
+  if ( batch.all )
+    tlb_fulls++;
+  else
+    tlb_pages += batch.npages;
+}
+
+void ktlb_batch_begin() {
+  if ( batch_depth++ == 0 )
+    batch.cpu = tlb_online ? this_cpu() : 0;
+}
+
+void ktlb_batch_end() {
+  uint32_t targets;
+
+  if ( --batch_depth > 0 )
+    return;
+  targets = batch.targets & tlb_online & ~((uint32_t)1 << batch.cpu);
+  if ( targets )
+    ktlb_post(targets);
+  kmemset(&batch, 0, sizeof(Tlb_batch_t));
+}
+
+void ktlb_flush_page(Proc_t *p, uint64_t vaddr, int global) {
+  uint32_t bit, targets;
+
+  if ( !tlb_online ) {          /* still booting, on one core */
+    __invlpg(vaddr);
+    return;
+  }
+
+  ktlb_batch_begin();
+  bit = (uint32_t)1 << batch.cpu;
+  if ( p == NULL )
+    p = loaded[batch.cpu];
+
+  /* this core */
+  if ( global || loaded[batch.cpu] == p )
+    __invlpg(vaddr);
+  else if ( invpcid_on && p->pcid && (p->tlb_cpus & bit) )
+    invpcid(INVPCID_ADDR, p->pcid, vaddr);
+  else
+    p->tlb_cpus &= ~bit;        /* flushed wherever it runs next */
+
+  /* the others */
+  if ( (targets = ktlb_targets(p, global)) )
+    ktlb_batch_add(vaddr, targets, global);
+  ktlb_batch_end();
+}
+
+void ktlb_flush_all(Proc_t *p, int global) {
+  uint32_t targets;
+
+  if ( !tlb_online ) {
+    ktlb_flush_local(global);
+    return;
+  }
+
+  ktlb_batch_begin();
+  if ( p == NULL )
+    p = loaded[batch.cpu];
+
+  if ( global || loaded[batch.cpu] == p )
+    ktlb_flush_local(global);
+  else
+    p->tlb_cpus &= ~((uint32_t)1 << batch.cpu);
+
+  if ( (targets = ktlb_targets(p, global)) ) {
+    batch.targets |= targets;
+    batch.global |= global;
+    batch.all = 1;
+  }
+  ktlb_batch_end();
+}
+
+/* 
+ * A target's side. Runs from the IPI, without the kernel lock, or from 
+ * acquire_lock(); whichever comes second finds nothing to do.
+ */
+void ktlb_shootdown() {
+  uint32_t bit;
+  uint64_t j;
+  int i;
+
+  if ( !tlb_pending )
+    return;
+  bit = (uint32_t)1 << this_cpu();
+  if ( !(tlb_pending & bit) )
+    return;
+
+  if ( batch.all )
+    ktlb_flush_local(batch.global);
+  else
+    for ( i = 0; i < batch.nranges; i++ )
+      for ( j = 0; j < batch.ranges[i].npages; j++ )
+	__invlpg(batch.ranges[i].start + j * PAGE_SIZE);
+  __sync_fetch_and_and(&tlb_pending, ~bit);
+}
+
+void ktlb_print_stats() {
+  uint64_t hz, secs, avg;
+
+  hz = get_tsc_freq();
+  secs = hz ? (readtsc() - tlb_start_tsc) / hz : 0;
+  avg = tlb_shootdowns ? tlb_wait_tsc / tlb_shootdowns : 0;
+  kprintf("[tlb] pcids %s, %d shootdowns (%d/s), %d ipis, %d pages, %d full\n",
+	  pcid_on ? (invpcid_on ? "on, invpcid" : "on") : "off",
+	  (int)tlb_shootdowns, (int)(secs ? tlb_shootdowns / secs : 0),
+	  (int)tlb_ipis, (int)tlb_pages, (int)tlb_fulls);
+  kprintf("[tlb] ipi wait %d cycles (%d us) avg, %d cycles max\n",
+	  (int)avg, (int)(hz ? avg * 1000000 / hz : 0), (int)tlb_wait_max);
+}
@@ -43,6 +43,10 @@
 #include <kvcall.h>         /* For VT-d hack     */
 #include <khash.h>          /* For hash table    */
 #include <kvmem.h>          /* For derp          */
+#include <ramio.h>          /* For RAMDISK_MAP   */
+#ifdef KERNEL
+#include <ktlb.h>           /* For TLB shootdowns */
+#endif
 #include <asm_subroutines.h>
 
 #define KVMEM_TYPE_MMIO 0
@@ -175,7 +179,7 @@ void detach_page(Proc_t *p, uint64_t vaddr) {
   struct page_directory *pd;
   struct page_table *pt;
   union page *page;
-  int pdpt_idx, pd_idx, pt_idx;
+  int pdpt_idx, pd_idx, pt_idx, global;
 
   /* In user proc address space? */
   if (vaddr > ((uint64_t)(1) << 39))
@@ -198,7 +202,11 @@ void detach_page(Proc_t *p, uint64_t vaddr) {
   page = &(pt->entries[pt_idx]);
 
   /* Zero out that pte. */
+  global = page->global;
   kmemset(page, 0, sizeof(union page));
+#ifdef KERNEL
+  ktlb_flush_page(p, vaddr, global);
+#endif
 }
 
 /******************************************************************************
@@ -209,17 +217,23 @@ void detach_page(Proc_t *p, uint64_t vaddr) {
  *
  *****************************************************************************/
 void flush_tlb(int where) {
+  uint64_t cr4;
+
   switch(where) {
-    uint64_t cr3;
+  case TLB_PL3:
+  case TLB_SCRATCH:
+    /* without the no-flush bit this drops the current pcid's entries */
+    write_cr3(read_cr3());
+    break;
   case TLB_PL0:
   case TLB_PL1:
   case TLB_PL2:
-  case TLB_PL3:
-  case TLB_SCRATCH:
   case TLB_ALL:
   default:
-    cr3 = read_cr3();
-    write_cr3(cr3);
+    /* toggling PGE drops everything, global or not, in every pcid */
+    cr4 = read_cr4();
+    write_cr4(cr4 ^ CR4_PGE);
+    write_cr4(cr4);
     break;
   }
 }
@@ -279,6 +293,32 @@ uint64_t kvmem_map_dma_region(Proc_t *p, uint64_t virt_addr, uint64_t bytes) {
   return phys_addr;
 }
 
+/******************************************************************************
+ *
+ * Function: kvmem_map_ramdisk
+ *
+ * Description: Maps the whole ramdisk, read/write, into a process at 
+ *              virt_addr and returns the number of bytes mapped. The frames 
+ *              belong to the ramdisk; they are unmapped, not freed, when the 
+ *              process ends.
+ *
+ *****************************************************************************/
+uint64_t kvmem_map_ramdisk(Proc_t *p, uint64_t virt_addr) {
+  uint64_t off;
+
+  if (virt_addr & 0xFFF)
+    return 0;
+
+  kvmem_add_dev_alloc(p->pid, KVMEM_TYPE_MMIO, virt_addr, 
+		      virt2phys((void*)RAMDISK_MAP), RAMDISK_SIZE / PAGE_SIZE);
+
+  for (off = 0; off < RAMDISK_SIZE; off += PAGE_SIZE)
+    attach_page(virt_addr + off, virt2phys((void*)(RAMDISK_MAP + off)), 
+		UMEM_IO_FLAGS | PG_NX);
+
+  return RAMDISK_SIZE;
+}
+
 /* TODO: FIX with new system */
 void kvmem_unmap_devmem(Proc_t *p) {
   Mem_alloc_t *dev_alloc;
@@ -292,12 +332,18 @@ void kvmem_unmap_devmem(Proc_t *p) {
     kprintf("	[KVmem] Unmapped dev memory*type=%d vaddr=0x%x paddr=0x%x*", dev_alloc->type, dev_alloc->vaddr,
 	    dev_alloc->paddr);
 #endif 
-    /* Unmap. */
+    /* Unmap, with one shootdown for the lot. */
+#ifdef KERNEL
+    ktlb_batch_begin();
+#endif
     for(i=0; i<(dev_alloc->num_pages); i++) {
       uint64_t vaddr;
       vaddr = dev_alloc->vaddr + (uint64_t)(i) * (uint64_t)(PAGE_SIZE);
       detach_page(p, vaddr);
     }
+#ifdef KERNEL
+    ktlb_batch_end();
+#endif
 
     /* Free the allocation record. */
     kfree_track(KVMEM_SITE,dev_alloc);
@@ -40,6 +40,7 @@
 #include <kernel.h>
 #include <kstdio.h>
 #include <kvmem.h>
+#include <kshm.h>
 #include <sys/wait.h>
 #include <kstring.h>
 
@@ -256,7 +257,7 @@ static void reap(void) {
     victim = (Proc_t*)qget(reaping_q);
     while ( victim ) {
 
-      flush_tlb(TLB_ALL);
+      flush_tlb(TLB_SCRATCH);
 
       /* find a spare pml4t entry in the reaper's tables */
       for ( i = 0; i < 512; i++ )
@@ -320,6 +321,12 @@ static void reap(void) {
 	      if ( pte.global )
 		continue;
 
+	      /* shared memory frames go when their last mapping does */
+	      if ( KSHM_ADDR(idx2vaddr(pml4t_idx, pdpt_idx, pd_idx, pt_idx)) ) {
+		kshm_put_frame(TABLE2ADDR(pte.addr));
+		continue;
+	      }
+
 	      attach_page(special_k, (uint64_t)TABLE2ADDR(pte.addr), PG_RW);
 	      special_k += PAGE_SIZE;
 	    } /* end pt loop */
@@ -335,7 +342,7 @@ static void reap(void) {
       /* if I am to reap another victim, I need to flush the TLB */
       victim = (Proc_t*)qget(reaping_q);
       if ( victim )
-      	flush_tlb(TLB_ALL);
+      	flush_tlb(TLB_SCRATCH);
     }
 
     ksched_yield();
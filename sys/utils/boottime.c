@@ -0,0 +1,124 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/* 
+ * boottime.c -- the boot timeline, see boottime.h. 
+ *
+ * Compiled into boot2, kboot2, the hypervisor and the kernel. Until the
+ * kernel saves it, the timeline is the one at BOOT_TIMELINE; each stage
+ * adds its marks to whatever the stage before it left there.
+ */
+#include <stdint.h>
+#include <constants.h>		/* NULL */
+#include <kstdio.h>
+#include <kstring.h>
+#include <tsc.h>
+#include <boottime.h>
+
+static Boottime_t *timeline = (Boottime_t *)BOOT_TIMELINE;
+
+#ifdef KERNEL
+static Boottime_t saved;		/* the kernel's copy */
+#endif
+
+static void boottime_add(char *name) {
+  Boottime_mark_t *m;
+  int i;
+
+  m = &timeline->marks[timeline->n++];
+  m->tsc = readtsc();
+  for(i = 0; i < BOOTTIME_NAMESZ - 1 && name[i] != '\0'; i++)
+    m->name[i] = name[i];
+  m->name[i] = '\0';
+}
+
+void boottime_init() {
+  uint64_t mbr;
+
+  mbr = timeline->marks[0].tsc;
+  kmemset(timeline, 0, sizeof(Boottime_t));
+  timeline->magic = BOOTTIME_MAGIC;
+  /* Anything that was left there by something other than the MBR would
+   * not be older than us */
+  if(mbr != 0 && mbr < readtsc()) {
+    timeline->marks[0].tsc = mbr;
+    kmemcpy(timeline->marks[0].name, "mbr", sizeof("mbr"));
+    timeline->n = 1;
+  }
+}
+
+void boottime_mark(char *name) {
+  /* keep a mark for boottime_close() */
+  if(timeline->magic != BOOTTIME_MAGIC || timeline->closed || 
+     timeline->n >= BOOTTIME_MAX - 1)
+    return;
+  boottime_add(name);
+}
+
+void boottime_save() {
+#ifdef KERNEL
+  if(timeline != &saved) {
+    kmemcpy(&saved, timeline, sizeof(Boottime_t));
+    timeline = &saved;
+  }
+#endif
+}
+
+int boottime_close(char *name) {
+  if(timeline->magic != BOOTTIME_MAGIC || timeline->closed)
+    return -1;
+  boottime_add(name);
+  timeline->closed = 1;
+  return 0;
+}
+
+Boottime_t *boottime_get() {
+  return timeline->magic == BOOTTIME_MAGIC ? timeline : NULL;
+}
+
+void boottime_print() {
+  Boottime_mark_t *m;
+  uint64_t hz, start, took;
+  int i;
+
+  if(timeline->magic != BOOTTIME_MAGIC || timeline->n == 0)
+    return;
+  hz = get_tsc_freq() / 1000000;	/* cycles per us */
+  m = timeline->marks;
+  if(hz == 0) {
+    kprintf("[boot] tsc frequency unknown, times are in cycles\n");
+    hz = 1;
+  }
+  kprintf("[boot] first mark %u us after reset\n", m[0].tsc / hz);
+  kprintf("  start\ttook\tphase\n");
+  for(i = 0; i < timeline->n; i++) {
+    start = (m[i].tsc - m[0].tsc) / hz;
+    if(i + 1 < timeline->n) {
+      took = (m[i+1].tsc - m[i].tsc) / hz;
+      kprintf("  %u\t%u\t%s\n", start, took, m[i].name);
+    }
+    else
+      kprintf("  %u\t-\t%s%s\n", start, m[i].name, 
+	      timeline->closed ? "" : " (still booting)");
+  }
+}
@@ -36,8 +36,6 @@
 
 // #define DIVERSITY_DEBUG 1
 
-static char* kitoa(uint64_t val);
-
 #if defined(KPLT) && defined(BOOTLOADER)
 
 volatile uint64_t kplt;
@@ -157,18 +155,17 @@ static void move_unit(Proc_t *proc, struct diversity_unit *unit,
 
 /******************************************************************************
  *
- * Function: fixup_unit(struct diversity_unit *, struct Elf64_Sym *)
+ * Function: apply_reloc(struct external_reloc *, struct Elf64_Sym *)
  *
- * Description: Given a diversity unit, apply its external relocations. This
- *              needs to be done after all the diversity units have been moved,
- *              otherwise the offset fields in the relocations and the symbol
- *              values will have wonky and possibly incorrect numbers.
+ * Description: Apply one external relocation. This needs to be done after all
+ *              the diversity units have been moved, otherwise the offset 
+ *              fields in the relocations and the symbol values will have 
+ *              wonky and possibly incorrect numbers.
  *****************************************************************************/
 
 
-static void fixup_unit(void *proc, struct diversity_unit *unit, struct Elf64_Sym *symtab) {
+static void apply_reloc(struct external_reloc *reloc, struct Elf64_Sym *symtab) {
 
-  struct external_reloc *reloc;
   struct Elf64_Sym *sym;
   int reltype;
   /* Relocation variables using the same names as in the ELF docs. All are
@@ -183,116 +180,334 @@ static void fixup_unit(void *proc, struct diversity_unit *unit, struct Elf64_Sym
   uint32_t *rel32 = NULL;
   uint64_t *rel64 = NULL;
 
-  /* Update the external relocations that point into this unit. */
-  list_for_each(&unit->external_relocs, reloc, list) {
+  /* This works regardless of the true type of the union. */
+  sym = symtab + ELF64_R_SYM(reloc->rel->r_info);
+  reltype = ELF64_R_TYPE(reloc->rel->r_info);
+  S = sym->st_value;
 
-    /* This works regardless of the true type of the union. */
-    sym = symtab + ELF64_R_SYM(reloc->rel->r_info);
-    reltype = ELF64_R_TYPE(reloc->rel->r_info);
-    S = sym->st_value;
+  /* NOTE: Currently calculating P as if our file is always considered an
+   *       executable. This is technically correct for now, but must be
+   *       changed if we ever load "relocatable files" that aren't
+   *       executable or shared objects. */
+  P = reloc->rel->r_offset;
 
-    /* NOTE: Currently calculating P as if our file is always considered an
-     *       executable. This is technically correct for now, but must be
-     *       changed if we ever load "relocatable files" that aren't
-     *       executable or shared objects. */
-    P = reloc->rel->r_offset;
+  if(reloc->type == RELA) {
+    /* This is easy; the addend is explicit. */
+    A = reloc->rela->r_addend;
+  } else {
+    /* The addend is the memory contents of the offset. */
 
-    if(reloc->type == RELA) {
-      /* This is easy; the addend is explicit. */
-      A = reloc->rela->r_addend;
-    } else {
-      /* The addend is the memory contents of the offset. */
+    A = *(uint64_t *)P;
 
-      A = *(uint64_t *)P;
+    /* We may have pulled in extra data depending on the size of the
+     * qrelocation; cut it down if that's the case. */
+    A >>= 64 - reloc_size(reltype);
+  }
 
-      /* We may have pulled in extra data depending on the size of the
-       * qrelocation; cut it down if that's the case. */
-      A >>= 64 - reloc_size(reltype);
-    }
+  /* We only support a select few relocation types at the moment, as we're
+   * a pretty basic loader (no shared libraries, etc.). */
+  switch(reltype) {
+  case R_X86_64_64:
+    rel64 = (uint64_t *)P;
+    *rel64 = S + A;
+    break;
+  case R_X86_64_PC32:
+    /* Ignore these relocations for now...we can't handle them, they
+     * shouldn't even be generated in the first place (!), and their
+     * presence doesn't do anything for us. At the moment, every single
+     * one of these would be truncated anyway. */
+    break;
+  case R_X86_64_32:
+  case R_X86_64_32S:
+    rel32 = (uint32_t *)P;
+    *rel32 = (uint32_t)(S + A);
+    break;
+  case R_X86_64_16:
+    rel16 = (uint16_t *)P;
+    *rel16 = (uint16_t)(S + A);
+    break;
+  case R_X86_64_8:
+    rel8 = (uint8_t *)P;
+    *rel8 = (uint8_t)(S + A);
+    break;
+  default:
+    kprintf("Reached default statement in apply_reloc\n");
+  }
+}
 
-    /* We only support a select few relocation types at the moment, as we're
-     * a pretty basic loader (no shared libraries, etc.). */
-    switch(reltype) {
-    case R_X86_64_64:
-      rel64 = (uint64_t *)P;
-      *rel64 = S + A;
-      break;
-    case R_X86_64_PC32:
-      /* Ignore these relocations for now...we can't handle them, they
-       * shouldn't even be generated in the first place (!), and their
-       * presence doesn't do anything for us. At the moment, every single
-       * one of these would be truncated anyway. */
-      break;
-    case R_X86_64_32:
-    case R_X86_64_32S:
-      rel32 = (uint32_t *)P;
-      *rel32 = (uint32_t)(S + A);
-      break;
-    case R_X86_64_16:
-      rel16 = (uint16_t *)P;
-      *rel16 = (uint16_t)(S + A);
-      break;
-    case R_X86_64_8:
-      rel8 = (uint8_t *)P;
-      *rel8 = (uint8_t)(S + A);
-      break;
-    default:
-      kprintf("Reached default statement in fixup_unit\n");
-    }
+/* r_offset is first in both a rel and a rela */
+#define reloc_offset(r) ((r)->rel->r_offset)
+
+/* Heapsort the relocations by the address they patch */
+static void sift_reloc(struct external_reloc **r, int root, int n) {
+  struct external_reloc *tmp;
+  int child;
+
+  while ( (child = 2*root + 1) < n ) {
+    if ( child + 1 < n && reloc_offset(r[child+1]) > reloc_offset(r[child]) )
+      child++;
+    if ( reloc_offset(r[root]) >= reloc_offset(r[child]) )
+      return;
+    tmp = r[root];
+    r[root] = r[child];
+    r[child] = tmp;
+    root = child;
   }
 }
 
-#define partition_size(p) (p->end - p->start)
+static void sort_relocs(struct external_reloc **r, int n) {
+  struct external_reloc *tmp;
+  int i;
+
+  for ( i = n/2 - 1; i >= 0; i-- )
+    sift_reloc(r, i, n);
+  for ( i = n - 1; i > 0; i-- ) {
+    tmp = r[0];
+    r[0] = r[i];
+    r[i] = tmp;
+    sift_reloc(r, 0, i);
+  }
+}
+
+/******************************************************************************
+ *
+ * Function: fixup_units(Proc_t *)
+ *
+ * Description: Apply the external relocations of every unit, in one pass in
+ *              address order, rather than unit by unit all over the image.
+ *****************************************************************************/
+static void fixup_units(Proc_t *proc) {
+
+  struct diversity_unit *unit;
+  struct external_reloc *reloc, **relocs;
+  int i, n;
+
+  n = 0;
+  list_for_each(&proc->file->diversity_units, unit, list)
+    list_for_each(&unit->external_relocs, reloc, list)
+      n++;
+  if ( !n )
+    return;
+
+  relocs = kmalloc_track(DIVERSITY_SITE, n * sizeof(struct external_reloc *));
+  i = 0;
+  list_for_each(&proc->file->diversity_units, unit, list)
+    list_for_each(&unit->external_relocs, reloc, list)
+      relocs[i++] = reloc;
+
+  sort_relocs(relocs, n);
+  for ( i = 0; i < n; i++ )
+    apply_reloc(relocs[i], proc->file->symtab);
+
+  kfree_track(DIVERSITY_SITE, relocs);
+}
+
 #define unit_size(u) ( u->memsz + (u->hdr->sh_addralign - 1) )
 #define new_unit_addr(u) ( (u->sign > 0) ? (u->addr + u->offset) : \
 			                   (u->addr - u->offset))
 
-static partition_t *partitions;
+/* 
+ * The free virtual space is a set of partitions, kept in an AVL tree by
+ * start address. Each node also holds the free bytes and the longest 
+ * partition in its subtree: a random byte of free space is found in one walk
+ * down, and when the slots must be counted, subtrees with nothing long enough
+ * are skipped.
+ */
+
+#define part_len(p)    ( (p)->end - (p)->start )
+#define part_height(p) ( (p) ? (p)->height : 0 )
+#define part_bytes(p)  ( (p) ? (p)->bytes : 0 )
+#define part_max(p)    ( (p) ? (p)->max : 0 )
+/* places for need bytes, align apart */
+#define part_slots(p, need, align) \
+  ( (part_len(p) > (need)) ? (part_len(p) - (need)) / (align) : 0 )
+
+#define page_down(a) ( (a) - ((a) % PAGE_SIZE) )
+#define page_up(a)   page_down((a) + PAGE_SIZE - 1)
+
+/* random bytes tried in pick_random_place before counting the slots */
+#define PICK_TRIES 32
+
+static partitions_t *partitions;
 static partition_t *curr_partition;
 
+static void part_update(partition_t *p) {
 
-static uint64_t n_parts;
+  p->height = part_height(p->left) > part_height(p->right) ? 
+    part_height(p->left) + 1 : part_height(p->right) + 1;
+  p->bytes = part_bytes(p->left) + part_len(p) + part_bytes(p->right);
+  p->max = part_len(p);
+  if ( part_max(p->left) > p->max )
+    p->max = part_max(p->left);
+  if ( part_max(p->right) > p->max )
+    p->max = part_max(p->right);
+}
 
-void add_to_partitions(partition_t *parts, uint64_t start, uint64_t size) {
+static partition_t *part_rotate_right(partition_t *p) {
 
-  partition_t *part, *new;
+  partition_t *l = p->left;
 
-  for ( part = parts; part; part = part->next ) {
-    if ( (part->start <= start) && (part->end >= start) ) {
-      if ( (start + size) > part->end )
-	part->end = (start + size) + (PAGE_SIZE - ((start+size)%PAGE_SIZE));
-      return;
+  p->left = l->right;
+  l->right = p;
+  part_update(p);
+  part_update(l);
+  return l;
+}
+
+static partition_t *part_rotate_left(partition_t *p) {
+
+  partition_t *r = p->right;
+
+  p->right = r->left;
+  r->left = p;
+  part_update(p);
+  part_update(r);
+  return r;
+}
+
+static partition_t *part_balance(partition_t *p) {
+
+  int bal;
+
+  part_update(p);
+  bal = part_height(p->left) - part_height(p->right);
+  if ( bal > 1 ) {
+    if ( part_height(p->left->left) < part_height(p->left->right) )
+      p->left = part_rotate_left(p->left);
+    return part_rotate_right(p);
+  }
+  if ( bal < -1 ) {
+    if ( part_height(p->right->right) < part_height(p->right->left) )
+      p->right = part_rotate_right(p->right);
+    return part_rotate_left(p);
+  }
+  return p;
+}
+
+static partition_t *part_insert(partition_t *root, partition_t *p) {
+
+  if ( !root )
+    return p;
+  if ( p->start < root->start )
+    root->left = part_insert(root->left, p);
+  else
+    root->right = part_insert(root->right, p);
+  return part_balance(root);
+}
+
+/* p's end moved: redo the sums on the path down to it */
+static void part_refresh(partition_t *root, partition_t *p) {
+
+  if ( !root )
+    return;
+  if ( root != p )
+    part_refresh((p->start < root->start) ? root->left : root->right, p);
+  part_update(root);
+}
+
+static partition_t *part_new(uint64_t start, uint64_t end) {
+
+  partition_t *p;
+
+  p = (partition_t*)kmalloc_track(DIVERSITY_SITE, sizeof(partition_t));
+  if ( !p ) {
+    kputs("[DIVERSITY] Allocation of a new partition failed");
+    panic();
+  }
+  kmemset(p, 0, sizeof(partition_t));
+  p->start = start;
+  p->end = end;
+  part_update(p);
+
+  return p;
+}
+
+static void part_add(partitions_t *parts, partition_t *p) {
+
+  parts->root = part_insert(parts->root, p);
+  parts->n++;
+}
+
+/* The partition holding addr, if any */
+static partition_t *part_find(partitions_t *parts, uint64_t addr) {
+
+  partition_t *p, *best;
+
+  for ( p = parts->root, best = 0x0; p; ) {
+    if ( p->start <= addr ) {
+      best = p;
+      p = p->right;
     }
-    else if ( !part->next || (part->next->start > start) ) {
+    else
+      p = p->left;
+  }
 
-      /* make a new partition */
-      new = (partition_t*)kmalloc_track(DIVERSITY_SITE, sizeof(partition_t));
-      if ( !new ) {
-	kputs("allocating partition failed in add_to_partitions");
-	panic();
-      }
+  return (best && best->end >= addr) ? best : 0x0;
+}
+
+/* The partition byte *off of the free space is in; *off becomes the offset
+   into it */
+static partition_t *part_at(partition_t *p, uint64_t *off) {
+
+  while ( p ) {
+    if ( *off < part_bytes(p->left) ) {
+      p = p->left;
+      continue;
+    }
+    *off -= part_bytes(p->left);
+    if ( *off < part_len(p) )
+      return p;
+    *off -= part_len(p);
+    p = p->right;
+  }
 
-      new->next = part->next;
-      new->prev = part;
-      part->next = new;
-      if ( part->next )
-	part->next->prev = new;
+  return 0x0;
+}
 
-      new->start = start - (start % PAGE_SIZE);
-      new->end   = (start + size) + (PAGE_SIZE - ((start + size) % PAGE_SIZE));
+static uint64_t part_count(partition_t *p, uint64_t need, uint64_t align) {
 
-      return;
+  if ( !p || p->max <= need )
+    return 0;
+  return part_count(p->left, need, align) + part_slots(p, need, align) +
+    part_count(p->right, need, align);
+}
+
+/* The partition with slot *n, counting from the lowest address; *n becomes 
+   the slot within it */
+static partition_t *part_nth(partition_t *p, uint64_t need, uint64_t align,
+			     uint64_t *n) {
+
+  partition_t *q;
+
+  if ( !p || p->max <= need )
+    return 0x0;
+  if ( (q = part_nth(p->left, need, align, n)) )
+    return q;
+  if ( *n < part_slots(p, need, align) )
+    return p;
+  *n -= part_slots(p, need, align);
+  return part_nth(p->right, need, align, n);
+}
+
+void add_to_partitions(partitions_t *parts, uint64_t start, uint64_t size) {
+
+  partition_t *part;
+
+  if ( (part = part_find(parts, start)) ) {
+    if ( (start + size) > part->end ) {
+      part->end = page_up(start + size);
+      part_refresh(parts->root, part);
     }
+    return;
   }
 
-  kputs("Never should have made it here in add_to_partitions...");
-  panic();
+  part_add(parts, part_new(page_down(start), page_up(start + size)));
 
-  /* never reached */
   return;
 }
 
-void split_partition(partition_t *part, uint64_t start, uint64_t end) {
+void split_partition(partitions_t *parts, partition_t *part, 
+		     uint64_t start, uint64_t end) {
 
   partition_t *new;
 
@@ -307,12 +522,6 @@ void split_partition(partition_t *part, uint64_t start, uint64_t end) {
     panic();
   }
 
-  new = (partition_t*)kmalloc_track(DIVERSITY_SITE, sizeof(partition_t));
-  if ( !new ) {
-    kputs("Error allocating new partition");
-    panic();
-  }
-
 #ifdef DIVERSITY_DEBUG
   kprintf("starting with partition \n      0x%x -> 0x%x\n",
 	  part->start, part->end);
@@ -320,22 +529,15 @@ void split_partition(partition_t *part, uint64_t start, uint64_t end) {
 	  start, end);
 #endif
 
-  /* place the new partition after the existing partition */
-  new->next = part->next;
-  new->prev = part;
-  if ( part->next )
-    part->next->prev = new;
-  part->next = new;
-
-  /* start of new partition is the end of the last page of the unit */
-  new->start = end;
-  if ( end % PAGE_SIZE )
-    new->start += PAGE_SIZE - (end % PAGE_SIZE);
-  /* end of new partition is the end of the old partition we are splitting */
-  new->end = part->end;
+  /* new partition: from the end of the last page of the unit to the end of
+     the old partition we are splitting */
+  new = part_new(page_up(end), part->end);
 
   /* adjust end of current partition to the first page unit will use */
-  part->end = start - (start % PAGE_SIZE);
+  part->end = page_down(start);
+  if ( part->end < part->start )
+    part->end = part->start;
+  part_refresh(parts->root, part);
 
 #ifdef DIVERSITY_DEBUG
   kprintf("ending with two partitions \n");
@@ -343,16 +545,17 @@ void split_partition(partition_t *part, uint64_t start, uint64_t end) {
   kprintf("       0x%x -> 0x%x\n", new->start, new->end);
 #endif
 
-  /* we added a partition */
-  n_parts++;
+  /* we added a partition, unless the unit went up to the end */
+  if ( new->start < new->end )
+    part_add(parts, new);
+  else
+    kfree_track(DIVERSITY_SITE, new);
 
   return;
 }
 
 static void start_partition(uint64_t start) {
 
-  partition_t *part;
-
 #ifdef DIVERSITY_DEBUG
   kprintf("starting a partition @ 0x%x\n", start);
 #endif
@@ -362,26 +565,7 @@ static void start_partition(uint64_t start) {
     panic();
   }
 
-  curr_partition = (partition_t*)kmalloc_track(DIVERSITY_SITE, 
-					       sizeof(partition_t));
-  if ( !curr_partition ) {
-    kputs("[DIVERSITY] Allocation of a new partition failed in start_partition");
-    panic();
-  }
-  kmemset(curr_partition, 0, sizeof(partition_t));
-
-  for ( part = partitions; part && part->next; part = part->next ) ;
-
-  curr_partition->prev = part;
-  if ( part )
-    part->next = curr_partition;
-
-  curr_partition->start = start;
-
-  if ( !partitions )
-    partitions = curr_partition;
-
-  n_parts++;
+  curr_partition = part_new(start, start);
 
   return;
 }
@@ -398,26 +582,43 @@ static void end_partition(uint64_t end) {
   }
 
   curr_partition->end = end;
+  part_update(curr_partition);
+  part_add(partitions, curr_partition);
 
   curr_partition = 0x0;
 
   return;
 }
 
-void free_partitions(partition_t *parts) {
+static void free_tree(partition_t *p) {
 
-  partition_t *next;
+  if ( !p )
+    return;
+  free_tree(p->left);
+  free_tree(p->right);
+  kfree_track(DIVERSITY_SITE, p);
+}
 
-  /* free the partitions */
-  for ( ; parts; parts = next ) {
-    next = parts->next;
-    kfree_track(DIVERSITY_SITE, parts);
-  }
+void free_partitions(partitions_t *parts) {
+
+  free_tree(parts->root);
+  kfree_track(DIVERSITY_SITE, parts);
 
   return;
 }
 
-partition_t *init_partitions(void) {
+#ifdef DIVERSITY_DEBUG
+static void print_tree(partition_t *p) {
+
+  if ( !p )
+    return;
+  print_tree(p->left);
+  kprintf("  Node: start @ 0x%x, end @ 0x%x\n", p->start, p->end);
+  print_tree(p->right);
+}
+#endif
+
+partitions_t *init_partitions(void) {
 
   int pml4t_idx, pdpt_idx, pd_idx, pt_idx;
 
@@ -430,9 +631,14 @@ partition_t *init_partitions(void) {
   kputs("In init partitions");
 #endif
 
-  partitions = 0x0;
+  partitions = (partitions_t*)kmalloc_track(DIVERSITY_SITE, 
+					    sizeof(partitions_t));
+  if ( !partitions ) {
+    kputs("[DIVERSITY] Allocation of the partitions failed in init_partitions");
+    panic();
+  }
+  kmemset(partitions, 0, sizeof(partitions_t));
   curr_partition = 0x0;
-
   /* loop through page tables */
   pml4t = (struct page_map_level_4_table*)phys2virt(read_cr3());
   for ( pml4t_idx = 0; pml4t_idx < 512; pml4t_idx++ ) {
@@ -497,60 +703,67 @@ partition_t *init_partitions(void) {
     } /* end pdpt level loop */
   } /* end pml4t level loop */
 
+  /* the walk ran off the end without finding its end */
+  if ( curr_partition ) {
+    kfree_track(DIVERSITY_SITE, curr_partition);
+    curr_partition = 0x0;
+  }
+
 #ifdef DIVERSITY_DEBUG
-  kputs("End of init partitions. Here is the state of the linked list");
-  for ( curr_partition = partitions; curr_partition; curr_partition = curr_partition->next )
-    kprintf("  Node: start @ 0x%x, end @ 0x%x\n", curr_partition->start, curr_partition->end);
+  kputs("End of init partitions. Here is the state of the tree");
+  print_tree(partitions->root);
 #endif
 
   return partitions;
 }
 
-uint64_t pick_random_place(partition_t *parts, uint64_t size,
+uint64_t pick_random_place(partitions_t *parts, uint64_t size,
 			   uint64_t align, partition_t **p) {
 
-  uint64_t rand;
-  uint64_t a = 0x0;
   partition_t *part;
+  uint64_t need, off, n;
+  int i;
 
-  for ( part = parts; part; part = part->next ) {
-    if ( size + align > part->end - part->start )
-      continue;
-    else
-      a += (part->end - part->start - size - align);
-  }
-
-  rand = random_between_align(0, a, align);
+  if ( !align )
+    align = 1;
+  need = size + align;
+  part = 0x0;
+  off = 0;
+
+  if ( parts->root && parts->root->max > need ) {
+    /* A random byte of free space, kept if it starts a slot the unit fits
+       in; so every slot is as likely. Free space is mostly in large 
+       partitions, and the first byte almost always does. */
+    for ( i = 0; i < PICK_TRIES && !part; i++ ) {
+      off = random_between(0, parts->root->bytes);
+      part = part_at(parts->root, &off);
+      if ( part && off / align >= part_slots(part, need, align) )
+	part = 0x0;
+    }
 
-  /* this function will work on units of alignment */
-  rand /= align;
+    /* Mostly pieces too small: count the slots. */
+    if ( !part && (n = part_count(parts->root, need, align)) ) {
+      n = random_between(0, n);
+      part = part_nth(parts->root, need, align, &n);
+      off = n * align;
+    }
+  }
 
 #ifdef DIVERSITY_DEBUG
   kputs("\nIn pick_random_place");
   kprintf("   size = 0x%x, alignment = 0x%x\n", size, align);
-  kprintf("   available space = 0x%x\n", a);
-  kprintf("   rand chosen = 0x%x\n", rand);
-#endif
-
-  for ( part = parts; part; part = part->next ) {
-    if ( size + align > part->end - part->start)
-      continue;
-    else if ( (part->end - part->start - size - align)/align <= rand )
-      rand -= ( part->end - part->start - size - align )/align;
-    else {
-#ifdef DIVERSITY_DEBUG
-      kprintf("   return partition with start 0x%x, end 0x%x\n",
-	      part->start, part->end);
-      kprintf("   random offset remaining: 0x%x\n", rand);
-      kprintf("   address returned: 0x%x\n", part->start + (rand*align));
-#endif
-      *p = part;
-      return part->start + (rand*align);
-    }
+  kprintf("   available space = 0x%x\n", part_bytes(parts->root));
+  if ( part ) {
+    kprintf("   return partition with start 0x%x, end 0x%x\n",
+	    part->start, part->end);
+    kprintf("   address returned: 0x%x\n", part->start + (off/align)*align);
   }
+#endif
 
-  *p = 0x0;
-  return 0xAAAAAAAAAAAAAAA;
+  *p = part;
+  if ( !part )
+    return 0xAAAAAAAAAAAAAAA;
+  return part->start + (off/align)*align;
 }
 
 
@@ -570,8 +783,12 @@ void diversify(void *generic_proc, SHA256_CTX *ctx) {
   struct diversity_unit *unit;
   uint64_t position;
   uint64_t i;
-  partition_t *partition, *next;
-  char *position_char;
+  partitions_t *parts;
+  partition_t *partition;
+  uchar **image;                /* the units read from the file */
+  uint *imagesz;
+  uchar (*digest)[32];
+  int nimage;
 
   /* generate and initialize the list of diversity units */
   units = kmalloc_track(DIVERSITY_SITE, sizeof(struct diversity_unit *) * proc->file->num_diversity_units);
@@ -582,28 +799,20 @@ void diversify(void *generic_proc, SHA256_CTX *ctx) {
     *(units + i++) = unit;
   }
 
-  /* initialize the list of partitions */
-  partitions = init_partitions();
+  /* initialize the tree of partitions */
+  parts = init_partitions();
 
   /* cover the hypervisor's stupid ass. */
-  for ( partition = partitions; partition; partition = partition->next ){
-    if ( (partition->start <= 0x100000000000) &&
-	 (partition->end   >= 0x300000000000) ) {
-      split_partition(partition, 0x100000000000, 0x300000000000);
-      break;
-    }
-  }
-  for ( partition = partitions; partition; partition = partition->next ){
-    if ( (partition->start <= 0x100000) &&
-	 (partition->end   >= 0x1000000) ) {
-      split_partition(partitions, 0x100000, 0x1000000);
-      break;
-    }
-  }
+  partition = part_find(parts, 0x100000000000);
+  if ( partition && (partition->end >= 0x300000000000) )
+    split_partition(parts, partition, 0x100000000000, 0x300000000000);
+  partition = part_find(parts, 0x100000);
+  if ( partition && (partition->end >= 0x1000000) )
+    split_partition(parts, partition, 0x100000, 0x1000000);
 #if defined(KPLT) && defined(BOOTLOADER)
   /* place the kplt! */
-  kplt = pick_random_place(partitions, 3*PAGE_SIZE, PAGE_SIZE, &partition);
-  split_partition(partition, kplt, kplt + (3*PAGE_SIZE));
+  kplt = pick_random_place(parts, 3*PAGE_SIZE, PAGE_SIZE, &partition);
+  split_partition(parts, partition, kplt, kplt + (3*PAGE_SIZE));
 
   /* this line will put the kplt into a known location */
   //kplt = 0x70000000000;
@@ -623,14 +832,14 @@ void diversify(void *generic_proc, SHA256_CTX *ctx) {
   for(i = 0; i < proc->file->num_diversity_units; i++) {
     unit = *(units + i);
 
-    position = pick_random_place(partitions, unit_size(unit),
+    position = pick_random_place(parts, unit_size(unit),
 				 unit->hdr->sh_addralign, &partition);
 
     /* split the position into two: make current partition small and then
        add a new partition for the second part. Note: partitions will be
        aligned by page boundaries to assist in the virtual memory system.
     */
-    split_partition(partition, position, position + unit->memsz);
+    split_partition(parts, partition, position, position + unit->memsz);
 
     /*
        IMPORTANT: Uncomment this in order to do the entire diversity algorithm
@@ -649,18 +858,16 @@ void diversify(void *generic_proc, SHA256_CTX *ctx) {
       unit->offset = position - unit->addr;
     }
 
-    /* Relocate current diversity unit to position. */
-    position_char = kitoa(position);
-    sha256_update(ctx, (unsigned char*)position_char,
-		  kstrlen(position_char)+1);
-    kfree_track(DIVERSITY_SITE, position_char);
+    /* the layout goes into the hash */
+    sha256_update(ctx, (unsigned char*)&position, sizeof(position));
   }
 
   /* free the partitions */
-  for ( partition = partitions; partition; partition = next ) {
-    next = partition->next;
-    kfree_track(DIVERSITY_SITE, partition);
-  }
+  free_partitions(parts);
+
+  image = kmalloc_track(DIVERSITY_SITE, sizeof(uchar *) * proc->file->num_diversity_units);
+  imagesz = kmalloc_track(DIVERSITY_SITE, sizeof(uint) * proc->file->num_diversity_units);
+  nimage = 0;
 
   list_for_each(&proc->file->diversity_units, unit, list) {
 
@@ -734,9 +941,21 @@ void diversify(void *generic_proc, SHA256_CTX *ctx) {
 	file_seek( proc->file->file_ctx, unit->hdr->sh_offset );
 	file_read( proc->file->file_ctx, (void*)new_unit_addr(unit), unit->memsz );
       }
+      image[nimage] = (uchar *)new_unit_addr(unit);
+      imagesz[nimage++] = unit->memsz;
     }
   }
 
+  /* the image goes into the hash too, as read: several units at once,
+     each digest in unit order */
+  digest = kmalloc_track(DIVERSITY_SITE, 32 * (nimage ? nimage : 1));
+  sha256_multi(image, imagesz, nimage, digest);
+  for(i = 0; i < nimage; i++)
+    sha256_update(ctx, digest[i], 32);
+  kfree_track(DIVERSITY_SITE, digest);
+  kfree_track(DIVERSITY_SITE, imagesz);
+  kfree_track(DIVERSITY_SITE, image);
+
   list_for_each(&proc->file->diversity_units, unit, list) {
     move_unit(proc, unit, new_unit_addr(unit) );
   }
@@ -745,9 +964,7 @@ void diversify(void *generic_proc, SHA256_CTX *ctx) {
   kfree_track(DIVERSITY_SITE,units);
 
   /* Now that all the units have been moved, we can apply the relocations. */
-  list_for_each(&proc->file->diversity_units, unit, list) {
-    fixup_unit(proc, unit, proc->file->symtab);
-  }
+  fixup_units(proc);
 #ifndef KERNEL
   /* remove write permissions for global data */
   list_for_each(&proc->file->diversity_units, unit, list) {
@@ -775,22 +992,3 @@ void diversify(void *generic_proc, SHA256_CTX *ctx) {
 
   return;
 }
-
-static char* kitoa(uint64_t val) {
-  char *res;
-  int idx;
-
-  if((res=(char*)kmalloc_track(DIVERSITY_SITE, 32*sizeof(char)))==NULL)
-    return NULL;
-
-  kmemset(res, '\0', 32);
-
-  idx=0;
-  while(val) {
-    res[idx++] = (val%10) + '\0';
-    val /= 10;
-  }
-
-  return res;
-}
-
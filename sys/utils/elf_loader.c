@@ -98,6 +98,7 @@ void free_elf_ctx(struct elf_ctx *ctx) {
     kfree_track(ELF_LOADER_SITE,ctx->section_strtab);
   if(ctx->strtab_loaded)
     kfree_track(ELF_LOADER_SITE,ctx->strtab);
+  elf_free_symindex(ctx);
   if(ctx->num_syms)
     kfree_track(ELF_LOADER_SITE,ctx->symtab);
   if(ctx->num_rels)
@@ -708,6 +709,33 @@ int elf_load_metadata(struct elf_ctx *ctx) {
   return status;
 }
 
+/*
+ * elf_load_symbols: as elf_load_metadata, but stops at the symbol table; for
+ * when all we want is to look up symbols in the file.
+ */
+int elf_load_symbols(struct elf_ctx *ctx) {
+  int status = 0;
+
+  if(!(ctx->file_header_loaded)) 
+    status |= load_file_header(ctx);
+  if(status)
+    return status;
+
+  if(!(ctx->program_headers_loaded)) 
+    status |= load_phdrs(ctx);
+
+  if(!(ctx->section_headers_loaded))
+    status |= load_shdrs(ctx);
+
+  if(!(ctx->section_strtab_loaded))
+    status |= load_section_strtab(ctx);
+
+  if(!(ctx->num_syms))
+    status |= load_symtab(ctx);
+
+  return status;
+}
+
 static int load_segment(
 #ifdef KERNEL
 			void *proc, 
@@ -905,238 +933,52 @@ int reloc_size(int reloctype) {
 }
 
 #define checkstatus(x) if(file_error_check(x)) return MEM_FAIL
-uint64_t get_symbol_addr(void* file_ctx, char* sym_name, char* string_table){
-
-  struct Elf64_Ehdr file_header;
-  struct Elf64_Shdr section_header;
-  struct Elf64_Sym  symbol;		
-  int i, seekto, len, rc;
-
-  /*start back at zero point in file in case it was jacked with!!!! */
-  file_seek(file_ctx, 0);
-  /*read in the main file header */
-  file_read(file_ctx, &file_header, sizeof(struct Elf64_Ehdr));
-  //checkstatus(file_ctx);
-  rc = checkhdr(&file_header);
-  if(rc) return MEM_FAIL;
-
-  /*set the seek to the index of the sections */
-  seekto = file_header.e_shoff;
-
-  /*length of the symbol we're given so we can run safe kstrncmp */
-  len =  kstrlen(sym_name);
-  if(len == 0){
-    /*sanity check in case user is retarted */
-    return MEM_FAIL;
-  }
-  /*loop over the various sections */
-  for(i=0; i < file_header.e_shnum;i++){
-    file_seek(file_ctx, seekto);
-    file_read(file_ctx, &section_header, sizeof(struct Elf64_Shdr));
-    /*until we find the symbol table sectonn */
-    if(section_header.sh_type ==0x2){
-      seekto = section_header.sh_offset; 
-      /*now loop over the symbols (in HEX dumbass)*/
-      for( i=0; i < section_header.sh_size / section_header.sh_entsize; i++){
-	file_seek(file_ctx, seekto);
-	file_read(file_ctx, &symbol, sizeof(struct Elf64_Sym));
-				
-	if(symbol.st_value != 0 ){
-	  /*see if our name is in the list */
-	  if(kstrncmp(string_table+symbol.st_name, sym_name, len) == 0){
-	    /*							
-	     * kprintf("name check 2%s ", &string_table[symbol.st_name]);
-	     * kprintf("addr %x \n", symbol.st_value);
-	     */	
-	    return symbol.st_value;
-	  }
-	}
-	/*otherwise jump to the next symbol */	
-	seekto += sizeof(struct Elf64_Sym);
-      } /*SYMBOL loop */ 
-      /*if we got here the symbol wasnt found */
-      return MEM_FAIL;  /* symbol not found */
-    }
-    else
-      seekto += sizeof(struct Elf64_Shdr);
-  }/*SECTION loop */
-  return MEM_FAIL;
-}
-
-static void swap (uint64_t a[], int left, int right)
-{
-  uint64_t temp;
-  temp=a[left];
-  a[left]=a[right];
-  a[right]=temp;
-}//end swap
-
-static int partition( uint64_t a[], int low, int high )
-{
-  uint64_t left, right;
-  uint64_t pivot_item;
-
-  pivot_item = a[low];
-  right = high;
-  while ( left < right )
-    {
-      // Move left while item < pivot
-      while( a[left] <= pivot_item )
-	left++;
-      // Move right while item > pivot
-      while( a[right] > pivot_item )
-	right--;
-      if ( left < right )
-	swap(a,left,right);
-    }
-  // right is final position for the pivot
-  a[low] = a[right];
-  a[right] = pivot_item;
-  return right;
-}//end partition 
-
-static void quicksort( uint64_t a[], int low, int high )
-{
-  uint64_t pivot;
-  // Termination condition!
-  if ( high > low )
-    {
-      pivot = partition( a, low, high );
-      quicksort( a, low, pivot-1 );
-      quicksort( a, pivot+1, high );
-    }
-} //end quicksort
-
-uint64_t* symbol_addr_list(void *file_ctx, int *sym_count){
+/* The symbol lookups go through the index in elf_symtab.c */
+uint64_t get_symbol_addr(struct elf_ctx *ctx, char* sym_name){
+  struct Elf_Sym *sym;
 
-  struct Elf64_Ehdr file_header;
-  struct Elf64_Shdr section_header;
-  struct Elf64_Sym  symbol;		
-  int i, seekto, rc;
-  uint64_t *sym_array; 
-  
-  /*start back at zero point in file in case it was jacked with!!!! */
-  file_seek(file_ctx, 0);
-  /*read in the main file header */
-  file_read(file_ctx, &file_header, sizeof(struct Elf64_Ehdr));
-  //checkstatus(file_ctx);
-  rc = checkhdr(&file_header);
-  if(rc) return NULL;
-  
-  /*set the seek to the index of the sections */
-  seekto = file_header.e_shoff;
-  
-  /*loop over the various sections */
-  for(i=0; i < file_header.e_shnum;i++){
-    file_seek(file_ctx, seekto);
-    file_read(file_ctx, &section_header, sizeof(struct Elf64_Shdr));
-    /*until we find the symbol table sectonn */
-    if(section_header.sh_type ==0x2){
-      seekto = section_header.sh_offset;
-      /*determine the size of the array and make space for it*/
-      sym_array = (uint64_t*)kmalloc_track(ELF_LOADER_SITE,
-					   ((section_header.sh_size/section_header.sh_entsize)*sizeof(uint64_t)));
-      /*now loop over the symbols (in HEX dumbass)*/
-      for( i=0; i < section_header.sh_size / section_header.sh_entsize; i++){
-	file_seek(file_ctx, seekto);
-	file_read(file_ctx, &symbol, sizeof(struct Elf64_Sym));
-	
-	sym_array[i] = symbol.st_value;
-	/*otherwise jump to the next symbol */	
-	seekto += sizeof(struct Elf64_Sym);
-      } /*SYMBOL loop */ 
-      *sym_count = i;
-      quicksort(sym_array, 0, i-1); 	
-      return sym_array;  
-    }
-    else
-      seekto += sizeof(struct Elf64_Shdr);
-  }/*SECTION loop */
-  return NULL;
+  if((sym = elf_sym_by_name(ctx, sym_name)) == NULL)
+    return MEM_FAIL;  /* symbol not found */
+  return sym->st_value;
 }
 
 char * search_symbol_name(uint64_t address, char *file_name){
+  struct elf_ctx *ctx;
+  struct Elf_Sym *sym;
+  char *name, *symname;
+  int rc, len;
 
-  int i, sym_count;
-  uint64_t temp;
-  char *string_table, *name;
-  uint64_t *sym_array;
-  FIL file_ctx;
-  int rc;
-
-  rc = f_open(&file_ctx, file_name, FA_READ);
-	
-  if(rc){
+  ctx = alloc_elf_ctx(file_read, file_seek, file_error_check);
+  ctx->file_ctx = file_open(file_name);
+  if((rc = file_error_check(ctx->file_ctx))) {
     kprintf("read file failed in search symbol with err code %d\n", rc);
+    free_elf_ctx(ctx);
     return NULL;
   }	
-  sym_array = symbol_addr_list(&file_ctx, &sym_count);
-  string_table = read_string_table(&file_ctx);
-		
-  temp =0;
-  for(i =0; i<sym_count-2; i++){
-    //	  if(address >= sym_array[sym_count]) { 
-    //temp = sym_array[sym_count];
-    //break;
-    //	  }
-    if((address >= sym_array[i]) && (address < sym_array[i+1]) ) {
-      temp = sym_array[i]; 
-      break;
-    }
+
+  name = NULL;
+  if(elf_load_symbols(ctx) == 0 && (sym = elf_sym_by_addr(ctx, address)) != NULL) {
+    /* the string table goes with the ctx */
+    symname = ELF_SYMNAME(*sym, ctx->strtab);
+    len = kstrlen(symname) + 1;
+    name = kmalloc_track(ELF_LOADER_SITE, len);
+    kstrncpy(name, symname, len);
   }
-	
-  name = get_symbol_name(&file_ctx, temp, string_table);
 
-  f_close(&file_ctx);
-  kfree_track(ELF_LOADER_SITE,string_table);
-  kfree_track(ELF_LOADER_SITE,sym_array);
+  file_close(ctx->file_ctx);
+  free_elf_ctx(ctx);
 
   return name;
 }
 
-char *get_symbol_name(void *file_ctx,  uint64_t address, char * string_table){
-  struct Elf64_Ehdr file_header;
-  struct Elf64_Shdr section_header;
-  struct Elf64_Sym  symbol;
-  int seekto, i, rc; 
-	
-  /*read in the main file header */
-  file_seek(file_ctx, 0);
-  file_read(file_ctx, &file_header, sizeof(struct Elf64_Ehdr));
-  //checkstatus(file_ctx);
-  rc = checkhdr(&file_header);
-  if(rc){
-    kprintf("read file failed in get symbol with err code %d\n", rc);
-    return NULL;
-  }	
-  /*set the seek to the index of the sections */
-  seekto = file_header.e_shoff;
+/* Name of the function starting at address */
+char *get_symbol_name(struct elf_ctx *ctx, uint64_t address){
+  struct Elf_Sym *sym;
 
-  /*loop over the various sections */
-  for(i=0; i < file_header.e_shnum;i++){
-    file_seek(file_ctx, seekto);
-    file_read(file_ctx, &section_header, sizeof(struct Elf64_Shdr));
-    /*until we find the symbol table sectonn */
-    if(section_header.sh_type ==0x2){
-      seekto = section_header.sh_offset; 
-      /*now loop over the symbols */
-      for( i=0x0; i < section_header.sh_size / section_header.sh_entsize; i++){
-	file_seek(file_ctx, seekto);
-	file_read(file_ctx, &symbol, sizeof(struct Elf64_Sym));
-				
-	if(symbol.st_value == address && (symbol.st_info & 0xF) == 2 ){
-	  // kprintf("Address is  %x offset %x, Name %s \n", symbol.st_value, symbol.st_name,
-	  // (char*)(string_table + symbol.st_name)); 
-	  return string_table + symbol.st_name;
-	}
-	/*otherwise jump to the next symbol */
-	seekto += sizeof(struct Elf64_Sym);
-      } /* close out symbol loop */
-    }/*close out the if type */
-    else
-      seekto += sizeof(struct Elf64_Shdr);
-  }
-  return NULL;
+  sym = elf_sym_by_addr(ctx, address);
+  if(sym == NULL || sym->st_value != address)
+    return NULL;
+  return ELF_SYMNAME(*sym, ctx->strtab);
 }
 
 char *read_string_table(void *file_ctx) {
@@ -1215,23 +1057,25 @@ char *read_section_table(void *file_ctx) {
 
 /**************  examples of how to use lookup functions   ********
 
-	string_table = read_string_table(file_ctx);	
+	rc = elf_load_symbols(ctx);	(or elf_load_metadata)
 
  	addr = 0x8850;
-       name =   get_symbol_name(file_ctx, addr, string_table);
-	if(name != MEM_FAIL)
+       name =   get_symbol_name(ctx, addr);
+	if(name != NULL)
 	kprintf("name is %s", name);
 
 
-	addr = get_symbol_addr(file_ctx, "freelistAdd", string_table);
+	addr = get_symbol_addr(ctx, "freelistAdd");
 	if(addr != MEM_FAIL)
 	kprintf("addr is %x ", addr);
 
-	addr =  get_symbol_addr(file_ctx, "vga_get_crtc", string_table);
+	addr =  get_symbol_addr(ctx, "vga_get_crtc");
 	if(addr != MEM_FAIL)
 	kprintf("addr is %x ", addr);
 
-	kfree_track(ELF_LOADER_SITE,string_table);
+	name = search_symbol_name(rip, "kernel");
+	...
+	kfree_track(ELF_LOADER_SITE,name);
 *****************************************************************/
 
 
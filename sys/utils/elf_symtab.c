@@ -0,0 +1,175 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/*
+ * elf_symtab.c -- an index over the symbol table of an elf_ctx, so a symbol
+ * can be looked up without rereading the table from the file. Built the first
+ * time it is needed, from the symtab and strtab load_symtab() read in:
+ *
+ *   - a hash table on the names (open addressing, the SysV ELF hash), and
+ *   - the functions, sorted by address, for a binary search.
+ *
+ * Kept apart from elf_loader.c so it can be tested on the build host; see 
+ * tools/elfsym.
+ */
+
+#include <stdint.h>
+#include <constants.h>
+#include <elf.h>
+#include <elf_loader.h>
+#include <kmalloc.h>
+#include <kstring.h>
+
+#define SYM_EMPTY (-1)
+
+/* The SysV ABI's ELF hash */
+static uint32_t elf_hash(const char *name) {
+  uint32_t h, g;
+
+  for(h = 0; *name; name++) {
+    h = (h << 4) + (uint8_t)*name;
+    if((g = h & 0xf0000000))
+      h ^= g >> 24;
+    h &= ~g;
+  }
+  return h;
+}
+
+#define SYMVAL(ctx, i) ((ctx)->symtab[(ctx)->symaddr[i]].st_value)
+
+/* Heapsort symaddr by address; no recursion, the kernel stack is small */
+static void sift_down(struct elf_ctx *ctx, int root, int n) {
+  int child, tmp;
+
+  while((child = 2 * root + 1) < n) {
+    if(child + 1 < n && SYMVAL(ctx, child + 1) > SYMVAL(ctx, child))
+      child++;
+    if(SYMVAL(ctx, root) >= SYMVAL(ctx, child))
+      return;
+    tmp = ctx->symaddr[root];
+    ctx->symaddr[root] = ctx->symaddr[child];
+    ctx->symaddr[child] = tmp;
+    root = child;
+  }
+}
+
+static void sort_symaddr(struct elf_ctx *ctx) {
+  int i, tmp;
+
+  for(i = ctx->num_symaddr / 2 - 1; i >= 0; i--)
+    sift_down(ctx, i, ctx->num_symaddr);
+  for(i = ctx->num_symaddr - 1; i > 0; i--) {
+    tmp = ctx->symaddr[0];
+    ctx->symaddr[0] = ctx->symaddr[i];
+    ctx->symaddr[i] = tmp;
+    sift_down(ctx, 0, i);
+  }
+}
+
+/* Returns 0 once the index is there. */
+static int elf_index_symtab(struct elf_ctx *ctx) {
+  struct Elf_Sym *sym;
+  char *name;
+  int i, h, mask;
+
+  if(ctx->symhash)
+    return 0;
+  if(!ctx->num_syms || !ctx->strtab_loaded)
+    return 1;
+
+  for(ctx->symhash_size = 16; ctx->symhash_size < 2 * ctx->num_syms; )
+    ctx->symhash_size <<= 1;
+  mask = ctx->symhash_size - 1;
+  ctx->symhash = kmalloc_track(ELF_LOADER_SITE, sizeof(int) * ctx->symhash_size);
+  ctx->symaddr = kmalloc_track(ELF_LOADER_SITE, sizeof(int) * ctx->num_syms);
+  for(i = 0; i < ctx->symhash_size; i++)
+    ctx->symhash[i] = SYM_EMPTY;
+  ctx->num_symaddr = 0;
+
+  for(i = 0, sym = ctx->symtab; i < ctx->num_syms; i++, sym++) {
+    /* defined, named symbols with an address */
+    if(!sym->st_name || sym->st_shndx == SHN_UNDEF || !sym->st_value)
+      continue;
+    if(ELF64_ST_TYPE(sym->st_info) == STT_FUNC)
+      ctx->symaddr[ctx->num_symaddr++] = i;
+
+    /* the first of a name wins, as it did when the file was scanned */
+    name = ELF_SYMNAME(*sym, ctx->strtab);
+    for(h = elf_hash(name) & mask; ctx->symhash[h] != SYM_EMPTY; h = (h + 1) & mask)
+      if(kstreq(ELF_SYMNAME(ctx->symtab[ctx->symhash[h]], ctx->strtab), name))
+	break;
+    if(ctx->symhash[h] == SYM_EMPTY)
+      ctx->symhash[h] = i;
+  }
+
+  sort_symaddr(ctx);
+  return 0;
+}
+
+void elf_free_symindex(struct elf_ctx *ctx) {
+  if(!ctx->symhash)
+    return;
+  kfree_track(ELF_LOADER_SITE, ctx->symhash);
+  kfree_track(ELF_LOADER_SITE, ctx->symaddr);
+  ctx->symhash = NULL;
+  ctx->symaddr = NULL;
+  ctx->symhash_size = 0;
+  ctx->num_symaddr = 0;
+}
+
+struct Elf_Sym *elf_sym_by_name(struct elf_ctx *ctx, const char *name) {
+  int h, mask;
+
+  if(!name || !*name || elf_index_symtab(ctx))
+    return NULL;
+
+  mask = ctx->symhash_size - 1;
+  for(h = elf_hash(name) & mask; ctx->symhash[h] != SYM_EMPTY; h = (h + 1) & mask)
+    if(kstreq(ELF_SYMNAME(ctx->symtab[ctx->symhash[h]], ctx->strtab), name))
+      return &ctx->symtab[ctx->symhash[h]];
+  return NULL;
+}
+
+struct Elf_Sym *elf_sym_by_addr(struct elf_ctx *ctx, uint64_t addr) {
+  struct Elf_Sym *sym;
+  int lo, hi, mid;
+
+  if(elf_index_symtab(ctx) || !ctx->num_symaddr || addr < SYMVAL(ctx, 0))
+    return NULL;
+
+  /* the last function at or below addr */
+  lo = 0;
+  hi = ctx->num_symaddr - 1;
+  while(lo < hi) {
+    mid = lo + (hi - lo + 1) / 2;
+    if(SYMVAL(ctx, mid) <= addr)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  sym = &ctx->symtab[ctx->symaddr[lo]];
+  if(sym->st_size && addr >= sym->st_value + sym->st_size)
+    return NULL;		/* between functions */
+  return sym;
+}
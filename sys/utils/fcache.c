@@ -0,0 +1,141 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/* 
+ * fcache.c -- kernel cache of file lookups on the ramdisk. 
+ *
+ * Looking a file up by name means following the path a directory sector at
+ * a time, and building its link map means following the FAT; both go 
+ * through the single sector window in FatFs, which is reloaded from the 
+ * ramdisk whenever the sector changes. The same handful of programs are 
+ * exec'd over and over, so remember what those lookups found.
+ */
+#include <stdint.h>
+#include <constants.h>
+#include <kstdio.h>
+#include <kstring.h>
+#include <khash.h>
+#include <fatfs.h>
+#include <fcache.h>
+
+static fcache_ent_t fcache[FCACHE_ENTRIES];
+static fcache_ent_t fcache_nocache;	/* Lookups with too long a path */
+static int fcache_used;			/* Entries of fcache[] filled */
+static hashtable_t *fcache_tbl;		/* path -> entry */
+static uint64_t fcache_clock;		/* Ticks once per lookup */
+
+/* Stats */
+static uint64_t fcache_hits, fcache_misses, fcache_evictions;
+
+static int fcache_match(void *ep, const void *keyp) {
+  return kstreq(((fcache_ent_t *)ep)->path, (const char *)keyp);
+}
+
+/* Pick an entry to fill: a free one, else the least recently used. */
+static fcache_ent_t *fcache_victim() {
+  fcache_ent_t *ep;
+  int i;
+
+  if(fcache_used < FCACHE_ENTRIES)
+    return &fcache[fcache_used++];
+
+  ep = &fcache[0];
+  for(i = 1; i < FCACHE_ENTRIES; i++)
+    if(fcache[i].stamp < ep->stamp)
+      ep = &fcache[i];
+
+  hremove(fcache_tbl, fcache_match, ep->path, kstrlen(ep->path));
+  fcache_evictions++;
+  return ep;
+}
+
+/****************************** PUBLIC FUNCTIONS *****************************/
+
+void fcache_init() {
+  fcache_tbl = hopen(FCACHE_ENTRIES);
+  fcache_used = 0;
+  fcache_clock = 0;
+  fcache_hits = fcache_misses = fcache_evictions = 0;
+}
+
+fcache_ent_t *fcache_lookup(char *path, FRESULT *rc) {
+  fcache_ent_t *ep;
+  FIL fd;
+  int len;
+
+  fcache_clock++;
+  len = kstrlen(path);
+  if(len < FCACHE_NAME_SZ) {
+    ep = hsearch(fcache_tbl, fcache_match, path, len);
+    if(ep != NULL) {
+      ep->stamp = fcache_clock;
+      fcache_hits++;
+      *rc = FR_OK;
+      return ep;
+    }
+  }
+  fcache_misses++;
+
+  *rc = f_open(&fd, path, FA_READ);
+  if(*rc != FR_OK)
+    return NULL;
+
+  if(len < FCACHE_NAME_SZ) {
+    ep = fcache_victim();
+    kstrncpy(ep->path, path, FCACHE_NAME_SZ);
+    hput(fcache_tbl, ep, ep->path, len);
+  }
+  else
+    ep = &fcache_nocache;
+
+  ep->sclust = fd.sclust;
+  ep->fsize = fd.fsize;
+  ep->stamp = fcache_clock;
+
+  /* A fragmented file may not fit; it gets its own link map on open */
+  ep->clmt[0] = FCACHE_CLMT_LEN;
+  fd.cltbl = ep->clmt;
+  if(f_lseek(&fd, CREATE_LINKMAP) != FR_OK)
+    ep->clmt[0] = 0;
+
+  f_close(&fd);
+  return ep;
+}
+
+void fcache_flush() {
+  int i;
+
+  for(i = 0; i < fcache_used; i++)
+    hremove(fcache_tbl, fcache_match, fcache[i].path, kstrlen(fcache[i].path));
+  fcache_used = 0;
+}
+
+void fcache_print_stats() {
+  uint64_t lookups;
+
+  lookups = fcache_hits + fcache_misses;
+  kprintf("[fcache] %d lookups, %d hits (%d%%), %d misses, %d evictions, %d/%d entries\n",
+	  (int)lookups, (int)fcache_hits, 
+	  lookups ? (int)((fcache_hits*100)/lookups) : 0,
+	  (int)fcache_misses, (int)fcache_evictions, fcache_used, FCACHE_ENTRIES);
+}
@@ -2061,6 +2061,7 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occurred */
 		return FR_DISK_ERR;
 #endif
 #if !_FS_READONLY
+	stat = disk_status(fs->drv);
 	if (chk_wp && (stat & STA_PROTECT))	/* Check disk write protection if needed */
 		return FR_WRITE_PROTECTED;
 #endif
@@ -2143,12 +2144,13 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occurred */
 	if (fmt == FS_FAT32) {
 	 	fs->fsi_flag = 0;
 		fs->fsi_sector = bsect + LD_WORD(fs->win+BPB_FSInfo);
-	if (ramdisk_read(fs->drv, fs->win, fs->fsi_sector, 1) == RES_OK &
-                                        LD_WORD(fs->win+BS_55AA) == 0xAA55 &
-                                        LD_DWORD(fs->win+FSI_LeadSig) == 0x41615252 &
-                                        LD_DWORD(fs->win+FSI_StrucSig) == 0x61417272) 
-                                                fs->last_clust = LD_DWORD(fs->win+FSI_Nxt_Free)
-                                                fs->free_clust = LD_DWORD(fs->win+FSI_Free_Count)
+		if (ramdisk_read(fs->drv, fs->win, fs->fsi_sector, 1) == RES_OK &&
+			LD_WORD(fs->win+BS_55AA) == 0xAA55 &&
+			LD_DWORD(fs->win+FSI_LeadSig) == 0x41615252 &&
+			LD_DWORD(fs->win+FSI_StrucSig) == 0x61417272) {
+				fs->last_clust = LD_DWORD(fs->win+FSI_Nxt_Free);
+				fs->free_clust = LD_DWORD(fs->win+FSI_Free_Count);
+		}
 	}
 #endif
 	fs->fs_type = fmt;		/* FAT sub-type */
@@ -2409,6 +2411,47 @@ FRESULT f_open (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Open a File by Start Cluster (Bear extension)                         */
+/*-----------------------------------------------------------------------*/
+/* For a file whose directory entry has already been looked up (e.g. held
+ * in a cache by the caller), so the path is not followed again. Read only.
+ */
+FRESULT f_open_clust (
+	FIL *fp,			/* Pointer to the blank file object */
+	DWORD sclust,		/* File start cluster */
+	DWORD fsize			/* File size */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	const TCHAR *path = "";
+
+
+	fp->fs = 0;			/* Clear file object */
+	res = chk_mounted(&path, &fs, 0);
+	if (res == FR_OK) {
+		fp->flag = FA_READ;
+		fp->sclust = sclust;
+		fp->fsize = fsize;
+		fp->fptr = 0;
+		fp->dsect = 0;
+#if !_FS_READONLY
+		fp->dir_sect = 0;					/* No directory entry to update */
+		fp->dir_ptr = 0;
+#endif
+#if _USE_FASTSEEK
+		fp->cltbl = 0;
+#endif
+		fp->fs = fs; fp->id = fs->id;	/* Validate file object */
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Read File                                                             */
 /*-----------------------------------------------------------------------*/
@@ -2994,6 +3037,53 @@ FRESULT f_lseek (
 }
 
 
+#if _USE_FASTSEEK
+/*-----------------------------------------------------------------------*/
+/* Map a File Offset to a Run of Contiguous Sectors (Bear extension)     */
+/*-----------------------------------------------------------------------*/
+/* Needs a cluster link map (see f_lseek/CREATE_LINKMAP). Does not touch the
+ * file pointer, so the caller can use the sectors directly, e.g. straight
+ * out of the ramdisk.
+ */
+FRESULT f_runmap (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD ofs,		/* File offset to be mapped */
+	DWORD *sect,	/* Sector holding the byte at ofs */
+	DWORD *nsect	/* Sectors contiguous on disk from *sect, 0 at EOF */
+)
+{
+	FRESULT res;
+	DWORD cl, ncl, csect, *tbl;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (!fp->cltbl)						/* No link map */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+
+	*nsect = 0;
+	if (ofs >= fp->fsize)				/* Nothing beyond the end of file */
+		LEAVE_FF(fp->fs, FR_OK);
+
+	tbl = fp->cltbl + 1;				/* Top of CLMT */
+	cl = ofs / SS(fp->fs) / fp->fs->csize;	/* Cluster order from top of the file */
+	for (;;) {
+		ncl = *tbl++;					/* Number of cluters in the fragment */
+		if (!ncl) LEAVE_FF(fp->fs, FR_INT_ERR);	/* End of table? (error) */
+		if (cl < ncl) break;			/* In this fragment? */
+		cl -= ncl; tbl++;				/* Next fragment */
+	}
+	csect = ofs / SS(fp->fs) & (fp->fs->csize - 1);	/* Sector offset in the cluster */
+	*sect = clust2sect(fp->fs, *tbl + cl);
+	if (!*sect) LEAVE_FF(fp->fs, FR_INT_ERR);
+	*sect += csect;
+	*nsect = (ncl - cl) * fp->fs->csize - csect;	/* Rest of the fragment */
+
+	LEAVE_FF(fp->fs, FR_OK);
+}
+#endif
+
+
 
 #if _FS_MINIMIZE <= 1
 /*-----------------------------------------------------------------------*/
@@ -3126,7 +3216,7 @@ FRESULT f_getfree (
 
 
 	/* Get drive number */
-	res = chk_mounted(&path, fatfs);
+	res = chk_mounted(&path, fatfs, 0);
 	if (res == FR_OK) {
 		/* If free_clust is valid, return it without full cluster scan */
 		if ((*fatfs)->free_clust <= (*fatfs)->n_fatent - 2) {
@@ -21,6 +21,8 @@
  SOFTWARE.
 */
 
+#include <stdint.h>
+#include <constants.h>		/* NULL */
 #include <ff_const.h>
 #include <disklabel.h>
 #include <kstdio.h>
@@ -29,6 +31,10 @@
 #include <fatfs.h>
 #include <file_abstraction.h>
 #include <kstring.h>
+#include <ramio.h>
+#ifdef KERNEL
+#include <fcache.h>
+#endif
 
 /* -----------------------------------------------------------------------------
  * -------------- Bear Project Filesystem Abstraction Stuff --------------------
@@ -37,10 +43,17 @@
 FATFS fs; /* This is used by Fat FS code */
 static size_t file_offset;
 
+/* Cluster link map entries kept in the context itself; enough for a file in
+ * 15 fragments. More fragmented files get a table from kmalloc.
+ */
+#define FAT_CLMT_LEN 32
+
 struct FAT_ctx {
   FIL fd;
   unsigned int status;
   int return_code;
+  DWORD pos;                          /* File position (fast path) */
+  DWORD clmt[FAT_CLMT_LEN];           /* Cluster link map, see f_lseek */
 };
 
 void fs_error(FRESULT code) {
@@ -49,6 +62,32 @@ void fs_error(FRESULT code) {
 	       "hlt");
 }
 
+/* 
+ * Resolve the file's cluster chain once, up front. Reads can then go 
+ * straight to the ramdisk a contiguous run at a time, rather than a sector 
+ * at a time through the FatFs window following the FAT as they go.
+ */
+static void FAT_linkmap(struct FAT_ctx *ctx) {
+  DWORD *tbl;
+  FRESULT rc;
+
+  ctx->clmt[0] = FAT_CLMT_LEN;
+  ctx->fd.cltbl = ctx->clmt;
+  rc = f_lseek(&(ctx->fd), CREATE_LINKMAP);
+  if(rc == FR_NOT_ENOUGH_CORE) {
+    /* clmt[0] now holds the size the table needs to be */
+    tbl = kmalloc_track(FILE_ABSTRACTION_SITE, ctx->clmt[0]*sizeof(DWORD));
+    tbl[0] = ctx->clmt[0];
+    ctx->fd.cltbl = tbl;
+    rc = f_lseek(&(ctx->fd), CREATE_LINKMAP);
+  }
+  if(rc != FR_OK) {
+    if(ctx->fd.cltbl != ctx->clmt)
+      kfree_track(FILE_ABSTRACTION_SITE, ctx->fd.cltbl);
+    ctx->fd.cltbl = NULL;             /* fall back to f_read */
+  }
+}
+
 /****************************** PUBLIC FUNCTIONS *****************************/
 
 /* Set up the filesystem for use. */
@@ -66,35 +105,173 @@ void FAT_init() {
 
   rc = f_mount_offset(0, &fs, fs_offset);
   if (rc) fs_error(rc);
+
+#ifdef KERNEL
+  fcache_init();
+#endif
+}
+
+/* Byte offset of the filesystem from the start of the ramdisk. */
+uint64_t FAT_offset() {
+  return fs.offset;
+}
+
+/* 
+ * Pick up changes another writer (ramfsd) made to the ramdisk: remount so 
+ * the FAT window is reread, and drop any cached lookups.
+ */
+void FAT_sync() {
+  FRESULT rc;
+
+  rc = f_mount_offset(0, &fs, fs.offset);
+  if (rc) fs_error(rc);
+
+#ifdef KERNEL
+  fcache_flush();
+#endif
 }
 
 
 void *FAT_open(char *filename) {
   struct FAT_ctx *ctx = kmalloc_track(FILE_ABSTRACTION_SITE,sizeof(struct FAT_ctx));
+#ifdef KERNEL
+  fcache_ent_t *ep;
+  FRESULT rc;
+#endif
 
+  ctx->pos = 0;
+  ctx->fd.cltbl = NULL;
+#ifdef KERNEL
+  /* The kernel opens the same few programs over and over */
+  ep = fcache_lookup(filename, &rc);
+  if(ep == NULL) {
+    ctx->return_code = rc;
+    return ctx;
+  }
+  ctx->return_code = f_open_clust(&(ctx->fd), ep->sclust, ep->fsize);
+  if(ctx->return_code == FR_OK && ep->clmt[0] != 0 && 
+     ep->clmt[0] <= FAT_CLMT_LEN) {
+    kmemcpy(ctx->clmt, ep->clmt, ep->clmt[0]*sizeof(DWORD));
+    ctx->fd.cltbl = ctx->clmt;
+    return ctx;
+  }
+#else
   ctx->return_code = f_open(&(ctx->fd), filename, FA_READ);
+#endif
+  if(ctx->return_code == FR_OK)
+    FAT_linkmap(ctx);
   return ctx;
 }
 
+/* 
+ * Check that a file exists and can be opened for reading; the size goes in
+ * *size if it is not NULL. Returns a FatFs result code.
+ */
+int FAT_stat(char *filename, size_t *size) {
+#ifdef KERNEL
+  fcache_ent_t *ep;
+  FRESULT rc;
+
+  ep = fcache_lookup(filename, &rc);
+  if(ep != NULL && size != NULL)
+    *size = ep->fsize;
+  return rc;
+#else
+  FILINFO info;
+  FRESULT rc;
+
+  rc = f_stat(filename, &info);
+  if(rc == FR_OK && (info.fattrib & AM_DIR))
+    rc = FR_NO_FILE;
+  if(rc == FR_OK && size != NULL)
+    *size = info.fsize;
+  return rc;
+#endif
+}
+
 void FAT_close(void *arg) {
   struct FAT_ctx *ctx = (struct FAT_ctx *)arg;
 
+  if(ctx->fd.cltbl != NULL && ctx->fd.cltbl != ctx->clmt)
+    kfree_track(FILE_ABSTRACTION_SITE, ctx->fd.cltbl);
+
   ctx->return_code = f_close(&(ctx->fd));
 
   kfree_track(FILE_ABSTRACTION_SITE,ctx);
 }
 
+/* 
+ * Direct pointer to the file's data at pos, which stays valid as long as the
+ * ramdisk does. *len is set to how many bytes can be read from it before the
+ * file (or its current run of clusters) ends. NULL if the file has no link
+ * map, or pos is at or past the end of file.
+ */
+void *FAT_map(void *arg, uint64_t pos, uint64_t *len) {
+  struct FAT_ctx *ctx = (struct FAT_ctx *)arg;
+  DWORD sect, nsect;
+
+  *len = 0;
+  if(ctx->fd.cltbl == NULL)
+    return NULL;
+  if(f_runmap(&(ctx->fd), pos, &sect, &nsect) != FR_OK || nsect == 0)
+    return NULL;
+
+  *len = nsect*512 - (pos % 512);
+  if(*len > ctx->fd.fsize - pos)
+    *len = ctx->fd.fsize - pos;
+
+  return (uint8_t *)ramdisk_ptr(sect) + (pos % 512);
+}
+
 void FAT_read(void *arg, void *dest, size_t size) {
   struct FAT_ctx *ctx = (struct FAT_ctx *)arg;
-  //printf("Elf FAT Base/memory/dst is %x, size is %x\n", dest, size  );
-  ctx->return_code = f_read(&(ctx->fd), dest, size, &(ctx->status));
-	 
+  uint8_t *src;
+  uint64_t len;
+
+  ctx->status = 0;
+
+  /* No link map -- go through FatFs */
+  if(ctx->fd.cltbl == NULL) {
+    ctx->return_code = f_read(&(ctx->fd), dest, size, &(ctx->status));
+    ctx->pos = ctx->fd.fptr;
+    return;
+  }
+
+  if(ctx->pos >= ctx->fd.fsize)
+    size = 0;
+  else if(size > ctx->fd.fsize - ctx->pos)
+    size = ctx->fd.fsize - ctx->pos;
+
+  /* One copy per contiguous run of clusters */
+  while(size) {
+    src = FAT_map(ctx, ctx->pos, &len);
+    if(src == NULL) {
+      ctx->return_code = FR_INT_ERR;
+      return;
+    }
+    if(len > size)
+      len = size;
+    kmemcpy(dest, src, len);
+    dest = (uint8_t *)dest + len;
+    ctx->pos += len;
+    ctx->status += len;
+    size -= len;
+  }
+  ctx->return_code = FR_OK;
 }
 
 void FAT_seek(void *arg, size_t pos) {
   struct FAT_ctx *ctx = (struct FAT_ctx *)arg;
 
-  ctx->return_code = f_lseek(&(ctx->fd), pos);
+  if(ctx->fd.cltbl == NULL) {
+    ctx->return_code = f_lseek(&(ctx->fd), pos);
+    ctx->pos = ctx->fd.fptr;
+    return;
+  }
+
+  /* Reads do not use the FatFs file pointer, so just remember where we are */
+  ctx->pos = pos > ctx->fd.fsize ? ctx->fd.fsize : pos;
+  ctx->return_code = FR_OK;
 }
 
 int FAT_error_check(void *arg) {
@@ -529,6 +529,7 @@ void interrupt_release_lock(void){
 
 /* Print the exception vector and CR2 if this was a pagefault. */
 void print_exception_info_one(uint64_t vec) {
+  kprintf_panic();
   kprintf("\nEXCEPTION ENCOUNTERED\n");
   kprintf("Vector: 0x%x\n",vec);
 
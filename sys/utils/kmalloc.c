@@ -134,6 +134,8 @@ void print_sites() {
   print_site(PCI_SITE,              "pci.c             ");
   print_site(KHASH_SITE,            "khash.c           ");
   print_site(SEMAPHORE_SITE,        "semaphore.c       ");
+  print_site(VSCHED_SITE,           "vsched.c          ");
+  print_site(KSHM_SITE,             "kshm.c            ");
   print_totals();
 }
 
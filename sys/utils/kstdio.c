@@ -35,6 +35,12 @@
 #include <sbin/vgad.h>
 #endif
 
+#if defined(SERIAL_OUT_SYSTEM) && (defined(KERNEL) || defined(HYPV))
+#define KLOG
+#include <apic.h>		/* this_cpu */
+#include <smp.h>		/* MAX_CORES */
+#endif
+
 #ifndef USER			/* ensure only used in system */
 
 #define STDOUT NULL
@@ -44,13 +50,17 @@
 static int putc(int c, FIL *fp);
 static void do_print(const char *fmt, va_list argp, FIL *stream);
 static void fputs(const char *s, FIL *fp);
+static void klog_publish(void);
 
 int kputchar(int c) {
-  return putc(c,STDOUT);
+  putc(c,STDOUT);
+  klog_publish();
+  return c;
 }
 
 void kputs(const char *s) {
   fputs(s,STDOUT);
+  klog_publish();
   return;
 }
 
@@ -66,6 +76,182 @@ void write_serial(char a) {
 }
 #endif
 
+#ifdef KLOG
+/*
+ * Serial output through per-cpu rings. Waiting on the UART costs about 87us
+ * a character at 115200 baud, so kprintf only copies into the ring of the 
+ * cpu it runs on, and publishes the whole call when it is done. The rings 
+ * are fed to the transmitter, 16 bytes (the FIFO) at a time and only when 
+ * it is empty: by the THRE interrupt and the systick hook in the kernel, on
+ * every vmexit in the hypervisor, and by kprintf on its way out. A cpu is 
+ * the only writer of its ring's head; tails move under klog_draining. We 
+ * wait on the port only when a ring is full, and after kprintf_panic().
+ */
+#define KLOG_SIZE 8192		/* per cpu, a power of two */
+#define UART_FIFO 16
+#define UART_IER  1		/* interrupt enable */
+#define UART_IIR  2		/* interrupt identification (read) */
+#define UART_FCR  2		/* fifo control (write) */
+#define UART_MCR  4		/* modem control */
+#define IER_THRE  0x02		/* interrupt when the transmitter empties */
+#define MCR_OUT2  0x08		/* gates the UART onto its IRQ line */
+
+typedef struct {
+  volatile uint32_t head;	/* published by the owning cpu */
+  volatile uint32_t tail;	/* moved by the drainer */
+  uint32_t pos;			/* end of the kprintf in progress */
+  char data[KLOG_SIZE];
+} Klog_t;
+
+static Klog_t klogs[MAX_CORES];
+static volatile int klog_draining;	/* a cpu is feeding the port */
+static int klog_cur;			/* ring being fed; kept until empty */
+static int klog_percpu;			/* this_cpu() is usable */
+static int klog_intr;			/* the THRE interrupt is ours */
+static int klog_ier;			/* what IER was last set to */
+static volatile int klog_sync;		/* panicking: straight to the port */
+
+/* 
+ * Before kprintf_ring_start only the boot cpu runs. A cpu whose APIC id is
+ * out of range shares ring 0; the kernel and hypervisor locks serialize it.
+ */
+static Klog_t *klog_this(void) {
+  uint32_t cpu;
+
+  cpu = klog_percpu ? this_cpu() : 0;
+  return &klogs[(cpu < MAX_CORES) ? cpu : 0];
+}
+
+static int klog_pending(void) {
+  int i;
+
+  for(i = 0; i < MAX_CORES; i++)
+    if(klogs[i].tail != klogs[i].head)
+      return 1;
+  return 0;
+}
+
+/* Fill the transmit FIFO if it is empty; with wait, spin until it is */
+static void klog_feed(int wait) {
+  Klog_t *l;
+  int i, n, ier;
+
+  if(!__sync_bool_compare_and_swap(&klog_draining, 0, 1))
+    return;
+  if(wait)
+    while(is_transmit_empty() == 0);
+  if(is_transmit_empty()) {
+    for(i = 0, n = 0; i < MAX_CORES && n < UART_FIFO; ) {
+      l = &klogs[klog_cur];
+      if(l->tail == l->head) {
+	klog_cur = (klog_cur + 1) % MAX_CORES;
+	i++;
+	continue;
+      }
+      outb(PORT, l->data[l->tail % KLOG_SIZE]);
+      l->tail++;
+      n++;
+    }
+  }
+  if(klog_intr) {
+    ier = klog_pending() ? IER_THRE : 0;
+    if(ier != klog_ier)
+      outb(PORT + UART_IER, (klog_ier = ier));
+  }
+  __sync_synchronize();
+  klog_draining = 0;
+}
+
+static void klog_putc(char c) {
+  Klog_t *l;
+
+  if(klog_sync) {
+    write_serial(c);
+    return;
+  }
+  l = klog_this();
+  while(l->pos - l->tail >= KLOG_SIZE) {	/* full: wait for the port */
+    __sync_synchronize();
+    l->head = l->pos;
+    klog_feed(1);
+  }
+  l->data[l->pos % KLOG_SIZE] = c;
+  l->pos++;
+}
+
+static void klog_publish(void) {
+  Klog_t *l;
+
+  if(klog_sync)
+    return;
+  l = klog_this();
+  __sync_synchronize();		/* the bytes before head */
+  l->head = l->pos;
+  klog_feed(0);
+}
+
+/* 
+ * Switch to per-cpu rings once this_cpu() works. With intr, the caller 
+ * routes IRQ 4 to kprintf_intr and the THRE interrupt drains the rings.
+ */
+void kprintf_ring_start(int intr) {
+  klog_percpu = 1;
+  if(intr) {
+    outb(PORT + UART_FCR, 0xC7);	/* fifo on and cleared, 14 byte rx */
+    outb(PORT + UART_MCR, inb(PORT + UART_MCR) | MCR_OUT2);
+    klog_intr = 1;
+  }
+  klog_feed(0);
+}
+
+/* Feed the port without waiting -- systick hook and vmexit path */
+void kprintf_drain(void) {
+  if(!klog_sync)
+    klog_feed(0);
+}
+
+/* IRQ 4: reading IIR acknowledges the THRE interrupt */
+void kprintf_intr(unsigned int vec, void *arg) {
+  inb(PORT + UART_IIR);
+  kprintf_drain();
+}
+
+/* Wait until everything published so far is on the wire */
+void kprintf_flush(void) {
+  while(klog_pending())
+    klog_feed(1);
+}
+
+/* 
+ * From here on, output waits on the port. Takes the rings over from a 
+ * drainer that may never come back, and empties them first.
+ */
+void kprintf_panic(void) {
+  Klog_t *l;
+
+  if(klog_sync)
+    return;
+  l = klog_this();
+  l->head = l->pos;		/* whatever this cpu was in the middle of */
+  klog_sync = 1;
+  klog_draining = 0;
+  kprintf_flush();
+}
+#else
+void kprintf_ring_start(int intr) {}
+void kprintf_drain(void) {}
+void kprintf_intr(unsigned int vec, void *arg) {}
+void kprintf_flush(void) {}
+void kprintf_panic(void) {}
+static void klog_publish(void) {}
+#endif	/* KLOG */
+
+#ifdef KLOG
+#define serial_putc(c) klog_putc(c)
+#else
+#define serial_putc(c) write_serial(c)
+#endif
+
 /* Parts of the following functions were adapted from Minix stdio code.
  * See LICENSE.Minix in the top-level Bear directory for the licensing
  * information for those sections.
@@ -76,6 +262,7 @@ void kprintf(const char *fmt, ...) {
   va_start(argp, fmt);
   
   do_print(fmt, argp, STDOUT);
+  klog_publish();
 
   va_end(argp);
 
@@ -88,7 +275,7 @@ static int putc(int c, FIL *fp) {
     if((c) == '\n'){
 #ifdef SERIAL_OUT_SYSTEM
 
-      write_serial(0xA);
+      serial_putc(0xA);
 #endif	/* SERIAL_OUT_SYSTEM */
 #ifdef VGA_OUT_SYSTEM
       vga_newline();
@@ -97,7 +284,7 @@ static int putc(int c, FIL *fp) {
     else if((c) == '\t') {
 #ifdef SERIAL_OUT_SYSTEM
 
-      write_serial(0x9);
+      serial_putc(0x9);
 #endif	/* SERIAL_OUT_SYSTEM */
 #ifdef VGA_OUT_SYSTEM
       vga_tabline();
@@ -106,7 +293,7 @@ static int putc(int c, FIL *fp) {
     else {
 #ifdef SERIAL_OUT_SYSTEM
 
-	write_serial((char)c);
+	serial_putc((char)c);
 
 #endif	/* SERIAL_OUT_SYSTEM */
 #ifdef VGA_OUT_SYSTEM
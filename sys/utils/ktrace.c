@@ -0,0 +1,216 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab;
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/*
+ * ktrace.c -- tracepoint rings, see ktrace.h.
+ *
+ * Compiled into the hypervisor and the kernel. A core is the only writer
+ * of its ring: it clears a record's seq, fills it in, then sets seq to the
+ * record's position + 1 and moves head. The reader copies a record and
+ * keeps it only if seq was the one it expected both before and after, so
+ * a record the writer lapped is counted lost rather than read torn. One
+ * reader at a time.
+ */
+#include <stdint.h>
+#include <constants.h>		/* NULL */
+#include <kstdio.h>
+#include <kstring.h>
+#include <tsc.h>
+#include <apic.h>
+#include <smp.h>
+#include <ktrace.h>
+
+#define barrier() asm volatile("" ::: "memory")
+
+volatile int ktrace_on;
+
+#ifdef KTRACE
+
+#define KTRACE_RING  512		/* records per cpu, a power of two */
+#define KTRACE_DEPTH 8			/* spans open at once on a cpu */
+
+typedef struct {
+  volatile uint64_t head;		/* records written, by the owning cpu */
+  uint64_t tail;			/* next record to read */
+  int depth;				/* open spans */
+  struct {
+    int ev;
+    int pid;
+    uint64_t arg;
+    uint64_t tsc;
+  } open[KTRACE_DEPTH];
+  Ktrace_rec_t recs[KTRACE_RING];
+} Ktrace_ring_t;
+
+static Ktrace_ring_t rings[MAX_CORES];
+static int ktrace_ready;		/* this_cpu() is usable */
+static volatile int ktrace_reading;
+
+#ifdef HYPV
+#define KTRACE_SRC KTRACE_SRC_HYPV
+#else
+#define KTRACE_SRC KTRACE_SRC_KERNEL
+#endif
+
+static Ktrace_ring_t *ktrace_this(uint32_t *cpu) {
+
+  *cpu = ktrace_ready ? this_cpu() : 0;
+  return (*cpu < MAX_CORES) ? &rings[*cpu] : NULL;
+}
+
+static void ktrace_put(Ktrace_ring_t *r, uint32_t cpu, int ev, int pid,
+		       uint64_t arg, uint64_t tsc, uint64_t dur) {
+  Ktrace_rec_t *rec;
+  uint64_t idx;
+
+  idx = r->head;
+  rec = &r->recs[idx & (KTRACE_RING - 1)];
+  rec->seq = 0;
+  barrier();
+  rec->tsc = tsc;
+  rec->arg = arg;
+  rec->dur = (dur > 0xffffffff) ? 0xffffffff : (uint32_t)dur;
+  rec->pid = pid;
+  rec->event = ev;
+  rec->cpu = cpu;
+  rec->src = KTRACE_SRC;
+  barrier();
+  rec->seq = (uint32_t)(idx + 1);
+  r->head = idx + 1;
+}
+
+void ktrace_point(int ev, int pid, uint64_t arg) {
+  Ktrace_ring_t *r;
+  uint32_t cpu;
+
+  if((r = ktrace_this(&cpu)) != NULL)
+    ktrace_put(r, cpu, ev, pid, arg, readtsc(), 0);
+}
+
+/* Spans of an event do not nest: one begun again before it ended (a
+ * system call that never returned to kernel_syscall) is dropped */
+void ktrace_begin(int ev, int pid, uint64_t arg) {
+  Ktrace_ring_t *r;
+  uint32_t cpu;
+  int i;
+
+  if((r = ktrace_this(&cpu)) == NULL)
+    return;
+  for(i = r->depth - 1; i >= 0; i--)
+    if(r->open[i].ev == ev)
+      r->depth = i;
+  if(r->depth == KTRACE_DEPTH)
+    return;
+  r->open[r->depth].ev = ev;
+  r->open[r->depth].pid = pid;
+  r->open[r->depth].arg = arg;
+  r->open[r->depth].tsc = readtsc();
+  r->depth++;
+}
+
+/* Closes the innermost open span of ev, and any left open inside it. An
+ * END without its BEGIN (tracing was off) records nothing */
+void ktrace_end(int ev) {
+  Ktrace_ring_t *r;
+  uint32_t cpu;
+  uint64_t now;
+  int i;
+
+  if((r = ktrace_this(&cpu)) == NULL)
+    return;
+  now = readtsc();
+  for(i = r->depth - 1; i >= 0; i--)
+    if(r->open[i].ev == ev) {
+      r->depth = i;
+      ktrace_put(r, cpu, ev, r->open[i].pid, r->open[i].arg,
+		 r->open[i].tsc, now - r->open[i].tsc);
+      return;
+    }
+}
+
+void ktrace_init() {
+
+  ktrace_ready = 1;
+}
+
+int ktrace_enable(int on) {
+  int i, was;
+
+  was = ktrace_on;
+  if(on && !was)
+    for(i = 0; i < MAX_CORES; i++)
+      rings[i].depth = 0;		/* spans begun before are gone */
+  ktrace_on = on;
+  return was ? 1 : 0;
+}
+
+int ktrace_read(Ktrace_rec_t *recs, int max, uint64_t *lost) {
+  Ktrace_ring_t *r;
+  Ktrace_rec_t *rec;
+  uint64_t head;
+  uint32_t seq;
+  int i, n;
+
+  if(__sync_lock_test_and_set(&ktrace_reading, 1))
+    return 0;
+  for(i = 0, n = 0; i < MAX_CORES && n < max; i++) {
+    r = &rings[i];
+    head = r->head;
+    if(head - r->tail > KTRACE_RING) {
+      *lost += head - r->tail - KTRACE_RING;
+      r->tail = head - KTRACE_RING;
+    }
+    for(; r->tail != head && n < max; r->tail++) {
+      rec = &r->recs[r->tail & (KTRACE_RING - 1)];
+      seq = rec->seq;
+      barrier();
+      kmemcpy(&recs[n], rec, sizeof(Ktrace_rec_t));
+      barrier();
+      if(seq != (uint32_t)(r->tail + 1) || rec->seq != seq)
+	(*lost)++;
+      else
+	n++;
+    }
+  }
+  __sync_lock_release(&ktrace_reading);
+  return n;
+}
+
+#else
+
+void ktrace_point(int ev, int pid, uint64_t arg) { }
+void ktrace_begin(int ev, int pid, uint64_t arg) { }
+void ktrace_end(int ev) { }
+void ktrace_init() { }
+
+int ktrace_enable(int on) {
+
+  return -1;
+}
+
+int ktrace_read(Ktrace_rec_t *recs, int max, uint64_t *lost) {
+
+  return -1;
+}
+
+#endif	/* KTRACE */
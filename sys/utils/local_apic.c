@@ -187,37 +187,6 @@ uint32_t this_cpu(void){
   return x;
 }
 
-void delay(int n){
-  int i;
-  for(i = 0; i < n*100; i++)
-    asm volatile("nop");
-
-  return;
-}
-
-
-/*Intel startup algorithm */
-void lapic_start_aps(uint8_t apicid, uint32_t addr){
-
-#ifdef DEBUG
-  kprintf("[APIC] starting apicid = %x at addr = %x\n",apicid,addr);
-#endif
-  lapic_write(APIC_ICRH, apicid<<24);
-  lapic_write(APIC_ICRL, APIC_INIT );
-  delay(200);   
-
-  lapic_write(APIC_ICRH, apicid<<24);
-  lapic_write(APIC_ICRL, APIC_STARTUP | (addr>>12));
-
-  delay(200);
-  lapic_write(APIC_ICRH, apicid<<24);
-  lapic_write(APIC_ICRL, APIC_STARTUP | (addr>>12));
-	
-  delay(100);
-
-  return;
-}
-
 void send_ipi(uint8_t apicid, uint32_t int_vector){
 
   //  kprintf("entered send_ipi on core %d w dest core %d and vector %d\n", 
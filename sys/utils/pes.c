@@ -91,7 +91,6 @@ void pes_free_save(char *s) {
   vmem_free( (uint64_t*)s, PAGE_SIZE);
   vkdirty( vk_heap, (uint64_t*)s, 1);
   vkfreedirty( vk_heap );
-  flush_tlb(0);
 }
 
 void pes_refresh_save(char *s) {
@@ -0,0 +1,230 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/*
+ * ramfs.c -- read/write FatFs over a ramdisk mapped into user space.
+ *
+ * This is the disk layer ff.c expects (ramdisk_read, disk_write,
+ * disk_status, disk_ioctl) plus a small handle based file interface
+ * for ramfsd. The library is built with _FS_READONLY=0; the kernel,
+ * hypervisor and boot loaders keep their read-only copy of ff.c.
+ */
+#include <stdint.h>
+#include <constants.h>		/* NULL */
+#include <fatfs.h>
+#include <ramio.h>
+#include <sbin/ramfs.h>
+
+/* newlib provides it; sys/include has no string.h */
+void *memcpy(void *dst, const void *src, unsigned long n);
+
+#define SECTOR 512
+#define INUSE  0x100		/* above the RAMFS_ open flags */
+
+static FATFS ramfs;
+static FIL files[RAMFS_MAXOPEN];
+static int fflags[RAMFS_MAXOPEN];	/* open flags|INUSE, 0 when free */
+static uint8_t *disk;			/* the mapped ramdisk */
+static uint64_t disksize;
+
+/* ---------------------------- disk layer ---------------------------- */
+
+DRESULT ramdisk_read(BYTE drive, BYTE *read_buf, DWORD LBA, BYTE count) {
+  if(((uint64_t)LBA + count) * SECTOR > disksize)
+    return RES_PARERR;
+  memcpy(read_buf, disk + (uint64_t)LBA * SECTOR, (unsigned long)count * SECTOR);
+  return RES_OK;
+}
+
+DRESULT disk_write(BYTE drive, const BYTE *buf, DWORD LBA, BYTE count) {
+  if(((uint64_t)LBA + count) * SECTOR > disksize)
+    return RES_PARERR;
+  memcpy(disk + (uint64_t)LBA * SECTOR, buf, (unsigned long)count * SECTOR);
+  return RES_OK;
+}
+
+DSTATUS disk_status(BYTE drive) {
+  return disk ? 0 : STA_NOINIT;
+}
+
+DRESULT disk_ioctl(unsigned char drive, unsigned char command, void *buffer) {
+  switch(command) {
+  case CTRL_SYNC:		/* writes go straight to the ramdisk */
+    return RES_OK;
+  case GET_SECTOR_COUNT:
+    *(DWORD *)buffer = disksize / SECTOR;
+    return RES_OK;
+  case GET_SECTOR_SIZE:
+    *(WORD *)buffer = SECTOR;
+    return RES_OK;
+  case GET_BLOCK_SIZE:
+    *(DWORD *)buffer = 1;
+    return RES_OK;
+  }
+  return RES_PARERR;
+}
+
+/* ------------------------------ files ------------------------------- */
+
+static FIL *handle(int h) {
+  if(h < 0 || h >= RAMFS_MAXOPEN || !fflags[h])
+    return NULL;
+  return &files[h];
+}
+
+int ramfs_mount(void *base, uint64_t size, uint64_t fs_offset) {
+  disk = (uint8_t *)base;
+  disksize = size;
+  return -(int)f_mount_offset(0, &ramfs, fs_offset);
+}
+
+int ramfs_open(const char *path, int flags) {
+  FIL *fp;
+  FRESULT rc;
+  BYTE mode;
+  int h;
+
+  for(h = 0; h < RAMFS_MAXOPEN && fflags[h]; h++)
+    ;
+  if(h == RAMFS_MAXOPEN)
+    return RAMFS_ERR_TOO_MANY_OPEN;
+  fp = &files[h];
+
+  mode = FA_OPEN_EXISTING;
+  if(flags & RAMFS_READ)
+    mode |= FA_READ;
+  if(flags & RAMFS_WRITE)
+    mode |= FA_WRITE;
+  if(flags & RAMFS_CREATE) {
+    if(flags & RAMFS_EXCL)
+      mode |= FA_CREATE_NEW;
+    else if(flags & RAMFS_TRUNC)
+      mode |= FA_CREATE_ALWAYS;
+    else
+      mode |= FA_OPEN_ALWAYS;
+  }
+
+  rc = f_open(fp, path, mode);
+  if(rc == FR_OK && (flags & (RAMFS_TRUNC|RAMFS_CREATE)) == RAMFS_TRUNC)
+    rc = f_truncate(fp);	/* fptr is 0 so this empties the file */
+  if(rc != FR_OK)
+    return -(int)rc;
+
+  fflags[h] = flags | INUSE;
+  return h;
+}
+
+int ramfs_close(int h) {
+  FIL *fp;
+  FRESULT rc;
+
+  if((fp = handle(h)) == NULL)
+    return RAMFS_ERR_INVALID;
+  rc = f_close(fp);
+  fflags[h] = 0;
+  return -(int)rc;
+}
+
+int64_t ramfs_read(int h, void *buf, uint64_t len) {
+  FIL *fp;
+  FRESULT rc;
+  UINT n;
+
+  if((fp = handle(h)) == NULL)
+    return RAMFS_ERR_INVALID;
+  rc = f_read(fp, buf, (UINT)len, &n);
+  if(rc != FR_OK)
+    return -(int64_t)rc;
+  return n;
+}
+
+int64_t ramfs_write(int h, const void *buf, uint64_t len) {
+  FIL *fp;
+  FRESULT rc;
+  UINT n;
+
+  if((fp = handle(h)) == NULL)
+    return RAMFS_ERR_INVALID;
+  if(fflags[h] & RAMFS_APPEND)
+    if((rc = f_lseek(fp, fp->fsize)) != FR_OK)
+      return -(int64_t)rc;
+  rc = f_write(fp, buf, (UINT)len, &n);
+  if(rc != FR_OK)
+    return -(int64_t)rc;
+  return n;
+}
+
+/* Seeking past the end of a file opened for writing extends it. */
+int64_t ramfs_seek(int h, int64_t offset, int whence) {
+  FIL *fp;
+  FRESULT rc;
+  int64_t pos;
+
+  if((fp = handle(h)) == NULL)
+    return RAMFS_ERR_INVALID;
+  switch(whence) {
+  case RAMFS_SEEK_SET:
+    pos = offset;
+    break;
+  case RAMFS_SEEK_CUR:
+    pos = (int64_t)fp->fptr + offset;
+    break;
+  case RAMFS_SEEK_END:
+    pos = (int64_t)fp->fsize + offset;
+    break;
+  default:
+    return RAMFS_ERR_INVALID;
+  }
+  if(pos < 0 || pos > 0xFFFFFFFFLL)
+    return RAMFS_ERR_INVALID;
+  if((rc = f_lseek(fp, (DWORD)pos)) != FR_OK)
+    return -(int64_t)rc;
+  return fp->fptr;
+}
+
+int ramfs_stat(const char *path, uint64_t *size, int *isdir) {
+  FILINFO fi;
+  FRESULT rc;
+
+  rc = f_stat(path, &fi);
+  if(rc != FR_OK)
+    return -(int)rc;
+  if(size)
+    *size = fi.fsize;
+  if(isdir)
+    *isdir = (fi.fattrib & AM_DIR) != 0;
+  return 0;
+}
+
+int ramfs_fstat(int h, uint64_t *size) {
+  FIL *fp;
+
+  if((fp = handle(h)) == NULL)
+    return RAMFS_ERR_INVALID;
+  *size = fp->fsize;
+  return 0;
+}
+
+int ramfs_unlink(const char *path) {
+  return -(int)f_unlink(path);
+}
@@ -27,15 +27,15 @@
 
 DRESULT ramdisk_read(BYTE drive, BYTE *read_buf, DWORD LBA, BYTE count) {
   /* Read from the ramdisk */
-  uint64_t ramdisk_offset =  0x200000;
-
-  LBA *= 512;
-
-  kmemcpy( read_buf, (void *)(ramdisk_offset + LBA), count * 512 );
+  kmemcpy( read_buf, ramdisk_ptr(LBA), count * 512 );
 
   return RES_OK;
 }
 
+void *ramdisk_ptr(DWORD LBA) {
+  return (void *)(RAMDISK_MAP + (uint64_t)LBA * 512);
+}
+
 DSTATUS disk_status(BYTE a) {
   return 0;
 }
@@ -30,6 +30,9 @@
 #include <kqueue.h>
 #include <kmalloc.h>
 #include <constants.h>
+#ifdef KERNEL
+#include <ktlb.h>
+#endif
 
 
 /* need to use xchg operation when spinning on locks as xchg is atomic
@@ -49,7 +52,11 @@ static uint64_t exchange(volatile uint64_t *sem_addr, uint64_t value)
 /*lock the semaphore*/
 void acquire_lock(volatile semaphore_t *sem) {
 
-  while(exchange(&sem->s_counter, 1) != 0);
+  while(exchange(&sem->s_counter, 1) != 0) {
+#ifdef KERNEL
+    ktlb_shootdown();		/* the holder may be waiting on us */
+#endif
+  }
 
   sem->owner = this_cpu();
 
@@ -24,7 +24,16 @@
 #include <sha256.h>
 #include <kstring.h>
 
-uint k[64] = {
+/*
+ * The compression function has three engines: the plain C one, the SHA
+ * extensions (sha256_ni.S), and four messages at once in the lanes of the
+ * SSE registers (sha256_multi). The best one the cpu has is picked the first
+ * time a hash is started. AVX2 would give eight lanes, but Bear never turns on
+ * XSAVE and saves only the SSE state on a switch, so the lanes stay 128 bits.
+ */
+
+/* sha256_ni.S loads these with movdqa */
+uint k[64] __attribute__((aligned(16))) = {
    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
    0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
    0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
@@ -35,50 +44,179 @@ uint k[64] = {
    0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
 };
 
+/* cpuid bits the SHA extensions need */
+#define CPUID1_ECX_SSSE3  (1 << 9)
+#define CPUID1_ECX_SSE41  (1 << 19)
+#define CPUID7_EBX_SHA    (1 << 29)
+
+void sha256_ni_blocks(uint state[], uchar data[], unsigned long nblocks);
+
+static int sha256_engine = -1;
+static void (*sha256_blocks)(uint state[], uchar data[], unsigned long nblocks);
+
+/* 4 lanes of 32 bits; the macros in sha256.h work on these too */
+typedef uint sha256_x4_t __attribute__((vector_size(16)));
+
+#define BE32(p) (((uint)(p)[0] << 24) | ((uint)(p)[1] << 16) | \
+		 ((uint)(p)[2] << 8) | (uint)(p)[3])
+
 
-void sha256_transform(SHA256_CTX *ctx, uchar data[])
+static void sha256_sw_blocks(uint state[], uchar data[], unsigned long nblocks)
 {  
    uint a,b,c,d,e,f,g,h,i,j,t1,t2,m[64];
-      
-   for (i=0,j=0; i < 16; ++i, j += 4)
-      m[i] = (data[j] << 24) | (data[j+1] << 16) | (data[j+2] << 8) | (data[j+3]);
-   for ( ; i < 64; ++i)
-      m[i] = SIG1(m[i-2]) + m[i-7] + SIG0(m[i-15]) + m[i-16];
-
-   a = ctx->state[0];
-   b = ctx->state[1];
-   c = ctx->state[2];
-   d = ctx->state[3];
-   e = ctx->state[4];
-   f = ctx->state[5];
-   g = ctx->state[6];
-   h = ctx->state[7];
-   
-   for (i = 0; i < 64; ++i) {
-      t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
-      t2 = EP0(a) + MAJ(a,b,c);
-      h = g;
-      g = f;
-      f = e;
-      e = d + t1;
-      d = c;
-      c = b;
-      b = a;
-      a = t1 + t2;
+
+   for ( ; nblocks; nblocks--, data += 64) {
+      for (i=0,j=0; i < 16; ++i, j += 4)
+         m[i] = BE32(data + j);
+      for ( ; i < 64; ++i)
+         m[i] = SIG1(m[i-2]) + m[i-7] + SIG0(m[i-15]) + m[i-16];
+
+      a = state[0];
+      b = state[1];
+      c = state[2];
+      d = state[3];
+      e = state[4];
+      f = state[5];
+      g = state[6];
+      h = state[7];
+
+      for (i = 0; i < 64; ++i) {
+         t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
+         t2 = EP0(a) + MAJ(a,b,c);
+         h = g;
+         g = f;
+         f = e;
+         e = d + t1;
+         d = c;
+         c = b;
+         b = a;
+         a = t1 + t2;
+      }
+
+      state[0] += a;
+      state[1] += b;
+      state[2] += c;
+      state[3] += d;
+      state[4] += e;
+      state[5] += f;
+      state[6] += g;
+      state[7] += h;
    }
-   
-   ctx->state[0] += a;
-   ctx->state[1] += b;
-   ctx->state[2] += c;
-   ctx->state[3] += d;
-   ctx->state[4] += e;
-   ctx->state[5] += f;
-   ctx->state[6] += g;
-   ctx->state[7] += h;
 }  
 
+/* The plain C rounds on four messages at once, nblocks from each. */
+static void sha256_x4_blocks(SHA256_CTX *ctx[], uchar *data[], unsigned long nblocks)
+{
+   sha256_x4_t a,b,c,d,e,f,g,h,t1,t2,m[16],s[8];
+   uint i,j,l;
+
+   for (i = 0; i < 8; ++i)
+      s[i] = (sha256_x4_t){ ctx[0]->state[i], ctx[1]->state[i], 
+                            ctx[2]->state[i], ctx[3]->state[i] };
+
+   for ( ; nblocks; nblocks--) {
+      for (i = 0; i < 16; ++i)
+         m[i] = (sha256_x4_t){ BE32(data[0] + 4*i), BE32(data[1] + 4*i),
+                               BE32(data[2] + 4*i), BE32(data[3] + 4*i) };
+      for (l = 0; l < 4; ++l)
+         data[l] += 64;
+
+      a = s[0];
+      b = s[1];
+      c = s[2];
+      d = s[3];
+      e = s[4];
+      f = s[5];
+      g = s[6];
+      h = s[7];
+
+      /* the schedule is kept 16 words deep, in place */
+      for (i = 0; i < 64; ++i) {
+         j = i & 15;
+         if (i >= 16)
+            m[j] += SIG1(m[(i-2) & 15]) + m[(i-7) & 15] + SIG0(m[(i-15) & 15]);
+         t1 = h + EP1(e) + CH(e,f,g) + (sha256_x4_t){ k[i], k[i], k[i], k[i] } + m[j];
+         t2 = EP0(a) + MAJ(a,b,c);
+         h = g;
+         g = f;
+         f = e;
+         e = d + t1;
+         d = c;
+         c = b;
+         b = a;
+         a = t1 + t2;
+      }
+
+      s[0] += a;
+      s[1] += b;
+      s[2] += c;
+      s[3] += d;
+      s[4] += e;
+      s[5] += f;
+      s[6] += g;
+      s[7] += h;
+   }
+
+   for (i = 0; i < 8; ++i)
+      for (l = 0; l < 4; ++l)
+         ctx[l]->state[i] = s[i][l];
+}
+
+static void sha256_cpuid(uint leaf, uint *eax, uint *ebx, uint *ecx)
+{
+   uint edx;
+
+   *eax = leaf;
+   *ecx = 0;
+   asm volatile("cpuid" : "+a"(*eax), "=b"(*ebx), "+c"(*ecx), "=d"(edx));
+}
+
+int sha256_select(int engine)
+{
+   uint eax, ebx, ecx, max;
+   int ni;
+
+   sha256_cpuid(0, &max, &ebx, &ecx);
+   sha256_cpuid(1, &eax, &ebx, &ecx);
+   ni = 0;
+   if (max >= 7 && (ecx & CPUID1_ECX_SSSE3) && (ecx & CPUID1_ECX_SSE41)) {
+      sha256_cpuid(7, &eax, &ebx, &ecx);
+      ni = (ebx & CPUID7_EBX_SHA) ? 1 : 0;
+   }
+
+   if (engine == SHA256_BEST)
+      engine = ni ? SHA256_NI : SHA256_SW;
+   if (engine == SHA256_NI && !ni)
+      engine = SHA256_SW;
+
+   sha256_blocks = (engine == SHA256_NI) ? sha256_ni_blocks : sha256_sw_blocks;
+   sha256_engine = engine;
+   return engine;
+}
+
+const char *sha256_engine_name(void)
+{
+   if (sha256_engine < 0)
+      sha256_select(SHA256_BEST);
+   return sha256_engine == SHA256_NI ? "sha-ni" : "sw";
+}
+
+/* The message length, in bits, as two 32-bit halves */
+static void sha256_addbits(SHA256_CTX *ctx, unsigned long bits)
+{
+   unsigned long total;
+
+   total = ((unsigned long)ctx->bitlen[1] << 32) | ctx->bitlen[0];
+   total += bits;
+   ctx->bitlen[0] = (uint)total;
+   ctx->bitlen[1] = (uint)(total >> 32);
+}
+
 void sha256_init(SHA256_CTX *ctx)
 {  
+   if (sha256_engine < 0)
+      sha256_select(SHA256_BEST);
+
    ctx->datalen = 0; 
    ctx->bitlen[0] = 0; 
    ctx->bitlen[1] = 0; 
@@ -94,17 +232,34 @@ void sha256_init(SHA256_CTX *ctx)
 
 void sha256_update(SHA256_CTX *ctx, uchar data[], uint len)
 {  
-   uint i;
-   
-   for (i=0; i < len; ++i) { 
-      ctx->data[ctx->datalen] = data[i]; 
-      ctx->datalen++; 
-      if (ctx->datalen == 64) { 
-         sha256_transform(ctx,ctx->data);
-         DBL_INT_ADD(ctx->bitlen[0],ctx->bitlen[1],512); 
-         ctx->datalen = 0; 
-      }  
-   }  
+   uint n;
+
+   /* top up a partial block first */
+   if (ctx->datalen) {
+      n = 64 - ctx->datalen;
+      if (n > len)
+         n = len;
+      kmemcpy(ctx->data + ctx->datalen, data, n);
+      ctx->datalen += n;
+      data += n;
+      len -= n;
+      if (ctx->datalen < 64)
+         return;
+      sha256_blocks(ctx->state, ctx->data, 1);
+      sha256_addbits(ctx, 512);
+      ctx->datalen = 0;
+   }
+
+   /* whole blocks straight from the caller's buffer */
+   if ((n = len / 64)) {
+      sha256_blocks(ctx->state, data, n);
+      sha256_addbits(ctx, (unsigned long)n * 512);
+      data += n * 64;
+      len -= n * 64;
+   }
+
+   kmemcpy(ctx->data, data, len);
+   ctx->datalen = len;
 }  
 
 void sha256_final(SHA256_CTX *ctx, uchar hash[])
@@ -123,12 +278,12 @@ void sha256_final(SHA256_CTX *ctx, uchar hash[])
       ctx->data[i++] = 0x80; 
       while (i < 64) 
          ctx->data[i++] = 0x00; 
-      sha256_transform(ctx,ctx->data);
+      sha256_blocks(ctx->state,ctx->data,1);
       kmemset(ctx->data,0,56); 
    }  
    
    // Append to the padding the total message's length in bits and transform. 
-   DBL_INT_ADD(ctx->bitlen[0],ctx->bitlen[1],ctx->datalen * 8);
+   sha256_addbits(ctx, ctx->datalen * 8);
    ctx->data[63] = ctx->bitlen[0]; 
    ctx->data[62] = ctx->bitlen[0] >> 8; 
    ctx->data[61] = ctx->bitlen[0] >> 16; 
@@ -137,7 +292,7 @@ void sha256_final(SHA256_CTX *ctx, uchar hash[])
    ctx->data[58] = ctx->bitlen[1] >> 8; 
    ctx->data[57] = ctx->bitlen[1] >> 16;  
    ctx->data[56] = ctx->bitlen[1] >> 24; 
-   sha256_transform(ctx,ctx->data);
+   sha256_blocks(ctx->state,ctx->data,1);
    
    // Since this implementation uses little endian byte ordering and SHA uses big endian,
    // reverse all the bytes when copying the final state to the output hash. 
@@ -152,3 +307,42 @@ void sha256_final(SHA256_CTX *ctx, uchar hash[])
       hash[i+28] = (ctx->state[7] >> (24-i*8)) & 0x000000ff;
    }  
 }  
+
+void sha256_multi(uchar *data[], uint len[], int n, uchar hash[][32])
+{
+   SHA256_CTX ctx[4], *lane[4];
+   uchar *p[4];
+   uint blocks;
+   int i, l;
+
+   if (sha256_engine < 0)
+      sha256_select(SHA256_BEST);
+
+   for (i = 0; i < n; ) {
+      /* the last few, or with the SHA extensions, go one at a time */
+      if (n - i < 4 || sha256_engine == SHA256_NI) {
+         sha256_init(&ctx[0]);
+         sha256_update(&ctx[0], data[i], len[i]);
+         sha256_final(&ctx[0], hash[i]);
+         i++;
+         continue;
+      }
+
+      /* the blocks all four have run in lockstep, then each its own tail */
+      blocks = len[i] / 64;
+      for (l = 0; l < 4; ++l) {
+         sha256_init(&ctx[l]);
+         lane[l] = &ctx[l];
+         p[l] = data[i+l];
+         if (len[i+l] / 64 < blocks)
+            blocks = len[i+l] / 64;
+      }
+      sha256_x4_blocks(lane, p, blocks);
+      for (l = 0; l < 4; ++l) {
+         sha256_addbits(&ctx[l], (unsigned long)blocks * 512);
+         sha256_update(&ctx[l], p[l], len[i+l] - blocks * 64);
+         sha256_final(&ctx[l], hash[i+l]);
+      }
+      i += 4;
+   }
+}
@@ -31,35 +31,75 @@
 #include <acpi.h>
 #include <kqueue.h>
 #include <kstring.h>
+#include <tsc.h>
+
+/*
+ * The application processors are started together: the INIT goes to all of 
+ * them, then one wait, then the two SIPIs to all of them. Each comes up on
+ * its own stacks -- a small one in low memory (AP_BOOT_STACK) through the 
+ * trampoline and the loader, then the one smp_boot_aps allocated for it -- 
+ * so they run their GDT, IDT and local APIC setup side by side, and the BSP
+ * only waits for the count at the end. The IPIs are sent to each APIC by id
+ * rather than with the all-excluding-self shorthand, which would also wake
+ * cores the MADT lists as disabled, or beyond MAX_CORES; and the hypervisor
+ * joins guest cores by the id of the SIPI.
+ */
+
+/* waits of the Intel MP startup algorithm, microseconds */
+#define AP_INIT_WAIT  10000
+#define AP_SIPI_WAIT  200
+/* give up on a core that has not checked in after this long */
+#define AP_BOOT_TIMEOUT 1000000
 
 static volatile uint32_t num_ap_cpus;
+static uint8_t *ap_stacks[MAX_CORES];
+static semaphore_t ap_init_lock;
 extern uint64_t* kstack;
 
 void set_running() {
-  num_ap_cpus++;
+  __sync_fetch_and_add(&num_ap_cpus, 1);
+}
+
+uint8_t *smp_ap_stack() {
+  return ap_stacks[this_cpu()];
+}
+
+/* The heap is not per cpu, so the APs take turns at the parts of their
+   setup that allocate. */
+void smp_ap_lock() {
+  acquire_lock(&ap_init_lock);
+}
+
+void smp_ap_unlock() {
+  release_lock(&ap_init_lock);
+}
+
+/* Send an ICR command to each id, waiting for each to be taken */
+static void ap_ipi(uint8_t *ids, int n, uint32_t cmd) {
+  int i;
+
+  for(i = 0; i < n; i++) {
+    lapic_write(APIC_ICRH, ids[i] << 24);
+    lapic_write(APIC_ICRL, cmd);
+    while(lapic_read(APIC_ICRL) & APIC_DELIVS);
+  }
 }
 
 /**TODO redo for new memory system*/
 #define checkstatus(x) if(x) fs_error(x)
 void smp_boot_aps(void)
 {
-  /*kernel programming is fun, if you can tell me why this is important I'll 
-    give you a dollar -Rob*/
-  /* Answer I need this value not to change on the BSP core. When other cores 
-     run this value can change. */
-
-  /* the other cores update num_ap_cpus, which advances the do while loop in 
-     this function*/
-
   uint32_t tramp_size, fstatus;
-  static volatile uint32_t i; 
   FIL ctx;
   uint64_t *boot_code_ptr;
   FILINFO stat;
   void* Qvalptr;
   struct APICLocalAPICEntry *apic;
+  uint8_t ids[MAX_CORES];
+  uint64_t start, hz;
+  int n;
 
-  boot_code_ptr = (uint64_t*)(0x6000);
+  boot_code_ptr = (uint64_t*)(AP_TRAMPOLINE);
   num_ap_cpus = 0;
   fstatus = 0;	
 
@@ -91,37 +131,49 @@ void smp_boot_aps(void)
 	
 #ifdef DEBUG_SMP
   kprintf("[SMP] tramp closed\n");
-#endif
-
-  i = 0;
-#ifdef DEBUG_SMP
   kprintf("[SMP] boot strap cpu APICID = %x\n",this_cpu());
 #endif
+
+  /* every core's stack before any of them starts */
+  n = 0;
   while( (Qvalptr = qget(CPUQueue)) ) {
     apic = (struct APICLocalAPICEntry*)Qvalptr;
     if (apic->APICID == this_cpu() || apic->APICID == 0)
       continue;
+    /* the stacks, the vcpus and the low stacks are by APIC id */
+    if (apic->APICID >= MAX_CORES)
+      continue;
 
-    temp_stack = new_stack(NULL); 
-		
-    kmemset(temp_stack-KSTACK_PAGES*PAGE_SIZE,
-	    0,sizeof(KSTACK_PAGES*PAGE_SIZE));
+    if (!ap_stacks[apic->APICID])
+      ap_stacks[apic->APICID] = new_stack(NULL); 
+    ids[n++] = apic->APICID;
 
 #ifdef DEBUG_SMP
     kprintf("[SMP] start core with APICID %d\n",apic->APICID);
 #endif
-
-    /* i <= (maximum number of cores wanted - 1) */
-    if ( i <= (MAX_CORES - 1) ) {
-      lapic_start_aps(apic->APICID, 0x6000);
-      while(num_ap_cpus == i);
-      i = num_ap_cpus;
-    }
   }
 
-
-#ifdef DEBUG_SMP
-  kprintf("[SMP] %d cores online\n", (i+1));
+  start = readtsc();
+  ap_ipi(ids, n, APIC_INIT);
+#ifndef KERNEL
+  /* In a guest the hypervisor joins a core on its SIPI; there is no INIT
+     to wait out. */
+  tsc_udelay(AP_INIT_WAIT);
 #endif
+  ap_ipi(ids, n, APIC_STARTUP | (AP_TRAMPOLINE >> 12));
+#ifndef KERNEL
+  tsc_udelay(AP_SIPI_WAIT);
+#endif
+  ap_ipi(ids, n, APIC_STARTUP | (AP_TRAMPOLINE >> 12));
+
+  hz = get_tsc_freq();
+  while(num_ap_cpus < n &&
+	(!hz || readtsc() - start < hz / 1000000 * AP_BOOT_TIMEOUT))
+    asm volatile("pause");
+
+  kprintf("[SMP] %d of %d cores online", num_ap_cpus + 1, n + 1);
+  if(hz)
+    kprintf(" in %d us", (int)((readtsc() - start) / (hz / 1000000)));
+  kprintf("\n");
   return;
 }
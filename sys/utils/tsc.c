@@ -114,3 +114,21 @@ uint64_t get_tsc_freq(){
 #endif
   return tsc_freq; 
 }
+
+/* Cycles per microsecond to assume when the frequency can't be read: a 
+   4GHz cpu, so the wait is never shorter than asked */
+#define TSC_UDELAY_DEFAULT 4000
+
+/* Spin for us microseconds */
+void tsc_udelay(uint64_t us) {
+  static uint64_t per_us;
+  uint64_t start;
+
+  start = readtsc();
+  if(!per_us)
+    per_us = get_tsc_freq() / 1000000;
+  if(!per_us)
+    per_us = TSC_UDELAY_DEFAULT;
+  while(readtsc() - start < us * per_us)
+    asm volatile("pause");
+}
@@ -37,6 +37,10 @@
 #include <khash.h>
 #include <kqueue.h>
 #include <vk.h>
+#include <ktrace.h>
+#ifdef KERNEL
+#include <ktlb.h>
+#endif
 
 /* 
  * we need to have these static variables because boot2 does not have a .bss
@@ -63,6 +67,15 @@ uint64_t get_free_frame(void);
 /* implementation of vmem_free */
 void vmem_free_imp(uint64_t* base, uint64_t length, int free);
 
+/* A pte changed: the kernel tells the other cores too (ktlb.c) */
+static void vmem_flush_page(uint64_t vaddr, int global) {
+#ifdef KERNEL
+  ktlb_flush_page(NULL, vaddr, global);
+#else
+  __invlpg(vaddr);
+#endif
+}
+
 /* Internal structure for the allocated queue, for keeping track of
  * allocated chunks. */
 struct allocated_chunk {
@@ -453,6 +466,7 @@ void frame_array_init(void) {
       else 
         framearray[framearray_idx].free = 0x0;
 
+      framearray[framearray_idx].refs = 0x0;
       framearray[framearray_idx++].type = chunk->type;
     }
 
@@ -470,6 +484,7 @@ void frame_array_init(void) {
     for ( j = 0; j < hole_length; j++ ) {
 
       framearray[framearray_idx].free = 0x0; /* no hole is free (TWSS) */
+      framearray[framearray_idx].refs = 0x0;
       framearray[framearray_idx++].type = 0x06; /* TODO: Fix the chunk types enum situation */
     }
   } /* end the loop iterating over chunks to populate framearray */
@@ -581,6 +596,7 @@ void vmem_alloc( uint64_t* base, uint64_t length, uint64_t flags ) {
   int pd_idx;
   int pt_idx;
 
+  KTRACE_BEGIN(KT_VMEM_ALLOC, -1, length);
   vaddr_init(base, flags);
 
   /** figure out where in the tables we will store the array based on the 
@@ -663,6 +679,7 @@ void vmem_alloc( uint64_t* base, uint64_t length, uint64_t flags ) {
     pt_idx++;
   }  //for loop on framearray_pages
 
+  KTRACE_END(KT_VMEM_ALLOC);
   return;
 }
 
@@ -674,18 +691,27 @@ void vmem_alloc( uint64_t* base, uint64_t length, uint64_t flags ) {
 void set_page_permission(uint64_t vaddr, uint64_t length, uint64_t flags) {
 
   uint64_t end;
+  int global;
 
   end = vaddr + length;
 
   /* round vaddr down to the page boundary. */
   vaddr -= vaddr % PAGE_SIZE;
 
+#ifdef KERNEL
+  ktlb_batch_begin();
+#endif
   for ( ; vaddr <= end; vaddr += PAGE_SIZE ) {
+    global = VADDR2PTE(vaddr)->global || (flags & PG_GLOBAL);
     VADDR2PTE(vaddr)->rw     = ( flags & PG_RW )     ? 1 : 0;
     VADDR2PTE(vaddr)->nx     = ( flags & PG_NX )     ? 1 : 0;
     VADDR2PTE(vaddr)->us     = ( flags & PG_USER )   ? 1 : 0;
     VADDR2PTE(vaddr)->global = ( flags & PG_GLOBAL ) ? 1 : 0;
+    vmem_flush_page(vaddr, global);
   }
+#ifdef KERNEL
+  ktlb_batch_end();
+#endif
 
   return;
 }
@@ -727,6 +753,7 @@ void vmem_free_imp(uint64_t* base, uint64_t length, int free) {
   uint64_t paddr, pte_vaddr;
   
   int inc_pdpt_idx, inc_pml4t_idx;
+  int freed_tables, global, global_seen;
   int pml4t_idx;
   int pdpt_idx;
   int pd_idx;
@@ -737,6 +764,11 @@ void vmem_free_imp(uint64_t* base, uint64_t length, int free) {
   pd_idx = virt2pd(base);
   pt_idx = virt2pt(base);
 
+#ifdef KERNEL
+  ktlb_batch_begin();
+#endif
+  global_seen = 0;
+
   /** first loop - free frames but not the paging structs */
   while ( (uint64_t)idx2vaddr(pml4t_idx,pdpt_idx,pd_idx,pt_idx) < ((uint64_t)base+length) ) {
 
@@ -772,16 +804,19 @@ void vmem_free_imp(uint64_t* base, uint64_t length, int free) {
     /** detach the frame from actual pte */
     pte_vaddr = (uint64_t)PTE2vaddr(pml4t_idx,pdpt_idx,pd_idx,pt_idx);
     if ( PTE_is_present(pml4t_idx, pdpt_idx, pd_idx, pt_idx) ) {
+      global = ((union page*)pte_vaddr)->global;
+      global_seen |= global;
       if ( free ) {
 	kmemset(idx2vaddr(pml4t_idx,pdpt_idx,pd_idx,pt_idx), 0, PAGE_SIZE);
 	paddr = TABLE2ADDR(((union page*)pte_vaddr)->addr);
 
 	framearray[paddr/PAGE_SIZE].vaddr = 0x0;
 	framearray[paddr/PAGE_SIZE].free  = 0x1;
-	framearray[paddr/PAGE_SIZE].proc  = 0x0;
+	framearray[paddr/PAGE_SIZE].refs  = 0x0;
 
       }
       *(uint64_t*)pte_vaddr = 0x0;
+      vmem_flush_page((uint64_t)idx2vaddr(pml4t_idx,pdpt_idx,pd_idx,pt_idx), global);
     }
     
     pt_idx++;
@@ -792,6 +827,7 @@ void vmem_free_imp(uint64_t* base, uint64_t length, int free) {
   pd_idx = virt2pd(base);
 
   /* second loop - free structures if necessary */
+  freed_tables = 0;
   while ( 1 ) {
 
     if ( (uint64_t)idx2vaddr(pml4t_idx,pdpt_idx,pd_idx,0) >= (uint64_t)base + length )
@@ -809,10 +845,11 @@ void vmem_free_imp(uint64_t* base, uint64_t length, int free) {
     if ( j == 512 && PDE_is_present(pml4t_idx, pdpt_idx, pd_idx) ){
       kmemset(PTE2vaddr(pml4t_idx, pdpt_idx, pd_idx, 0), 0, PAGE_SIZE);
       paddr = TABLE2ADDR(((union pt_entry*)PDE2vaddr(pml4t_idx, pdpt_idx, pd_idx))->addr);
+      freed_tables = 1;
 
       framearray[paddr/PAGE_SIZE].vaddr = 0x0;
       framearray[paddr/PAGE_SIZE].free  = 0x1;
-      framearray[paddr/PAGE_SIZE].proc  = 0x0;
+      framearray[paddr/PAGE_SIZE].refs  = 0x0;
 
       *(uint64_t*)PDE2vaddr(pml4t_idx, pdpt_idx, pd_idx) = 0x0;
     }
@@ -832,10 +869,11 @@ void vmem_free_imp(uint64_t* base, uint64_t length, int free) {
     if ( j == 512 && PDPTE_is_present(pml4t_idx, pdpt_idx) ) {
       kmemset(PDE2vaddr(pml4t_idx, pdpt_idx, 0), 0, PAGE_SIZE);
       paddr = TABLE2ADDR(((union pt_entry*)PDPTE2vaddr(pml4t_idx, pdpt_idx))->addr);
+      freed_tables = 1;
 
       framearray[paddr/PAGE_SIZE].vaddr = 0x0;
       framearray[paddr/PAGE_SIZE].free  = 0x1;
-      framearray[paddr/PAGE_SIZE].proc  = 0x0;
+      framearray[paddr/PAGE_SIZE].refs  = 0x0;
 
       *(uint64_t*)PDPTE2vaddr(pml4t_idx, pdpt_idx) = 0x0;
       
@@ -851,10 +889,11 @@ void vmem_free_imp(uint64_t* base, uint64_t length, int free) {
     if ( j == 512 && PML4TE_is_present(pml4t_idx) ) {
       kmemset(PDPTE2vaddr(pml4t_idx, 0), 0, PAGE_SIZE);
       paddr = TABLE2ADDR(((union pt_entry*)PML4TE2vaddr(pml4t_idx))->addr);
+      freed_tables = 1;
 
       framearray[paddr/PAGE_SIZE].vaddr = 0x0;
       framearray[paddr/PAGE_SIZE].free  = 0x1;
-      framearray[paddr/PAGE_SIZE].proc  = 0x0;
+      framearray[paddr/PAGE_SIZE].refs  = 0x0;
 
       *(uint64_t*)PML4TE2vaddr(pml4t_idx) = 0x0;
 
@@ -873,6 +912,17 @@ void vmem_free_imp(uint64_t* base, uint64_t length, int free) {
 
   }
 
+  /* an invlpg drops the paging-structure caches whole; the tables under
+     global pages are the kernel's, which every address space shares */
+#ifdef KERNEL
+  if ( freed_tables )
+    ktlb_flush_all(NULL, global_seen);
+  ktlb_batch_end();
+#else
+  if ( freed_tables )
+    __invlpg((uint64_t)base);
+#endif
+
   /* TODO: fix this annoying bug that we cant find ): */
   save_frame_array_idx = 0;
   
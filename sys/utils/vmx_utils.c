@@ -334,6 +334,9 @@ void init_vmcs_defaults() {
 #ifdef DEBUG
   kprintf("[Hypv] VMX secondary exe process controls support %x \n", msr>>32);
 #endif
+  /* Optional: lets the guest flush one pcid's entries (ktlb.c) */
+  if((msr >> 32) & (1 << PROC_SEC_ENABLE_INVPCID))
+    vmcs_default.SECONDARY_VM_EXEC_CONTROL |= (1 << PROC_SEC_ENABLE_INVPCID);
   if(((msr >> 32) & vmcs_default.SECONDARY_VM_EXEC_CONTROL) ^
      vmcs_default.SECONDARY_VM_EXEC_CONTROL)
     goto error;
@@ -0,0 +1,163 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * chksumbench.c -- checks and times the Internet checksum kernels in 
+ * usr/src/liblwip/core/ipv4/chksum_wide.c on the build host:
+ *
+ *     make && ./chksumbench [bytes] [rounds]
+ *
+ * Every length up to 2KB, at every alignment, is checked against the 
+ * 16-bit loop lwIP used before (LWIP_CHKSUM_ALGORITHM 2). Then each kernel
+ * sums the same buffer for a number of rounds and the rate is reported in
+ * bytes per TSC cycle.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sbin/lwip/chksum_wide.h>
+
+#define MAXLEN 2048
+
+static uint8_t src[MAXLEN + 64], dst[MAXLEN + 64];
+
+static inline uint64_t readtsc() {
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return (uint64_t)(lo) | ((uint64_t)(hi) << 32);
+}
+
+/* lwIP's LWIP_CHKSUM_ALGORITHM 2 */
+static uint16_t chksum_ref(void *dataptr, int len) {
+  uint8_t *pb = (uint8_t *)dataptr;
+  uint16_t *ps, t = 0;
+  uint32_t sum = 0;
+  int odd = ((uintptr_t)pb & 1);
+
+  if (odd && len > 0) {
+    ((uint8_t *)&t)[1] = *pb++;
+    len--;
+  }
+  ps = (uint16_t *)(void *)pb;
+  while (len > 1) {
+    sum += *ps++;
+    len -= 2;
+  }
+  if (len > 0)
+    ((uint8_t *)&t)[0] = *(uint8_t *)ps;
+  sum += t;
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  if (odd)
+    sum = ((sum & 0xff) << 8) | ((sum & 0xff00) >> 8);
+  return (uint16_t)sum;
+}
+
+/* what lwip_chksum_copy did: copy, then sum the copy */
+static uint16_t chksum_ref_copy(void *d, const void *s, int len) {
+  memcpy(d, s, len);
+  return chksum_ref(d, len);
+}
+
+static int check(void) {
+  int len, off, doff, bad = 0;
+  uint16_t want, got;
+
+  for (len = 0; len <= MAXLEN; len++)
+    for (off = 0; off < 8; off++) {
+      want = chksum_ref(src + off, len);
+      got = chksum_wide(src + off, len);
+      if (got != want && bad++ < 10)
+	printf("chksum_wide: len %d off %d: 0x%04x, want 0x%04x\n", 
+	       len, off, got, want);
+      doff = 7 - off;
+      memset(dst, 0, sizeof(dst));
+      got = chksum_wide_copy(dst + doff, src + off, len);
+      if ((got != want || memcmp(dst + doff, src + off, len) != 0) && 
+	  bad++ < 10)
+	printf("chksum_wide_copy: len %d off %d: 0x%04x, want 0x%04x\n", 
+	       len, off, got, want);
+    }
+  return bad;
+}
+
+static void timesum(char *name, uint16_t (*fn)(void *, int), int len, 
+		    int rounds) {
+  uint64_t start, cycles;
+  volatile uint16_t sink;
+  int i;
+
+  start = readtsc();
+  for (i = 0; i < rounds; i++)
+    sink = fn(src, len);
+  cycles = readtsc() - start;
+  (void)sink;
+  printf("%-18s %6.2f bytes/cycle\n", name, 
+	 (double)len * rounds / (double)cycles);
+}
+
+static void timecopy(char *name, uint16_t (*fn)(void *, const void *, int),
+		     int len, int rounds) {
+  uint64_t start, cycles;
+  volatile uint16_t sink;
+  int i;
+
+  start = readtsc();
+  for (i = 0; i < rounds; i++)
+    sink = fn(dst, src, len);
+  cycles = readtsc() - start;
+  (void)sink;
+  printf("%-18s %6.2f bytes/cycle\n", name, 
+	 (double)len * rounds / (double)cycles);
+}
+
+static uint16_t wide(void *p, int len) {
+  return chksum_wide(p, len);
+}
+
+int main(int argc, char *argv[]) {
+  int i, len, rounds, bad;
+
+  len = (argc > 1) ? atoi(argv[1]) : 1460;
+  rounds = (argc > 2) ? atoi(argv[2]) : 200000;
+  if (len <= 0 || len > MAXLEN || rounds <= 0) {
+    printf("Usage: chksumbench [bytes <= %d] [rounds]\n", MAXLEN);
+    return EXIT_FAILURE;
+  }
+
+  srand(1);
+  for (i = 0; i < (int)sizeof(src); i++)
+    src[i] = rand();
+
+  bad = check();
+  printf("[chksumbench: %s]\n", bad ? "MISMATCH" : "kernels agree");
+  if (bad)
+    return EXIT_FAILURE;
+
+  printf("%d bytes, %d rounds\n", len, rounds);
+  timesum("16-bit loop", chksum_ref, len, rounds);
+  timesum("64-bit adc", wide, len, rounds);
+  timecopy("memcpy + 16-bit", chksum_ref_copy, len, rounds);
+  timecopy("fused copy", chksum_wide_copy, len, rounds);
+  return EXIT_SUCCESS;
+}
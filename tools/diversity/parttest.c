@@ -0,0 +1,289 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * parttest.c -- checks the free-space tree of sys/utils/diversity.c on the
+ * build host:
+ *
+ *     make && ./parttest
+ *
+ * First it places units of random size and alignment, the way diversify()
+ * does, splitting the partition each time, and after every split checks 
+ * the tree: in order by start and not overlapping, balanced, with the 
+ * right heights, free bytes and longest partition, and as many nodes as 
+ * it claims. Then it picks many times in a fixed tree and checks that 
+ * every slot the unit fits in comes up as often as the others: once with
+ * the free space in a few large partitions, where a random byte is found,
+ * and once with most of it in pieces too small, where the slots are 
+ * counted.
+ *
+ * Only Bear's headers are used; the few libc calls are declared here.
+ */
+#include <stdint.h>
+#include <constants.h>
+#include <diversity.h>
+
+int printf(const char *, ...);
+void *malloc(unsigned long);
+void free(void *);
+void abort(void);
+#define EXIT_SUCCESS 0
+#define EXIT_FAILURE 1
+
+/* What the partition code needs of the kernel */
+void *kmalloc(int bytes) { 
+  return malloc(bytes); 
+}
+
+int kfree(void *p) { 
+  free(p); 
+  return 0; 
+}
+
+void *kmemset(void *p, int c, size_t n) {
+  return __builtin_memset(p, c, n);
+}
+
+void kputs(const char *s) {
+  printf("%s\n", s);
+}
+
+void kprintf(const char *fmt, ...) {
+}
+
+void panic() {
+  printf("[parttest: panic]\n");
+  abort();
+}
+
+/* xorshift, so a run can be repeated */
+static uint64_t seed = 88172645463325252ULL;
+
+uint64_t random_between(uint64_t low, uint64_t high) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return (seed % (high - low)) + low;
+}
+
+#define SPLITS   3000
+#define DRAWS    200000
+#define MAXSLOTS 512
+
+static int bad;
+
+#define fail(...) do { if(bad++ < 10) printf(__VA_ARGS__); } while(0)
+
+/* no libm */
+static double root(double x) {
+  double r;
+  int i;
+
+  for(i = 0, r = x > 1 ? x : 1; i < 64; i++)
+    r = (r + x / r) / 2;
+  return r;
+}
+
+static uint64_t slots(partition_t *p, uint64_t need, uint64_t align) {
+  uint64_t len = p->end - p->start;
+
+  return len > need ? (len - need) / align : 0;
+}
+
+/* 
+ * Check the subtree at p, whose partitions all lie in [lo, hi). Returns 
+ * its height; *n counts the nodes and *last is the end of the rightmost.
+ */
+static int check_tree(partition_t *p, uint64_t lo, uint64_t hi, 
+		      uint64_t *n, uint64_t *last) {
+  int hl, hr;
+  uint64_t bytes, max;
+
+  if(!p)
+    return 0;
+  hl = check_tree(p->left, lo, p->start, n, last);
+  if(p->start < *last || p->end < p->start || p->start < lo || p->end > hi)
+    fail("partition 0x%lx -> 0x%lx out of order\n", p->start, p->end);
+  *last = p->end;
+  (*n)++;
+  hr = check_tree(p->right, p->end, hi, n, last);
+
+  if(hl - hr > 1 || hr - hl > 1)
+    fail("partition 0x%lx: unbalanced, %d and %d\n", p->start, hl, hr);
+  if(p->height != (hl > hr ? hl : hr) + 1)
+    fail("partition 0x%lx: height %d, not %d\n", p->start, p->height, 
+	 (hl > hr ? hl : hr) + 1);
+  bytes = p->end - p->start;
+  max = bytes;
+  if(p->left) {
+    bytes += p->left->bytes;
+    max = p->left->max > max ? p->left->max : max;
+  }
+  if(p->right) {
+    bytes += p->right->bytes;
+    max = p->right->max > max ? p->right->max : max;
+  }
+  if(p->bytes != bytes || p->max != max)
+    fail("partition 0x%lx: %lu bytes, max %lu; not %lu, %lu\n", p->start,
+	 p->bytes, p->max, bytes, max);
+  return (hl > hr ? hl : hr) + 1;
+}
+
+static void check(partitions_t *parts, char *when) {
+  uint64_t n, last;
+  int was;
+
+  n = last = 0;
+  was = bad;
+  check_tree(parts->root, 0, ~0UL, &n, &last);
+  if(n != parts->n)
+    fail("%lu partitions, not %lu\n", n, parts->n);
+  if(bad != was)
+    printf("  (%s)\n", when);
+}
+
+/* Place units until SPLITS have gone in or nothing fits */
+static void splits() {
+  partitions_t *parts;
+  partition_t *part;
+  uint64_t size, align, addr;
+  int i, placed;
+
+  parts = malloc(sizeof(partitions_t));
+  __builtin_memset(parts, 0, sizeof(partitions_t));
+  add_to_partitions(parts, 0x100000000UL, 0x40000000UL);
+  add_to_partitions(parts, 0x800000000UL, 0x10000000UL);
+  add_to_partitions(parts, 0x10000000UL, 0x8000000UL);
+  add_to_partitions(parts, 0x10000000UL, 0x9000000UL);	/* grows the last */
+  check(parts, "after adding");
+
+  for(i = 0, placed = 0; i < SPLITS && !bad; i++) {
+    size = random_between(1, 64) * PAGE_SIZE;
+    align = PAGE_SIZE << random_between(0, 6);
+    addr = pick_random_place(parts, size, align, &part);
+    if(!part)
+      break;
+    if(addr < part->start || addr + size > part->end || 
+       (addr - part->start) % align)
+      fail("0x%lx bytes at 0x%lx do not fit 0x%lx -> 0x%lx\n", size, addr,
+	   part->start, part->end);
+    split_partition(parts, part, addr, addr + size);
+    check(parts, "after a split");
+    placed++;
+  }
+  printf("[parttest: %d units placed, %lu partitions, tree %s]\n", placed, 
+	 parts->n, bad ? "BROKEN" : "sound");
+  free_partitions(parts);
+}
+
+/* 
+ * Pick DRAWS times in parts and check the hits per slot. The count in 
+ * each is binomial; allow five standard deviations.
+ */
+static void uniform(partitions_t *parts, uint64_t size, uint64_t align, 
+		    char *what) {
+  static partition_t *where[MAXSLOTS];
+  static uint64_t at[MAXSLOTS], hits[MAXSLOTS];
+  partition_t *part;
+  uint64_t addr, k;
+  double mean, dev, worst;
+  int i, j, n, was;
+
+  was = bad;
+  /* the slots, in order */
+  for(i = 0, n = 0; i < MAXSLOTS; i++)
+    hits[i] = 0;
+  for(part = NULL, addr = 0; ; ) {
+    /* the next partition after addr: walk from the root */
+    partition_t *p, *next;
+
+    for(p = parts->root, next = NULL; p; )
+      if(p->start >= addr) {
+	next = p;
+	p = p->left;
+      }
+      else
+	p = p->right;
+    if(!next)
+      break;
+    for(k = 0; k < slots(next, size + align, align) && n < MAXSLOTS; k++) {
+      where[n] = next;
+      at[n++] = next->start + k * align;
+    }
+    addr = next->start + 1;
+  }
+
+  for(i = 0; i < DRAWS; i++) {
+    addr = pick_random_place(parts, size, align, &part);
+    for(j = 0; j < n && (where[j] != part || at[j] != addr); j++)
+      ;
+    if(j == n) {
+      fail("picked 0x%lx, not a slot\n", addr);
+      break;
+    }
+    hits[j]++;
+  }
+
+  mean = (double)DRAWS / n;
+  dev = root(mean * (1 - 1.0 / n));
+  for(j = 0, worst = 0; j < n; j++) {
+    double d = ((double)hits[j] - mean) / dev;
+
+    if(d < 0)
+      d = -d;
+    if(d > worst)
+      worst = d;
+  }
+  if(worst > 5)
+    fail("slot hits off by %.1f standard deviations\n", worst);
+  printf("[parttest: %s: %d slots, worst %.1f deviations, %s]\n", what, n,
+	 worst, bad != was ? "NOT UNIFORM" : "uniform");
+}
+
+int main(int argc, char *argv[]) {
+  partitions_t *parts;
+  uint64_t a;
+  int i;
+
+  splits();
+
+  /* a few partitions, of different lengths */
+  parts = malloc(sizeof(partitions_t));
+  __builtin_memset(parts, 0, sizeof(partitions_t));
+  add_to_partitions(parts, 0x100000, 40 * PAGE_SIZE);
+  add_to_partitions(parts, 0x400000, 7 * PAGE_SIZE);
+  add_to_partitions(parts, 0x800000, 100 * PAGE_SIZE);
+  uniform(parts, 3 * PAGE_SIZE, PAGE_SIZE, "large partitions");
+  free_partitions(parts);
+
+  /* the same slots, but most of the space in pieces too small for them */
+  parts = malloc(sizeof(partitions_t));
+  __builtin_memset(parts, 0, sizeof(partitions_t));
+  add_to_partitions(parts, 0x100000, 12 * PAGE_SIZE);
+  add_to_partitions(parts, 0x400000, 9 * PAGE_SIZE);
+  for(i = 0, a = 0x1000000; i < 2000; i++, a += 8 * PAGE_SIZE)
+    add_to_partitions(parts, a, 3 * PAGE_SIZE);
+  uniform(parts, 3 * PAGE_SIZE, 2 * PAGE_SIZE, "small partitions");
+  free_partitions(parts);
+
+  return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * elfsymtest.c -- checks and times the symbol index in 
+ * sys/utils/elf_symtab.c on the build host, over real Bear binaries:
+ *
+ *     make && ./elfsymtest build/bin/kernel build/bin/hypv ...
+ *
+ * Each name is looked up and checked against a scan of the table in file
+ * order, as get_symbol_addr() used to do it; each function is looked up by
+ * its first and last byte and a gap after it, and checked against a scan 
+ * for the closest function below. Then both ways are timed; the scans run
+ * in memory, where the old code also read each symbol through FatFs.
+ *
+ * Only Bear's headers are used, so the elf_ctx is the one the kernel sees;
+ * the few libc calls are declared here.
+ */
+#include <stdint.h>
+#include <constants.h>
+#include <elf.h>
+#include <elf_loader.h>
+
+typedef struct FILE FILE;
+FILE *fopen(const char *, const char *);
+unsigned long fread(void *, unsigned long, unsigned long, FILE *);
+int fseek(FILE *, long, int);
+int fclose(FILE *);
+int printf(const char *, ...);
+void *malloc(unsigned long);
+void free(void *);
+int strcmp(const char *, const char *);
+#define SEEK_SET 0
+#define EXIT_SUCCESS 0
+#define EXIT_FAILURE 1
+
+/* What elf_symtab.c needs of the kernel */
+void *kmalloc(int bytes) { 
+  return malloc(bytes); 
+}
+
+int kfree(void *p) { 
+  free(p); 
+  return 0; 
+}
+
+int kstreq(const char *s1, const char *s2) { 
+  return strcmp(s1, s2) == 0; 
+}
+
+static inline uint64_t readtsc() {
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return (uint64_t)(lo) | ((uint64_t)(hi) << 32);
+}
+
+static int readat(FILE *f, long off, void *buf, unsigned long len) {
+  return fseek(f, off, SEEK_SET) == 0 && fread(buf, 1, len, f) == len;
+}
+
+/* Fill in what load_symtab() would have: symtab, strtab, num_syms */
+static int load(char *path, struct elf_ctx *ctx) {
+  struct Elf_Ehdr eh;
+  struct Elf_Shdr *sh;
+  FILE *f;
+  int i, ok;
+
+  if((f = fopen(path, "rb")) == NULL || !readat(f, 0, &eh, sizeof(eh)))
+    return 0;
+  sh = malloc(sizeof(struct Elf_Shdr) * eh.e_shnum);
+  ok = readat(f, eh.e_shoff, sh, sizeof(struct Elf_Shdr) * eh.e_shnum);
+  for(i = 0; ok && i < eh.e_shnum; i++) {
+    if(sh[i].sh_type != SHT_SYMTAB)
+      continue;
+    ctx->symtab = malloc(sh[i].sh_size);
+    ctx->num_syms = sh[i].sh_size / sizeof(struct Elf_Sym);
+    ctx->strtab = malloc(sh[sh[i].sh_link].sh_size);
+    ctx->strtab_loaded = 1;
+    ok = readat(f, sh[i].sh_offset, ctx->symtab, sh[i].sh_size) &&
+      readat(f, sh[sh[i].sh_link].sh_offset, ctx->strtab, sh[sh[i].sh_link].sh_size);
+    break;
+  }
+  free(sh);
+  fclose(f);
+  return ok && ctx->num_syms;
+}
+
+static int indexed(struct Elf_Sym *s) {
+  return s->st_name && s->st_shndx != SHN_UNDEF && s->st_value;
+}
+
+static int function(struct Elf_Sym *s) {
+  return indexed(s) && ELF64_ST_TYPE(s->st_info) == STT_FUNC;
+}
+
+/* The old way: the first symbol of that name, in file order */
+static struct Elf_Sym *scan_name(struct elf_ctx *ctx, char *name) {
+  int i;
+
+  for(i = 0; i < ctx->num_syms; i++)
+    if(indexed(&ctx->symtab[i]) && 
+       kstreq(ELF_SYMNAME(ctx->symtab[i], ctx->strtab), name))
+      return &ctx->symtab[i];
+  return NULL;
+}
+
+/* The closest function at or below addr, and whether addr is inside it */
+static struct Elf_Sym *scan_addr(struct elf_ctx *ctx, uint64_t addr) {
+  struct Elf_Sym *s, *best;
+  int i;
+
+  for(i = 0, best = NULL; i < ctx->num_syms; i++) {
+    s = &ctx->symtab[i];
+    if(function(s) && s->st_value <= addr && 
+       (best == NULL || s->st_value >= best->st_value))
+      best = s;
+  }
+  if(best && best->st_size && addr >= best->st_value + best->st_size)
+    return NULL;
+  return best;
+}
+
+/* Same answer: both NULL, or symbols at the same address */
+static int same(struct Elf_Sym *a, struct Elf_Sym *b) {
+  return a == b || (a && b && a->st_value == b->st_value);
+}
+
+static int check(struct elf_ctx *ctx) {
+  struct Elf_Sym *s;
+  uint64_t probe[3];
+  int i, j, bad;
+
+  for(i = 0, bad = 0; i < ctx->num_syms; i++) {
+    s = &ctx->symtab[i];
+    if(!indexed(s))
+      continue;
+    if(elf_sym_by_name(ctx, ELF_SYMNAME(*s, ctx->strtab)) != 
+       scan_name(ctx, ELF_SYMNAME(*s, ctx->strtab)) && bad++ < 10)
+      printf("by name: %s\n", ELF_SYMNAME(*s, ctx->strtab));
+    if(!function(s))
+      continue;
+    probe[0] = s->st_value;
+    probe[1] = s->st_value + (s->st_size ? s->st_size - 1 : 0);
+    probe[2] = s->st_value + s->st_size;
+    for(j = 0; j < 3; j++)
+      if(!same(elf_sym_by_addr(ctx, probe[j]), scan_addr(ctx, probe[j])) && 
+	 bad++ < 10)
+	printf("by address: 0x%lx (%s)\n", probe[j], ELF_SYMNAME(*s, ctx->strtab));
+  }
+  if(elf_sym_by_name(ctx, "no such symbol, surely") != NULL && bad++ < 10)
+    printf("by name: found a missing symbol\n");
+  if(elf_sym_by_addr(ctx, 0) != NULL && bad++ < 10)
+    printf("by address: found 0\n");
+  return bad;
+}
+
+/* Cycles per lookup of every name, and of every function's address */
+static void timeit(struct elf_ctx *ctx) {
+  uint64_t start, scan, index;
+  struct Elf_Sym * volatile sink;
+  int i, n;
+
+  for(i = 0, n = 0; i < ctx->num_syms; i++)
+    n += indexed(&ctx->symtab[i]);
+  start = readtsc();
+  for(i = 0; i < ctx->num_syms; i++)
+    if(indexed(&ctx->symtab[i]))
+      sink = scan_name(ctx, ELF_SYMNAME(ctx->symtab[i], ctx->strtab));
+  scan = readtsc() - start;
+  start = readtsc();
+  for(i = 0; i < ctx->num_syms; i++)
+    if(indexed(&ctx->symtab[i]))
+      sink = elf_sym_by_name(ctx, ELF_SYMNAME(ctx->symtab[i], ctx->strtab));
+  index = readtsc() - start;
+  printf("  by name:    %8lu cycles scanning, %6lu indexed\n", 
+	 scan / n, index / n);
+
+  for(i = 0, n = 0; i < ctx->num_syms; i++)
+    n += function(&ctx->symtab[i]);
+  start = readtsc();
+  for(i = 0; i < ctx->num_syms; i++)
+    if(function(&ctx->symtab[i]))
+      sink = scan_addr(ctx, ctx->symtab[i].st_value + 1);
+  scan = readtsc() - start;
+  start = readtsc();
+  for(i = 0; i < ctx->num_syms; i++)
+    if(function(&ctx->symtab[i]))
+      sink = elf_sym_by_addr(ctx, ctx->symtab[i].st_value + 1);
+  index = readtsc() - start;
+  (void)sink;
+  printf("  by address: %8lu cycles scanning, %6lu indexed\n", 
+	 n ? scan / n : 0, n ? index / n : 0);
+}
+
+int main(int argc, char *argv[]) {
+  struct elf_ctx ctx;
+  uint64_t start;
+  int i, bad, total;
+
+  if(argc < 2) {
+    printf("Usage: elfsymtest <bear ELF binary>...\n");
+    return EXIT_FAILURE;
+  }
+
+  for(i = 1, total = 0; i < argc; i++) {
+    __builtin_memset(&ctx, 0, sizeof(ctx));
+    if(!load(argv[i], &ctx)) {
+      printf("%s: no symbol table\n", argv[i]);
+      total++;
+      continue;
+    }
+    start = readtsc();
+    elf_sym_by_name(&ctx, "main");	/* builds the index */
+    printf("%s: %d symbols, %d functions, indexed in %lu cycles\n", argv[i],
+	   ctx.num_syms, ctx.num_symaddr, readtsc() - start);
+    bad = check(&ctx);
+    printf("[elfsymtest: %s]\n", bad ? "MISMATCH" : "index agrees with scan");
+    if(!bad)
+      timeit(&ctx);
+    total += bad;
+    elf_free_symindex(&ctx);
+    free(ctx.symtab);
+    free(ctx.strtab);
+  }
+  return total ? EXIT_FAILURE : EXIT_SUCCESS;
+}
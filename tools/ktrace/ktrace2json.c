@@ -0,0 +1,166 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab;
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * ktrace2json.c -- turns a trace dump from the trace program into Chrome
+ * trace JSON, for chrome://tracing or Perfetto:
+ *
+ *     make && ./ktrace2json dump > trace.json
+ *     ./ktrace2json serial.log > trace.json
+ *
+ * The dump is either the file "trace dump file" writes, or a serial log
+ * with the "ktrace:" lines of "trace dump". The kernel and the hypervisor
+ * show as two processes, with a thread for each cpu. Times are in
+ * microseconds from the first record; in cycles if the dump does not have
+ * the TSC frequency.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/ktrace.h>
+
+#define LINE_PREFIX "ktrace: "
+
+static Ktrace_dump_t hdr;
+static Ktrace_rec_t *recs;
+static uint64_t nrecs, maxrecs;
+
+static const char *names[KT_NEVENTS] = KTRACE_EVENT_NAMES;
+
+static void add(Ktrace_rec_t *r) {
+
+  if(nrecs == maxrecs) {
+    maxrecs = maxrecs ? maxrecs * 2 : 1024;
+    if((recs = realloc(recs, maxrecs * sizeof(Ktrace_rec_t))) == NULL) {
+      fprintf(stderr, "ktrace2json: out of memory\n");
+      exit(1);
+    }
+  }
+  recs[nrecs++] = *r;
+}
+
+static int read_binary(FILE *f) {
+  Ktrace_rec_t r;
+
+  if(fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != KTRACE_DUMP_MAGIC)
+    return -1;
+  if(hdr.recsz != sizeof(Ktrace_rec_t)) {
+    fprintf(stderr, "ktrace2json: records are %u bytes, not %zu\n",
+	    hdr.recsz, sizeof(Ktrace_rec_t));
+    return -1;
+  }
+  while(fread(&r, sizeof(r), 1, f) == 1)
+    add(&r);
+  return 0;
+}
+
+/* 32 bytes of hex, as the trace program prints them */
+static int unhex(const char *s, uint8_t *out, int len) {
+  unsigned int b;
+  int i;
+
+  for(i = 0; i < len; i++, s += 2)
+    if(sscanf(s, "%2x", &b) != 1)
+      return -1;
+    else
+      out[i] = b;
+  return 0;
+}
+
+static int read_log(FILE *f) {
+  char line[512], *p;
+  uint8_t buf[sizeof(Ktrace_rec_t)];
+  int have_hdr = 0;
+
+  while(fgets(line, sizeof(line), f) != NULL) {
+    if((p = strstr(line, LINE_PREFIX)) == NULL)
+      continue;
+    if(unhex(p + strlen(LINE_PREFIX), buf, sizeof(buf)) < 0)
+      continue;
+    if(!have_hdr && ((Ktrace_dump_t *)buf)->magic == KTRACE_DUMP_MAGIC) {
+      memcpy(&hdr, buf, sizeof(hdr));
+      have_hdr = 1;
+    }
+    else if(have_hdr)
+      add((Ktrace_rec_t *)buf);
+  }
+  return have_hdr ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+  FILE *f;
+  Ktrace_rec_t *r;
+  uint64_t i, base;
+  double per_us;
+  const char *name;
+
+  if(argc != 2) {
+    fprintf(stderr, "Usage: ktrace2json dump|serial.log > trace.json\n");
+    return 1;
+  }
+  if((f = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  if(read_binary(f) < 0) {
+    rewind(f);
+    nrecs = 0;
+    if(read_log(f) < 0) {
+      fprintf(stderr, "ktrace2json: %s is not a trace dump\n", argv[1]);
+      return 1;
+    }
+  }
+  fclose(f);
+
+  per_us = hdr.tsc_hz ? hdr.tsc_hz / 1e6 : 1.0;
+  for(i = 0, base = UINT64_MAX; i < nrecs; i++)
+    if(recs[i].tsc < base)
+      base = recs[i].tsc;
+
+  printf("{\"displayTimeUnit\":\"ns\",\n");
+  printf(" \"otherData\":{\"tsc_hz\":%llu,\"lost\":%llu,\"units\":\"%s\"},\n",
+	 (unsigned long long)hdr.tsc_hz, (unsigned long long)hdr.lost,
+	 hdr.tsc_hz ? "us" : "cycles");
+  printf(" \"traceEvents\":[\n");
+  printf("  {\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+	 "\"args\":{\"name\":\"kernel\"}},\n", KTRACE_SRC_KERNEL);
+  printf("  {\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+	 "\"args\":{\"name\":\"hypervisor\"}}", KTRACE_SRC_HYPV);
+  for(i = 0; i < nrecs; i++) {
+    r = &recs[i];
+    name = (r->event < KT_NEVENTS) ? names[r->event] : "unknown";
+    printf(",\n  {\"name\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,",
+	   name, r->src, r->cpu, (r->tsc - base) / per_us);
+    if(r->dur)
+      printf("\"ph\":\"X\",\"dur\":%.3f,", r->dur / per_us);
+    else
+      printf("\"ph\":\"i\",\"s\":\"t\",");
+    printf("\"args\":{\"pid\":%d,\"arg\":%llu}}", r->pid,
+	   (unsigned long long)r->arg);
+  }
+  printf("\n ]}\n");
+
+  fprintf(stderr, "ktrace2json: %llu records, %llu lost\n",
+	  (unsigned long long)nrecs, (unsigned long long)hdr.lost);
+  return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * sha256bench.c -- checks and times the SHA-256 engines in
+ * sys/utils/sha256.c on the build host:
+ *
+ *     make && ./sha256bench
+ *
+ * Each engine the cpu has is run over the FIPS 180-2 known answers, fed in
+ * one piece and in odd sized pieces, and checked against the plain C engine
+ * over random messages of every length up to a few blocks; sha256_multi is
+ * checked the same way. Then throughput is timed for one 1MB buffer, and for
+ * sixteen 4KB ones through sha256_multi.
+ */
+#include <stdint.h>
+#include <sha256.h>
+
+int printf(const char *, ...);
+void *malloc(unsigned long);
+void free(void *);
+int memcmp(const void *, const void *, unsigned long);
+void *memcpy(void *, const void *, unsigned long);
+void *memset(void *, int, unsigned long);
+int rand(void);
+#define EXIT_SUCCESS 0
+#define EXIT_FAILURE 1
+
+/* What sha256.c needs of the kernel */
+void *kmemcpy(void *dst, const void *src, unsigned long n) {
+  return memcpy(dst, src, n);
+}
+
+void *kmemset(void *dst, int c, unsigned long n) {
+  return memset(dst, c, n);
+}
+
+static inline uint64_t readtsc() {
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return (uint64_t)(lo) | ((uint64_t)(hi) << 32);
+}
+
+static struct {
+  char *msg;
+  int repeat;
+  char *digest;
+} kat[] = {
+  { "abc", 1,
+    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+  { "", 1,
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+  { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+  { "a", 1000000,
+    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+#define NKAT (sizeof(kat) / sizeof(kat[0]))
+
+static void hex(uchar hash[], char out[]) {
+  int i;
+
+  for(i = 0; i < 32; i++) {
+    out[2*i] = "0123456789abcdef"[hash[i] >> 4];
+    out[2*i+1] = "0123456789abcdef"[hash[i] & 15];
+  }
+  out[64] = '\0';
+}
+
+/* The message of a known answer, and its length */
+static uchar *kat_msg(int i, uint *len) {
+  uchar *m;
+  uint n, r;
+
+  for(n = 0; kat[i].msg[n]; n++)
+    ;
+  m = malloc(n * kat[i].repeat + 1);
+  for(r = 0; r < kat[i].repeat; r++)
+    memcpy(m + r * n, kat[i].msg, n);
+  *len = n * kat[i].repeat;
+  return m;
+}
+
+/* Hash len bytes, in pieces of at most step bytes */
+static void hash_steps(uchar *m, uint len, uint step, uchar hash[]) {
+  SHA256_CTX ctx;
+  uint n;
+
+  sha256_init(&ctx);
+  for( ; len; m += n, len -= n) {
+    n = len < step ? len : step;
+    sha256_update(&ctx, m, n);
+  }
+  sha256_final(&ctx, hash);
+}
+
+static int check_kat() {
+  static uint steps[] = { 0xffffffff, 1, 63, 64, 65, 1000 };
+  uchar hash[32], *m, *data[NKAT];
+  uchar multi[NKAT][32];
+  char out[65];
+  uint len[NKAT];
+  int i, j, bad;
+
+  for(i = 0, bad = 0; i < NKAT; i++) {
+    m = kat_msg(i, &len[i]);
+    data[i] = m;
+    for(j = 0; j < sizeof(steps) / sizeof(steps[0]); j++) {
+      hash_steps(m, len[i], steps[j], hash);
+      hex(hash, out);
+      if(memcmp(out, kat[i].digest, 64) && bad++ < 10)
+	printf("kat %d in pieces of %u: %s\n", i, steps[j], out);
+    }
+  }
+  sha256_multi(data, len, NKAT, multi);
+  for(i = 0; i < NKAT; i++) {
+    hex(multi[i], out);
+    if(memcmp(out, kat[i].digest, 64) && bad++ < 10)
+      printf("kat %d through sha256_multi: %s\n", i, out);
+    free(data[i]);
+  }
+  return bad;
+}
+
+/* Random messages of every length to 300 bytes, against the C engine */
+#define NRAND 301
+static int check_random(int engine) {
+  static uchar buf[NRAND][NRAND];
+  uchar want[NRAND][32], got[NRAND][32], *data[NRAND];
+  uint len[NRAND];
+  int i, j, bad;
+
+  for(i = 0; i < NRAND; i++) {
+    for(j = 0; j < i; j++)
+      buf[i][j] = rand();
+    data[i] = buf[i];
+    len[i] = i;
+  }
+  sha256_select(SHA256_SW);
+  for(i = 0; i < NRAND; i++)
+    hash_steps(data[i], len[i], 0xffffffff, want[i]);
+  sha256_select(engine);
+  for(i = 0, bad = 0; i < NRAND; i++) {
+    hash_steps(data[i], len[i], 0xffffffff, got[i]);
+    if(memcmp(got[i], want[i], 32) && bad++ < 10)
+      printf("random message of %d bytes\n", i);
+  }
+  sha256_multi(data, len, NRAND, got);
+  for(i = 0; i < NRAND; i++)
+    if(memcmp(got[i], want[i], 32) && bad++ < 10)
+      printf("random message of %d bytes through sha256_multi\n", i);
+  return bad;
+}
+
+/* Cycles per byte for one big buffer, and for many pages at once */
+#define BIG (1 << 20)
+#define NPAGES 16
+#define PAGE 4096
+#define ROUNDS 20
+static void timeit() {
+  static uchar hash[NPAGES][32];
+  uchar *big, *data[NPAGES];
+  uint len[NPAGES];
+  uint64_t start, one, multi;
+  int i, r;
+
+  big = malloc(BIG);
+  for(i = 0; i < BIG; i++)
+    big[i] = rand();
+  for(i = 0; i < NPAGES; i++) {
+    data[i] = big + i * PAGE;
+    len[i] = PAGE;
+  }
+
+  start = readtsc();
+  for(r = 0; r < ROUNDS; r++)
+    hash_steps(big, BIG, BIG, hash[0]);
+  one = readtsc() - start;
+  start = readtsc();
+  for(r = 0; r < ROUNDS * (BIG / (NPAGES * PAGE)); r++)
+    sha256_multi(data, len, NPAGES, hash);
+  multi = readtsc() - start;
+  printf("  %-7s %3lu.%02lu cycles/byte one buffer, %3lu.%02lu cycles/byte "
+	 "%d pages at once\n", sha256_engine_name(),
+	 one / ((uint64_t)BIG * ROUNDS / 100) / 100,
+	 one / ((uint64_t)BIG * ROUNDS / 100) % 100,
+	 multi / ((uint64_t)BIG * ROUNDS / 100) / 100,
+	 multi / ((uint64_t)BIG * ROUNDS / 100) % 100, NPAGES);
+  free(big);
+}
+
+int main() {
+  static int engines[] = { SHA256_SW, SHA256_NI };
+  int i, bad, total;
+
+  for(i = 0, total = 0; i < 2; i++) {
+    if(sha256_select(engines[i]) != engines[i]) {
+      printf("[sha256bench: no sha-ni on this cpu]\n");
+      continue;
+    }
+    bad = check_kat() + check_random(engines[i]);
+    printf("[sha256bench: %s %s]\n", sha256_engine_name(),
+	   bad ? "MISMATCH" : "passes the known answers");
+    if(!bad)
+      timeit();
+    total += bad;
+  }
+  return total ? EXIT_FAILURE : EXIT_SUCCESS;
+}
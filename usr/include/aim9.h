@@ -7,6 +7,8 @@ static void fork_test();
 
 static void exec_test();
 
+static void msg_test();
+
 static void add_long();
 
 static void add_short();
@@ -0,0 +1,8 @@
+#pragma once
+
+/* stdout and stderr through a ring shared with vgad, see libgloss/console.c */
+int console_write(int fd, char *buf, int nbytes);
+void console_flush(void);
+void console_sync(void);
+void console_forked(void);
+void console_close(void);
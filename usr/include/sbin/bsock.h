@@ -26,8 +26,8 @@ void bsock_recvfrom(Net_recv_req_t *req, Msg_status_t *status);
 void bsock_ghbn(Net_ghbn_req_t *req, Msg_status_t *status);
 void bsock_close(Net_close_req_t *req, Msg_status_t *status);
 void bsock_update_owner(Net_update_owner_req_t *req, Msg_status_t *status);
+void bsock_sbuf_setup(Net_sbuf_setup_req_t *req, Msg_status_t *status);
+void bsock_sbuf_send(Net_sbuf_req_t *req, Msg_status_t *status);
+void bsock_sbuf_recv(Net_sbuf_req_t *req, Msg_status_t *status);
 
-/* Direct function call stuff, because why the hell are we sending messages 
- * to ourselves again? */
-int bsock_has_data(int sockfd);
-int bsock_is_closed(int sockfd);
+void bsock_poll_arm(Pollev_req_t *req, Msg_status_t *status);
@@ -6,7 +6,41 @@
 
 #include <stdint.h>
 #include <sbin/lwip/netif.h>
+#include <sbin/lwip/pbuf.h>
 #include <sbin/lwip/err.h>
+#include <sbin/netd.h>
+
+struct netrx;
+
+/* A receive buffer lent to lwIP; freeing the pbuf gives it back. */
+typedef struct {
+	struct pbuf_custom pc;	/* must be first */
+	struct netrx *rx;
+	int idx;
+} Netrx_pbuf_t;
+
+/* The receive buffers a driver shares with the net task (see netd.h). */
+typedef struct netrx {
+	Netrx_ring_t *ring;
+	uint8_t *bufs;
+	int pid;		/* driver, -1 once it has been replaced */
+	int ring_id;
+	int held;		/* buffers lwIP has */
+	Netrx_pbuf_t pbufs[NETRX_BUF_NR];
+} Netrx_t;
+
+/* The transmit buffers a driver shares with the net task (see netd.h). */
+#define NETTX_BACKLOG 64	/* frames held back while the ring is full */
+
+typedef struct {
+	Nettx_ring_t *ring;
+	uint8_t *bufs;
+	int pid;		/* driver */
+	int ring_id;
+	int back_head;		/* oldest frame held back */
+	int nback;
+	struct pbuf *backlog[NETTX_BACKLOG];
+} Nettx_t;
 
 /*
  * the minimal driver info kept around in the net task.  Basically
@@ -15,8 +49,12 @@
 typedef struct {
 	struct netif *ifp;
 	int pid;
+	Netrx_t *rx;		/* NULL if the driver copies frames to us */
+	Nettx_t *tx;		/* NULL if we send frames in messages */
 } Driver_api_softc_t;
 
 err_t driver_linkoutput(struct netif *ifp, struct pbuf *p);
 err_t driver_init(struct netif *ifp);
+int driver_rxbatch(struct netif *ifp);
+void driver_txready(struct netif *ifp);
 
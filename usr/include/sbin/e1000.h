@@ -21,8 +21,11 @@
 
 #include <sbin/syspid.h>
 #include <sbin/e1000_hw.h>
+#include <sbin/netd.h>
 
 #define E1000_PING 3	
+#define E1000_POLL 7	/* to ourselves, while polling */
+#define E1000_STATS 8	/* print e1000_printstats(); from "ifconfig -s" */
 
 typedef struct {
   int type;
@@ -147,7 +150,18 @@ typedef struct e1000_stat
 			   was a transmission of an
 			   other station in progress */
     collision,          /* # collissions */
-    good_pktT;
+    good_pktT,
+    rxPkts,             /* # packets handed to netd */
+    rxBatches,          /* # NET_PKT_BATCH messages sent */
+    txPkts,             /* # packets given to the card */
+    txKicks,            /* # tail writes for them */
+    txFull,             /* # packets dropped on a full ring */
+    intrs,              /* # interrupts */
+    intrPkts,           /* # packets received in interrupts */
+    polls,              /* # passes of the polling loop */
+    pollPkts;           /* # packets received while polling */
+  uint64_t rxLatency;   /* TSC from interrupt to netd, summed */
+  unsigned int rxLatencyN;
 
 }e1000_stat_t;
 
@@ -190,6 +204,34 @@ typedef struct e1000
     
        
   int rx_tail;   /*current Tail pointer inside the descriptor ring */
+
+  /* Zero-copy receive, see Netrx_ring_t. rx_ring is NULL if the buffers 
+   * could not be shared, and each frame is copied to netd instead. */
+  Netrx_ring_t *rx_ring;	  /**< Ring shared with netd. */
+  int rx_ring_id;		  /**< Shared memory id of rx_ring. */
+  int rx_buffer_id;		  /**< Shared memory id of rx_buffer. */
+  uint64_t rx_buffer_p;		  /**< Physical address of rx_buffer. */
+  int rx_bufidx[E1000_RXDESC_NR]; /**< Buffer given to each descriptor. */
+  uint16_t rx_free[NETRX_BUF_NR]; /**< Buffers the driver holds spare. */
+  int rx_nfree;			  /**< Number of spare buffers. */
+  int rx_refill;		  /**< Next descriptor to give a buffer (RDT). */
+  int rx_armed;			  /**< Descriptors with a buffer. */
+
+  /* Transmit ring. tx_tail and tx_clean count up forever; the card owns 
+   * the descriptors from tx_clean up to tx_tail. tx_ring is NULL if the 
+   * buffers could not be shared, and netd sends each frame in a message. */
+  uint32_t tx_tail;		  /**< Next descriptor to fill. */
+  uint32_t tx_clean;		  /**< Oldest descriptor not yet done. */
+  Nettx_ring_t *tx_ring;	  /**< Ring shared with netd. */
+  int tx_ring_id;		  /**< Shared memory id of tx_ring. */
+  int tx_buffer_id;		  /**< Shared memory id of tx_buffer. */
+
+  /* Interrupt moderation and polling, see e1000_moderate. */
+  int itr_level;		  /**< Index into e1000_itr_levels. */
+  int itr_intrs;		  /**< Interrupts this epoch. */
+  int itr_pkts;			  /**< Packets this epoch. */
+  int polling;			  /**< Irq masked, polling the card. */
+  int poll_idle;		  /**< Polls in a row that found nothing. */
    
 }e1000_t;
 
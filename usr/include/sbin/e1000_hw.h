@@ -167,6 +167,18 @@ union ich8_hws_flash_regacc
 /** Report Status. */
 #define E1000_TX_CMD_RS		(1 << 3)
 
+/**
+ * @}
+ */
+
+/**
+ * @name Transmit Status Field Bits.
+ * @{
+ */
+
+/** Descriptor Done. */
+#define E1000_TX_STATUS_DONE	(1 << 0)
+
 /**
  * @}
  */
@@ -129,7 +129,7 @@
 
 #define E1000_REG_ITR 0x000C4 
 
-#define E1000_REG_RADV 0x0282
+#define E1000_REG_RADV 0x0282C
 
 #define E1000_REG_RSRPD 0x02c00
 
@@ -333,6 +333,9 @@
 /** Link Status Change. */
 #define E1000_REG_IMS_LSC	(1 << 2) 
 
+/** Receive Descriptor Minimum Threshold Reached. */
+#define E1000_REG_IMS_RXDMT	(1 << 4)
+
 /** Receiver FIFO Overrun. */
 #define E1000_REG_IMS_RXO	(1 << 6)  
 
@@ -18,9 +18,13 @@
 #include <sbin/syspid.h>
 
 int e1000_hw_init(Ndrv_config_msg_t *msg, Ndrv_init_req_t *req );
-void e1000_interrupt();
+void e1000_interrupt(uint64_t tsc);
 void e1000_getmac_addr(Ndrv_init_resp_t *resp);
 void e1000_output_pkt(Pkt_msg_t *pkt );
+void e1000_rx_refill();
+void e1000_tx_kick();
+void e1000_poll();
+void e1000_stats();
 
 
 
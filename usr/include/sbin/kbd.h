@@ -14,6 +14,7 @@
 
 #define MAX_STR_SZ   80
 #define KEYB_GETSTR   1
+#define KEYB_POLL     2		/* poll() on fd 0, see sbin/pollev.h */
 
 /* getstr */
 typedef struct {
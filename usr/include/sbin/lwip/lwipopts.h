@@ -34,7 +34,7 @@
 
 #define MEMP_NUM_PBUF                   64
 #define MEMP_NUM_RAW_PCB                32
-#define MEMP_NUM_UDP_PCB                32
+#define MEMP_NUM_UDP_PCB                1040 /* tpoll opens 1000 idle sockets */
 #define MEMP_NUM_TCP_PCB                32
 #define MEMP_NUM_TCP_PCB_LISTEN         32
 #define MEMP_NUM_TCP_SEG                32
@@ -76,4 +76,10 @@
 #define LWIP_NETCONN                1
 #define LWIP_SOCKET                 0
 
+/* Checksums a 64-bit word at a time, and summed while tcp_write copies */
+#include <sbin/lwip/chksum_wide.h>
+#define LWIP_CHKSUM_ALGORITHM       4
+#define LWIP_CHECKSUM_ON_COPY       1
+#define LWIP_CHKSUM_COPY(dst, src, len) chksum_wide_copy(dst, src, len)
+
 #endif /* __LWIP_OPTS_H__ */
@@ -35,6 +35,11 @@
 #define NET_UPDATE       17
 #define NET_POLL         18
 #define NET_PING	 19
+#define NET_PKT_BATCH    20
+#define NET_TX_READY     21
+#define NET_SBUF_SETUP   22
+#define NET_SBUF_SEND    23
+#define NET_SBUF_RECV    24
 
 /* These go to/from a network driver (for us, bced). */
 /**** DEFINITIONS ****/
@@ -43,6 +48,8 @@
 #define NDRV_OUTPKT    2  /* Outgoing packet        */
 #define NDRV_TIMER_MSG 3  /* Timer msg              */
 #define NDRV_CONFIG    4  /* Config msg from kernel */
+#define NDRV_RXREFILL  5  /* RX buffers returned    */
+#define NDRV_TXKICK    6  /* TX ring has new frames */
 
 /* first third for files, second third for sockets, last third for pipes */
 #define SOCKIDMIN ((INT_MAX/3)+1)
@@ -225,6 +232,51 @@ typedef struct {
         uint8_t buf[SOCKET_SNDBUF_MAX];
 } Net_recv_resp_t;
 
+/* 
+ * Bulk socket buffers. A process that moves a lot of data over a TCP socket
+ * creates a Net_sbuf_t, grants it to netd and registers it with 
+ * NET_SBUF_SETUP. send() then copies as much as fits into snd and posts one
+ * NET_SBUF_SEND; netd hands the bytes to tcp_write straight from the region 
+ * and replies once it has taken them all. recv() posts NET_SBUF_RECV when 
+ * rcv is empty; netd copies everything that has arrived into rcv and replies
+ * with the count, and later recv() calls are served from rcv without a 
+ * message. Head and tail are running byte counts: the producer moves head, 
+ * the consumer tail.
+ */
+#define NET_SBUF_SIZE (64*1024)
+
+typedef struct {
+        volatile uint32_t head;
+        volatile uint32_t tail;
+        uint8_t data[NET_SBUF_SIZE];
+} Net_sring_t;
+
+typedef struct {
+        Net_sring_t snd;        /* process -> netd */
+        Net_sring_t rcv;        /* netd -> process */
+} Net_sbuf_t;
+
+typedef struct {
+        int type;
+        int sockfd;
+        int shm_id;             /* region holding the Net_sbuf_t */
+} Net_sbuf_setup_req_t;
+
+/* NET_SBUF_SEND: len bytes are waiting in snd. NET_SBUF_RECV: len is unused */
+typedef struct {
+        int type;
+        int sockfd;
+        size_t len;
+        int flags;
+} Net_sbuf_req_t;
+
+/* Replies to all three; ret is the byte count for send and recv */
+typedef struct {
+        int type;
+        ssize_t ret;
+        int errno;
+} Net_sbuf_resp_t;
+
 /* gethostbyname() */
 #define NET_NAME_LEN 64
 typedef struct {
@@ -251,18 +303,8 @@ typedef struct {
         int errno;
 } Net_close_resp_t;
 
-/* poll(); request/response are same messages */
-#include <poll.h> /* For struct pollfd */
-
-typedef struct {
-	int type;
-	int pid;
-	struct pollfd fds[100]; /* A reasonable limit for now */
-	int numfds;
-	int timeout;
-	int rval;
-	int errno;
-} Net_poll_t;
+/* poll(); NET_POLL arms, see sbin/pollev.h */
+#include <sbin/pollev.h>
 
 /* update_owner() */
 typedef struct {
@@ -288,8 +330,85 @@ typedef struct {
         int ifnum;
         int ret;
         uint8_t eaddr[6];
+        int rx_ring_id;         /* shm id of the Netrx_ring_t, 0 if none */
+        int rx_buf_id;          /* shm id of the receive buffers */
+        int tx_ring_id;         /* shm id of the Nettx_ring_t, 0 if none */
+        int tx_buf_id;          /* shm id of the transmit buffers */
 } Ndrv_init_resp_t;
 
+/* 
+ * Zero-copy receive. The driver DMAs frames into NETRX_BUF_NR buffers of 
+ * NETRX_BUF_SIZE bytes in one shared region, and hands them to netd by index
+ * through the rx ring of a Netrx_ring_t in another. netd passes the buffers
+ * to lwIP in place and puts each index on the free ring once lwIP lets go of 
+ * it. Each ring has room for every buffer, so neither can overflow.
+ *
+ * The driver sends one NET_PKT_BATCH, and sets pending, when it adds to an 
+ * empty rx ring; netd clears pending before it drains the ring. When the 
+ * driver runs short of buffers it sets starved, and netd sends NDRV_RXREFILL
+ * when it next returns one.
+ */
+#define NETRX_BUF_NR   256
+#define NETRX_BUF_SIZE 2048
+#define NETRX_RING_NR  NETRX_BUF_NR
+
+typedef struct {
+        uint16_t idx;           /* buffer */
+        uint16_t len;           /* bytes of frame in it */
+} Netrx_slot_t;
+
+typedef struct {
+        volatile uint32_t rx_head;      /* driver: next rx slot to fill */
+        volatile uint32_t rx_tail;      /* netd: next rx slot to drain */
+        volatile uint32_t free_head;    /* netd: next free slot to fill */
+        volatile uint32_t free_tail;    /* driver: next free slot to drain */
+        volatile uint32_t pending;      /* a NET_PKT_BATCH is on its way */
+        volatile uint32_t starved;      /* driver wants NDRV_RXREFILL */
+        Netrx_slot_t rx[NETRX_RING_NR];
+        uint16_t free[NETRX_RING_NR];
+} Netrx_ring_t;
+
+/*
+ * Transmit works the same way in the other direction. Slot i of a 
+ * Nettx_ring_t, its buffer and the driver's transmit descriptor i go 
+ * together. netd copies frames into the buffers and moves head; the driver 
+ * gives everything up to head to the card with one tail write when it gets
+ * NDRV_TXKICK, and moves done as the card finishes with them. netd sends a
+ * kick, and sets kicked, only if none is already on its way.
+ *
+ * When the ring is full netd keeps frames back and sets blocked; the driver
+ * sends NET_TX_READY once the card has made room.
+ */
+#define NETTX_BUF_NR   128
+#define NETTX_BUF_SIZE 2048
+
+typedef struct {
+        volatile uint32_t head;         /* netd: next slot to fill */
+        volatile uint32_t tail;         /* driver: next slot to give the card */
+        volatile uint32_t done;         /* driver: next slot the card will finish */
+        volatile uint32_t kicked;       /* a NDRV_TXKICK is on its way */
+        volatile uint32_t blocked;      /* netd wants NET_TX_READY */
+        uint16_t len[NETTX_BUF_NR];
+} Nettx_ring_t;
+
+typedef struct {
+        int type;
+        int ifnum;
+} Net_batch_msg_t;
+
+typedef struct {
+        int type;
+} Ndrv_rxrefill_msg_t;
+
+typedef struct {
+        int type;
+} Ndrv_txkick_msg_t;
+
+typedef struct {
+        int type;
+        int ifnum;
+} Net_txready_msg_t;
+
 typedef struct {
         int type;
         int alarm_type;
@@ -11,6 +11,7 @@
 #include <msg.h>		/* Msg_status_t */
 #include <sbin/daemon_msg_types.h>/* generic message types DINIT,DPING,DQUIT */
 #include <sbin/syspid.h>	  /* must define the daemon id e.g PIPED */
+#include <sbin/pollev.h>	  /* poll() arm/disarm messages */
 
 /* first third for files, second third for sockets, last third for pipes */
 #define PIPEIDMIN ((2*(INT_MAX/3))+1)
@@ -18,8 +19,7 @@
 #define is_pipeid(x) (x>=PIPEIDMIN && x<=PIPEIDMAX)
 
 #define MAXOPEN      50
-#define PIPE_MSG_LEN 512
-#define PIPE_LENGTH  51200
+#define PIPE_LENGTH  65536	/* bytes a pipe holds -- a power of two */
 
 /*
  * NOTE: Place daemon specific request & response message formats
@@ -48,14 +48,42 @@
  * } piped_foobar_resp_t;
  *
  */
-#define PIPED_NEW   5
-#define PIPED_READ  6
-#define PIPED_WRITE 7
-#define PIPED_CLOSE 8
+#define PIPED_NEW    5
+#define PIPED_ATTACH 6		/* the ring of an inherited pipe end */
+#define PIPED_WAIT   7		/* block until the ring has data, or room */
+#define PIPED_CLOSE  8
+#define PIPED_POLL   9		/* Pollev_req_t, see sbin/pollev.h */
+#define PIPED_WAKE   11		/* the ring changed under a waiter; no reply */
 
+/* ends of a pipe that are closed */
+#define PIPE_RCLOSED 0x1
+#define PIPE_WCLOSED 0x2
+
+/*
+ * The ring a pipe's data moves through, in a region shared by piped and
+ * the processes using the pipe. head and tail run freely and are taken
+ * modulo PIPE_LENGTH; only writers move head and only readers move tail,
+ * each under their own lock, so readers and writers never wait for each
+ * other. piped sets rwait while a reader or a poll() waits for data and
+ * wwait while a writer or a poll() waits for room, and whoever moves
+ * head or tail under it sends PIPED_WAKE.
+ */
+typedef struct {
+  volatile uint32_t head;	/* next byte to write */
+  volatile uint32_t tail;	/* next byte to read */
+  volatile int rwait;
+  volatile int wwait;
+  volatile int closed;		/* PIPE_RCLOSED, PIPE_WCLOSED */
+  lock_t rlock;
+  lock_t wlock;
+  char buf[PIPE_LENGTH];
+} Pipe_ring_t;
+
+/* the creator of the ring is the only process that may send it */
 typedef struct {
   int type;
   unsigned int tag;
+  int shm_id;
 } Pipe_new_req_t;
 
 typedef struct {
@@ -66,45 +94,19 @@ typedef struct {
   int ret_val;
 } Pipe_new_resp_t;
 
+/* attach, wait, close and wake */
 typedef struct {
   int type;
   unsigned int tag;
   int fd;
-  int length;
-} Pipe_read_req_t;
-
-typedef struct {
-  int type;
-  unsigned int tag;
-  int length;
-  char buf[PIPE_MSG_LEN];
-} Pipe_read_resp_t;
-
-typedef struct {
-  int type;
-  unsigned int tag;
-  int fd;
-  int length;
-  char buf[PIPE_MSG_LEN];
-} Pipe_write_req_t;
-
-typedef struct {
-  int type;
-  unsigned int tag;
-  int length;
-} Pipe_write_resp_t;
-
-typedef struct { 
-  int type;
-  unsigned int tag;
-  int filedes;
-} Pipe_close_req_t;
+} Pipe_fd_req_t;
 
 typedef struct {
   int type;
   unsigned int tag;
+  int shm_id;			/* attach: the ring */
   int ret_val;
-} Pipe_close_resp_t;
+} Pipe_resp_t;
 
 /* The Daemon Message Buffer -- always aligned on a 64 bit boundary */
 typedef union { 
@@ -114,30 +116,26 @@ typedef union {
   generic_dquit_req_t dquit;	/* quit request */
   Pipe_new_req_t new_req;
   Pipe_new_resp_t new_resp;
-  Pipe_read_req_t read_req;
-  Pipe_read_resp_t read_resp;
-  Pipe_write_req_t write_req;
-  Pipe_write_resp_t write_resp;
-  Pipe_close_req_t close_req;
-  Pipe_close_resp_t close_resp;
+  Pipe_fd_req_t fd_req;
+  Pipe_resp_t resp;
+  Pollev_req_t poll_req;
 } piped_msg_t __attribute__ ((aligned(sizeof(uint64_t))));
 
-typedef struct reader_data {
+/* a reader or writer blocked in PIPED_WAIT */
+typedef struct waiter_data {
   int pid;
-  int len;
   unsigned int tag;
-} reader_t;
+} waiter_t;
 
 typedef struct pipe_type {
-  char    *buf      ;
+  Pipe_ring_t *ring     ;
+  int      shm_id   ;
   int      read_fd  ;
-  char    *read_ptr ;
   int      write_fd ;
-  char    *write_ptr;
-  int      length   ;
-  int      wrapped  ;
-  lock_t   lock     ;
-  queue_t *read_q   ;
+  queue_t *read_q   ;		/* readers waiting for data  */
+  queue_t *write_q  ;		/* writers waiting for room  */
+  queue_t *rpoll_q  ;		/* poll() watches on the read end  */
+  queue_t *wpoll_q  ;		/* poll() watches on the write end */
 } Pipe_t;
 
 /* Deamon Printing Interface -- used to print piped messages */
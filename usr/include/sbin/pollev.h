@@ -0,0 +1,82 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#pragma once
+/*
+ * pollev.h -- readiness notification between the daemons and poll()
+ *
+ * poll() keeps an interest set at every daemon that owns some of its
+ * fds: the fds and the events wanted. An arm message replaces the set
+ * (POLLEV_SET), adds to it (POLLEV_ADD), or, with neither, leaves it
+ * as it is, so a poll() on the same fds as the last one sends no fds at
+ * all. The daemon then looks at the fds just sent, or at the whole set,
+ * and posts an event for each one that is ready; the others keep a
+ * watch, which posts one event when they become ready. The last post
+ * for an arm has fd POLLEV_DONE.
+ *
+ * Events are posted to the kernel (poll_post()), which keeps them for
+ * the process, tagged with the poll() they are for, and drops those of
+ * a poll() that is over. So poll() receives only from SYS, and never
+ * takes the replies meant for the rest of the program. A post for a
+ * process that is gone fails, and the daemon forgets its set.
+ *
+ * Each daemon picks its own arm message type.
+ */
+#include <syscall.h>		/* poll_post, POLL_DONE_FD */
+#include <utils/queue.h>
+
+#define POLLEV_MAXFDS 128	/* fds per arm message */
+#define POLLEV_DONE   POLL_DONE_FD /* fd of the last post for an arm */
+
+/* arm flags */
+#define POLLEV_SET    0x1	/* the set is these fds    */
+#define POLLEV_ADD    0x2	/* the set has these too   */
+
+typedef struct {
+  int fd;
+  short events;
+} Pollev_fd_t;
+
+/* arm */
+typedef struct {
+  int type;
+  unsigned int tag;		/* names the poll() call */
+  int flags;			/* POLLEV_SET, POLLEV_ADD, or 0 */
+  int nfds;
+  Pollev_fd_t fds[POLLEV_MAXFDS];
+} Pollev_req_t;
+
+/* a watch, kept by the daemon on whatever is behind the fd */
+typedef struct {
+  int pid;
+  unsigned int tag;
+  int fd;
+  short events;
+} Pollev_watch_t;
+
+/* Daemon side -- usr/src/utils/pollev.c */
+Pollev_fd_t *pollev_interest(int pid, Pollev_req_t *req, int *nfdsp);
+int  pollev_post(int pid, unsigned int tag, int fd, short revents);
+int  pollev_watch(queue_t *wq, int pid, unsigned int tag, int fd, short events);
+void pollev_notify(queue_t *wq, short revents);
+void pollev_clear(queue_t *wq);
@@ -0,0 +1,68 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#pragma once
+/*
+ * ramfs.h -- read/write access to the FAT filesystem on the ramdisk
+ *
+ * The library (sys/utils/ramfs.c) is FatFs built with _FS_READONLY=0
+ * over a ramdisk mapped into the caller's address space. Only ramfsd
+ * links it; everyone else goes through the ramfsd interface
+ * (sbin/ramfsd.h). Functions return >=0 on success, otherwise the
+ * negated FatFs error code.
+ */
+#include <stdint.h>
+
+#define RAMFS_MAXOPEN 32	/* open files across all clients */
+
+/* open flags */
+#define RAMFS_READ   0x01
+#define RAMFS_WRITE  0x02
+#define RAMFS_CREATE 0x04	/* create if it does not exist */
+#define RAMFS_TRUNC  0x08	/* truncate to zero length */
+#define RAMFS_APPEND 0x10	/* every write goes to the end */
+#define RAMFS_EXCL   0x20	/* with RAMFS_CREATE: fail if it exists */
+
+/* seek whence */
+#define RAMFS_SEEK_SET 0
+#define RAMFS_SEEK_CUR 1
+#define RAMFS_SEEK_END 2
+
+/* errors (negated FRESULT) worth telling apart */
+#define RAMFS_ERR_NO_FILE       (-4)
+#define RAMFS_ERR_NO_PATH       (-5)
+#define RAMFS_ERR_INVALID_NAME  (-6)
+#define RAMFS_ERR_DENIED        (-7)
+#define RAMFS_ERR_EXIST         (-8)
+#define RAMFS_ERR_INVALID       (-9)
+#define RAMFS_ERR_TOO_MANY_OPEN (-18)
+
+int ramfs_mount(void *base, uint64_t size, uint64_t fs_offset);
+int ramfs_open(const char *path, int flags);	/* returns a handle */
+int ramfs_close(int h);
+int64_t ramfs_read(int h, void *buf, uint64_t len);
+int64_t ramfs_write(int h, const void *buf, uint64_t len);
+int64_t ramfs_seek(int h, int64_t offset, int whence);
+int ramfs_stat(const char *path, uint64_t *size, int *isdir);
+int ramfs_fstat(int h, uint64_t *size);
+int ramfs_unlink(const char *path);
@@ -0,0 +1,135 @@
+#pragma once
+/*
+ * ramfsd.h -- The ramfsd interface
+ *
+ * RAMFSD serves the FAT filesystem on the ramdisk, read and write, in
+ * the STANDALONE build (where there is no nfsd). It maps the ramdisk
+ * once at init and keeps every open file; clients name them by file
+ * descriptors in the usual file range (FILEIDMIN up). libgloss routes
+ * open/read/write/lseek/close/stat/fstat/unlink here. Interface
+ * functions are in ramfsd_if.c and return >=0 on success, otherwise -1
+ * with errno set. usr/test/tramfsd.c shows how to use the interface.
+ */
+#include <_ansi.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>		/* offsetof */
+#include <sys/stat.h>
+#include <syscall.h>
+#include <msg.h>		/* Msg_status_t */
+#include <sbin/daemon_msg_types.h>/* generic message types DINIT,DPING,DQUIT */
+#include <sbin/syspid.h>	  /* must define the daemon id e.g RAMFSD */
+#include <sbin/nfsd.h>		  /* FILEIDMIN, is_fileid */
+
+#define RAMFSD_MAXBUFF 16384	/* largest read or write in one message */
+#define RAMFSD_MAXPATH 256
+#define RAMFSD_SHMBUF  65536	/* shared buffer of a file descriptor */
+
+/*
+ * Daemon Message Types: 
+ * daemon_msg_types.h provides:
+ * DINIT=1
+ * DPING=2
+ * DQUIT=3 
+ */
+#define RAMFSD_OPEN   4
+#define RAMFSD_CLOSE  5
+#define RAMFSD_READ   6
+#define RAMFSD_WRITE  7
+#define RAMFSD_SEEK   8
+#define RAMFSD_STAT   9
+#define RAMFSD_FSTAT  10
+#define RAMFSD_UNLINK 11
+#define RAMFSD_SHARE  12	/* the client's buffer for fd */
+#define RAMFSD_READ_SHARED  13	/* read into the shared buffer */
+#define RAMFSD_WRITE_SHARED 14	/* write from the shared buffer */
+
+/* open, stat, unlink */
+typedef struct {
+  int type;
+  unsigned int tag;
+  int flags;			/* open: O_RDONLY, O_CREAT etc */
+  char path[RAMFSD_MAXPATH];
+} Ramfsd_path_req_t;
+
+/* close, read, seek, fstat; read and write through the shared buffer */
+typedef struct {
+  int type;
+  unsigned int tag;
+  int fd;
+  int whence;			/* seek */
+  int64_t offset;		/* seek */
+  uint64_t len;			/* read */
+} Ramfsd_fd_req_t;
+
+/*
+ * A region of RAMFSD_SHMBUF bytes, created by the client and granted to
+ * ramfsd, that file data for fd moves through instead of in messages.
+ * The buffer belongs to the process that shared it: reads and writes
+ * through it from any other (a child that inherited the fd) fail with
+ * ENXIO, and that process shares a buffer of its own.
+ */
+typedef struct {
+  int type;
+  unsigned int tag;
+  int fd;
+  int shm_id;
+} Ramfsd_share_req_t;
+
+/* only the first len bytes of buf are sent */
+typedef struct {
+  int type;
+  unsigned int tag;
+  int fd;
+  uint64_t len;
+  char buf[RAMFSD_MAXBUFF];
+} Ramfsd_write_req_t;
+
+/* value is the fd, byte count or offset; -errno on failure */
+typedef struct {
+  int type;
+  unsigned int tag;
+  int64_t value;
+  uint64_t size;		/* stat, fstat */
+  int isdir;			/* stat */
+} Ramfsd_resp_t;
+
+/* only the first value bytes of buf are sent */
+typedef struct {
+  int type;
+  unsigned int tag;
+  int64_t value;
+  char buf[RAMFSD_MAXBUFF];
+} Ramfsd_read_resp_t;
+
+/* The Daemon Message Buffer -- always aligned on a 64 bit boundary */
+typedef union { 
+  generic_dresp_t dresp;	/* generic response */
+  generic_dinit_req_t dinit;	/* init request */
+  generic_dping_req_t dping;	/* ping request */
+  generic_dquit_req_t dquit;	/* quit request */
+  Ramfsd_path_req_t path_req;
+  Ramfsd_fd_req_t fd_req;
+  Ramfsd_write_req_t write_req;
+  Ramfsd_share_req_t share_req;
+  Ramfsd_resp_t resp;
+  Ramfsd_read_resp_t read_resp;
+} ramfsd_msg_t __attribute__ ((aligned(sizeof(uint64_t))));
+
+/* Deamon Printing Interface -- used to print ramfsd messages */
+void ramfsd_print_req(FILE *logp,char *op,ramfsd_msg_t *msgp);
+void ramfsd_print_resp(FILE *logp,char *op,ramfsd_msg_t *respp);
+
+/* Daemon Communication Interface -- used to communcation with ramfsd */
+int ramfsd_init(int dpid);
+int ramfsd_ping(int dpid);
+int ramfsd_quit(int dpid);
+int ramfsd_open(const char *path, int flags);
+int ramfsd_close(int fd);
+int ramfsd_read(int fd, void *buf, uint64_t nbytes);
+int ramfsd_write(int fd, const void *buf, uint64_t nbytes);
+int64_t ramfsd_seek(int fd, int64_t offset, int whence);
+int ramfsd_stat(const char *path, struct stat *buf);
+int ramfsd_fstat(int fd, struct stat *buf);
+void ramfsd_forked(void);
+int ramfsd_unlink(const char *path);
@@ -18,6 +18,7 @@
 #define SYSD      (-11)		/* system daemon - operations on ids, top of process hierachy */
 #define PIPED     (-12)		/* pipe daemon (operations on pipes) */
 #define RSHD      (-13)		/* remote shell daemon */
+#define RAMFSD    (-14)		/* ramdisk file daemon (operations on files, STANDALONE) */
 
 /* The generic daemon -- used only for generating new daemons */
 #define DAEMOND (-9999)		/* ID - only used when daemon installed */
@@ -33,6 +33,10 @@
 #define VGA_DRAWC   0
 #define VGA_RETREAT 1
 #define VGA_PUTS    2
+#define VGA_RING_SETUP 3
+#define VGA_RING_KICK  4
+#define VGA_RING_SYNC  5
+#define VGA_RING_CLOSE 6
 
 /*
  * Interface to the bootstrap's internal VGA driver.
@@ -97,6 +101,48 @@ typedef struct {
         int ret;
 } Puts_resp_t;
 
+/*
+ * Console rings. Rather than a VGA_PUTS round trip per write(), a process
+ * whose stdout is vgad creates a Vga_ring_t, grants it to vgad and registers
+ * it with VGA_RING_SETUP. write() then only copies into data. Head and tail
+ * are running byte counts: the process moves head, vgad tail.
+ *
+ * vgad is told there is something to draw with a VGA_RING_KICK, which has
+ * no reply. The process sends one when it has written a whole line, has
+ * VGA_RING_FLUSH bytes waiting, or is about to block, and only if kicked is
+ * clear; it sets kicked as it sends. vgad clears kicked before it reads
+ * head, so bytes written after that read always bring another kick, and a
+ * busy writer costs vgad one message per batch rather than per line.
+ *
+ * VGA_RING_SYNC asks vgad to draw everything and reply; it is used when the
+ * ring is full and before fork. VGA_RING_CLOSE drains and drops the ring,
+ * with no reply. vgad has VGA_RINGS slots; when they are all taken it frees
+ * those of processes that have exited, and refuses the setup if none has.
+ * Such processes keep using VGA_PUTS.
+ */
+#define VGA_RING_SIZE  (16*1024)	/* a power of two */
+#define VGA_RING_FLUSH (VGA_RING_SIZE/4)
+#define VGA_RINGS      32
+
+typedef struct {
+        volatile uint32_t head;
+        volatile uint32_t tail;
+        volatile uint32_t kicked;
+        char data[VGA_RING_SIZE];
+} Vga_ring_t;
+
+/* VGA_RING_SETUP: shm_id names the region. The others leave it unused. */
+typedef struct {
+        int type;
+        int shm_id;
+} Ring_req_t;
+
+/* Replies to VGA_RING_SETUP and VGA_RING_SYNC */
+typedef struct {
+        int type;
+        int ret;
+} Ring_resp_t;
+
 /* This tells us how big a buffer we need to recv any valid msg. */
 typedef union {
   Vgaback_req_t vgaback_req;
@@ -107,16 +153,20 @@ typedef union {
   Retreat_resp_t retreat_resp;
   Puts_req_t puts_req;
   Puts_resp_t puts_resp;
+  Ring_req_t ring_req;
+  Ring_resp_t ring_resp;
 } Vgad_msg_t;
 
 void vga_set_loc(unsigned short*);
 void vga_setpos(int, int);
 void vga_clear(int);
 void vga_scroll(int);
+void vga_scroll_rows(int, int);
 void vga_drawc(int, int);
 void vga_cursor_display(void);
 void vga_advance(int);
 void vga_retreat(int);
 void vga_newline(void);
 void vga_tabline(void);
+void vga_puts(char*, int, int);
 
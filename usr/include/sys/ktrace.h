@@ -0,0 +1,51 @@
+#pragma once
+/*******************************************************************************
+ *
+ * File: ktrace.h
+ *
+ * The kernel and hypervisor trace record, as the trace program reads it
+ * with SC_TRACE and writes it to a dump. tools/ktrace turns a dump into
+ * Chrome trace JSON. The tracepoints are in sys/include/ktrace.h.
+ *
+ ******************************************************************************/
+#include <stdint.h>
+
+/* Events. Spans have a duration, the rest are points */
+#define KT_MSG_SEND   1		/* kmsg_send: pid sent to arg */
+#define KT_MSG_RECV   2		/* kmsg_recv: pid receives from arg */
+#define KT_SCHED      3		/* ksched_schedule: pid runs next */
+#define KT_INTR       4		/* interrupt: vector arg for pid */
+#define KT_SYSCALL    5		/* span, kernel_syscall: pid made call arg */
+#define KT_VMEM_ALLOC 6		/* span, vmem_alloc: arg bytes */
+#define KT_VMEXIT     7		/* span, vmexit to entry: vproc pid, reason arg */
+#define KT_NEVENTS    8
+
+#define KTRACE_EVENT_NAMES {						\
+    "none", "msg_send", "msg_recv", "sched", "interrupt",		\
+    "syscall", "vmem_alloc", "vmexit" }
+
+/* Where a record came from */
+#define KTRACE_SRC_KERNEL 0
+#define KTRACE_SRC_HYPV   1
+
+typedef struct {
+  uint64_t tsc;			/* when it happened, or the span started */
+  uint64_t arg;			/* per event, see above */
+  uint32_t dur;			/* span length in cycles; 0 for a point */
+  uint32_t seq;			/* ring position + 1; 0 while being written */
+  int32_t  pid;
+  uint16_t event;
+  uint8_t  cpu;
+  uint8_t  src;
+} Ktrace_rec_t;
+
+/* A dump: this header, then nrecs records */
+#define KTRACE_DUMP_MAGIC 0x4352544b	/* "KTRC" */
+
+typedef struct {
+  uint32_t magic;
+  uint32_t recsz;		/* sizeof(Ktrace_rec_t) */
+  uint64_t tsc_hz;		/* 0 if unknown */
+  uint64_t lost;		/* records overwritten before they were read */
+  uint64_t nrecs;
+} Ktrace_dump_t;
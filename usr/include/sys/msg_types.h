@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 /*
  * kmsg_types.h
  */
@@ -6,4 +7,5 @@
 /* Keyboard interrupt msg */
 typedef struct {
   int type;
+  uint64_t tsc;			/* when the kernel took the interrupt */
 } Hwint_msg_t;
@@ -8,6 +8,7 @@
 #include <sbin/syspid.h>
 #include <sbin/pci_structs.h>
 #include <signal.h>
+#include <sys/ktrace.h>
 
 #ifdef USER
 #include <time.h>
@@ -18,6 +19,11 @@
 
 #define MAX_FNAME_SZ 64
 #define MAX_PS_SZ 64
+#define MAX_BOOTTIME_SZ 63	/* BOOTTIME_MAX, sys/include/boottime.h */
+#define MAX_BOOTTIME_NAME 24	/* BOOTTIME_NAMESZ */
+#define MAX_TRACE_SZ 64		/* KTRACE_BATCH, sys/include/ktrace.h */
+#define MAX_PROF_SZ 32		/* profile lines in a reply */
+#define MAX_PROF_NAME 32
 
 /* SYSCALL MESSAGE TYPES */
 #define HARD_INT    0   /* All hardware interrupts */
@@ -54,7 +60,16 @@
 #define SC_MAP_MMIO 26
 #define SC_MAP_DMA  27
 #define SC_MSI_EN  29
-/*note next number is 30 !!!! */
+#define SC_RAMDISK 30	/* map_ramdisk()/sync_ramdisk() -- ramfsd only */
+#define SC_SHM_CREATE 31 /* shm_create()             */
+#define SC_SHM_MAP    32 /* shm_map()                */
+#define SC_SHM_UNMAP  33 /* shm_unmap()              */
+#define SC_BOOTTIME   34 /* boot_mark()/boot_timeline() */
+#define SC_TRACE      35 /* trace_enable()/trace_read() */
+#define SC_PROF       36 /* prof_start()/prof_stop()/prof_read() */
+#define SC_POLLPOST   37 /* poll_post() -- daemons only */
+#define SC_SHM_GRANT  38 /* shm_grant()              */
+/*note next number is 39 !!!! */
 
 /* fork */
 typedef struct {
@@ -252,18 +267,54 @@ typedef struct {
 }Map_dma_resp_t;
 
 
-/* poll */
+/*
+ * poll -- the fds are watched by the daemons, which post the events to
+ * the kernel; it keeps them for the process until its poll() waits.
+ * POLL_BEGIN names the poll() (no reply), so that only its events are
+ * kept; POLL_WAIT is answered with them, once every daemon armed has
+ * posted POLL_DONE_FD and there is an event, or at once when the timeout
+ * is 0, or when it runs out (-1 is no timeout).
+ */
+#define POLL_BEGIN   0
+#define POLL_WAIT    1
+#define POLL_MAXEV   32		/* events in a reply */
+#define POLL_DONE_FD -1		/* fd of a daemon's last post for an arm */
+
+typedef struct {
+  int fd;
+  short revents;
+} Poll_event_t;
+
 typedef struct {
   int type;
-  char poll_structure[1024]; /* This should be a a pointer to a struct */	
-  int nfds; /* Number of FDs */
-  int timeout;
+  unsigned int tag;		/* names the poll() call */
+  int op;			/* POLL_BEGIN, POLL_WAIT */
+  int timeout;			/* ms */
+  int owed;			/* arms sent, each ends in POLL_DONE_FD */
 } Poll_req_t;
 
 typedef struct {
-  int ret_val;
+  int type;
+  unsigned int tag;
+  int ret_val;			/* events, -1 if not this poll() */
+  Poll_event_t ev[POLL_MAXEV];
 } Poll_resp_t;
 
+/* poll_post */
+typedef struct {
+  int type;
+  unsigned int tag;
+  int pid;			/* the poll()ing process */
+  unsigned int ptag;		/* its poll() */
+  Poll_event_t ev;
+} Poll_post_req_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int ret_val;			/* -1 if pid is gone or sender not allowed */
+} Poll_post_resp_t;
+
 /* get_core */
 typedef struct {
   int type;
@@ -397,6 +448,165 @@ typedef struct {
 
 
 
+/* ramdisk -- lets the ramdisk server (usr/sbin/ramfsd) read and write the 
+ * filesystem the kernel loads programs from */
+#define RAMDISK_OP_MAP  1	/* map the ramdisk read/write */
+#define RAMDISK_OP_SYNC 2	/* filesystem changed, drop the kernel's caches */
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int op;
+} Ramdisk_req_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int ret;
+  uint64_t *virt_addr;		/* RAMDISK_OP_MAP: where it is mapped */
+  uint64_t size;		/* RAMDISK_OP_MAP: bytes mapped */
+  uint64_t fs_offset;		/* RAMDISK_OP_MAP: byte offset of the filesystem */
+} Ramdisk_resp_t;
+
+/* shared memory -- a region is created by one process, which names the 
+ * pids allowed to map it; children forked afterwards share it too. Any 
+ * process allowed to map it may grant it to another pid (shm_grant) */
+#define SHM_MAX_GRANTS 8		/* pids a region can be granted to */
+#define SHM_MAX_SIZE   (16*1024*1024)	/* largest region */
+#define SHM_CONTIG     0x1		/* physically contiguous, for DMA */
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  uint64_t size;
+  int flags;			/* SHM_CONTIG */
+  int ngrants;
+  int grants[SHM_MAX_GRANTS];
+} Shm_create_req_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int id;
+} Shm_map_req_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  void *vaddr;
+} Shm_unmap_req_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int id;
+  int pid;
+} Shm_grant_req_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int ret;
+  int id;			/* region id */
+  void *vaddr;			/* where it is mapped in the caller */
+  uint64_t size;		/* bytes mapped */
+  uint64_t paddr;		/* SHM_CONTIG: physical address, creator only */
+  int owner;			/* map: pid that created the region */
+} Shm_resp_t;
+
+/* boot timeline -- when each phase of the boot started, see 
+ * sys/include/boottime.h. Until the timeline is closed, anyone may add a 
+ * mark; the first shell prompt closes it */
+#define BOOTTIME_OP_GET   1	/* the marks so far */
+#define BOOTTIME_OP_MARK  2	/* a phase called name starts now */
+#define BOOTTIME_OP_CLOSE 3	/* boot ended now, at name */
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int op;
+  char name[MAX_BOOTTIME_NAME];
+} Boottime_req_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int ret;
+  int entries;			/* marks in the timeline */
+  int closed;			/* boot is over */
+  uint64_t tsc_hz;		/* 0 if unknown */
+  uint64_t tsc[MAX_BOOTTIME_SZ];
+  char name[MAX_BOOTTIME_SZ][MAX_BOOTTIME_NAME];
+} Boottime_resp_t;
+
+/* tracepoints -- kernel and hypervisor events, see sys/include/ktrace.h.
+ * Only there if the system was built with KTRACE. A read takes records
+ * from the rings of one source (KTRACE_SRC_*); each is read once */
+#define TRACE_OP_ON   1		/* KTRACE_OP_ON */
+#define TRACE_OP_OFF  2
+#define TRACE_OP_READ 3
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int op;
+  int src;			/* read: KTRACE_SRC_KERNEL or _HYPV */
+} Trace_req_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int ret;			/* -1: not built with KTRACE; on/off: 1 if it was on */
+  int n;			/* records */
+  uint64_t lost;		/* overwritten before this read */
+  uint64_t tsc_hz;
+  Ktrace_rec_t recs[MAX_TRACE_SZ];
+} Trace_resp_t;
+
+/* sampling profiler -- see sys/include/kprof.h. Start, stop, then read
+ * the flat profile, MAX_PROF_SZ lines at a time from line first, the
+ * busiest first */
+#define PROF_OP_START 1
+#define PROF_OP_STOP  2
+#define PROF_OP_READ  3
+
+/* What to sample on. Without a PMU every event falls back to the timer */
+#define PROF_EV_CYCLES       0	/* unhalted core cycles */
+#define PROF_EV_INSTRUCTIONS 1	/* instructions retired */
+#define PROF_EV_LLC_MISSES   2	/* last level cache misses */
+#define PROF_EV_TIMER        3	/* the systick */
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int op;
+  int event;			/* start: PROF_EV_* */
+  uint64_t period;		/* start: events per sample, 0 for default */
+  int first;			/* read: first line wanted */
+} Prof_req_t;
+
+typedef struct {
+  uint64_t count;		/* samples */
+  uint64_t addr;		/* start of the function, or the sample */
+  int pid;
+  int kernel;			/* in the kernel, on behalf of pid */
+  char proc[MAX_PROF_NAME];
+  char func[MAX_PROF_NAME];	/* "" if there is no symbol */
+} Prof_line_t;
+
+typedef struct {
+  int type;
+  unsigned int tag;
+  int ret;			/* start: the event it samples on; -1 busy */
+  int event;
+  uint64_t period;
+  uint64_t samples;		/* taken */
+  uint64_t dropped;		/* buffer full */
+  int lines;			/* in the whole profile */
+  int n;			/* in this reply */
+  Prof_line_t line[MAX_PROF_SZ];
+} Prof_resp_t;
+
 /* This provides the maximum msg size the systask expects to recieve */
 typedef union {
   Fork_req_t fork_req;
@@ -429,6 +639,8 @@ typedef union {
   Pci_set_config_resp_t pci_set_resp;
   Poll_req_t poll_req;
   Poll_resp_t poll_resp;
+  Poll_post_req_t poll_post_req;
+  Poll_post_resp_t poll_post_resp;
   Get_core_req_t Get_core_req;
   Get_core_resp_t Get_core_resp;
   Ps_req_t ps_req;
@@ -459,17 +671,49 @@ typedef union {
   Map_mmio_resp_t mmio_resp;
   Msi_en_req_t    msi_req;
   Msi_en_resp_t    msi_resp;
+  Ramdisk_req_t ramdisk_req;
+  Ramdisk_resp_t ramdisk_resp;
+  Shm_create_req_t shm_create_req;
+  Shm_map_req_t shm_map_req;
+  Shm_unmap_req_t shm_unmap_req;
+  Shm_grant_req_t shm_grant_req;
+  Shm_resp_t shm_resp;
+  Boottime_req_t boottime_req;
+  Boottime_resp_t boottime_resp;
+  Trace_req_t trace_req;
+  Trace_resp_t trace_resp;
+  Prof_req_t prof_req;
+  Prof_resp_t prof_resp;
    
 
 } Systask_msg_t;
 
 int getstr(char *s, int len);
+int get_core();
 void bsleep(int ms);
 int clock_gettime(clockid_t clk_id, struct timespec *tp);
 // int ifconfig(char *interface, struct in_addr *ip, struct in_addr *nm, struct in_addr *gw);
 uint16_t* map_vga_mem();
+void *map_ramdisk(uint64_t *size, uint64_t *fs_offset);
+int sync_ramdisk();
+void *shm_create(uint64_t size, int *grants, int ngrants, int *id);
+void *shm_create_dma(uint64_t size, int *grants, int ngrants, int *id, 
+		     uint64_t *paddr);
+void *shm_map(int id, uint64_t *size);
+void *shm_map_owner(int id, uint64_t *size, int *owner);
+int shm_unmap(void *addr);
+int shm_grant(int id, int pid);
+int poll_post(int pid, unsigned int ptag, int fd, short revents);
+int boot_mark(char *name, int last);
+int boot_timeline(Boottime_resp_t *resp);
+int trace_enable(int on);
+int trace_read(int src, Trace_resp_t *resp);
+int prof_start(int event, uint64_t period);
+int prof_stop();
+int prof_read(int first, Prof_resp_t *resp);
 void reboot();
 void unmask_irq(unsigned char irq);
+void user_eoi();
 int force_vmexit(uint64_t int1, uint64_t int2, void *strct_1);
 
 void kprintint(char *strp,int val,int src);
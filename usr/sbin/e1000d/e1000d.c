@@ -59,6 +59,8 @@ typedef union {
 	Ndrv_init_req_t init_req;
 	Pkt_msg_t outpkt_msg;
 	E1000_ping_req_t pq;
+	Ndrv_rxrefill_msg_t refill_msg;
+	Ndrv_txkick_msg_t kick_msg;
 } E1000_msg_t;
 
 /* Message-handling functions */
@@ -70,10 +72,14 @@ void e1000_do_outpkt  (E1000_msg_t*, Msg_status_t*);
 void e1000_do_invalid (E1000_msg_t *, Msg_status_t*);
 
 void e1000_do_ping (E1000_msg_t *, Msg_status_t*);
+void e1000_do_rxrefill (E1000_msg_t *, Msg_status_t*);
+void e1000_do_txkick (E1000_msg_t *, Msg_status_t*);
+void e1000_do_poll (E1000_msg_t *, Msg_status_t*);
+void e1000_do_stats (E1000_msg_t *, Msg_status_t*);
 
-#define E1000_FUNC_ARRAY_SZ 4
+#define E1000_FUNC_ARRAY_SZ 9
 /* CAUTION: Order of these functions must match numbers defined in kmsg.h */
-void (*func_array[E1000_FUNC_ARRAY_SZ])(E1000_msg_t*, Msg_status_t*) = { e1000_do_hwint, e1000_do_sendmac, e1000_do_outpkt, e1000_do_ping };
+void (*func_array[E1000_FUNC_ARRAY_SZ])(E1000_msg_t*, Msg_status_t*) = { e1000_do_hwint, e1000_do_sendmac, e1000_do_outpkt, e1000_do_ping, e1000_do_invalid, e1000_do_rxrefill, e1000_do_txkick, e1000_do_poll, e1000_do_stats };
 
 
 /* Start function. */
@@ -151,7 +157,9 @@ void e1000_main_loop() {
  * Calls the hardware interrupt service routine 				 *	
  *===============================================================*/
 void e1000_do_hwint(E1000_msg_t *msg, Msg_status_t *status) {
-	e1000_interrupt();
+	if (status->src != HARDWARE)
+		return;
+	e1000_interrupt(msg->hwint_msg.tsc);
 }
 
 /*===============================================================*
@@ -196,3 +204,39 @@ void e1000_do_ping (E1000_msg_t *msg, Msg_status_t *status) {
 	resp.value = e1000_is_up;
 	msgsend(status->src, &resp, sizeof(E1000_ping_resp_t));
 }
+
+/*===============================================================*
+ *				e1000_do_rxrefill	 						     *
+ * netd has returned receive buffers we asked for				 *	
+ *===============================================================*/
+void e1000_do_rxrefill (E1000_msg_t *msg, Msg_status_t *status) {
+	if (status->src != NETD)
+		return;
+	e1000_rx_refill();
+}
+
+/*===============================================================*
+ *				e1000_do_txkick		 						     *
+ * netd has put frames on the transmit ring					 *	
+ *===============================================================*/
+void e1000_do_txkick (E1000_msg_t *msg, Msg_status_t *status) {
+	if (status->src != NETD)
+		return;
+	e1000_tx_kick();
+}
+
+/*===============================================================*
+ *				e1000_do_poll		 						     *
+ * Next pass of the polling loop, from ourselves				 *	
+ *===============================================================*/
+void e1000_do_poll (E1000_msg_t *msg, Msg_status_t *status) {
+	e1000_poll();
+}
+
+/*===============================================================*
+ *				e1000_do_stats		 						     *
+ * Prints the card's counters on the console					 *	
+ *===============================================================*/
+void e1000_do_stats (E1000_msg_t *msg, Msg_status_t *status) {
+	e1000_stats();
+}
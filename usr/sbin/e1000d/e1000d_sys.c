@@ -86,6 +86,7 @@ static e1000_t e1000_state;
 e1000_t *e;
 static Pci_dev_t e1000_dev;
 static void e1000_linkinput(uint8_t *dbuf);
+static int e1000_frame_len(uint8_t *dbuf);
 static uint16_t e1000_htons(uint16_t n);
 static uint16_t e1000_ntohs(uint16_t n);
 static void send_linkstatus(unsigned int ifnum, int status);
@@ -115,8 +116,48 @@ static int e1000_init_rx(e1000_t *e);
 /*turn on and configure interrupts */
 static void e1000_init_intr(e1000_t *e);
 
-//static void e1000_tx_intr();
-static void e1000_rx_intr();
+static int e1000_rx_intr();
+
+/*zero-copy receive into buffers shared with netd */
+static int e1000_init_rx_shared(e1000_t *e);
+static int e1000_rx_batch(e1000_t *e);
+static void e1000_rx_arm(e1000_t *e);
+static int e1000_init_tx_shared(e1000_t *e, uint64_t *paddr);
+static void e1000_tx_reclaim(e1000_t *e);
+static void e1000_tx_unblock(e1000_t *e);
+static void e1000_tx_intr();
+
+/*interrupt moderation and polling */
+static void e1000_moderate(e1000_t *e, int n);
+static void e1000_set_itr(e1000_t *e, int level);
+static void e1000_poll_next();
+static uint64_t e1000_rdtsc();
+
+/* 
+ * Interrupt moderation levels, from least to most delay. ITR is in 256ns 
+ * units, RDTR and RADV in 1.024us units.
+ */
+typedef struct {
+  uint32_t itr;		/* minimum gap between interrupts */
+  uint32_t rdtr;	/* wait this long after a frame for another */
+  uint32_t radv;	/* but no longer than this after the first */
+} e1000_itr_level_t;
+
+static const e1000_itr_level_t e1000_itr_levels[] = {
+  {   0,  0,   0 },	/* an interrupt for every frame */
+  { 196,  0,   0 },	/* at most ~20000 interrupts/s */
+  { 976, 32, 128 },	/* at most ~4000 interrupts/s, for bulk traffic */
+};
+
+#define E1000_ITR_EPOCH  32	/* interrupts between moderation changes */
+#define E1000_POLL_ENTER 32	/* frames in one interrupt that start polling */
+#define E1000_POLL_IDLE  16	/* empty polls in a row that stop it */
+
+/* netd's slots line up with our descriptors and buffers */
+#if NETTX_BUF_NR != E1000_TXDESC_NR || NETTX_BUF_SIZE != E1000_IOBUF_SIZE || \
+  NETRX_BUF_SIZE != E1000_IOBUF_SIZE
+#error "netd's shared buffers do not match the e1000 descriptors"
+#endif
 
 /*for talking to the nic card phy interface */
 int e1000_read_phy_reg(e1000_t *e, uint16_t phy_reg, uint16_t *phy_data);
@@ -459,23 +500,28 @@ static int e1000_init_tx(e1000_t *e){
 
 
   /***************Buffers ***************************/
-  dma_req.type = SC_MAP_DMA;
-  dma_req.tag = dma_resp.tag = get_msg_tag();
-  dma_req.num_bytes = E1000_TXDESC_NR * E1000_IOBUF_SIZE;
-
-  msgsend(SYS, &dma_req, sizeof(Map_dma_req_t));
-  msgrecv(SYS, &dma_resp, sizeof(Map_dma_resp_t), &status);
+  /* Share the buffers with netd if we can, otherwise it sends us frames */
+  if (e1000_init_tx_shared(e, &tx_buff_p) != 0) {
+    dma_req.type = SC_MAP_DMA;
+    dma_req.tag = dma_resp.tag = get_msg_tag();
+    dma_req.num_bytes = E1000_TXDESC_NR * E1000_IOBUF_SIZE;
+
+    msgsend(SYS, &dma_req, sizeof(Map_dma_req_t));
+    msgrecv(SYS, &dma_resp, sizeof(Map_dma_resp_t), &status);
 #ifdef NET_DEBUG
-  printf("TX Buf dma vaddr %p paddr %p size %X\n", dma_resp.virt_addr, dma_resp.phys_addr, dma_req.num_bytes);
+    printf("TX Buf dma vaddr %p paddr %p size %X\n", dma_resp.virt_addr, dma_resp.phys_addr, dma_req.num_bytes);
 #endif
-  e->tx_buffer = (uint8_t *)(dma_resp.virt_addr);
-  tx_buff_p    = (uint64_t)dma_resp.phys_addr;
+    e->tx_buffer = (uint8_t *)(dma_resp.virt_addr);
+    tx_buff_p    = (uint64_t)dma_resp.phys_addr;
+  }
 	
-  /*Add a buffer to each descirptor  */
+  /*Add a buffer to each descirptor, for good  */
   for (i = 0; i < E1000_TXDESC_NR; i++)
     {
       e->tx_desc[i].buffer = tx_buff_p + (i * E1000_IOBUF_SIZE);
     }	
+  e->tx_tail = 0;
+  e->tx_clean = 0;
 
   /* Setup the transmit ring registers.  */
   e1000_reg_write(e, E1000_REG_TDBAL, e->tx_desc_p & 0xFFFFFFFF );
@@ -492,6 +538,33 @@ static int e1000_init_tx(e1000_t *e){
 
   e1000_reg_write(e, E1000_REG_TIPG, 10);
 
+  return 0;
+}
+
+/*===========================================================================*
+ *				e1000_init_tx_shared 					     *
+ * Sets up the transmit buffers and a Nettx_ring_t in memory shared with    *
+ * netd. The physical address of the buffers goes in *paddr.                 *
+ *===========================================================================*/
+static int e1000_init_tx_shared(e1000_t *e, uint64_t *paddr){
+  int grants[1];
+
+  grants[0] = NETD;
+  e->tx_buffer = shm_create_dma(NETTX_BUF_NR * NETTX_BUF_SIZE, grants, 1,
+				&e->tx_buffer_id, paddr);
+  if (e->tx_buffer == NULL)
+    return 1;
+  e->tx_ring = shm_create(sizeof(Nettx_ring_t), grants, 1, &e->tx_ring_id);
+  if (e->tx_ring == NULL) {
+    shm_unmap(e->tx_buffer);
+    e->tx_buffer = NULL;
+    e->tx_buffer_id = 0;
+    return 1;
+  }
+#ifdef NET_DEBUG
+  printf("TX buf shm vaddr %p paddr %p ring %p\n", e->tx_buffer, (void *)*paddr, e->tx_ring);
+#endif
+  return 0;
 }
 
 static int e1000_init_rx(e1000_t *e){
@@ -519,26 +592,29 @@ static int e1000_init_rx(e1000_t *e){
   memset(e->rx_desc, 0, sizeof(e1000_rx_desc_t) * E1000_RXDESC_NR);
 
 
-  /***************Buffers ***************************/
-  dma_req.type = SC_MAP_DMA;
-  dma_req.tag = dma_resp.tag = get_msg_tag();
-  dma_req.num_bytes = E1000_RXDESC_NR * E1000_IOBUF_SIZE;
+  e->rx_tail = 0;		
 
-  msgsend(SYS, &dma_req, sizeof(Map_dma_req_t));
-  msgrecv(SYS, &dma_resp, sizeof(Map_dma_resp_t), &status);
+  /***************Buffers ***************************/
+  /* Share the buffers with netd if we can, otherwise copy frames to it */
+  if (e1000_init_rx_shared(e) != 0) {
+    dma_req.type = SC_MAP_DMA;
+    dma_req.tag = dma_resp.tag = get_msg_tag();
+    dma_req.num_bytes = E1000_RXDESC_NR * E1000_IOBUF_SIZE;
+
+    msgsend(SYS, &dma_req, sizeof(Map_dma_req_t));
+    msgrecv(SYS, &dma_resp, sizeof(Map_dma_resp_t), &status);
 #ifdef NET_DEBUG  
-  printf("RX buf dma vaddr %p paddr %p size %x\n", dma_resp.virt_addr, dma_resp.phys_addr, dma_req.num_bytes);
+    printf("RX buf dma vaddr %p paddr %p size %x\n", dma_resp.virt_addr, dma_resp.phys_addr, dma_req.num_bytes);
 #endif
-  e->rx_buffer = (uint8_t *)dma_resp.virt_addr;
-  rx_buff_p    = (uint64_t)dma_resp.phys_addr;
+    e->rx_buffer = (uint8_t *)dma_resp.virt_addr;
+    rx_buff_p    = (uint64_t)dma_resp.phys_addr;
 
-  /*Add a buffer to each descirptor  */
-  for (i = 0; i < E1000_RXDESC_NR; i++)
-    {
-      e->rx_desc[i].buffer = rx_buff_p + (i * E1000_IOBUF_SIZE);
-    }
-	
-  e->rx_tail = 0;		
+    /*Add a buffer to each descirptor  */
+    for (i = 0; i < E1000_RXDESC_NR; i++)
+      {
+	e->rx_desc[i].buffer = rx_buff_p + (i * E1000_IOBUF_SIZE);
+      }
+  }
 
   /* Setup the receive ring registers.  */
   e1000_reg_write(e, E1000_REG_MTA,   0);
@@ -551,6 +627,53 @@ static int e1000_init_rx(e1000_t *e){
   e1000_reg_unset(e, E1000_REG_RCTL,  E1000_REG_RCTL_BSIZE);
   e1000_reg_set(e,   E1000_REG_RCTL,  E1000_REG_RCTL_EN);
 
+  return 0;
+}
+
+/*===========================================================================*
+ *				e1000_init_rx_shared 					     *
+ * Sets up NETRX_BUF_NR receive buffers and a Netrx_ring_t in memory shared  *
+ * with netd, and gives all but one descriptor a buffer. The rest are spare  *
+ * so that the card can keep receiving while netd holds some of them.       *
+ *===========================================================================*/
+static int e1000_init_rx_shared(e1000_t *e){
+  uint64_t paddr;
+  int grants[1], i;
+
+  grants[0] = NETD;
+  e->rx_buffer = shm_create_dma(NETRX_BUF_NR * NETRX_BUF_SIZE, grants, 1,
+				&e->rx_buffer_id, &paddr);
+  if (e->rx_buffer == NULL)
+    return 1;
+  e->rx_ring = shm_create(sizeof(Netrx_ring_t), grants, 1, &e->rx_ring_id);
+  if (e->rx_ring == NULL) {
+    shm_unmap(e->rx_buffer);
+    e->rx_buffer = NULL;
+    e->rx_buffer_id = 0;
+    return 1;
+  }
+  e->rx_buffer_p = paddr;
+#ifdef NET_DEBUG  
+  printf("RX buf shm vaddr %p paddr %p ring %p\n", e->rx_buffer, (void *)paddr, e->rx_ring);
+#endif
+
+  e->rx_nfree = 0;
+  for (i = NETRX_BUF_NR - 1; i >= 0; i--)
+    e->rx_free[e->rx_nfree++] = i;
+  for (i = 0; i < E1000_RXDESC_NR; i++)
+    e->rx_bufidx[i] = -1;
+
+  /* same as the copying path: RDT one short of a full ring */
+  e->rx_refill = 0;
+  e->rx_armed = 0;
+  while (e->rx_armed < e->rx_desc_count - 1) {
+    i = e->rx_free[--e->rx_nfree];
+    e->rx_desc[e->rx_refill].buffer = paddr + (uint64_t)i * NETRX_BUF_SIZE;
+    e->rx_bufidx[e->rx_refill] = i;
+    e->rx_refill++;
+    e->rx_armed++;
+  }
+  return 0;
 }
 
 
@@ -576,22 +699,20 @@ static void e1000_reset_card(e1000_t *e)
  *==========================================================================*/
 static void e1000_init_intr(e1000_t *e){
 
+  /* Start with no moderation; e1000_moderate adjusts it to the load. */
+  e1000_set_itr(e, 0);
+
   /* Enable interrupts. */
+  e1000_reg_write(e, E1000_REG_IMCR, 0xFFFFFFFF);
   e1000_reg_write(e,   E1000_REG_IMS, E1000_REG_IMS_LSC   |
 		  E1000_REG_IMS_SRPD |
 		  E1000_REG_IMS_RXT |   
+		  E1000_REG_IMS_RXDMT |   
 		  E1000_REG_IMS_RXO);/* |
 					E1000_REG_IMS_TXDW |
 					E1000_REG_IMS_TXQE);*/
-	
-  //	e1000_reg_set(e, E1000_REG_RADV,  100); //reeive abs delay
-	
-  //	e1000_reg_set(e, E1000_REG_RDTR, 0); //receive delay timer
-	
-  //e1000_reg_set(e, E1000_REG_ITR, 0xffff); 
-	
-  e1000_reg_write(e, E1000_REG_IMCR, 0xFFF60000 | E1000_REG_ICR_RXT | E1000_REG_IMS_TXQE	);
 										 
+  /* small packets (acks) skip the receive delay timer */
   e1000_reg_set(e, E1000_REG_RSRPD, 0x1ff );
 										 
 }
@@ -601,63 +722,143 @@ static void e1000_init_intr(e1000_t *e){
  *Main entry point for interrupts, called by the driver main loop when the   *
  *kernel sends us an interrupt message. 
  *===========================================================================*/
-void e1000_interrupt(){
+void e1000_interrupt(uint64_t tsc){
   uint32_t cause;
+  int n = 0;
 
   /*
-   * Check the card for interrupt reason(s).
+   * Check the card for interrupt reason(s), and deal with all of them.
    */
 
   /* Read the Interrupt Cause Read register. */
-  if((cause = e1000_reg_read(e, E1000_REG_ICR))){
-    //printf("cause is %x \n", cause);
-    if(cause & ( E1000_REG_ICR_RXT)){
-      //printf("read timer Interrupt \n");	
-      e1000_rx_intr();
-      //e1000_reg_write(e, E1000_REG_ICR, 0);
-      unmask_irq(e1000_dev.interrupt_line);
-      return;
-				
-    }
-    else if (cause & 0x80000000){
-      unmask_irq(e1000_dev.interrupt_line);
-      return;
-    }	
-    else if(cause & E1000_REG_ICR_LSC){
-      //printf("link status change intr \n");
-      e1000_check_link(e);
-    }
-    else if(cause & (E1000_REG_ICR_RXO )){
-      printf("read overrun Interrupt \n");	
-    }
-    else if(cause & ( E1000_REG_ICR_RXSEQ)){
-      printf("read sequence error \n");
-    }
-    else if(cause & ( E1000_REG_ICR_RXDMT)){
-      printf("warning running out of descriptors\n");
-    }
-    else if(cause & ( E1000_REG_ICR_SRPD)){
-      printf("small packed received \n ");
-      e1000_rx_intr();
-    }
-    else if(cause & ( E1000_REG_ICR_PHYINT)){
-      printf(" phyint occurred \n");
-    }
-    else if(cause & ( E1000_REG_ICR_TXDW)){
-      printf("completed transmits \n");
-    }
-    else if(cause & ( E1000_REG_ICR_TXQE)){
-      //printf("transmit queue empty \n");
-    }	
-    else{
-      printf("unknown Interrupt %d \n", cause);
+  cause = e1000_reg_read(e, E1000_REG_ICR);
+  if (cause == 0) {
+    unmask_irq(e1000_dev.interrupt_line);
+    return;
+  }
+  e->stats.intrs++;
+
+  if(cause & E1000_REG_ICR_LSC){
+    //printf("link status change intr \n");
+    e1000_check_link(e);
+  }
+  if(cause & E1000_REG_ICR_RXO)
+    e->stats.OVW++;
+  if(cause & E1000_REG_ICR_RXSEQ)
+    printf("read sequence error \n");
+  if(cause & E1000_REG_ICR_PHYINT)
+    printf(" phyint occurred \n");
+
+  /* only enabled while netd waits for room, see e1000_tx_unblock */
+  if(cause & E1000_REG_ICR_TXDW)
+    e1000_tx_intr();
+
+  if(cause & (E1000_REG_ICR_RXT | E1000_REG_ICR_SRPD | 
+	      E1000_REG_ICR_RXDMT | E1000_REG_ICR_RXO)){
+    n = e1000_rx_intr();
+    if (n > 0) {
+      e->stats.rxLatency += e1000_rdtsc() - tsc;
+      e->stats.rxLatencyN++;
     }
   }
+  e->stats.intrPkts += n;
+  e1000_moderate(e, n);
+
+  /* 
+   * Busy: leave the irq masked and poll the card until it goes quiet. The
+   * kernel only sends the EOI with the unmask, so send it now.
+   */
+  if (n >= E1000_POLL_ENTER) {
+    e->polling = 1;
+    e->poll_idle = 0;
+    user_eoi();
+    e1000_poll_next();
+    return;
+  }
+
   /*re-enable interrupts after servicing the previous one */
-	
   unmask_irq(e1000_dev.interrupt_line);
 }
 
+/*===========================================================================*
+ *				e1000_poll											     *
+ * One pass of the polling loop. Each pass queues the next as a message to   *
+ * ourselves, so messages from netd are still handled in between.           *
+ *===========================================================================*/
+void e1000_poll(){
+  int n;
+
+  if (!e->polling)
+    return;
+
+  n = e1000_rx_intr();
+  e1000_tx_intr();
+  e->stats.polls++;
+  e->stats.pollPkts += n;
+
+  if (n > 0)
+    e->poll_idle = 0;
+  else if (++e->poll_idle >= E1000_POLL_IDLE) {
+    /* quiet again, back to interrupts */
+    e->polling = 0;
+    unmask_irq(e1000_dev.interrupt_line);
+    return;
+  }
+  e1000_poll_next();
+}
+
+static void e1000_poll_next(){
+  E1000_ping_req_t msg;
+  static int self = 0;
+
+  if (self == 0)
+    self = getpid();
+  msg.type = E1000_POLL;
+  msgsend(self, &msg, sizeof(E1000_ping_req_t));
+}
+
+/*===========================================================================*
+ *				e1000_moderate											     *
+ * Every E1000_ITR_EPOCH interrupts, picks the moderation level from the     *
+ * average number of frames per interrupt: few frames want low latency, many *
+ * want fewer interrupts.                                                    *
+ *===========================================================================*/
+static void e1000_moderate(e1000_t *e, int n){
+  int ppi, level;
+
+  e->itr_pkts += n;
+  if (++e->itr_intrs < E1000_ITR_EPOCH)
+    return;
+
+  ppi = e->itr_pkts / e->itr_intrs;
+  e->itr_intrs = 0;
+  e->itr_pkts = 0;
+
+  if (ppi < 2)
+    level = 0;
+  else if (ppi < 16)
+    level = 1;
+  else
+    level = 2;
+  if (level != e->itr_level)
+    e1000_set_itr(e, level);
+}
+
+static void e1000_set_itr(e1000_t *e, int level){
+
+  e->itr_level = level;
+  e1000_reg_write(e, E1000_REG_ITR,  e1000_itr_levels[level].itr);
+  e1000_reg_write(e, E1000_REG_RDTR, e1000_itr_levels[level].rdtr);
+  e1000_reg_write(e, E1000_REG_RADV, e1000_itr_levels[level].radv);
+}
+
+static uint64_t e1000_rdtsc(){
+  uint32_t lo, hi;
+
+  asm volatile("rdtscp" : "=a"(lo), "=d"(hi) :: "rcx" );
+  return (uint64_t)(lo) | ((uint64_t)(hi) << 32);
+}
+
 
 /*===========================================================================*
  *			e1000_output_pkt				                                 *
@@ -667,9 +868,17 @@ void e1000_output_pkt(Pkt_msg_t *pkt ){
   e1000_tx_desc_t *desc;
   uint64_t  tail;
 
-  /* Find the head, tail and current descriptors. */
-  tail =  e1000_reg_read(e, E1000_REG_TDT);
+  if (pkt->len <= 0 || pkt->len > sizeof(pkt->pkt))
+    return;
 
+  /* Don't write over a descriptor the card has not sent yet. */
+  e1000_tx_reclaim(e);
+  if (e->tx_tail - e->tx_clean >= e->tx_desc_count - 1) {
+    e->stats.txFull++;
+    return;
+  }
+
+  tail = e->tx_tail % e->tx_desc_count;
   desc = &e->tx_desc[tail];
 	
   memcpy(e->tx_buffer + (tail * E1000_IOBUF_SIZE),
@@ -699,42 +908,132 @@ void e1000_output_pkt(Pkt_msg_t *pkt ){
   }	
 #endif 
 
-  /* Mark this descriptor ready. */
+  /* Mark this descriptor ready, and have the card tell us when it's sent. */
   desc->status  = 0;
   desc->length  = pkt->len;
   desc->command = E1000_TX_CMD_EOP  |
-    E1000_TX_CMD_FCS; /* |
-			 E1000_TX_CMD_RS;*/
+    E1000_TX_CMD_FCS |
+    E1000_TX_CMD_RS;
 	
   /* Move to next descriptor. */
-  tail   = (tail + 1) % e->tx_desc_count;
+  e->tx_tail++;
+  e->stats.txPkts++;
+  e->stats.txKicks++;
 	
   /* Increment tail. Start transmission. */
-  e1000_reg_write(e, E1000_REG_TDT,  tail);
-	
+  e1000_reg_write(e, E1000_REG_TDT,  e->tx_tail % e->tx_desc_count);
+}
 
+/*===========================================================================*
+ *				e1000_tx_kick            				     *
+ * netd has put frames on the shared ring. Gives them all to the card with  *
+ * one write of the tail register.                                           *
+ *===========================================================================*/
+void e1000_tx_kick(){
+  Nettx_ring_t *r = e->tx_ring;
+  e1000_tx_desc_t *desc;
+  uint32_t head, i;
+
+  if (r == NULL)
+    return;
+
+  /* netd moves head before it looks at kicked */
+  r->kicked = 0;
+  __sync_synchronize();
+  head = r->head;
+  __sync_synchronize();
+
+  e1000_tx_reclaim(e);
+  if (head - e->tx_clean > e->tx_desc_count - 1) {
+    printf("[%s] netd overran the transmit ring\n", e->name);
+    head = e->tx_tail;
+  }
+
+  if (head != e->tx_tail) {
+    for (; e->tx_tail != head; e->tx_tail++) {
+      i = e->tx_tail % e->tx_desc_count;
+      desc = &e->tx_desc[i];
+      desc->status  = 0;
+      desc->length  = r->len[i] <= NETTX_BUF_SIZE ? r->len[i] : 0;
+      desc->command = E1000_TX_CMD_EOP | E1000_TX_CMD_FCS | E1000_TX_CMD_RS;
+      e->stats.txPkts++;
+    }
+    r->tail = e->tx_tail;
+    e1000_reg_write(e, E1000_REG_TDT, e->tx_tail % e->tx_desc_count);
+    e->stats.txKicks++;
+  }
+
+  e1000_tx_unblock(e);
 }
 
+/*===========================================================================*
+ *				e1000_tx_reclaim            			     *
+ * Takes back the descriptors the card has finished sending.                 *
+ *===========================================================================*/
+static void e1000_tx_reclaim(e1000_t *e){
+  e1000_tx_desc_t *desc;
+
+  while (e->tx_clean != e->tx_tail) {
+    desc = &e->tx_desc[e->tx_clean % e->tx_desc_count];
+    if (!(desc->status & E1000_TX_STATUS_DONE))
+      break;
+    desc->status = 0;
+    e->tx_clean++;
+  }
+
+  if (e->tx_ring != NULL) {
+    __sync_synchronize();
+    e->tx_ring->done = e->tx_clean;
+  }
+}
+
+/*===========================================================================*
+ *				e1000_tx_unblock            			     *
+ * If netd is holding frames back for lack of room, tells it to go ahead    *
+ * once half the ring is free. Until then the card interrupts us as it      *
+ * finishes descriptors.                                                     *
+ *===========================================================================*/
+static void e1000_tx_unblock(e1000_t *e){
+  Nettx_ring_t *r = e->tx_ring;
+  Net_txready_msg_t msg;
+
+  if (r == NULL || !r->blocked)
+    return;
+
+  if (e->tx_tail - e->tx_clean > e->tx_desc_count / 2) {
+    e1000_reg_write(e, E1000_REG_IMS, E1000_REG_IMS_TXDW);
+    /* in case it finished before the interrupt was on */
+    e1000_tx_reclaim(e);
+    if (e->tx_tail - e->tx_clean > e->tx_desc_count / 2)
+      return;
+  }
+
+  e1000_reg_write(e, E1000_REG_IMCR, E1000_REG_IMS_TXDW);
+  r->blocked = 0;
+  msg.type = NET_TX_READY;
+  msg.ifnum = e->ifnumber;
+  msgsend(NETD, &msg, sizeof(Net_txready_msg_t));
+}
 
 /*===========================================================================*
  *				e1000_tx_intr            								     *
- *Used to handle Tx interrupts that we currently don't enable as theyre not  *
- * needed at the moment. However if you do here you go.                      *
+ * The card has sent frames while netd was waiting for room.                 *
  *===========================================================================*/
-#if 0
 static void e1000_tx_intr(){
 
-  e1000_t *e = &e1000_state;
-  e->status |= E1000_TRANSMIT;
+  e1000_tx_reclaim(e);
+  e1000_tx_unblock(e);
 }
-#endif
 
 
 /*===========================================================================*
  *				e1000_read_from interupt								     *
  *===========================================================================*/
-static void e1000_rx_intr(){
-  int tail, drop=0;
+static int e1000_rx_intr(){
+  int tail, drop=0, n=0;
+
+  if (e->rx_ring != NULL)
+    return e1000_rx_batch(e);
 	
   while( (e->rx_desc[e->rx_tail].status) & (1 << 0) ){
     if(e->rx_desc[e->rx_tail].errors){
@@ -744,24 +1043,159 @@ static void e1000_rx_intr(){
 	
     if(drop	== 0){
       e1000_linkinput(e->rx_buffer + ((e->rx_tail) * E1000_IOBUF_SIZE));
+      n++;
     }
 		
     e->rx_desc[e->rx_tail].status = (uint16_t)0;
     e->rx_tail = (e->rx_tail + 1) %e->rx_desc_count;
     e1000_reg_write(e, E1000_REG_RDT, e->rx_tail);
   }
+  return n;
+}
+
+
+/*===========================================================================*
+ *				e1000_rx_batch		 				     *
+ * Passes every received frame to netd through the shared ring, with one     *
+ * message for the lot if netd is not already on its way to the ring, then   *
+ * gives the descriptors new buffers.                                        *
+ *===========================================================================*/
+static int e1000_rx_batch(e1000_t *e){
+  Netrx_ring_t *r = e->rx_ring;
+  e1000_rx_desc_t *desc;
+  Net_batch_msg_t msg;
+  uint32_t head;
+  int idx, len, n = 0;
+
+  head = r->rx_head;
+  while (e->rx_armed > 0 && 
+	 (e->rx_desc[e->rx_tail].status & E1000_RX_STATUS_DONE)) {
+    desc = &e->rx_desc[e->rx_tail];
+    idx = e->rx_bufidx[e->rx_tail];
+    len = 0;
+    if (desc->errors)
+      printf("warning packet errors \n");
+    else
+      len = e1000_frame_len(e->rx_buffer + idx * NETRX_BUF_SIZE);
+    if (len > desc->length)
+      len = 0;
+
+    if (len > 0) {
+      r->rx[head % NETRX_RING_NR].idx = idx;
+      r->rx[head % NETRX_RING_NR].len = len;
+      head++;
+      n++;
+    }
+    else
+      e->rx_free[e->rx_nfree++] = idx;
+
+    desc->status = 0;
+    e->rx_bufidx[e->rx_tail] = -1;
+    e->rx_tail = (e->rx_tail + 1) % e->rx_desc_count;
+    e->rx_armed--;
+  }
+
+  if (n > 0) {
+    /* netd clears pending before it reads rx_head, so one of us sees the
+     * other's write and no batch is left sitting in the ring */
+    __sync_synchronize();
+    r->rx_head = head;
+    __sync_synchronize();
+    e->stats.rxPkts += n;
+    if (!r->pending) {
+      r->pending = 1;
+      msg.type = NET_PKT_BATCH;
+      msg.ifnum = e->ifnumber;
+      msgsend(NETD, &msg, sizeof(Net_batch_msg_t));
+      e->stats.rxBatches++;
+    }
+  }
+
+  e1000_rx_arm(e);
+  return n;
 }
 
+/*===========================================================================*
+ *				e1000_rx_arm		 				     *
+ * Takes back the buffers netd has finished with and gives them to empty     *
+ * descriptors. If that leaves the card short, asks netd for NDRV_RXREFILL.  *
+ *===========================================================================*/
+static void e1000_rx_arm(e1000_t *e){
+  Netrx_ring_t *r = e->rx_ring;
+  uint32_t head, tail;
+  int idx, armed;
+
+  armed = e->rx_armed;
+  for (;;) {
+    head = r->free_head;
+    __sync_synchronize();
+    for (tail = r->free_tail; tail != head; tail++) {
+      idx = r->free[tail % NETRX_RING_NR];
+      if (idx < NETRX_BUF_NR && e->rx_nfree < NETRX_BUF_NR)
+	e->rx_free[e->rx_nfree++] = idx;
+    }
+    __sync_synchronize();
+    r->free_tail = tail;
+
+    while (e->rx_armed < e->rx_desc_count - 1 && e->rx_nfree > 0) {
+      idx = e->rx_free[--e->rx_nfree];
+      e->rx_desc[e->rx_refill].buffer = e->rx_buffer_p + 
+	(uint64_t)idx * NETRX_BUF_SIZE;
+      e->rx_desc[e->rx_refill].status = 0;
+      e->rx_bufidx[e->rx_refill] = idx;
+      e->rx_refill = (e->rx_refill + 1) % e->rx_desc_count;
+      e->rx_armed++;
+    }
+
+    if (e->rx_armed >= e->rx_desc_count / 2)
+      break;
+    /* netd sets free_head before it looks at starved */
+    r->starved = 1;
+    __sync_synchronize();
+    if (r->free_head == tail)
+      break;
+  }
+
+  if (e->rx_armed != armed)
+    e1000_reg_write(e, E1000_REG_RDT, e->rx_refill);
+}
+
+/*===========================================================================*
+ *				e1000_rx_refill		 			     *
+ * netd returned buffers while we were short of them.                        *
+ *===========================================================================*/
+void e1000_rx_refill(){
+
+  if (e->rx_ring != NULL)
+    e1000_rx_arm(e);
+}
 
 /*============================================================================*
  *				e1000_linkinput		 						     			  *
  * Called by the rx interrupt routine to send a packe up to lwip			  *	
  *===========================================================================*/
 static void e1000_linkinput(uint8_t *dbuf) {
-  struct eth_hdr *ethhdr;
   Pkt_msg_t pkt;
+
+  pkt.len = e1000_frame_len(dbuf);
+  if (pkt.len == 0)
+    return;
+  pkt.type = NET_PKT_INCOMING;
+  pkt.ifnum = e->ifnumber;
+
+  memcpy(pkt.pkt, dbuf, pkt.len);
+  msgsend(NETD, &pkt, sizeof(Pkt_msg_t) - 1600 + pkt.len);
+}
+
+/*============================================================================*
+ *				e1000_frame_len		 						     			  *
+ * Bytes of the frame in dbuf worth passing up to lwip, 0 to drop it		  *	
+ *===========================================================================*/
+static int e1000_frame_len(uint8_t *dbuf) {
+  struct eth_hdr *ethhdr;
   struct ip_hdr *iphdr;
   uint16_t ip_total_length, eth_hdr_len;
+  int len;
 			
   /* Examine the packet and see if this is something we're interested in. */
   ethhdr = (struct eth_hdr *)dbuf;
@@ -771,13 +1205,7 @@ static void e1000_linkinput(uint8_t *dbuf) {
     case ETHTYPE_ARP:
       /* APR packets are 42 bytes so kick that up*/
       /*also this prevents some idiot from using it as a covert comm link */
-      pkt.len = 42;
-      pkt.type = NET_PKT_INCOMING;  
-      pkt.ifnum = e->ifnumber;
-
-      memcpy(pkt.pkt, dbuf, pkt.len);
-      msgsend(NETD, &pkt, sizeof(Pkt_msg_t) - 1600 + pkt.len);
-      break;
+      return 42;
 
     case ETHTYPE_IP:
       /*we need to get the size of the ip packet out of the header */
@@ -785,20 +1213,15 @@ static void e1000_linkinput(uint8_t *dbuf) {
       iphdr = (struct ip_hdr*)(dbuf+eth_hdr_len);
       ip_total_length = e1000_ntohs(IPH_LEN(iphdr));
 
-      pkt.len = ip_total_length + eth_hdr_len;
-      if(pkt.len > 1600){
+      len = ip_total_length + eth_hdr_len;
+      if(len > 1600){
 	printf(" got to big of a packet");
-	break;
+	return 0;
       }
-      pkt.type = NET_PKT_INCOMING;
-      pkt.ifnum = e->ifnumber;
-		
-      memcpy(pkt.pkt, dbuf, pkt.len);
-      msgsend(NETD, &pkt, sizeof(Pkt_msg_t) - 1600 + pkt.len);
-      break;	
+      return len;
 	
     default:
-      return;
+      return 0;
     } 
 }
 
@@ -830,6 +1253,10 @@ void e1000_getmac_addr(Ndrv_init_resp_t *resp) {
   resp->eaddr[5] = e1000_state.address.ea_addr[5];
 
   resp->ifnum = e->ifnumber;
+  resp->rx_ring_id = e->rx_ring_id;
+  resp->rx_buf_id = e->rx_buffer_id;
+  resp->tx_ring_id = e->tx_ring_id;
+  resp->tx_buf_id = e->tx_buffer_id;
 
 }
 
@@ -851,9 +1278,27 @@ static void e1000_getstats(e1000_t *e){
 	
 }
 
+/*===========================================================================*
+ *				e1000_stats											     *
+ *===========================================================================*/
+void e1000_stats(){
+
+  e1000_getstats(e);
+  e1000_printstats(e);
+}
+
 static void e1000_printstats(e1000_t *e){
 
   printf("pktT %d, pct_GT %d, alignE %d, CRCe %d \n", e->stats.packetT, e->stats.good_pktT, e->stats.err_align, e->stats.CRCerr );
+  printf("rxPkts %d, rxBatches %d \n", e->stats.rxPkts, e->stats.rxBatches);
+  printf("txPkts %d, txKicks %d, txFull %d \n", e->stats.txPkts, e->stats.txKicks, e->stats.txFull);
+  printf("intrs %d, intrPkts %d, polls %d, pollPkts %d, intrs/1000 pkts %d \n",
+	 e->stats.intrs, e->stats.intrPkts, e->stats.polls, e->stats.pollPkts,
+	 e->stats.intrPkts + e->stats.pollPkts ? 
+	 (int)(e->stats.intrs * 1000ULL / (e->stats.intrPkts + e->stats.pollPkts)) : 0);
+  printf("itr level %d, polling %d, overruns %d, rx latency %llu cycles \n",
+	 e->itr_level, e->polling, e->stats.OVW, e->stats.rxLatencyN ? 
+	 (unsigned long long)(e->stats.rxLatency / e->stats.rxLatencyN) : 0ULL);
 
 }
 /* Utility function for endian byteswapping */
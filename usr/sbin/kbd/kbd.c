@@ -33,12 +33,15 @@
 #include <msg.h>	  /* For msgsend/msgrecv */
 #include <msg_types.h>
 #include <signal.h>
+#include <poll.h>
+#include <utils/queue.h>
 
 #include <sbin/syspid.h>
 #include <sbin/pio.h>	  /* For Port IO */
 #include <sbin/kbd.h>
 #include <sbin/vgad.h>
 #include <sbin/kb_scancodes.h> /* For scancodes */
+#include <sbin/pollev.h>
 
 /* Keyboard communication */
 #define KB_DATA 0x60	  /* For receiving keyboard scancodes */
@@ -54,6 +57,10 @@ static volatile uint8_t      ctrled;  	/* left ctrl key pressed? */
 /* Keyboard Buffer */
 static char kb_buf[MAX_STR_SZ];/* Key buffer */
 static unsigned int buf_pos;   /* How many chars waiting in buf */
+static int line_ready;         /* A full line is waiting for a reader */
+
+/* poll() watches on stdin */
+static queue_t *pollers;
 
 /* Current Request */
 static int req_pid;       /* Who asked for a string? */
@@ -66,6 +73,7 @@ static int vga_backup(int cols);
 typedef union {
   Getstr_req_t getstr_req;
   Hwint_msg_t keyb_int;
+  Pollev_req_t poll_req;
 } Keyb_msg_t;
 
 /*
@@ -90,13 +98,14 @@ typedef union {
 /* These are the functions called when a message comes in. */
 static void handle_keypress(Keyb_msg_t*, Msg_status_t*);
 static void handle_kb_request(Keyb_msg_t*, Msg_status_t*);
+static void handle_poll(Keyb_msg_t*, Msg_status_t*);
 
 /* These numbers must match the syscall types in kmsg.h */
-#define KEYB_MSGTYPE_MAX  1
+#define KEYB_MSGTYPE_MAX  2
 #define KEYB_NUM_MSGTYPES (KEYB_MSGTYPE_MAX + 1)
 
 static void (*func_array[KEYB_NUM_MSGTYPES])(Keyb_msg_t*, Msg_status_t*) = 
- { handle_keypress, handle_kb_request };
+ { handle_keypress, handle_kb_request, handle_poll };
 
 /* Other Functions */
 static void handle_invalid(Keyb_msg_t*, Msg_status_t*);
@@ -171,6 +180,8 @@ static void kb_init() {
   buf_pos--;
 #endif
   req_pid = -1;
+  line_ready = 0;
+  pollers = qopen();
 }
 
 
@@ -206,6 +217,12 @@ static void handle_kb_request(Keyb_msg_t *msg, Msg_status_t *status) {
 	/* Save request */
 	req_pid = pid;
 
+	/* A line typed before anyone asked for it */
+	if (line_ready) {
+		complete_req();
+		return;
+	}
+
 	/* Wait for string from hardware */
 	while(req_pid != -1) {
 		msgrecv(HARDWARE, msg, sizeof(Keyb_msg_t), status);
@@ -242,8 +259,9 @@ static void handle_keypress(Keyb_msg_t *msg, Msg_status_t *status) {
     return;
   }
 #endif
-  /* Print character and service request if user pushed enter.  */
-  if (print) {
+  /* Print character and service request if user pushed enter. Keys
+   * typed while a finished line waits for its reader are dropped. */
+  if (print && !line_ready) {
     kbputchar(new_char);
 
     kb_buf[buf_pos++] = new_char;
@@ -299,7 +317,7 @@ static int translate_scancode(uint8_t code, char *new_char) {
   case 0x1d: ctrled  	= 	1;	break; 	/* left ctrl pressed */
   case 0x9d: ctrled		=		0;	break;	/* left ctrl released */
   case 0x0e: /* Backspace */
-    if (buf_pos != 0) {
+    if (buf_pos != 0 && !line_ready) {
       buf_pos--;
       kb_buf[buf_pos] = '\0';  /* Update buf */
       vga_backup(1);          /* Update screen */
@@ -351,24 +369,60 @@ static int translate_scancode(uint8_t code, char *new_char) {
 /*
  * Function: complete_req()
  *
- * Description: Respond to the pending request, if it exists.
+ * Description: Respond to the pending request, if it exists. Otherwise
+ *              the line is kept for the next request and anyone polling
+ *              stdin is told it can be read.
  */
 static void complete_req() {
   Getstr_resp_t resp;
   unsigned int cp_len;
   
-  if (req_pid != -1) {
-    cp_len = buf_pos + 1;
-    resp.type = KEYB_GETSTR;
-    resp.slen = cp_len;
-    memcpy(resp.str, kb_buf, cp_len);
-    msgsend(req_pid, &resp, sizeof(Getstr_resp_t));
+  if (req_pid == -1) {
+    line_ready = 1;
+    pollev_notify(pollers, POLLIN);
+    return;
   }
+
+  cp_len = buf_pos + 1;
+  resp.type = KEYB_GETSTR;
+  resp.slen = cp_len;
+  memcpy(resp.str, kb_buf, cp_len);
+  msgsend(req_pid, &resp, sizeof(Getstr_resp_t));
+
   /* Reset request state */
   clear_buf();
+  line_ready = 0;
   req_pid = -1;
 }
 
+/*
+ * Function: handle_poll()
+ *
+ * Description: Watch stdin for a poll(). Stdin is readable once a full
+ *              line is waiting and always writable (writes go to vgad).
+ */
+static void handle_poll(Keyb_msg_t *msg, Msg_status_t *status) {
+  Pollev_req_t *req;
+  Pollev_fd_t *fds;
+  short revents;
+  int i, nfds;
+
+  req = &msg->poll_req;
+  fds = pollev_interest(status->src, req, &nfds);
+  for (i = 0; i < nfds; i++) {
+    revents = fds[i].events & POLLOUT;
+    if (line_ready)
+      revents |= fds[i].events & POLLIN;
+
+    if (revents || 
+	pollev_watch(pollers, status->src, req->tag, fds[i].fd, fds[i].events) < 0)
+      if (pollev_post(status->src, req->tag, fds[i].fd, 
+		      revents ? revents : POLLERR) < 0)
+	return;			/* gone, and its set with it */
+  }
+  pollev_post(status->src, req->tag, POLLEV_DONE, 0);
+}
+
 /* Puts a character on the screen. */
 static int kbputchar(char c) {
   Drawc_req_t req;
@@ -40,6 +40,7 @@
 #include <malloc.h>
 #include <string.h>
 #include <msg.h>      /* For msgsend and msgrecv       */
+#include <syscall.h>  /* For shm_map_owner             */
 #include <stdint.h>
 
 #include <utils/queue.h>
@@ -82,7 +83,6 @@ static void print_timestamp();
 
 struct bsock_struct;
 
-/* Used for select() */
 /** A callback prototype to inform about events for a netconn */
 typedef void (* bsock_callback)(struct bsock_struct *, enum netconn_evt, u16_t len);
 
@@ -138,12 +138,21 @@ typedef struct bsock_struct {
   size_t recv_len;     /* How much data did the caller ask for      */
   int recv_flags;      /* What flags did the caller give            */
   
-  bsock_callback callback; /* Used to implement select() */
+  /* Bulk buffers shared with the owner, see Net_sbuf_t in netd.h */
+  Net_sbuf_t *sbuf;    /* Mapped region, or NULL                    */
+  int write_sbuf;      /* Sending from sbuf->snd, not write_buf     */
+  int recv_sbuf;       /* Receiving into sbuf->rcv, not a message   */
+  
+  /* For poll() */
+  queue_t *pollers;    /* Pollev_watch_t's, see sbin/pollev.h       */
+  int rcv_eof;         /* The peer closed its end (TCP)             */
+  bsock_callback callback; /* Posts readiness events to pollers */
 } bsock_t;
 
 typedef struct {
   bsock_t *sock;
   Net_recv_resp_t *resp;
+  Net_sring_t *ring;   /* Copy into this ring rather than resp->buf */
   int recvlen;
   int bytes_copied;
   int pbufs_to_dequeue;
@@ -219,6 +228,7 @@ static uint8_t  bsock_recv_raw(void *arg, struct raw_pcb *pcb, struct pbuf *p,
 static err_t bsock_do_sendto(bsock_t *sock, struct netbuf *buf);
 static err_t bsock_do_write(bsock_t *sock, void *dataptr, size_t size, uint8_t apiflags);
 static err_t bsock_do_writemore(bsock_t *sock);
+static err_t bsock_sbuf_writemore(bsock_t *sock);
 static err_t bsock_do_delconn(bsock_t *sock);
 static void bsock_drain(bsock_t *sock);
 static void bsock_free_rq(bsock_t *sock);
@@ -691,6 +701,7 @@ void bsock_recvfrom(Net_recv_req_t *req, Msg_status_t *status) {
   }
   
   /* Do the recvfrom part */
+  sock->recv_sbuf = 0;
   err = bsock_do_recvfrom(sock, req->len, req->flags);
   
  bsock_recvfrom_out:
@@ -731,6 +742,7 @@ void bsock_recv(Net_recv_req_t *req, Msg_status_t *status) {
     goto bsock_recv_out;
   }
   
+  sock->recv_sbuf = 0;
   err = bsock_do_recvfrom(sock, req->len, req->flags);
   
  bsock_recv_out:
@@ -750,6 +762,149 @@ void bsock_recv(Net_recv_req_t *req, Msg_status_t *status) {
   BSOCK_FUNC_EXIT();
 }
 
+/* 
+ * Register the bulk buffers for a socket, in place of any it had. The region
+ * must have been created by the socket's owner, so one process cannot point
+ * netd at another's. The owner is waiting on us, so the old one is idle.
+ */
+void bsock_sbuf_setup(Net_sbuf_setup_req_t *req, Msg_status_t *status) {
+  Net_sbuf_resp_t resp;
+  bsock_t *sock;
+  Net_sbuf_t *sbuf;
+  uint64_t size;
+  int owner;
+  err_t err;
+  
+  sock = bsock_get_sock(req->sockfd);
+  if (bsock_validate_sock(sock, status->src) != 0) {
+    err = ERR_CONN;
+    goto bsock_sbuf_setup_out;
+  }
+  
+  /* Only TCP streams */
+  if (sock->stype != NETCONN_TCP) {
+    err = ERR_VAL;
+    goto bsock_sbuf_setup_out;
+  }
+  
+  sbuf = (Net_sbuf_t *)shm_map_owner(req->shm_id, &size, &owner);
+  if (sbuf == NULL) {
+    err = ERR_MEM;
+    goto bsock_sbuf_setup_out;
+  }
+  if (owner != status->src || size < sizeof(Net_sbuf_t)) {
+    BSOCK_LOG("[BSOCK] Error: bad region given to bsock_sbuf_setup\n");
+    shm_unmap(sbuf);
+    err = ERR_VAL;
+    goto bsock_sbuf_setup_out;
+  }
+  
+  if (sock->sbuf != NULL)
+    shm_unmap(sock->sbuf);
+  sock->sbuf = sbuf;
+  err = ERR_OK;
+  
+ bsock_sbuf_setup_out:
+  
+  resp.type = NET_SBUF_SETUP;
+  resp.ret = (err == ERR_OK) ? 0 : -1;
+  resp.errno = err_to_errno(err);
+  msgsend(status->src, &resp, sizeof(Net_sbuf_resp_t));
+}
+
+/* Doorbell: the owner has put req->len bytes in sbuf->snd */
+void bsock_sbuf_send(Net_sbuf_req_t *req, Msg_status_t *status) {
+  Net_sbuf_resp_t resp;
+  Net_sring_t *ring;
+  bsock_t *sock;
+  int flags;
+  err_t err;
+  
+  flags = req->flags;
+  
+  sock = bsock_get_sock(req->sockfd);
+  if (bsock_validate_sock(sock, status->src) != 0 || sock->sbuf == NULL) {
+    err = ERR_CONN;
+    goto bsock_sbuf_send_out;
+  }
+  
+  /* The owner can only post what is actually in the ring */
+  ring = &(sock->sbuf->snd);
+  if (req->len > (size_t)(ring->head - ring->tail) || req->len == 0) {
+    err = ERR_VAL;
+    goto bsock_sbuf_send_out;
+  }
+  
+  if (ERR_IS_FATAL(sock->last_err)) {
+    err = sock->last_err;
+  } else if (sock->state != NETCONN_NONE) {
+    err = ERR_INPROGRESS;
+  } else if (tcp_conn(sock) == NULL) {
+    err = ERR_CONN;
+  } else {
+    sock->state        = NETCONN_WRITE;
+    sock->write_offset = 0;
+    sock->write_flags  = NETCONN_COPY |
+      ((flags & MSG_MORE)     ? NETCONN_MORE      : 0) |
+      ((flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0);
+    sock->write_buf    = NULL;
+    sock->write_len    = req->len;
+    sock->write_sbuf   = 1;
+    sock->blocked_on   = BSOCK_BL_SEND;
+    err = bsock_sbuf_writemore(sock);
+  }
+  
+ bsock_sbuf_send_out:
+  
+  /* If there was an error, inform user */
+  if (err != ERR_OK) {
+    resp.type = NET_SBUF_SEND;
+    resp.ret = -1;
+    resp.errno = err_to_errno(err);
+    msgsend(status->src, &resp, sizeof(Net_sbuf_resp_t));
+  }
+  
+  /* User will be notified when netd has taken everything (or fails) */
+}
+
+/* Doorbell: the owner has emptied sbuf->rcv and wants more */
+void bsock_sbuf_recv(Net_sbuf_req_t *req, Msg_status_t *status) {
+  Net_sbuf_resp_t resp;
+  Net_sring_t *ring;
+  bsock_t *sock;
+  err_t err;
+  
+  sock = bsock_get_sock(req->sockfd);
+  if (bsock_validate_sock(sock, status->src) != 0 || sock->sbuf == NULL) {
+    err = ERR_CONN;
+    goto bsock_sbuf_recv_out;
+  }
+  
+  if (ERR_IS_FATAL(sock->last_err)) {
+    err = sock->last_err;
+    goto bsock_sbuf_recv_out;
+  }
+  
+  /* Fill whatever room the ring has */
+  ring = &(sock->sbuf->rcv);
+  sock->recv_sbuf = 1;
+  err = bsock_do_recvfrom(sock, NET_SBUF_SIZE - (ring->head - ring->tail), 
+			  req->flags & ~MSG_PEEK); /* the owner peeks at the ring */
+  if (err != ERR_OK)
+    sock->recv_sbuf = 0;
+  
+ bsock_sbuf_recv_out:
+  
+  /* Send response immediately if there was an error */
+  if (err != ERR_OK) {
+    resp.type = NET_SBUF_RECV;
+    resp.ret = -1;
+    resp.errno = err_to_errno(err);
+    msgsend(status->src, &resp, sizeof(Net_sbuf_resp_t));
+  }
+  
+  /* Otherwise, a message will be sent once recv completes */
+}
 
 void bsock_ghbn(Net_ghbn_req_t *req, Msg_status_t *status) {
   
@@ -814,17 +969,57 @@ void bsock_update_owner(Net_update_owner_req_t *req, Msg_status_t *status) {
   msgsend(status->src, &resp, sizeof(Net_update_owner_resp_t));
 }
 
-int bsock_has_data(int sockfd) {
-  bsock_t *sock = bsock_get_sock(sockfd);
-  if(sock == NULL) return 0;
-  return (sock->rq_len > 0);
+/*
+ * Which of events the socket is ready for right now. Changes after this
+ * arrive through bsock_event_callback.
+ */
+static short bsock_revents(bsock_t *sock, short events) {
+  short revents;
+  struct tcp_pcb *pcb;
+
+  revents = 0;
+  if (sock->rq_len > 0 || sock->rcv_eof ||
+      (sock->aq_valid && sock->aq_len > 0))
+    revents |= POLLIN;
+
+  if (sock->stype == NETCONN_TCP) {
+    pcb = tcp_conn(sock);
+    if (pcb == NULL)		/* bsock_err_tcp took it */
+      revents |= POLLERR | POLLHUP;
+    else if ((pcb->state == ESTABLISHED || pcb->state == CLOSE_WAIT) &&
+	     tcp_sndbuf(pcb) > 0)
+      revents |= POLLOUT;
+  }
+  else
+    revents |= POLLOUT;		/* datagrams never wait for room */
+
+  return revents & (events | POLLERR | POLLHUP);
 }
 
-int bsock_is_closed(int sockfd) {
-  bsock_t *sock = bsock_get_sock(sockfd);
-  return 0;
-  if(sock == NULL) return 1;
-  else return (sock->shutdown_state == NETCONN_SHUT_RDWR || sock->state == NETCONN_CLOSE);
+/* Watch the sockets a poll() is interested in */
+void bsock_poll_arm(Pollev_req_t *req, Msg_status_t *status) {
+  bsock_t *sock;
+  Pollev_fd_t *fds;
+  short revents;
+  int i, nfds;
+
+  fds = pollev_interest(status->src, req, &nfds);
+  for (i = 0; i < nfds; i++) {
+    sock = bsock_get_sock(fds[i].fd);
+    if (sock == NULL)
+      revents = POLLNVAL;
+    else
+      revents = bsock_revents(sock, fds[i].events);
+
+    if (revents ||
+	pollev_watch(sock->pollers, status->src, req->tag, 
+		     fds[i].fd, fds[i].events) < 0)
+      if (pollev_post(status->src, req->tag, fds[i].fd, 
+		      revents ? revents : POLLERR) < 0)
+	return;			/* gone, and its set with it */
+  }
+
+  pollev_post(status->src, req->tag, POLLEV_DONE, 0);
 }
 
 /*** PRIVATE HELPER FUNCTIONS ***/
@@ -878,6 +1073,15 @@ static int bsock_alloc_sockfd(void *conn, int accepted, int pid, bsock_t **sockp
   sp->recv_len     = 0;
   sp->rq_len       = 0;
   sp->last_off     = 0;
+  sp->sbuf         = NULL;
+  sp->write_sbuf   = 0;
+  sp->recv_sbuf    = 0;
+  sp->rcv_eof      = 0;
+  if((sp->pollers = qopen())==NULL) {
+    free(sp);
+    *sockp = NULL;
+    return ERR_MEM;
+  }
   sp->callback     = bsock_event_callback;
   shput(opensockets,sp,nextsockfd);
   *sockp=sp;
@@ -888,6 +1092,13 @@ static int bsock_alloc_sockfd(void *conn, int accepted, int pid, bsock_t **sockp
 static void bsock_free_sockfd(int sockfd) {
   bsock_t *sockp;
   sockp = shremove(opensockets,lookup,sockfd);
+  if (sockp == NULL)
+    return;
+  if (sockp->sbuf != NULL)
+    shm_unmap(sockp->sbuf);
+  /* anyone still polling it hears that it is gone */
+  pollev_notify(sockp->pollers, POLLNVAL);
+  qclose(sockp->pollers);
   free(sockp);
 }
 
@@ -1168,6 +1379,7 @@ static err_t bsock_do_write(bsock_t *sock, void *dataptr, size_t size, uint8_t a
 	  sock->write_flags  = apiflags;
 	  sock->write_buf    = buf;
 	  sock->write_len    = size;
+	  sock->write_sbuf   = 0;
 	  sock->blocked_on   = BSOCK_BL_SEND;
 	  
 	  err = bsock_do_writemore(sock);
@@ -1211,6 +1423,8 @@ static err_t bsock_do_writemore(bsock_t *sock) {
     (sock->write_flags & NETCONN_DONTBLOCK);
   u8_t apiflags = sock->write_flags;
   
+  if (sock->write_sbuf)
+    return bsock_sbuf_writemore(sock);
   
   dataptr = (u8_t*)(sock->write_buf) + sock->write_offset;
   diff = sock->write_len - sock->write_offset;
@@ -1284,6 +1498,69 @@ static err_t bsock_do_writemore(bsock_t *sock) {
   return ERR_OK;
 }
 
+/**
+ * As do_writemore, for data in the socket's snd ring. tcp_write copies 
+ * straight out of the ring, a contiguous run at a time, for as long as 
+ * lwIP has room; the ring tail moves as bytes are taken so the owner can 
+ * refill behind us. Finishes once everything posted has been taken, or, for
+ * a nonblocking send, as soon as lwIP is full.
+ */
+static err_t bsock_sbuf_writemore(bsock_t *sock) {
+  Net_sring_t *ring;
+  err_t err = ERR_OK;
+  uint32_t idx;
+  u16_t len;
+  size_t diff;
+  u8_t apiflags;
+  u8_t dontblock = bsock_is_nonblocking(sock) ||
+    (sock->write_flags & NETCONN_DONTBLOCK);
+  
+  ring = &(sock->sbuf->snd);
+  
+  while (sock->write_offset < sock->write_len) {
+    apiflags = sock->write_flags;
+    idx = ring->tail % NET_SBUF_SIZE;
+    diff = sock->write_len - sock->write_offset;
+    if (diff > NET_SBUF_SIZE - idx)
+      diff = NET_SBUF_SIZE - idx;	/* stop at the end of the ring */
+    if (diff > tcp_sndbuf(tcp_conn(sock)))
+      diff = tcp_sndbuf(tcp_conn(sock));
+    if (diff == 0) {
+      err = ERR_MEM;
+      break;
+    }
+    len = (u16_t)diff;
+    if (sock->write_offset + len < sock->write_len)
+      apiflags |= TCP_WRITE_FLAG_MORE;
+    
+    err = tcp_write(tcp_conn(sock), &(ring->data[idx]), len, apiflags);
+    if (err != ERR_OK)
+      break;
+    ring->tail += len;
+    sock->write_offset += len;
+  }
+  
+  if ((err == ERR_OK) || (err == ERR_MEM))
+    tcp_output(tcp_conn(sock));
+  
+  /* ERR_MEM: wait for sent_tcp or poll_tcp, unless we may not block */
+  if ((err == ERR_MEM) && !dontblock)
+    return ERR_OK;
+  
+  if (err == ERR_MEM) {
+    sock->flags |= NETCONN_FLAG_CHECK_WRITESPACE;
+    API_EVENT(sock, NETCONN_EVT_SENDMINUS, 0);
+    err = (sock->write_offset > 0) ? ERR_OK : ERR_WOULDBLOCK;
+  }
+  
+  /* Tell the owner how much was taken */
+  sock->write_len = sock->write_offset;
+  sock->write_offset = 0;
+  sock->state = NETCONN_NONE;
+  bsock_wakeup(sock, err);
+  return ERR_OK;
+}
+
 static err_t bsock_do_recvfrom(bsock_t *sock, size_t len, int flags) {
   
   BSOCK_FUNC_ENTER();
@@ -1295,7 +1572,7 @@ static err_t bsock_do_recvfrom(bsock_t *sock, size_t len, int flags) {
   sock->recv_flags = flags;
   
   /* Due to message-passing constraints, a recv can only pass back so much info */
-  if (len > SOCKET_SNDBUF_MAX)
+  if (!sock->recv_sbuf && len > SOCKET_SNDBUF_MAX)
     len = SOCKET_SNDBUF_MAX;
   
   sock->recv_len = len;
@@ -1303,7 +1580,8 @@ static err_t bsock_do_recvfrom(bsock_t *sock, size_t len, int flags) {
   
   /* Check if there is enough data left from last recv operation */
   if (((sock->stype == NETCONN_TCP) && ((sock->rq_len) >= len)) ||
-      ((sock->stype == NETCONN_UDP) && ((sock->rq_len) > 0))) {
+      ((sock->stype == NETCONN_UDP) && ((sock->rq_len) > 0)) ||
+      (sock->recv_sbuf && ((sock->rq_len) > 0))) {
     BSOCK_LOG("[BSOCK] Enough data left from previous op\n");
     bsock_wakeup(sock, ERR_OK);
     return ERR_OK;
@@ -1367,6 +1645,7 @@ static err_t bsock_recv_tcp(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_
     len = p->tot_len;
   } else {
     len = 0;
+    sock->rcv_eof = 1;
   }
   
   if (qput(sock->rq, p) != 0) {
@@ -1383,7 +1662,7 @@ static err_t bsock_recv_tcp(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_
     /* Time to wake up the caller? */
     if ((sock->blocked_on) == BSOCK_BL_RECV) {
       BSOCK_LOG("Blocked on recv... ");
-      if ((p == NULL) || 
+      if ((p == NULL) || sock->recv_sbuf ||
 	  ((sock->rq_len) >= (sock->recv_len)) ||
 	  ((sock->rq_len) >= SOCKET_SNDBUF_MAX)) {
 	BSOCK_LOG("Tiem to wake up!");
@@ -2040,7 +2319,8 @@ static void bsock_wakeup_send(bsock_t *sock, err_t err) {
     sock->write_buf = NULL;
   }
   
-  resp.type = NET_SEND;
+  resp.type = sock->write_sbuf ? NET_SBUF_SEND : NET_SEND;
+  sock->write_sbuf = 0;
   if (err != ERR_OK) {
     BSOCK_LOG("BSOCK: send returning -1\n");
     resp.ret = -1;
@@ -2062,6 +2342,8 @@ static void bsock_wakeup_recv(bsock_t *sock, err_t err) {
   
   BSOCK_FUNC_ENTER();
   
+  copy_info.bytes_copied = 0;
+  
   /* Catch previous errors */
   if (ERR_IS_FATAL(sock->last_err)) {
     ret = -1;
@@ -2101,6 +2383,7 @@ static void bsock_wakeup_recv(bsock_t *sock, err_t err) {
   memset(&copy_info, 0, sizeof(bsock_copy_info_t));
   copy_info.sock = sock;
   copy_info.resp = &resp;
+  copy_info.ring = sock->recv_sbuf ? &(sock->sbuf->rcv) : NULL;
   copy_info.recvlen = sock->recv_len;
   copy_info.bytes_copied = 0;
   copy_info.pbufs_to_dequeue = 0;
@@ -2142,6 +2425,10 @@ static void bsock_wakeup_recv(bsock_t *sock, err_t err) {
     sock->last_off = copy_info.last_off;
   }
   
+  /* Hand the owner what we put in its ring */
+  if (copy_info.ring != NULL)
+    copy_info.ring->head += copy_info.bytes_copied;
+  
   err = ERR_OK;
   ret = copy_info.bytes_copied;
   
@@ -2180,6 +2467,17 @@ static void bsock_wakeup_recv(bsock_t *sock, err_t err) {
   sock->recv_len = 0;
   sock->recv_flags = 0;
   
+  /* The data is in the ring; the reply only carries the count */
+  if (sock->recv_sbuf) {
+    Net_sbuf_resp_t sresp;
+    sock->recv_sbuf = 0;
+    sresp.type = NET_SBUF_RECV;
+    sresp.ret = ret;
+    sresp.errno = err_to_errno(err);
+    msgsend(sock->pid, &sresp, sizeof(Net_sbuf_resp_t));
+    return;
+  }
+  
   /* Send message back to user */
   resp.hdr.type = NET_RECV;
   resp.hdr.sockfd = sock->sockfd;
@@ -2225,9 +2523,22 @@ static int bsock_copy_recv(void *elementp, const void *keyp) {
     copylen = copy_info->recvlen;
   }
   
-  /* Copy into buffer */
-  pbuf_copy_partial(p, (uint8_t*)(copy_info->resp->buf) + (copy_info->bytes_copied),
-		    copylen, copy_info->last_off);
+  /* Copy into buffer, or into the ring in up to two pieces */
+  if (copy_info->ring != NULL) {
+    Net_sring_t *ring = copy_info->ring;
+    uint32_t idx = (ring->head + copy_info->bytes_copied) % NET_SBUF_SIZE;
+    int first = NET_SBUF_SIZE - idx;
+    
+    if (first > copylen)
+      first = copylen;
+    pbuf_copy_partial(p, &(ring->data[idx]), first, copy_info->last_off);
+    if (first < copylen)
+      pbuf_copy_partial(p, ring->data, copylen - first, 
+			copy_info->last_off + first);
+  } else {
+    pbuf_copy_partial(p, (uint8_t*)(copy_info->resp->buf) + (copy_info->bytes_copied),
+		      copylen, copy_info->last_off);
+  }
   
   /* If this is the first packet we've copied, also need to copy addr info */
   if (copy_info->pbufs_to_dequeue == 0) {
@@ -2359,123 +2670,26 @@ static err_t bsock_getaddr(bsock_t *sock, ip_addr_t *addr, uint16_t *port, uint8
 
 /**
  * Callback registered in the netconn layer for each socket-netconn.
- * Processes recvevent (data available) and wakes up tasks waiting for select.
+ * Sends poll() events to the processes watching the socket.
  */
 static void bsock_event_callback(bsock_t *sock, enum netconn_evt evt, uint16_t len) {
-  
-  //	BSOCK_FUNC_ENTER();
-#if 0 /* FIXME: select() not implemented */
-  int s;
-  struct lwip_select_cb *scb;
-  int last_select_cb_ctr;
-  SYS_ARCH_DECL_PROTECT(lev);
-  
-  LWIP_UNUSED_ARG(len);
-  
-  /* Get socket */
-  if (conn) {
-    s = conn->socket;
-    if (s < 0) {
-      /* Data comes in right away after an accept, even though
-       * the server task might not have created a new socket yet.
-       * Just count down (or up) if that's the case and we
-       * will use the data later. Note that only receive events
-       * can happen before the new socket is set up. */
-      SYS_ARCH_PROTECT(lev);
-      if (conn->socket < 0) {
-	if (evt == NETCONN_EVT_RCVPLUS) {
-	  conn->socket--;
-	}
-	SYS_ARCH_UNPROTECT(lev);
-	return;
-      }
-      s = conn->socket;
-      SYS_ARCH_UNPROTECT(lev);
-    }
-    
-    sock = get_socket(s);
-    if (!sock) {
-      return;
-    }
-  } else {
-    return;
-  }
-  
-  SYS_ARCH_PROTECT(lev);
-  /* Set event as required */
+  short revents;
+
   switch (evt) {
   case NETCONN_EVT_RCVPLUS:
-    sock->rcvevent++;
-    break;
-  case NETCONN_EVT_RCVMINUS:
-    sock->rcvevent--;
+    revents = POLLIN;
     break;
   case NETCONN_EVT_SENDPLUS:
-    sock->sendevent = 1;
-    break;
-  case NETCONN_EVT_SENDMINUS:
-    sock->sendevent = 0;
+    revents = POLLOUT;
     break;
   case NETCONN_EVT_ERROR:
-    sock->errevent = 1;
-    break;
-  default:
-    LWIP_ASSERT("unknown event", 0);
+    revents = POLLERR;
     break;
-  }
-  
-  if (sock->select_waiting == 0) {
-    /* noone is waiting for this socket, no need to check select_cb_list */
-    SYS_ARCH_UNPROTECT(lev);
+  default:			/* the MINUS events make nothing ready */
     return;
   }
-  
-  /* Now decide if anyone is waiting for this socket */
-  /* NOTE: This code goes through the select_cb_list list multiple times
-     ONLY IF a select was actually waiting. We go through the list the number
-     of waiting select calls + 1. This list is expected to be small. */
-  
-  /* At this point, SYS_ARCH is still protected! */
- again:
-  for (scb = select_cb_list; scb != NULL; scb = scb->next) {
-    if (scb->sem_signalled == 0) {
-      /* semaphore not signalled yet */
-      int do_signal = 0;
-      /* Test this select call for our socket */
-      if (sock->rcvevent > 0) {
-	if (scb->readset && FD_ISSET(s, scb->readset)) {
-	  do_signal = 1;
-	}
-      }
-      if (sock->sendevent != 0) {
-	if (!do_signal && scb->writeset && FD_ISSET(s, scb->writeset)) {
-	  do_signal = 1;
-	}
-      }
-      if (sock->errevent != 0) {
-	if (!do_signal && scb->exceptset && FD_ISSET(s, scb->exceptset)) {
-	  do_signal = 1;
-	}
-      }
-      if (do_signal) {
-	scb->sem_signalled = 1;
-	/* Don't call SYS_ARCH_UNPROTECT() before signaling the semaphore, as this might
-	   lead to the select thread taking itself off the list, invalidagin the semaphore. */
-	sys_sem_signal(&scb->sem);
-      }
-    }
-    /* unlock interrupts with each step */
-    last_select_cb_ctr = select_cb_ctr;
-    SYS_ARCH_UNPROTECT(lev);
-    /* this makes sure interrupt protection time is short */
-    SYS_ARCH_PROTECT(lev);
-    if (last_select_cb_ctr != select_cb_ctr) {
-      /* someone has changed select_cb_list, restart at the beginning */
-      goto again;
-    }
-  }
-  SYS_ARCH_UNPROTECT(lev);
-#endif /* if 0 */
+
+  pollev_notify(sock->pollers, revents);
 }
 
 static void print_timestamp() {
@@ -32,6 +32,8 @@
 #include <msg.h>	/* For msgsend and msgrecv */
 #include <msg_types.h>
 #include <string.h>
+#include <malloc.h>
+#include <syscall.h>	/* For shm_map */
 
 #include <sbin/lwip/err.h>
 #include <sbin/lwip/etharp.h>
@@ -49,12 +51,23 @@
 #include <stdio.h>
 #endif /*USER */
 
+static void driver_rxinit(Driver_api_softc_t *sc, Ndrv_init_resp_t *resp);
+static void driver_rxfree(struct pbuf *p);
+static void driver_rxput(Netrx_t *rx, int idx);
+static void driver_txinit(Driver_api_softc_t *sc, Ndrv_init_resp_t *resp);
+static err_t driver_txqueue(Nettx_t *tx, struct pbuf *p);
+static int driver_txput(Nettx_t *tx, struct pbuf *p);
+static void driver_txkick(Nettx_t *tx);
+
 err_t driver_linkoutput(struct netif *ifp, struct pbuf *p) {
 	Driver_api_softc_t *sc;
 	Pkt_msg_t pkt;
 
 	sc = (Driver_api_softc_t*)ifp->state;
 
+	if (sc->tx != NULL)
+		return driver_txqueue(sc->tx, p);
+
 	pkt.type = NDRV_OUTPKT;
 	pkt.ifnum = ifp->num;
 	pkt.len = p->tot_len;
@@ -90,6 +103,9 @@ err_t driver_init(struct netif *ifp) {
 		return (err_t)resp.ret;
 	}
 
+	driver_rxinit(sc, &resp);
+	driver_txinit(sc, &resp);
+
 	/* name */
 	ifp->name[0] = 'e';
 	ifp->name[1] = 't';
@@ -111,3 +127,286 @@ err_t driver_init(struct netif *ifp) {
 	return (err_t)resp.ret;
 }
 
+/*
+ * Pass every frame the driver has put on the shared ring to lwIP, in its 
+ * buffer. Returns the number of frames.
+ */
+int driver_rxbatch(struct netif *ifp) {
+	Driver_api_softc_t *sc;
+	Netrx_t *rx;
+	Netrx_ring_t *r;
+	Netrx_slot_t slot;
+	struct pbuf *p;
+	uint32_t head, tail;
+	int n;
+
+	sc = (Driver_api_softc_t*)ifp->state;
+	rx = sc->rx;
+	if (rx == NULL)
+		return 0;
+	r = rx->ring;
+
+	/* the driver sets rx_head before it looks at pending */
+	r->pending = 0;
+	__sync_synchronize();
+	head = r->rx_head;
+	__sync_synchronize();
+
+	n = 0;
+	for (tail = r->rx_tail; tail != head; tail++) {
+		slot = r->rx[tail % NETRX_RING_NR];
+		if (slot.idx >= NETRX_BUF_NR || slot.len == 0 || 
+		    slot.len > NETRX_BUF_SIZE)
+			continue;
+
+		if (rx->held >= NETRX_BUF_NR / 2) {
+			/* 
+			 * lwIP is sitting on half the buffers already; copy
+			 * this one so that the driver does not run dry.
+			 */
+			p = pbuf_alloc(PBUF_RAW, slot.len, PBUF_POOL);
+			if (p != NULL)
+				pbuf_take(p, rx->bufs + slot.idx * NETRX_BUF_SIZE,
+					  slot.len);
+			driver_rxput(rx, slot.idx);
+		}
+		else {
+			/* 
+			 * payload_mem_len is the frame length, not the buffer
+			 * size: lwIP 1.4.0 rejects one bigger than length.
+			 */
+			p = pbuf_alloced_custom(PBUF_RAW, slot.len, PBUF_REF, 
+						&rx->pbufs[slot.idx].pc,
+						rx->bufs + slot.idx * NETRX_BUF_SIZE,
+						slot.len);
+			if (p == NULL)
+				driver_rxput(rx, slot.idx);
+			else
+				rx->held++;
+		}
+		if (p == NULL) {
+			printf("[NET] Warning: Packet dropped! No pbufs left.\n");
+			continue;
+		}
+
+		/* Pass to lwIP */
+		if (ifp->input(p, ifp) != ERR_OK)
+			pbuf_free(p);
+		n++;
+	}
+	r->rx_tail = tail;
+
+	return n;
+}
+
+/* Map the driver's receive buffers and ring, if it offers them. */
+static void driver_rxinit(Driver_api_softc_t *sc, Ndrv_init_resp_t *resp) {
+	Netrx_t *rx;
+	uint64_t size;
+	int i;
+
+	/* NDRV_INIT again to the same driver */
+	if (sc->rx != NULL && sc->rx->pid == sc->pid && 
+	    sc->rx->ring_id == resp->rx_ring_id)
+		return;
+
+	/* 
+	 * A new driver. The old buffers stay mapped, since lwIP may still 
+	 * hold some of them.
+	 */
+	if (sc->rx != NULL)
+		sc->rx->pid = -1;
+	sc->rx = NULL;
+	if (resp->rx_ring_id == 0)
+		return;
+
+	rx = malloc(sizeof(Netrx_t));
+	if (rx == NULL) {
+		printf("[NET] Error: could not allocate Netrx_t\n");
+		return;
+	}
+	rx->ring = shm_map(resp->rx_ring_id, &size);
+	if (rx->ring == NULL || size < sizeof(Netrx_ring_t)) {
+		printf("[NET] Error: could not map the driver's rx ring\n");
+		free(rx);
+		return;
+	}
+	rx->bufs = shm_map(resp->rx_buf_id, &size);
+	if (rx->bufs == NULL || size < NETRX_BUF_NR * NETRX_BUF_SIZE) {
+		printf("[NET] Error: could not map the driver's rx buffers\n");
+		shm_unmap(rx->ring);
+		free(rx);
+		return;
+	}
+
+	rx->pid = sc->pid;
+	rx->ring_id = resp->rx_ring_id;
+	rx->held = 0;
+	for (i = 0; i < NETRX_BUF_NR; i++) {
+		rx->pbufs[i].pc.custom_free_function = &driver_rxfree;
+		rx->pbufs[i].rx = rx;
+		rx->pbufs[i].idx = i;
+	}
+	sc->rx = rx;
+}
+
+/* lwIP is done with a receive buffer */
+static void driver_rxfree(struct pbuf *p) {
+	Netrx_pbuf_t *rp;
+
+	rp = (Netrx_pbuf_t*)p;
+	rp->rx->held--;
+	driver_rxput(rp->rx, rp->idx);
+}
+
+/* Give a receive buffer back to the driver */
+static void driver_rxput(Netrx_t *rx, int idx) {
+	Netrx_ring_t *r;
+	Ndrv_rxrefill_msg_t msg;
+
+	r = rx->ring;
+	r->free[r->free_head % NETRX_RING_NR] = idx;
+	__sync_synchronize();
+	r->free_head++;
+
+	/* the driver sets starved before it looks at free_head */
+	__sync_synchronize();
+	if (r->starved && rx->pid >= 0) {
+		r->starved = 0;
+		msg.type = NDRV_RXREFILL;
+		msgsend(rx->pid, &msg, sizeof(Ndrv_rxrefill_msg_t));
+	}
+}
+
+/* The driver has made room on the transmit ring; send what we held back. */
+void driver_txready(struct netif *ifp) {
+	Driver_api_softc_t *sc;
+	Nettx_t *tx;
+
+	sc = (Driver_api_softc_t*)ifp->state;
+	tx = sc->tx;
+	if (tx == NULL)
+		return;
+
+	while (tx->nback > 0 && driver_txput(tx, tx->backlog[tx->back_head]) == 0) {
+		pbuf_free(tx->backlog[tx->back_head]);
+		tx->back_head = (tx->back_head + 1) % NETTX_BACKLOG;
+		tx->nback--;
+	}
+	if (tx->nback > 0)
+		tx->ring->blocked = 1;
+	driver_txkick(tx);
+}
+
+/* Map the driver's transmit buffers and ring, if it offers them. */
+static void driver_txinit(Driver_api_softc_t *sc, Ndrv_init_resp_t *resp) {
+	Nettx_t *tx;
+	uint64_t size;
+
+	/* NDRV_INIT again to the same driver */
+	if (sc->tx != NULL && sc->tx->pid == sc->pid && 
+	    sc->tx->ring_id == resp->tx_ring_id)
+		return;
+
+	/* A new driver; nothing of ours points into the old buffers. */
+	if (sc->tx != NULL) {
+		tx = sc->tx;
+		for (; tx->nback > 0; tx->nback--) {
+			pbuf_free(tx->backlog[tx->back_head]);
+			tx->back_head = (tx->back_head + 1) % NETTX_BACKLOG;
+		}
+		shm_unmap(tx->bufs);
+		shm_unmap(tx->ring);
+		free(tx);
+	}
+	sc->tx = NULL;
+	if (resp->tx_ring_id == 0)
+		return;
+
+	tx = malloc(sizeof(Nettx_t));
+	if (tx == NULL) {
+		printf("[NET] Error: could not allocate Nettx_t\n");
+		return;
+	}
+	tx->ring = shm_map(resp->tx_ring_id, &size);
+	if (tx->ring == NULL || size < sizeof(Nettx_ring_t)) {
+		printf("[NET] Error: could not map the driver's tx ring\n");
+		free(tx);
+		return;
+	}
+	tx->bufs = shm_map(resp->tx_buf_id, &size);
+	if (tx->bufs == NULL || size < NETTX_BUF_NR * NETTX_BUF_SIZE) {
+		printf("[NET] Error: could not map the driver's tx buffers\n");
+		shm_unmap(tx->ring);
+		free(tx);
+		return;
+	}
+
+	tx->pid = sc->pid;
+	tx->ring_id = resp->tx_ring_id;
+	tx->back_head = 0;
+	tx->nback = 0;
+	sc->tx = tx;
+}
+
+/* 
+ * Put a frame on the transmit ring, or hold a copy of it back if the ring is
+ * full. lwIP may change the pbuf once we return, so we can't keep it.
+ */
+static err_t driver_txqueue(Nettx_t *tx, struct pbuf *p) {
+	struct pbuf *q;
+
+	if (p->tot_len > NETTX_BUF_SIZE) {
+		printf("[Net] Error: packet too big for the tx ring\n");
+		return ERR_BUF;
+	}
+
+	/* frames go out in order, so behind any held back */
+	if (tx->nback == 0 && driver_txput(tx, p) == 0) {
+		driver_txkick(tx);
+		return ERR_OK;
+	}
+
+	if (tx->nback == NETTX_BACKLOG)
+		return ERR_MEM;
+	q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+	if (q == NULL)
+		return ERR_MEM;
+	pbuf_copy(q, p);
+	tx->backlog[(tx->back_head + tx->nback) % NETTX_BACKLOG] = q;
+	tx->nback++;
+
+	/* the driver clears kicked before it looks at blocked */
+	tx->ring->blocked = 1;
+	driver_txkick(tx);
+	return ERR_OK;
+}
+
+/* Copy a frame into the next free slot; -1 if there is none */
+static int driver_txput(Nettx_t *tx, struct pbuf *p) {
+	Nettx_ring_t *r;
+	int i;
+
+	r = tx->ring;
+	if (r->head - r->done >= NETTX_BUF_NR - 1)
+		return -1;
+
+	i = r->head % NETTX_BUF_NR;
+	pbuf_copy_partial(p, tx->bufs + i * NETTX_BUF_SIZE, p->tot_len, 0);
+	r->len[i] = p->tot_len;
+	__sync_synchronize();
+	r->head++;
+	return 0;
+}
+
+/* Have the driver look at the ring, unless it is going to anyway */
+static void driver_txkick(Nettx_t *tx) {
+	Ndrv_txkick_msg_t msg;
+
+	__sync_synchronize();
+	if (tx->ring->kicked)
+		return;
+	tx->ring->kicked = 1;
+	msg.type = NDRV_TXKICK;
+	msgsend(tx->pid, &msg, sizeof(Ndrv_txkick_msg_t));
+}
@@ -62,8 +62,6 @@ static struct netif *ifp_array[NETD_MAX_IFS];
 static int netd_is_up = 0;
 static int number_of_cards =0;
 uint32_t packets_in = 0;
-/* Poll queue. */
-static queue_t *pollq;
 
 static void net_init();
 static void loopif_init();
@@ -71,9 +69,6 @@ static void net_main_loop();
 static int  net_mac2ip(uint8_t *hwaddr, ip_addr_t *ip, ip_addr_t *nm, ip_addr_t *gw);
 static int  net_maccmp(uint8_t *hwaddr1, uint8_t *hwaddr2);
 static int  net_is_dup_if(pid_t pid, struct netif **pifp);
-static int poll_check(Net_poll_t *proc);
-static int poll_search(void *elementp, const void *keyp);
-static void poll_tick();
 
 /* 
  * Types of messages that may be received. This union provides the minimum
@@ -96,8 +91,12 @@ typedef union {
 	Net_ghbn_req_t    ghbn_msg;          /* From user prog  - gethostbyname()*/
 	Net_close_req_t   close_req;         /* From user prog  - close()        */
 	Net_update_owner_req_t up_owner_req;  /*From user program to update new socket pid owner  */
-	Net_poll_t    poll_msg;          /* From kernel - start poll() */
+	Pollev_req_t      poll_msg;          /* From user prog  - poll()        */
 	Netd_ping_req_t ping_msg;
+	Net_batch_msg_t   batch_msg;         /* From NIC driver - new pkts      */
+	Net_txready_msg_t txready_msg;       /* From NIC driver - tx ring room  */
+	Net_sbuf_setup_req_t sbuf_setup_msg; /* From user prog  - bulk buffers  */
+	Net_sbuf_req_t    sbuf_msg;          /* From user prog  - bulk doorbell */
 } Net_msg_t;
 
 static void net_do_invalid (Net_msg_t*, Msg_status_t*);
@@ -122,7 +121,12 @@ static void net_do_update  (Net_msg_t*, Msg_status_t*);
 static void net_do_poll    (Net_msg_t*, Msg_status_t*);
 
 static void netd_do_ping	 (Net_msg_t*, Msg_status_t*);
-#define NET_FUNC_ARRAY_SZ 20
+static void net_do_inbatch (Net_msg_t*, Msg_status_t*);
+static void net_do_txready (Net_msg_t*, Msg_status_t*);
+static void net_do_sbuf_setup(Net_msg_t*, Msg_status_t*);
+static void net_do_sbuf_send (Net_msg_t*, Msg_status_t*);
+static void net_do_sbuf_recv (Net_msg_t*, Msg_status_t*);
+#define NET_FUNC_ARRAY_SZ 25
 
 /* CAUTION: Order of these functions must match numbers defined in kmsg.h */
 static void (*func_array[NET_FUNC_ARRAY_SZ])(Net_msg_t*, Msg_status_t*) = 
@@ -130,7 +134,9 @@ static void (*func_array[NET_FUNC_ARRAY_SZ])(Net_msg_t*, Msg_status_t*) =
   net_do_timer,   net_do_ifconfig, net_do_socket, net_do_bind,
   net_do_listen,  net_do_connect,  net_do_accept, net_do_send,
   net_do_sendto,  net_do_recv,     net_do_recvfrom, net_do_ghbn,
-  net_do_close,   net_do_update,   net_do_poll, netd_do_ping
+  net_do_close,   net_do_update,   net_do_poll, netd_do_ping,
+  net_do_inbatch, net_do_txready,  net_do_sbuf_setup, net_do_sbuf_send,
+  net_do_sbuf_recv
 };
 
 /* Start function. */
@@ -149,7 +155,6 @@ int main() {
 
 static void net_init() {
 	memset(ifp_array,0,sizeof(ifp_array));
-	pollq = qopen();
 	bsock_init();
 	lwip_init();
 	loopif_init();
@@ -159,7 +164,7 @@ static void net_main_loop() {
 	Net_msg_t msg;
 	Msg_status_t status;
 	int *ptype;
-	int ret, i=0;
+	int ret;
 
 	ptype = (int*)(&msg);
 
@@ -175,9 +180,6 @@ static void net_main_loop() {
 				net_do_invalid(&msg,&status);
 			}
 		}
-		//if(!(i%10))
-			poll_tick();
-		//i++;
 	}
 }
 
@@ -249,6 +251,8 @@ static void net_do_ifadd(Net_msg_t *msg, Msg_status_t *status) {
 	/* Init driver struct */
 	sc->pid = status->src;
 	sc->ifp = ifp;
+	sc->rx = NULL;
+	sc->tx = NULL;
 
 	/* Add new if */
 
@@ -370,6 +374,56 @@ static void net_do_inpkt(Net_msg_t *msg, Msg_status_t *status) {
 	}
 }
 
+/* The driver has put frames on the ring it shares with us */
+static void net_do_inbatch(Net_msg_t *msg, Msg_status_t *status) {
+	Net_batch_msg_t *bmsg;
+	Driver_api_softc_t *sc;
+	struct netif *ifp;
+
+	bmsg = (Net_batch_msg_t *)msg;
+
+	/* Get ifp from array */
+	if (bmsg->ifnum < 0 || bmsg->ifnum >= NETD_MAX_IFS ||
+	    (ifp = ifp_array[bmsg->ifnum]) == NULL) {
+		printf("[NET] Error: Got a batch for unknown ifp in do inbatch??\n");
+		return;
+	}
+
+	/* Check to see if the PID matches up (no spoofed messages) */
+	sc = (Driver_api_softc_t *)ifp->state;
+	if (sc->pid != status->src) {
+		printf("WARNING: Found spoofed message! from %d expected %d\n", status->src, sc->pid);
+		return;
+	}
+
+	packets_in += driver_rxbatch(ifp);
+}
+
+/* The driver has room on the transmit ring again */
+static void net_do_txready(Net_msg_t *msg, Msg_status_t *status) {
+	Net_txready_msg_t *tmsg;
+	Driver_api_softc_t *sc;
+	struct netif *ifp;
+
+	tmsg = (Net_txready_msg_t *)msg;
+
+	/* Get ifp from array */
+	if (tmsg->ifnum < 0 || tmsg->ifnum >= NETD_MAX_IFS ||
+	    (ifp = ifp_array[tmsg->ifnum]) == NULL) {
+		printf("[NET] Error: Got tx ready for unknown ifp in do txready??\n");
+		return;
+	}
+
+	/* Check to see if the PID matches up (no spoofed messages) */
+	sc = (Driver_api_softc_t *)ifp->state;
+	if (sc->pid != status->src) {
+		printf("WARNING: Found spoofed message! from %d expected %d\n", status->src, sc->pid);
+		return;
+	}
+
+	driver_txready(ifp);
+}
+
 static void net_do_timer(Net_msg_t *msg, Msg_status_t *status) {
 	Net_timer_msg_t *tmsg;
 
@@ -476,150 +530,20 @@ static void net_do_update(Net_msg_t *msg, Msg_status_t *status) {
 	bsock_update_owner((Net_update_owner_req_t *)msg, status);
 }
 
-static void net_do_poll(Net_msg_t *msg, Msg_status_t *status) {
-	Net_poll_t *req = (Net_poll_t *)msg;
-	Net_poll_t *copy;
-	int i;
-	struct timespec tp;
-
-	if(qsearch(pollq, poll_search, &status->src) != NULL) {
-		/* Serious error -- there's already an ongoing poll! */
-		req->rval = -1;
-		req->errno = -1; /* TODO EUNKNOWN */
-		goto out;
-	}
-
-	if(!(req->numfds >= 0)) {
-		/* The client sent us a bad value. */
-		req->rval = 0;
-		goto out;
-	}
-
-	/* Check if there's already data waiting. If so, we need to return
-	 * right now. */
-	for(i = 0, req->rval = 0; i < req->numfds; i++) {
-		int set = 0;
-		if((req->fds[i].events & POLLIN) &&
-		   bsock_has_data(req->fds[i].fd)) {
-			req->fds[i].revents |= POLLIN;
-			set = 1;
-		}
-		if(req->fds[i].events & POLLOUT) {
-			// FIXME: We say we're always ready to write.
-			req->fds[i].revents |= POLLOUT;
-			set = 1;
-		}
-		if(bsock_is_closed(req->fds[i].fd)) {
-			req->fds[i].revents = POLLHUP;
-			set = 1;
-		}
-		if(set)
-			req->rval++;
-	}
-	if(req->rval) goto out;
-
-	/* If we made it this far, good to go with the polling. */
-	req->pid = status->src;
-	copy = malloc(sizeof(Net_poll_t));
-	memcpy(copy, req, sizeof(Net_poll_t));
-
-
-	/* Set timer. Note that a timeout of 0 means that the polled fds MUST
-	 * be checked once. Thus, they get poll-enqueued anyway, since the
-	 * timer is checked AFTER the fds are checked. */
-	if(req->timeout < 0) {
-		copy->timeout = 0;
-	} else {
-		copy->timeout = (clock_gettime(4, &tp) * 1000 ) + req->timeout;
-	}
-
-	qput(pollq, copy);
-	
-	/* Don't send a return message yet. A return message will cause the
-	 * process to wake up, which we can't do until timeout or when polled
-	 * data arrives. */
-	return;
-
-	out:
-	msgsend(status->src, req, sizeof(Net_poll_t));
+static void net_do_sbuf_setup(Net_msg_t *msg, Msg_status_t *status) {
+	bsock_sbuf_setup((Net_sbuf_setup_req_t *)msg, status);
 }
 
-static int poll_check(Net_poll_t *proc) {
-	int i;
-	int revents;
-	struct timespec tp;
-
-	/* Any revents? */
-	for(i = 0, revents = 0; i < proc->numfds; i++) {
-		int set = 0;
-		if((proc->fds[i].events & POLLIN) && bsock_has_data(proc->fds[i].fd)) {
-			proc->fds[i].revents |= POLLIN;
-			set = 1;
-		}
-		if(proc->fds[i].events & POLLOUT) {
-			// FIXME: Always ready to write.
-			proc->fds[i].revents |= POLLOUT;
-			set = 1;
-		}
-		if(bsock_is_closed(proc->fds[i].fd)) {
-			proc->fds[i].revents = POLLHUP;
-			set = 1;
-		}
-		if(set)
-			revents++;
-	}
-	if(revents) {
-		proc->rval = revents;
-		return 1;
-	}
-
-	/* Did we timeout? */
-	if(proc->timeout > 0 &&
-	   (clock_gettime(4, &tp) * 1000 ) > proc->timeout) {
-		return 1;
-	}
+static void net_do_sbuf_send(Net_msg_t *msg, Msg_status_t *status) {
+	bsock_sbuf_send((Net_sbuf_req_t *)msg, status);
+}
 
-	
-	/* If we made it here, nothing to report. */
-	return 0;
+static void net_do_sbuf_recv(Net_msg_t *msg, Msg_status_t *status) {
+	bsock_sbuf_recv((Net_sbuf_req_t *)msg, status);
 }
 
-static int poll_search(void *elementp, const void *keyp) {
-  Net_poll_t *ep;
-  int *kp;
-
-  ep = (Net_poll_t*)(elementp);
-  kp = (int*)keyp;
-  return(ep->pid == *kp);
-}
-
-/* poll_tick: check to see if the processes have polled data in their
- *            examined fds or timed out. This is hooked into the netd
- *            main loop. */
-static void poll_tick() {
-	/* We can't use qapply here because you can't qremove during a qapply.
-	 * Thus, we need to pull from / put back into the queue until we find
-	 * the first element again, which marks a complete cycle. */
-	Net_poll_t *orig;
-	Net_poll_t *current;
-
-	orig = qget(pollq);
-	if(orig == NULL) return;
-	qput(pollq, orig);
-	while((current = qget(pollq)) != orig) {
-		if(!poll_check(current)) {
-			qput(pollq, current);
-		} else {
-			msgsend(current->pid, current, sizeof(Net_poll_t));
-			free(current);
-		}
-	}
-	if(!poll_check(orig)) {
-		qput(pollq, orig);
-	} else {
-		msgsend(orig->pid, orig, sizeof(Net_poll_t));
-		free(orig);
-	}
+static void net_do_poll(Net_msg_t *msg, Msg_status_t *status) {
+	bsock_poll_arm((Pollev_req_t *)msg, status);
 }
 
 static int net_is_dup_if(pid_t pid, struct netif **pifp) {
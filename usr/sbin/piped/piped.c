@@ -23,6 +23,11 @@
 
 /*
  * piped.c -- The piped implementation
+ *
+ * A pipe's data never passes through here: it moves through a ring
+ * shared by the processes using the pipe (see Pipe_ring_t). piped hands
+ * out the descriptors, blocks readers on an empty ring and writers on a
+ * full one, wakes them, and answers poll().
  */
 #include <stdlib.h>		/* EXIT_SUCCESS */
 #include <stdio.h>		/* printf */
@@ -30,6 +35,9 @@
 #include <msg.h>		/* msgsend/msgrecv */
 #include <unistd.h>		/* sleep */
 #include <stdint.h>
+#include <stddef.h>		/* offsetof */
+#include <string.h>		/* memcpy */
+#include <poll.h>		/* POLLIN, POLLOUT */
 #include <lock.h>
 
 #include <utils/bool.h>
@@ -47,9 +55,21 @@ hashtable_t *write_htable;
 int pipe_desc_ctr;
 
 static int get_pipe_descriptor(void);
-static int do_read(Pipe_read_req_t *req, int pid);
-static int do_write(Pipe_write_req_t *req);
-static int do_close(Pipe_close_req_t *req);
+static int do_new(Pipe_new_req_t *req, int pid);
+static int do_wait(Pipe_fd_req_t *req, int pid);
+static void do_wake(Pipe_fd_req_t *req);
+static int do_close(Pipe_fd_req_t *req);
+static Pipe_t *find_pipe(int fd);
+
+static uint32_t ring_used(Pipe_t *pipe);
+static void wake_readers(Pipe_t *pipe);
+static void wake_writers(Pipe_t *pipe);
+static void set_waiting(Pipe_t *pipe);
+static void send_resp(int pid, int type, unsigned int tag, int ret_val);
+
+static short pipe_revents(Pipe_t *pipe, int fd);
+static void pipe_notify(Pipe_t *pipe);
+static void do_poll(Pollev_req_t *req, int pid);
 
 static void free_pipe(Pipe_t *pipe);
 
@@ -57,6 +77,7 @@ static void free_pipe(Pipe_t *pipe);
 static int search_fn(void *ep, const void *skey);
 static int read_search_fn(void *ep, const void *skey);
 static int write_search_fn(void *ep, const void *skey);
+static int any_fn(void *ep, const void *skey);
 
 /* 
  * main -- The main loop of the daemon
@@ -67,11 +88,7 @@ int main(void) {
   Msg_status_t status;		/* status of a recv */
   int done,ready,replysize,rc;
   piped_msg_t *msgp,*replyp;
-
-  Pipe_read_req_t *read_req;
-  Pipe_read_resp_t *read_resp;
-
-  Pipe_t *new_pipe, *pipe;
+  Pipe_t *pipe;
 
   msgp = replyp = &msgbuff;	/* buffer reused for reply */
   /* 
@@ -116,96 +133,56 @@ int main(void) {
 
     /* request for a new pipe */
     case PIPED_NEW:
-      
-      /* malloc new pipe */
-      new_pipe = (Pipe_t*)malloc(sizeof(Pipe_t));
-      if ( !new_pipe ) {
-	printf("Could not malloc a new pipe\n");
-	exit(EXIT_FAILURE);
-      }
-
-      /* malloc the buffer for the pipe */
-      new_pipe->buf = (char*)malloc(PIPE_LENGTH * sizeof(char));
-      if ( !new_pipe->buf ) {
-	printf("Could not allocate the buffer for a new pipe\n");
-	exit(EXIT_FAILURE);
-      }      
-
-      /* initialize the queue */
-      new_pipe->read_q = qopen();
-      if ( !new_pipe->read_q ) {
-	printf("Could not initialize the read queue\n");
-	exit(EXIT_FAILURE);
-      }
-
-      /* initialize various members */
-      new_pipe->length = 0;
-      new_pipe->wrapped = 0;
-
-      /* initialize the lock */
-      init_lock(&(new_pipe->lock));
-      
-      /* read and write pointers both start at beginning of buffer */
-      new_pipe->read_ptr = new_pipe->buf;
-      new_pipe->write_ptr = new_pipe->buf;
-      
-      /* get file descriptors for writing and reading */
-      new_pipe->read_fd = get_pipe_descriptor();
-      new_pipe->write_fd = get_pipe_descriptor();
-
-      /* put pipe in writing hashtable and reading hashtable */
-      hput(read_htable, new_pipe, (char*)(&new_pipe->read_fd), sizeof(int));
-      hput(write_htable, new_pipe, (char*)(&new_pipe->write_fd), sizeof(int));
-
-      /* build response message */
-      ((Pipe_new_resp_t*)replyp)->read_fd = new_pipe->read_fd;
-      ((Pipe_new_resp_t*)replyp)->write_fd = new_pipe->write_fd;
-      ((Pipe_new_resp_t*)replyp)->ret_val = 0;
       replysize = sizeof(Pipe_new_resp_t);
+      ((Pipe_new_resp_t*)replyp)->ret_val = 
+	do_new((Pipe_new_req_t*)msgp, status.src);
+      break;
 
+    /* the ring of a pipe end that came through fork and exec; exec 
+       dropped the mapping, so let the process map the ring again */
+    case PIPED_ATTACH:
+      replysize = sizeof(Pipe_resp_t);
+      if ( (pipe = find_pipe(((Pipe_fd_req_t*)msgp)->fd)) == NULL ||
+	   shm_grant(pipe->shm_id, status.src) < 0 )
+	((Pipe_resp_t*)replyp)->ret_val = -1;
+      else {
+	((Pipe_resp_t*)replyp)->shm_id = pipe->shm_id;
+	((Pipe_resp_t*)replyp)->ret_val = 0;
+      }
       break;
 
-    /* request to read a pipe */
-    case PIPED_READ:
- 
-      /* set size of reply message */
-      replysize = sizeof(Pipe_read_resp_t);
-      
-      /* do all the heavy lifting */
-      if ( (rc = do_read((Pipe_read_req_t*)msgp, status.src)) < 0 )
-	((Pipe_read_resp_t*)replyp)->length = -1;
-      else if ( rc == 1 )
+    /* block until the ring has data or room */
+    case PIPED_WAIT:
+      replysize = sizeof(Pipe_resp_t);
+      if ( (rc = do_wait((Pipe_fd_req_t*)msgp, status.src)) == 1 )
 	continue; /* dont send response so proc blocks */
-      
+      ((Pipe_resp_t*)replyp)->ret_val = rc;
       break;
-      
-    /* request to write a pipe */
-    case PIPED_WRITE:
-
-      /* set size of reply message */
-      replysize = sizeof(Pipe_write_resp_t);
 
-      /* do all the heavy lifting */
-      if ( do_write((Pipe_write_req_t*)msgp) < 0 )
-	((Pipe_write_resp_t*)replyp)->length = -1;
-
-      break;
+    /* someone moved head or tail with a waiter about */
+    case PIPED_WAKE:
+      do_wake((Pipe_fd_req_t*)msgp);
+      continue;
 
     /* request to close a pipe */
     case PIPED_CLOSE:
 
       /* set size of reply message */
-      replysize = sizeof(Pipe_close_resp_t);
+      replysize = sizeof(Pipe_resp_t);
 
       /* TODO: add a file descriptor count so close only really closes the 
                open file desriptor if all open references to it are closed */
       
       /* do the actual closing logic */
-      if ( do_close((Pipe_close_req_t*)msgp) < 0)
-	((Pipe_close_resp_t*)replyp)->ret_val = -1;
+      ((Pipe_resp_t*)replyp)->ret_val = do_close((Pipe_fd_req_t*)msgp);
 
       break;
 
+    /* poll() -- the events go through the kernel */
+    case PIPED_POLL:
+      do_poll((Pollev_req_t*)msgp, status.src);
+      continue;
+
     default:			/* error! */
       fprintf(stdout,"[error on recv: %d]\n",msgtype(msgp));
       respvalue(replyp)=DNAK;	/* respond with NAK */
@@ -223,259 +200,293 @@ int main(void) {
 /* 
    A note on how pipes work:
 
-   they are implemented on as a circular buffer. There is a read pointer 
-     and a write pointer. Both point within the buffer and they are 
-     incremented on read or write calls. Basically, we are implementing a 
-     FIFO with less overhead. Under normal cases, we call the distance 
-     between the write ptr and the end of the buffer the "tail"
-
-   Initially:
-          |<------------ tail-------------->|
-          |_________________________________|
-          |                                 |
-          |_________________________________|
-          ^
-          | - read ptr
-          | - write ptr
-      
-   After writing:
-                        |<------ tail ----->|
-           _____________|___________________|
-          |             :                   |
-          |_____________:___________________|
-          ^             ^
-          | - read ptr  | - write ptr
-
-   After reading:
-                        |<------ tail ----->|
-           _____________|___________________|
-          |             :                   |
-          |_____________:___________________|
-                        ^
-                        | - write ptr
-                        | - read ptr
-
-   Special case: 
-     Conventional wisdom says the read pointer cannot be further "to the right"
-       than the write pointer. However, because the buffer is circular, there 
-       is a case where this can happen. In the code, we refer to this case as 
-       the pipe having "wrapped", and we call the space between the read ptr 
-       and the end of the buffer in this case the "tail"
-
-                                    |<-tail->|
-           _________________________|________|
-          |                         :        |
-          |_________________________:________|
-            ^                       ^
-            | - write ptr           | - read ptr
-
+   the ring is a circular buffer of PIPE_LENGTH bytes with two counters,
+     head and tail, that only ever go up; a byte's place in the buffer is
+     its counter modulo PIPE_LENGTH. head - tail bytes are in the pipe.
+
+           ______________________________________
+          |         :xxxxxxxxxxxxxxxxx:          |
+          |_________:_________________:__________|
+                    ^                 ^
+                    | - tail          | - head
+
+   A writer copies in at head and then moves head; a reader copies out at
+     tail and then moves tail. Each only reads the other's counter, so the
+     two run at the same time without a lock between them. 
+
+   A reader that finds the ring empty asks piped to wait. piped sets rwait
+     and looks at the ring again; a writer moves head and then looks at
+     rwait. With a fence between the store and the load on both sides, 
+     either piped sees the data and answers at once, or the writer sees 
+     rwait and sends PIPED_WAKE -- so no wakeup is lost. Writers waiting 
+     for room work the same way with wwait.
  */
 
-static int do_read(Pipe_read_req_t *req, int pid) {
+/*
+ * Returns 0 with the new descriptors in the reply, or -1 if the ring
+ * is not a region pid created or there are no descriptors left.
+ */
+static int do_new(Pipe_new_req_t *req, int pid) {
 
-  int tail;
-  int req_fd;
-  int req_len;
-  unsigned int req_tag;
-  char *resp_buf;
-  Pipe_t *pipe;
+  Pipe_t *new_pipe;
+  Pipe_new_resp_t *resp;
+  Pipe_ring_t *ring;
+  uint64_t size;
+  int owner;
 
-  Pipe_read_resp_t *resp;
+  /* reuse buffer for response */
+  resp = (Pipe_new_resp_t*)req;
 
-  reader_t *reader;
+  ring = (Pipe_ring_t*)shm_map_owner(req->shm_id, &size, &owner);
+  if ( !ring )
+    return -1;
+  if ( owner != pid || size < sizeof(Pipe_ring_t) ) {
+    shm_unmap(ring);
+    return -1;
+  }
 
-  /* save request stats because we will be reusing the 
-     request buffer for the response */
-  req_len = req->length;
-  req_fd  = req->fd ;
-  req_tag = req->tag;
+  /* malloc new pipe */
+  new_pipe = (Pipe_t*)malloc(sizeof(Pipe_t));
+  if ( !new_pipe ) {
+    printf("Could not malloc a new pipe\n");
+    exit(EXIT_FAILURE);
+  }
+  new_pipe->ring = ring;
+  new_pipe->shm_id = req->shm_id;
+
+  /* initialize the queues */
+  new_pipe->read_q = qopen();
+  new_pipe->write_q = qopen();
+  new_pipe->rpoll_q = qopen();
+  new_pipe->wpoll_q = qopen();
+  if ( !new_pipe->read_q || !new_pipe->write_q ||
+       !new_pipe->rpoll_q || !new_pipe->wpoll_q ) {
+    printf("Could not initialize the read and write queues\n");
+    exit(EXIT_FAILURE);
+  }
 
-  /* reuse buffer for response */
-  resp = (Pipe_read_resp_t*)req;
+  /* the region comes zeroed: empty, nobody waiting, both ends open */
+  init_lock(&ring->rlock);
+  init_lock(&ring->wlock);
 
-  /* find the pipe */
-  pipe = hsearch(read_htable, read_search_fn, (char*)(&req_fd), sizeof(int));
-  if ( !pipe ) 
+  /* get file descriptors for writing and reading */
+  new_pipe->read_fd = get_pipe_descriptor();
+  new_pipe->write_fd = get_pipe_descriptor();
+  if ( new_pipe->read_fd == -1 || new_pipe->write_fd == -1 ) {
+    new_pipe->read_fd = new_pipe->write_fd = -1;
+    free_pipe(new_pipe);
     return -1;
+  }
 
-  /* aqcuire pipe's lock */
-  aquire_lock(&(pipe->lock));
+  /* put pipe in writing hashtable and reading hashtable */
+  hput(read_htable, new_pipe, (char*)(&new_pipe->read_fd), sizeof(int));
+  hput(write_htable, new_pipe, (char*)(&new_pipe->write_fd), sizeof(int));
 
-  /* is there enough to read? */
-  if ( !pipe->length ) {
+  /* build response message */
+  resp->read_fd = new_pipe->read_fd;
+  resp->write_fd = new_pipe->write_fd;
+
+  return 0;
+}
 
-    release_lock(&(pipe->lock));
+/*
+ * Returns 0 if the reader can go on (there is data, or the write end is
+ * closed) or the writer can (there is room, or the read end is closed),
+ * 1 if it has to wait for a wakeup (no response), or -1 on error.
+ */
+static int do_wait(Pipe_fd_req_t *req, int pid) {
 
-    /* TODO: HOW DO I TAKE DEAD PROCESSES OUT OF THE WAITING QUEUE */
-    if ( pid ) {
+  Pipe_t *pipe;
+  Pipe_ring_t *ring;
+  waiter_t *waiter;
+  queue_t *wq;
 
-      /* add proc to reader queue */
-      reader = (reader_t*)malloc(sizeof(reader_t));
-      if ( !reader ) 
-	return -1;
-      
-      reader->pid = pid;
-      reader->len = req_len;
-      reader->tag = req_tag;
-      
-      qput(pipe->read_q, (void*)reader);
-      
-      return 1; /* don't send response message */
+  if ( (pipe = find_pipe(req->fd)) == NULL )
+    return -1;
+  ring = pipe->ring;
+
+  /* say we are waiting, then look again (see the note above) */
+  if ( req->fd == pipe->read_fd ) {
+    ring->rwait = TRUE;
+    __sync_synchronize();
+    if ( ring_used(pipe) || (ring->closed & PIPE_WCLOSED) ) {
+      set_waiting(pipe);
+      return 0;
     }
-    else
-      return -1;
+    wq = pipe->read_q;
+  }
+  else {
+    ring->wwait = TRUE;
+    __sync_synchronize();
+    if ( ring_used(pipe) < PIPE_LENGTH || (ring->closed & PIPE_RCLOSED) ) {
+      set_waiting(pipe);
+      return 0;
+    }
+    wq = pipe->write_q;
   }
 
-  /* it will definitely succeed now */
+  /* TODO: HOW DO I TAKE DEAD PROCESSES OUT OF THE WAITING QUEUE */
+  waiter = (waiter_t*)malloc(sizeof(waiter_t));
+  if ( !waiter ) 
+    return -1;
+  waiter->pid = pid;
+  waiter->tag = req->tag;
+  qput(wq, (void*)waiter);
 
-  /* update response length and pipe length */
-  req_len = ( req_len < pipe->length ? req_len : pipe->length );
+  return 1; /* don't send response message */
+}
 
-  resp->length = req_len;
-  pipe->length -= req_len;
-  
-  /* where we should be writing to */
-  resp_buf = resp->buf;
+/* wake whoever the change to the ring lets go on */
+static void do_wake(Pipe_fd_req_t *req) {
 
-  /* if it is wrapped, handle tail first */
-  if ( pipe->wrapped ) {
-    
-    /* calculate size of tail */
-    tail = pipe->buf + PIPE_LENGTH - pipe->read_ptr;
+  Pipe_t *pipe;
 
-    /* if the read will be bigger than the tail */
-    if ( tail <= req_len ) {
+  if ( (pipe = find_pipe(req->fd)) == NULL )
+    return;
+  wake_readers(pipe);
+  wake_writers(pipe);
+  pipe_notify(pipe);
+  set_waiting(pipe);
+}
 
-      /* read the tail first */
-      memcpy(resp_buf, pipe->read_ptr, tail);      
+/* bytes in the ring */
+static uint32_t ring_used(Pipe_t *pipe) {
 
-      /* update lengths and pointers */
-      req_len -= tail;
-      resp_buf += tail;
-      pipe->read_ptr = pipe->buf;
+  return pipe->ring->head - pipe->ring->tail;
+}
 
-      /* we are no longer wrapped */
-      pipe->wrapped = 0;
-    }
+/* The pipe has data, or no writer is left: let the readers in */
+static void wake_readers(Pipe_t *pipe) {
+
+  waiter_t *waiter;
+
+  if ( !ring_used(pipe) && !(pipe->ring->closed & PIPE_WCLOSED) )
+    return;
+  while ( (waiter = (waiter_t*)qget(pipe->read_q)) ) {
+    send_resp(waiter->pid, PIPED_WAIT, waiter->tag, 0);
+    free(waiter);
   }
+}
 
-  /* do the read, or rest of read if we already read tail */
-  memcpy(resp_buf, pipe->read_ptr, req_len);
+/* There is room in the pipe, or no reader is left: let the writers in */
+static void wake_writers(Pipe_t *pipe) {
 
-  /* move pointer */
-  pipe->read_ptr += req_len;
-  
-  /* release the lock */
-  release_lock(&(pipe->lock));
+  waiter_t *waiter;
 
-  return 0;
+  if ( ring_used(pipe) == PIPE_LENGTH && !(pipe->ring->closed & PIPE_RCLOSED) )
+    return;
+  while ( (waiter = (waiter_t*)qget(pipe->write_q)) ) {
+    send_resp(waiter->pid, PIPED_WAIT, waiter->tag, 0);
+    free(waiter);
+  }
 }
-      
-static int do_write(Pipe_write_req_t *req) {
-
-  int tail;
-  int req_fd;
-  int req_len;
-  char *req_buf;
-  Pipe_t *pipe;
 
-  Pipe_write_resp_t *resp;
+/* ask for wakeups only while somebody is waiting or watching */
+static void set_waiting(Pipe_t *pipe) {
 
-  piped_msg_t read_msg;
+  pipe->ring->rwait = qsearch(pipe->read_q, any_fn, NULL) || 
+    qsearch(pipe->rpoll_q, any_fn, NULL);
+  pipe->ring->wwait = qsearch(pipe->write_q, any_fn, NULL) || 
+    qsearch(pipe->wpoll_q, any_fn, NULL);
+}
 
-  reader_t *reader;
+static void send_resp(int pid, int type, unsigned int tag, int ret_val) {
 
-  /* save request stats because we will be reusing the 
-     request buffer for the response */  
-  req_len = req->length;
-  req_fd  = req->fd ;
-  req_buf = req->buf;
+  Pipe_resp_t resp;
 
-  /* reuse buffer for response */
-  resp = (Pipe_write_resp_t*)req;
+  resp.type = type;
+  resp.tag = tag;
+  resp.ret_val = ret_val;
+  msgsend(pid, &resp, sizeof(Pipe_resp_t));
+}
 
-  /* find the pipe */
-  pipe = hsearch(write_htable, write_search_fn, (char*)(&req_fd), sizeof(int));
-  if ( !pipe ) 
-    return -1;
+/*
+ * What the end of the pipe named by fd is ready for: the read end when
+ * there is data or no writer is left, the write end when there is room.
+ */
+static short pipe_revents(Pipe_t *pipe, int fd) {
 
-  /* aquire the lock */
-  aquire_lock(&(pipe->lock));
+  short revents = 0;
 
-  /* is there enough room to write? */
-  if ( (PIPE_LENGTH - pipe->length) < req_len ) {
-    release_lock(&(pipe->lock));
-    return -1; /* TODO: Block? */
+  if ( fd == pipe->read_fd ) {
+    if ( ring_used(pipe) )
+      revents |= POLLIN;
+    if ( pipe->write_fd == -1 )
+      revents |= POLLIN | POLLHUP;
+  }
+  else if ( fd == pipe->write_fd ) {
+    if ( pipe->read_fd == -1 )
+      revents |= POLLERR;
+    else if ( ring_used(pipe) < PIPE_LENGTH )
+      revents |= POLLOUT;
   }
 
-  /* we know it is going to succeed */
-
-  /* update lengths */
-  resp->length = req_len;
-  pipe->length += req_len;
+  return revents;
+}
 
-  /* calculate size of tail */
-  tail = pipe->buf + PIPE_LENGTH - pipe->write_ptr;
-  
-  /* if the write will cause the buffer to "wrap" */
-  if ( tail <= req_len ) {
-    
-    /* write the tail first */
-    memcpy(pipe->write_ptr, req_buf, tail);
-    
-    /* update lengths and pointers */
-    req_len -= tail;
-    req_buf += tail;
-    pipe->write_ptr = pipe->buf;
+/* tell the poll()s watching either end what it is ready for now */
+static void pipe_notify(Pipe_t *pipe) {
 
-    /* update pipe status */
-    pipe->wrapped = 1;
-  }
-  
-  /* do the write, or rest of write if already wrote tail */
-  memcpy(pipe->write_ptr, req_buf, req_len);
+  short revents;
 
-  /* move pointer */
-  pipe->write_ptr += req_len;
-  
-  /* release lock */
-  release_lock(&(pipe->lock));
+  if ( pipe->read_fd != -1 && (revents = pipe_revents(pipe, pipe->read_fd)) )
+    pollev_notify(pipe->rpoll_q, revents);
+  if ( pipe->write_fd != -1 && (revents = pipe_revents(pipe, pipe->write_fd)) )
+    pollev_notify(pipe->wpoll_q, revents);
+}
 
-  /* check to see if someone can read now */
-  while ( pipe->length ) {
+/* 
+ * Watch the pipe ends pid's poll() is interested in. Ends that are ready,
+ * or not pipes of ours, are answered straight away.
+ */
+static void do_poll(Pollev_req_t *req, int pid) {
 
-    reader = (reader_t*)qget(pipe->read_q);
-    if ( reader ) { 
-      
-      /* replicate a request from the reader */
-      read_msg.read_req.type   = PIPED_READ;
-      read_msg.read_req.length = reader->len;
-      read_msg.read_req.fd     = pipe->read_fd;
-      read_msg.read_req.tag    = reader->tag;
-      
-      if ( do_read((Pipe_read_req_t*)(&read_msg), 0) < 0 ) {
-	qput(pipe->read_q, reader);
-	return 0;
-      }
-      
-      msgsend(reader->pid, (Pipe_read_resp_t*)(&read_msg), 
-	      sizeof(Pipe_read_resp_t));
-	      free(reader);
+  int i, fd, nfds;
+  short revents;
+  Pollev_fd_t *fds;
+  Pipe_t *pipe;
+  queue_t *wq;
+
+  fds = pollev_interest(pid, req, &nfds);
+  for ( i = 0; i < nfds; i++ ) {
+
+    fd = fds[i].fd;
+    wq = NULL;
+    if ( (pipe = hsearch(read_htable, read_search_fn, (char*)(&fd), sizeof(int))) )
+      wq = pipe->rpoll_q;
+    else if ( (pipe = hsearch(write_htable, write_search_fn, (char*)(&fd), sizeof(int))) )
+      wq = pipe->wpoll_q;
+
+    if ( !pipe ) {
+      if ( pollev_post(pid, req->tag, fd, POLLNVAL) < 0 )
+	return;
+      continue;
     }
-    else 
-      break;
+
+    /* ask for wakeups first, then look (see the note above) */
+    if ( wq == pipe->rpoll_q )
+      pipe->ring->rwait = TRUE;
+    else
+      pipe->ring->wwait = TRUE;
+    __sync_synchronize();
+    revents = pipe_revents(pipe, fd) & (fds[i].events | POLLERR | POLLHUP);
+
+    if ( revents || pollev_watch(wq, pid, req->tag, fd, fds[i].events) < 0 )
+      if ( pollev_post(pid, req->tag, fd, revents ? revents : POLLERR) < 0 )
+	return;			/* gone, and its set with it */
+    set_waiting(pipe);
   }
 
-  return 0;
+  pollev_post(pid, req->tag, POLLEV_DONE, 0);
 }
 
-static int do_close(Pipe_close_req_t *req) {
+static int do_close(Pipe_fd_req_t *req) {
   
   int filedes;
   Pipe_t *pipe;
 
   /* retrieve the file descriptor */
-  filedes = req->filedes;
+  filedes = req->fd;
 
   /* we dont know if its a write or a read file descriptor... */
   
@@ -485,10 +496,17 @@ static int do_close(Pipe_close_req_t *req) {
 
     /* close write file descriptor */
     pipe->write_fd = -1;
+    pipe->ring->closed |= PIPE_WCLOSED;
     
     /* is the read side also closed? */
     if ( pipe->read_fd == -1 ) 
       free_pipe(pipe);
+    else {
+      wake_readers(pipe); /* anyone waiting gets end of file */
+      pollev_notify(pipe->wpoll_q, POLLNVAL);
+      pipe_notify(pipe);
+      set_waiting(pipe);
+    }
   }
   else if ( pipe = hremove(read_htable, read_search_fn, (char*)(&filedes), sizeof(int)) ) {
     
@@ -496,10 +514,17 @@ static int do_close(Pipe_close_req_t *req) {
     
     /* close the read file descriptor */
     pipe->read_fd = -1;
+    pipe->ring->closed |= PIPE_RCLOSED;
     
     /* is the write side also closed? */
     if ( pipe->write_fd == -1 )
       free_pipe(pipe);
+    else {
+      wake_writers(pipe); /* anyone waiting gets an error */
+      pollev_notify(pipe->rpoll_q, POLLNVAL);
+      pipe_notify(pipe);
+      set_waiting(pipe);
+    }
   }
   else /* bad file descriptor. */
     return -1;
@@ -507,6 +532,16 @@ static int do_close(Pipe_close_req_t *req) {
   return 0;
 }
 
+/* the pipe either end of which is fd */
+static Pipe_t *find_pipe(int fd) {
+
+  Pipe_t *pipe;
+
+  if ( (pipe = hsearch(read_htable, read_search_fn, (char*)(&fd), sizeof(int))) )
+    return pipe;
+  return hsearch(write_htable, write_search_fn, (char*)(&fd), sizeof(int));
+}
+
 /* search for just a read  pipe descriptor */
 static int read_search_fn(void *ep, const void *skey) {
 
@@ -535,6 +570,12 @@ static int search_fn(void *ep, const void *skey) {
   return 0;
 }
 
+/* matches anything -- is the queue empty? */
+static int any_fn(void *ep, const void *skey) {
+
+  return 1;
+}
+
 /* search descriptor space for free descriptor */
 static int get_pipe_descriptor(void) {
 
@@ -565,8 +606,13 @@ static void free_pipe(Pipe_t *pipe) {
     hremove(write_htable, write_search_fn, (char*)(&pipe->write_fd), sizeof(int));
 
   /* free resources */
+  pollev_notify(pipe->rpoll_q, POLLNVAL);
+  pollev_notify(pipe->wpoll_q, POLLNVAL);
   qclose(pipe->read_q);
-  free(pipe->buf);
+  qclose(pipe->write_q);
+  qclose(pipe->rpoll_q);
+  qclose(pipe->wpoll_q);
+  shm_unmap(pipe->ring);
   free(pipe);
 
   return;
@@ -24,10 +24,18 @@
  * piped_if.c -- this file contains the implementation for 
  * functions that communicate with piped. The prototypes are
  * available throught the interface piped.h.
+ *
+ * Reads and writes copy straight to and from the pipe's ring, which
+ * pipe() creates and shares with piped; a child forked afterwards
+ * shares it too. piped is only asked to block while the ring is empty
+ * or full, and told when a waiter can go on. An end that came through
+ * an exec is attached to its ring on first use.
  */
 #include <stdio.h>		/* fprintf */
 #include <string.h>
+#include <errno.h>
 #include <stdint.h>		/* uint8_t */
+#include <stddef.h>		/* offsetof */
 #include <sbin/piped.h>		/* daemon interface */
 
 //define PIPED_IF_DEBUG 1 	/* set this to see messages in test*/
@@ -35,12 +43,25 @@
 static piped_msg_t msgbuff;
 static const piped_msg_t *msgbuffp = &msgbuff;
 
+/* the pipe ends this process has used, and their rings */
+typedef struct {
+  int fd;			/* 0 when the slot is free */
+  Pipe_ring_t *ring;
+} pipe_end_t;
+
+static pipe_end_t ends[MAXOPEN];
+
 #ifdef PIPED_IF_DEBUG
 static clear_buff(uint8_t *p,uint64_t numbytes);
 #endif
 
 /* helper function */
 static int send_recv_generic(int dpid,int msgsize);
+static int send_recv_fd(int type, int fd, Pipe_resp_t *resp);
+static void send_wake(int fd);
+static Pipe_ring_t *ring_lookup(int fd);
+static int add_end(int fd, Pipe_ring_t *ring);
+static void drop_end(int fd);
 
 /*
  * The generic interface provides init/ping/quit messages
@@ -74,17 +95,42 @@ int pipe(int filedes[2]) {
 
   Pipe_new_req_t req;
   Pipe_new_resp_t resp;
+  Pipe_ring_t *ring;
+  int grant, id, i, nfree;
 
   Msg_status_t status;
 
+  /* room to remember both ends */
+  for ( i = nfree = 0; i < MAXOPEN; i++ )
+    if ( ends[i].fd == 0 )
+      nfree++;
+  if ( nfree < 2 ) {
+    errno = EMFILE;
+    return -1;
+  }
+
+  /* the ring, which piped maps too */
+  grant = PIPED;
+  ring = (Pipe_ring_t*)shm_create(sizeof(Pipe_ring_t), &grant, 1, &id);
+  if ( !ring ) {
+    errno = ENFILE;
+    return -1;
+  }
+
   req.type = resp.type = PIPED_NEW;
   req.tag = resp.tag = get_msg_tag();
+  req.shm_id = id;
 
   msgsend(PIPED, &req, sizeof(Pipe_new_req_t));
   msgrecv(PIPED, &resp, sizeof(Pipe_new_resp_t), &status);
 
-  if ( resp.ret_val < 0 )
+  if ( resp.ret_val < 0 ) {
+    shm_unmap(ring);
+    errno = ENFILE;
     return -1;
+  }
+  add_end(resp.read_fd, ring);
+  add_end(resp.write_fd, ring);
   
   /* return pipe file descriptors */
   filedes[0] = resp.read_fd;
@@ -93,93 +139,197 @@ int pipe(int filedes[2]) {
   return resp.ret_val;
 }
 
-/* called by read() if it finds the fd belongs to a pipe */
+/* 
+ * called by read() if it finds the fd belongs to a pipe. Blocks until 
+ * there is something to read and returns what there is, up to nbytes; 
+ * 0 means the write end is closed and the pipe is empty.
+ */
 int pipe_read(void *buf, uint64_t nbytes, int fd) {
 
-  Pipe_read_req_t req;
-  Pipe_read_resp_t resp;
-
-  Msg_status_t status;
-  
-  int len = 0;
+  Pipe_ring_t *ring;
+  Pipe_resp_t resp;
+  uint32_t tail, off, n, first;
+  int closed;
 
-  req.type = resp.type = PIPED_READ;
-  req.tag = resp.tag = get_msg_tag();
-  
-  req.fd = fd;
-
-  /* only PIPE_MSG_LEN can be recieved from the pipe daemon 
-   *   at a time, so we might have to do more than one call */
-  while ( len < nbytes ) {
-    req.length = ( nbytes-len > PIPE_MSG_LEN ? PIPE_MSG_LEN : nbytes - len );
-    msgsend(PIPED, &req, sizeof(Pipe_read_req_t));
-
-    msgrecv(PIPED, &resp, sizeof(Pipe_read_resp_t), &status);
-    if ( resp.length < 0 )
+  if ( (ring = ring_lookup(fd)) == NULL )
+    return -1;
+  if ( nbytes == 0 )
+    return 0;
+
+  for ( ;; ) {
+    /* closed before head: data written before the close is not missed */
+    closed = ring->closed;
+    aquire_lock(&ring->rlock);
+    tail = ring->tail;
+    n = ring->head - tail;
+    if ( n ) {
+      if ( n > nbytes )
+	n = nbytes;
+      off = tail % PIPE_LENGTH;
+      first = ( n < PIPE_LENGTH - off ? n : PIPE_LENGTH - off );
+      memcpy(buf, ring->buf + off, first);
+      memcpy((char*)buf + first, ring->buf, n - first);
+      __sync_synchronize();	/* the bytes are out before the room shows */
+      ring->tail = tail + n;
+      release_lock(&ring->rlock);
+      __sync_synchronize();	/* tail moved before wwait is looked at */
+      if ( ring->wwait )
+	send_wake(fd);
+      return (int)n;
+    }
+    release_lock(&ring->rlock);
+
+    if ( closed & PIPE_WCLOSED )
+      return 0;
+    if ( send_recv_fd(PIPED_WAIT, fd, &resp) < 0 )
       return -1;
-
-    memcpy(buf, resp.buf, resp.length);
-
-    len += resp.length;
-    buf += resp.length;
-    
-    if ( resp.length < req.length )
-      break;
   }
-
-  return len;  
 }
 
 /* called by close() if it finds that the file descriptor belongs to a pipe */
 int pipe_close(int filedes) {
   
-  Pipe_close_req_t req;
-  Pipe_close_resp_t resp;
+  Pipe_resp_t resp;
 
-  Msg_status_t status;
+  drop_end(filedes);
+  return send_recv_fd(PIPED_CLOSE, filedes, &resp);
+}
 
-  req.type = resp.type = PIPED_CLOSE;
-  req.tag = resp.tag = get_msg_tag();
+/* 
+ * called by write() if it finds that the file descriptor belongs to a pipe.
+ * Blocks while the pipe is full; returns the number of bytes written, or 
+ * -1 if the read end is closed.
+ */
+int pipe_write(void *buf, uint64_t nbytes, int fd) {
 
-  req.filedes = filedes;
+  Pipe_ring_t *ring;
+  Pipe_resp_t resp;
+  uint32_t head, off, n, first;
+  uint64_t len;
 
-  msgsend(PIPED, &req, sizeof(Pipe_close_req_t));
-  msgrecv(PIPED, &resp, sizeof(Pipe_close_resp_t), &status);
+  if ( (ring = ring_lookup(fd)) == NULL )
+    return -1;
 
-  return resp.ret_val;
-}
+  for ( len = 0; len < nbytes; ) {
+    if ( ring->closed & PIPE_RCLOSED ) {
+      errno = EPIPE;
+      return ( len ? (int)len : -1 );
+    }
+
+    aquire_lock(&ring->wlock);
+    head = ring->head;
+    n = PIPE_LENGTH - (head - ring->tail);
+    if ( n ) {
+      if ( n > nbytes - len )
+	n = nbytes - len;
+      off = head % PIPE_LENGTH;
+      first = ( n < PIPE_LENGTH - off ? n : PIPE_LENGTH - off );
+      memcpy(ring->buf + off, (char*)buf + len, first);
+      memcpy(ring->buf, (char*)buf + len + first, n - first);
+      __sync_synchronize();	/* the bytes are in before they show */
+      ring->head = head + n;
+      release_lock(&ring->wlock);
+      __sync_synchronize();	/* head moved before rwait is looked at */
+      if ( ring->rwait )
+	send_wake(fd);
+      len += n;
+      continue;
+    }
+    release_lock(&ring->wlock);
+
+    if ( send_recv_fd(PIPED_WAIT, fd, &resp) < 0 )
+      return ( len ? (int)len : -1 );
+  }
 
-/* called by write() if it finds that the file descriptor belongs to a pipe */
-int pipe_write(void *buf, uint64_t nbytes, int fd) {
+  return (int)len;
+}
 
-  Pipe_write_req_t req;
-  Pipe_write_resp_t resp;
+/* 
+ * send_recv_fd -- sends piped a request about fd and waits for the 
+ * reply. Returns its value, or -1 with errno set.
+ */
+static int send_recv_fd(int type, int fd, Pipe_resp_t *resp) {
 
+  Pipe_fd_req_t req;
   Msg_status_t status;
-  
-  int len = 0;
 
-  req.type = resp.type = PIPED_WRITE;
-  req.tag = resp.tag = get_msg_tag();
-  
+  req.type = type;
+  req.tag = get_msg_tag();
   req.fd = fd;
 
-  /* only PIPE_MSG_LEN can be sent to the pipe daemon 
-   *   at a time, so we might have to do more than one call */
-  while ( len < nbytes ) {
-    req.length = ( nbytes-len > PIPE_MSG_LEN ? PIPE_MSG_LEN : nbytes - len );
-    memcpy(req.buf, buf, req.length);
-    len += req.length;
-    buf += req.length;
+  msgsend(PIPED, &req, sizeof(Pipe_fd_req_t));
+  msgrecv(PIPED, resp, sizeof(Pipe_resp_t), &status);
+  if ( resp->ret_val < 0 ) {
+    errno = EBADF;
+    return -1;
+  }
+  return resp->ret_val;
+}
 
-    msgsend(PIPED, &req, sizeof(Pipe_write_req_t));
+/* the ring moved under a waiter; piped does not answer */
+static void send_wake(int fd) {
 
-    msgrecv(PIPED, &resp, sizeof(Pipe_write_resp_t), &status);
-    if ( resp.length < 0 )
-      return -1;
+  Pipe_fd_req_t req;
+
+  req.type = PIPED_WAKE;
+  req.tag = get_msg_tag();
+  req.fd = fd;
+  msgsend(PIPED, &req, sizeof(Pipe_fd_req_t));
+}
+
+/* the ring behind fd, attached on first use after an exec */
+static Pipe_ring_t *ring_lookup(int fd) {
+
+  Pipe_resp_t resp;
+  Pipe_ring_t *ring;
+  uint64_t size;
+  int i;
+
+  for ( i = 0; i < MAXOPEN; i++ )
+    if ( ends[i].fd == fd )
+      return ends[i].ring;
+
+  if ( send_recv_fd(PIPED_ATTACH, fd, &resp) < 0 )
+    return NULL;
+  ring = (Pipe_ring_t*)shm_map(resp.shm_id, &size);
+  if ( !ring || size < sizeof(Pipe_ring_t) || add_end(fd, ring) < 0 ) {
+    if ( ring )
+      shm_unmap(ring);
+    errno = EBADF;
+    return NULL;
   }
+  return ring;
+}
+
+static int add_end(int fd, Pipe_ring_t *ring) {
+
+  int i;
+
+  for ( i = 0; i < MAXOPEN; i++ )
+    if ( ends[i].fd == 0 ) {
+      ends[i].fd = fd;
+      ends[i].ring = ring;
+      return 0;
+    }
+  return -1;
+}
 
-  return 0;  
+/* forget fd, and unmap its ring unless the other end still uses it */
+static void drop_end(int fd) {
+
+  Pipe_ring_t *ring;
+  int i;
+
+  for ( i = 0; i < MAXOPEN && ends[i].fd != fd; i++ )
+    ;
+  if ( i == MAXOPEN )
+    return;
+  ring = ends[i].ring;
+  ends[i].fd = 0;
+  for ( i = 0; i < MAXOPEN; i++ )
+    if ( ends[i].fd != 0 && ends[i].ring == ring )
+      return;
+  shm_unmap(ring);
 }
 
 /*
@@ -0,0 +1,352 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/*
+ * ramfsd.c -- The ramfsd implementation
+ *
+ * Maps the ramdisk at init and serves files from it with the read/write
+ * FatFs in libramfs. Whenever the filesystem changes (a file written
+ * to is closed, or a file is unlinked) the kernel is told to sync, so
+ * that exec sees the new contents.
+ *
+ * A client may share a buffer for a file descriptor (RAMFSD_SHARE);
+ * reads and writes through it then move file data in that buffer and
+ * only the request and the count go in messages. Shares are kept per
+ * handle and client, and dropped when the handle is closed.
+ */
+#include <stdlib.h>		/* EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>		/* O_RDONLY etc */
+#include <syscall.h>		/* map_ramdisk, sync_ramdisk, shm_map_owner */
+#include <msg.h>		/* msgsend/msgrecv */
+#include <stdint.h>
+
+#include <utils/bool.h>
+
+#include <sbin/ramfs.h>		/* the filesystem */
+#include <sbin/ramfsd.h>	/* daemon interface */
+
+//#define RAMFSD_DEBUG 1
+
+/* The ramfsd message buffer */
+static ramfsd_msg_t msgbuff;
+
+/* handles that have been written to since they were opened */
+static int written[RAMFS_MAXOPEN];
+
+/* buffers shared by clients, for a handle */
+#define RAMFSD_MAXSHARE (2*RAMFS_MAXOPEN)
+
+typedef struct {
+  int h;			/* -1 when the slot is free */
+  int pid;			/* the client that shared it */
+  char *buf;
+  uint64_t size;
+} share_t;
+
+static share_t shares[RAMFSD_MAXSHARE];
+
+static int do_open(Ramfsd_path_req_t *req);
+static int do_close(int h);
+static int do_share(int h, int shm_id, int src);
+static share_t *find_share(int h, int src);
+static int to_errno(int rc);
+
+/* 
+ * main -- The main loop of the daemon
+ *
+ * Every message recieves a reply - typically DACK or DNAK
+ */
+int main(void) {
+  Msg_status_t status;		/* status of a recv */
+  int done,ready,replysize,h,rc,i;
+  ramfsd_msg_t *msgp,*replyp;
+  Ramfsd_resp_t *resp;
+  share_t *sp;
+  void *base;
+  uint64_t size,fs_offset,len;
+  int64_t val,off;
+  int whence;
+
+  msgp = replyp = &msgbuff;	/* buffer reused for reply */
+  resp = &replyp->resp;
+  for(i=0; i<RAMFSD_MAXSHARE; i++)
+    shares[i].h = -1;
+  /* 
+   * while not done { receive msg, service it, respond to sender } 
+   */
+  for(done=FALSE, ready=FALSE; !done ; ) {
+
+    /* set the default reply size based on generic response */
+    replysize=sizeof(generic_dresp_t); 
+    /* block and wait to recieve a message */
+    msgrecv(ANY,(void*)msgp, sizeof(msgbuff), &status); /* recieve */
+#ifdef RAMFSD_DEBUG
+    ramfsd_print_req(stdout,"ramfsd-recv",msgp);
+#endif 
+    switch(msgtype(msgp)) {	/* what message type arrived */
+    case DINIT:			/* init */
+      if(!ready) {
+	base = map_ramdisk(&size,&fs_offset);
+	if(base!=NULL && ramfs_mount(base,size,fs_offset)==0)
+	  ready = TRUE;		/* set ready when init complete */
+      }
+    case DPING:			/* ping */
+      respvalue(replyp)=DACK;	/* default reply is ACK */
+      if(!ready)		/* send NAK if not ready */
+	respvalue(replyp)=DNAK;	
+      break;
+
+    case DQUIT:			/* quit for testing only */
+      if(ready)	{		/* only quit if ready */
+	done=TRUE;		
+	respvalue(replyp)=DACK; /* repond with ACK */
+      }
+      else
+	respvalue(replyp)=DNAK; /* respond with NAK */
+      break;
+
+    case RAMFSD_OPEN:
+      rc = do_open(&msgp->path_req);
+      resp->value = (rc<0) ? to_errno(rc) : FILEIDMIN+rc;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    case RAMFSD_CLOSE:
+      rc = do_close(msgp->fd_req.fd-FILEIDMIN);
+      resp->value = (rc<0) ? to_errno(rc) : 0;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    case RAMFSD_READ:
+      h = msgp->fd_req.fd-FILEIDMIN;
+      len = msgp->fd_req.len;
+      if(len>RAMFSD_MAXBUFF)
+	len = RAMFSD_MAXBUFF;
+      /* reads straight into the reply, which overlays the request */
+      val = ramfs_read(h,replyp->read_resp.buf,len);
+      replyp->read_resp.value = (val<0) ? to_errno((int)val) : val;
+      replysize = offsetof(Ramfsd_read_resp_t,buf);
+      if(val>0)
+	replysize += val;
+      break;
+
+    case RAMFSD_WRITE:
+      h = msgp->write_req.fd-FILEIDMIN;
+      len = msgp->write_req.len;
+      if(len>RAMFSD_MAXBUFF)
+	len = RAMFSD_MAXBUFF;
+      val = ramfs_write(h,msgp->write_req.buf,len);
+      if(val>0 && h>=0 && h<RAMFS_MAXOPEN)
+	written[h] = TRUE;
+      resp->value = (val<0) ? to_errno((int)val) : val;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    case RAMFSD_SHARE:
+      rc = do_share(msgp->share_req.fd-FILEIDMIN,msgp->share_req.shm_id,
+		    status.src);
+      resp->value = rc;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    case RAMFSD_READ_SHARED:
+    case RAMFSD_WRITE_SHARED:
+      h = msgp->fd_req.fd-FILEIDMIN;
+      len = msgp->fd_req.len;
+      if((sp = find_share(h,status.src)) == NULL)
+	val = -ENXIO;		/* not this client's buffer */
+      else {
+	if(len>sp->size)
+	  len = sp->size;
+	if(msgtype(msgp)==RAMFSD_READ_SHARED)
+	  val = ramfs_read(h,sp->buf,len);
+	else {
+	  val = ramfs_write(h,sp->buf,len);
+	  if(val>0)
+	    written[h] = TRUE;
+	}
+	if(val<0)
+	  val = to_errno((int)val);
+      }
+      resp->value = val;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    case RAMFSD_SEEK:
+      h = msgp->fd_req.fd-FILEIDMIN;
+      off = msgp->fd_req.offset;
+      switch(msgp->fd_req.whence) {
+      case SEEK_SET: whence = RAMFS_SEEK_SET; break;
+      case SEEK_CUR: whence = RAMFS_SEEK_CUR; break;
+      case SEEK_END: whence = RAMFS_SEEK_END; break;
+      default:       whence = -1;             break;
+      }
+      val = ramfs_seek(h,off,whence);
+      resp->value = (val<0) ? to_errno((int)val) : val;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    case RAMFSD_STAT:
+      size = 0;
+      h = FALSE;
+      rc = ramfs_stat(msgp->path_req.path,&size,&h);
+      resp->value = (rc<0) ? to_errno(rc) : 0;
+      resp->size = size;
+      resp->isdir = h;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    case RAMFSD_FSTAT:
+      size = 0;
+      rc = ramfs_fstat(msgp->fd_req.fd-FILEIDMIN,&size);
+      resp->value = (rc<0) ? to_errno(rc) : 0;
+      resp->size = size;
+      resp->isdir = FALSE;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    case RAMFSD_UNLINK:
+      rc = ramfs_unlink(msgp->path_req.path);
+      if(rc==0)
+	sync_ramdisk();
+      resp->value = (rc<0) ? to_errno(rc) : 0;
+      replysize = sizeof(Ramfsd_resp_t);
+      break;
+
+    default:			/* error! */
+      fprintf(stdout,"[error on recv: %d]\n",msgtype(msgp));
+      respvalue(replyp)=DNAK;	/* respond with NAK */
+      break;
+    }
+    /* reply to sender using message specific size */
+    msgsend(status.src,(void*)replyp, replysize); 
+#ifdef RAMFSD_DEBUG
+    ramfsd_print_resp(stdout,"ramfsd-send",replyp);
+#endif 
+  }
+  exit(EXIT_SUCCESS);
+}
+
+/* open with the O_ flags from open(2) */
+static int do_open(Ramfsd_path_req_t *req) {
+  int flags,h;
+
+  req->path[RAMFSD_MAXPATH-1] = '\0';
+  switch(req->flags & O_ACCMODE) {
+  case O_RDONLY: flags = RAMFS_READ;              break;
+  case O_WRONLY: flags = RAMFS_WRITE;             break;
+  default:       flags = RAMFS_READ|RAMFS_WRITE;  break;
+  }
+  if(req->flags & O_CREAT)
+    flags |= RAMFS_CREATE;
+  if(req->flags & O_TRUNC)
+    flags |= RAMFS_TRUNC;
+  if(req->flags & O_APPEND)
+    flags |= RAMFS_APPEND;
+  if(req->flags & O_EXCL)
+    flags |= RAMFS_EXCL;
+
+  h = ramfs_open(req->path,flags);
+  if(h>=0)			/* creating or truncating is a change */
+    written[h] = (flags & (RAMFS_CREATE|RAMFS_TRUNC)) != 0;
+  return h;
+}
+
+static int do_close(int h) {
+  int rc,i;
+
+  rc = ramfs_close(h);
+  if(rc==0) {
+    for(i=0; i<RAMFSD_MAXSHARE; i++)
+      if(shares[i].h==h) {
+	shm_unmap(shares[i].buf);
+	shares[i].h = -1;
+      }
+    if(written[h]) {
+      written[h] = FALSE;
+      sync_ramdisk();		/* let the kernel see the new contents */
+    }
+  }
+  return rc;
+}
+
+/* map the buffer src shares for handle h, in place of any it had */
+static int do_share(int h, int shm_id, int src) {
+  share_t *sp;
+  char *buf;
+  uint64_t size;
+  int owner,i;
+
+  if(h<0 || h>=RAMFS_MAXOPEN)
+    return -EBADF;
+  if((buf = shm_map_owner(shm_id,&size,&owner)) == NULL)
+    return -EINVAL;
+  if(owner!=src) {		/* only the client's own region */
+    shm_unmap(buf);
+    return -EINVAL;
+  }
+  if((sp = find_share(h,src)) != NULL)
+    shm_unmap(sp->buf);
+  else {
+    for(i=0; i<RAMFSD_MAXSHARE && shares[i].h>=0; i++)
+      ;
+    if(i==RAMFSD_MAXSHARE) {
+      shm_unmap(buf);
+      return -ENOMEM;
+    }
+    sp = &shares[i];
+  }
+  sp->h = h;
+  sp->pid = src;
+  sp->buf = buf;
+  sp->size = (size<RAMFSD_SHMBUF) ? size : RAMFSD_SHMBUF;
+  return 0;
+}
+
+static share_t *find_share(int h, int src) {
+  int i;
+
+  if(h<0)
+    return NULL;
+  for(i=0; i<RAMFSD_MAXSHARE; i++)
+    if(shares[i].h==h && shares[i].pid==src)
+      return &shares[i];
+  return NULL;
+}
+
+/* FatFs errors (negated) to -errno */
+static int to_errno(int rc) {
+  switch(rc) {
+  case RAMFS_ERR_NO_FILE:
+  case RAMFS_ERR_NO_PATH:       return -ENOENT;
+  case RAMFS_ERR_INVALID_NAME:  return -EINVAL;
+  case RAMFS_ERR_DENIED:        return -EACCES;
+  case RAMFS_ERR_EXIST:         return -EEXIST;
+  case RAMFS_ERR_INVALID:       return -EBADF;
+  case RAMFS_ERR_TOO_MANY_OPEN: return -EMFILE;
+  default:                      return -EIO;
+  }
+}
@@ -0,0 +1,442 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * ramfsd_if.c -- this file contains the implementation for 
+ * functions that communicate with ramfsd. The prototypes are
+ * available throught the interface ramfsd.h.
+ *
+ * Reads smaller than RAMFSD_MAXBUFF fetch RAMFSD_MAXBUFF bytes and keep
+ * the rest, so a program reading a file a line or a block at a time
+ * sends one message per RAMFSD_MAXBUFF bytes rather than one per read.
+ * Anything that moves the file position on the daemon's side first
+ * gives back what was read ahead and not used.
+ *
+ * On the first read or write of a descriptor a RAMFSD_SHMBUF region is
+ * shared with the daemon, and from then on file data moves through it:
+ * the read ahead lives in the region, and the messages carry only the
+ * counts. A child that inherited the descriptor shares a region of its
+ * own before using it. If the daemon will not take a region, data goes
+ * in the messages as before.
+ */
+#include <stdio.h>		/* fprintf */
+#include <stdlib.h>		/* malloc */
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>		/* uint8_t */
+#include <unistd.h>		/* getpid */
+#include <syscall.h>		/* shm_create, shm_unmap */
+#include <utils/bool.h>
+#include <sbin/ramfs.h>		/* RAMFS_MAXOPEN */
+#include <sbin/ramfsd.h>	/* daemon interface */
+
+static ramfsd_msg_t msgbuff;
+static ramfsd_msg_t *const msgbuffp = &msgbuff;
+
+/* read ahead, per file descriptor */
+typedef struct {
+  char *buf;			/* the shared region, or RAMFSD_MAXBUFF bytes */
+  uint64_t pos;			/* next byte to hand out */
+  uint64_t len;			/* bytes in buf */
+  int shared;			/* buf is a region shared with the daemon */
+  int pid;			/* by this process */
+  int noshare;			/* the daemon would not take one */
+} readahead_t;
+
+static readahead_t ra[RAMFS_MAXOPEN];
+
+/* getpid() is a round trip to the kernel; fork clears this */
+static int mypid;
+
+/* helper functions */
+static int send_recv_generic(int dpid,int msgsize);
+static int64_t send_recv(int msgsize);
+static int64_t read_msg(int fd, void *buf, uint64_t nbytes);
+static readahead_t *readahead(int fd);
+static int64_t unread(int fd);
+static int share(int fd, readahead_t *rap);
+static void release(readahead_t *rap);
+static int read_shared(int fd, readahead_t *rap, char *p, uint64_t nbytes);
+static int write_shared(int fd, readahead_t *rap, const char *p, 
+			uint64_t nbytes);
+
+/*
+ * The generic interface provides init/ping/quit messages
+ */
+int ramfsd_init(int dpid) {
+  msgtype(msgbuffp) = DINIT;
+  return send_recv_generic(dpid,sizeof(generic_dinit_req_t));
+}
+
+int ramfsd_ping(int dpid) {
+  msgtype(msgbuffp) = DPING;
+  return send_recv_generic(dpid,sizeof(generic_dping_req_t));
+}
+
+int ramfsd_quit(int dpid) {
+  msgtype(msgbuffp) = DQUIT;
+  return send_recv_generic(dpid,sizeof(generic_dquit_req_t));
+}
+
+int ramfsd_open(const char *path, int flags) {
+  Ramfsd_path_req_t *req = &msgbuffp->path_req;
+  int64_t fd;
+  readahead_t *rap;
+
+  if(strlen(path) >= RAMFSD_MAXPATH) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  req->type = RAMFSD_OPEN;
+  req->flags = flags;
+  strcpy(req->path,path);
+  fd = send_recv(offsetof(Ramfsd_path_req_t,path)+strlen(path)+1);
+  if(fd >= 0 && (rap = readahead((int)fd)) != NULL) {
+    release(rap);
+    rap->noshare = FALSE;
+  }
+  return (int)fd;
+}
+
+int ramfsd_close(int fd) {
+  Ramfsd_fd_req_t *req = &msgbuffp->fd_req;
+  readahead_t *rap;
+
+  if((rap = readahead(fd)) != NULL)
+    release(rap);
+  req->type = RAMFSD_CLOSE;
+  req->fd = fd;
+  return (int)send_recv(sizeof(Ramfsd_fd_req_t));
+}
+
+int ramfsd_read(int fd, void *buf, uint64_t nbytes) {
+  readahead_t *rap;
+  uint64_t done,want;
+  int64_t got;
+  char *p = buf;
+
+  rap = readahead(fd);
+  if(rap && share(fd,rap) == 0)
+    return read_shared(fd,rap,p,nbytes);
+
+  done = 0;
+  if(rap && rap->pos < rap->len) { /* what is already here first */
+    done = rap->len - rap->pos;
+    if(done > nbytes)
+      done = nbytes;
+    memcpy(p,rap->buf+rap->pos,done);
+    rap->pos += done;
+  }
+
+  while(done < nbytes) {
+    want = nbytes - done;
+    if(rap && want < RAMFSD_MAXBUFF &&
+       (rap->buf || (rap->buf = malloc(RAMFSD_MAXBUFF)) != NULL)) {
+      got = read_msg(fd,rap->buf,RAMFSD_MAXBUFF);
+      if(got < 0)
+	return done ? (int)done : -1;
+      rap->len = got;
+      rap->pos = (want < (uint64_t)got) ? want : (uint64_t)got;
+      memcpy(p+done,rap->buf,rap->pos);
+      done += rap->pos;
+      break;			/* satisfied, or end of file */
+    }
+    if(want > RAMFSD_MAXBUFF)
+      want = RAMFSD_MAXBUFF;
+    got = read_msg(fd,p+done,want);
+    if(got < 0)
+      return done ? (int)done : -1;
+    done += got;
+    if((uint64_t)got < want)	/* end of file */
+      break;
+  }
+  return (int)done;
+}
+
+int ramfsd_write(int fd, const void *buf, uint64_t nbytes) {
+  Ramfsd_write_req_t *req = &msgbuffp->write_req;
+  const char *p = buf;
+  readahead_t *rap;
+  uint64_t done;
+  int64_t n;
+
+  if(unread(fd) < 0)
+    return -1;
+  rap = readahead(fd);
+  if(rap && share(fd,rap) == 0)
+    return write_shared(fd,rap,p,nbytes);
+  for(done = 0; done < nbytes; done += n) {
+    req->type = RAMFSD_WRITE;
+    req->fd = fd;
+    req->len = nbytes - done;
+    if(req->len > RAMFSD_MAXBUFF)
+      req->len = RAMFSD_MAXBUFF;
+    memcpy(req->buf,p+done,req->len);
+    n = send_recv(offsetof(Ramfsd_write_req_t,buf)+req->len);
+    if(n < 0)
+      return done ? (int)done : -1;
+    if(n == 0)			/* disk full */
+      break;
+  }
+  return (int)done;
+}
+
+int64_t ramfsd_seek(int fd, int64_t offset, int whence) {
+  Ramfsd_fd_req_t *req = &msgbuffp->fd_req;
+  readahead_t *rap;
+
+  /* fold what was read ahead into a relative seek */
+  if((rap = readahead(fd)) != NULL) {
+    if(whence == SEEK_CUR)
+      offset -= rap->len - rap->pos;
+    rap->pos = rap->len = 0;
+  }
+  req->type = RAMFSD_SEEK;
+  req->fd = fd;
+  req->offset = offset;
+  req->whence = whence;
+  return send_recv(sizeof(Ramfsd_fd_req_t));
+}
+
+int ramfsd_stat(const char *path, struct stat *buf) {
+  Ramfsd_path_req_t *req = &msgbuffp->path_req;
+  Ramfsd_resp_t *resp = &msgbuffp->resp;
+
+  if(strlen(path) >= RAMFSD_MAXPATH) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  req->type = RAMFSD_STAT;
+  strcpy(req->path,path);
+  if(send_recv(offsetof(Ramfsd_path_req_t,path)+strlen(path)+1) < 0)
+    return -1;
+  memset(buf,0,sizeof(struct stat));
+  buf->st_mode = resp->isdir ? (S_IFDIR|0777) : (S_IFREG|0666);
+  buf->st_size = resp->size;
+  buf->st_blksize = RAMFSD_MAXBUFF;
+  return 0;
+}
+
+int ramfsd_fstat(int fd, struct stat *buf) {
+  Ramfsd_fd_req_t *req = &msgbuffp->fd_req;
+  Ramfsd_resp_t *resp = &msgbuffp->resp;
+
+  req->type = RAMFSD_FSTAT;
+  req->fd = fd;
+  if(send_recv(sizeof(Ramfsd_fd_req_t)) < 0)
+    return -1;
+  memset(buf,0,sizeof(struct stat));
+  buf->st_mode = S_IFREG|0666;
+  buf->st_size = resp->size;
+  buf->st_blksize = RAMFSD_MAXBUFF;
+  return 0;
+}
+
+int ramfsd_unlink(const char *path) {
+  Ramfsd_path_req_t *req = &msgbuffp->path_req;
+
+  if(strlen(path) >= RAMFSD_MAXPATH) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  req->type = RAMFSD_UNLINK;
+  strcpy(req->path,path);
+  return (int)send_recv(offsetof(Ramfsd_path_req_t,path)+strlen(path)+1);
+}
+
+/* read up to nbytes (<= RAMFSD_MAXBUFF) at the daemon's file position */
+static int64_t read_msg(int fd, void *buf, uint64_t nbytes) {
+  Ramfsd_fd_req_t *req = &msgbuffp->fd_req;
+  int64_t n;
+
+  req->type = RAMFSD_READ;
+  req->fd = fd;
+  req->len = nbytes;
+  n = send_recv(sizeof(Ramfsd_fd_req_t));
+  if(n > 0)
+    memcpy(buf,msgbuffp->read_resp.buf,n);
+  return n;
+}
+
+static readahead_t *readahead(int fd) {
+  if(fd < FILEIDMIN || fd >= FILEIDMIN+RAMFS_MAXOPEN)
+    return NULL;
+  return &ra[fd-FILEIDMIN];
+}
+
+/*
+ * share -- makes sure rap->buf is a region this process has shared
+ * with the daemon for fd, keeping what was read ahead. Returns 0, or
+ * -1 if data has to go in the messages instead.
+ */
+static int share(int fd, readahead_t *rap) {
+  Ramfsd_share_req_t *req = &msgbuffp->share_req;
+  char *buf;
+  int pid,grant,id,err;
+
+  if(rap->noshare)
+    return -1;
+  if(mypid == 0)
+    mypid = getpid();
+  pid = mypid;
+  if(rap->shared && rap->pid == pid)
+    return 0;
+  grant = RAMFSD;
+  if((buf = shm_create(RAMFSD_SHMBUF,&grant,1,&id)) == NULL) {
+    rap->noshare = TRUE;
+    return -1;
+  }
+  err = errno;
+  req->type = RAMFSD_SHARE;
+  req->fd = fd;
+  req->shm_id = id;
+  if(send_recv(sizeof(Ramfsd_share_req_t)) < 0) {
+    errno = err;
+    shm_unmap(buf);
+    rap->noshare = TRUE;
+    return -1;
+  }
+  rap->len -= rap->pos;		/* at most RAMFSD_MAXBUFF, or the region */
+  if(rap->len > 0)
+    memcpy(buf,rap->buf+rap->pos,rap->len);
+  rap->pos = 0;
+  if(rap->shared)		/* inherited: unmapped only here */
+    shm_unmap(rap->buf);
+  else
+    free(rap->buf);
+  rap->buf = buf;
+  rap->shared = TRUE;
+  rap->pid = pid;
+  return 0;
+}
+
+/* In the child after fork: the shared buffers are the parent's */
+void ramfsd_forked(void) {
+  mypid = 0;
+}
+
+/* forget the buffer of a descriptor that is closed or reused */
+static void release(readahead_t *rap) {
+  if(rap->shared)
+    shm_unmap(rap->buf);
+  else
+    free(rap->buf);
+  rap->buf = NULL;
+  rap->pos = rap->len = 0;
+  rap->shared = FALSE;
+}
+
+/* reads refill the region whenever it is used up */
+static int read_shared(int fd, readahead_t *rap, char *p, uint64_t nbytes) {
+  Ramfsd_fd_req_t *req = &msgbuffp->fd_req;
+  uint64_t done,n;
+  int64_t got;
+
+  for(done = 0; done < nbytes; done += n) {
+    if(rap->pos == rap->len) {
+      req->type = RAMFSD_READ_SHARED;
+      req->fd = fd;
+      req->len = RAMFSD_SHMBUF;
+      got = send_recv(sizeof(Ramfsd_fd_req_t));
+      if(got < 0)
+	return done ? (int)done : -1;
+      rap->pos = 0;
+      rap->len = got;
+      if(got == 0)		/* end of file */
+	break;
+    }
+    n = rap->len - rap->pos;
+    if(n > nbytes - done)
+      n = nbytes - done;
+    memcpy(p+done,rap->buf+rap->pos,n);
+    rap->pos += n;
+  }
+  return (int)done;
+}
+
+/* nothing is read ahead here: the caller gave it back */
+static int write_shared(int fd, readahead_t *rap, const char *p, 
+			uint64_t nbytes) {
+  Ramfsd_fd_req_t *req = &msgbuffp->fd_req;
+  uint64_t done;
+  int64_t n;
+
+  rap->pos = rap->len = 0;
+  for(done = 0; done < nbytes; done += n) {
+    req->type = RAMFSD_WRITE_SHARED;
+    req->fd = fd;
+    req->len = nbytes - done;
+    if(req->len > RAMFSD_SHMBUF)
+      req->len = RAMFSD_SHMBUF;
+    memcpy(rap->buf,p+done,req->len);
+    n = send_recv(sizeof(Ramfsd_fd_req_t));
+    if(n < 0)
+      return done ? (int)done : -1;
+    if(n == 0)			/* disk full */
+      break;
+  }
+  return (int)done;
+}
+
+/* give back what was read ahead and not used */
+static int64_t unread(int fd) {
+  readahead_t *rap;
+
+  if((rap = readahead(fd)) == NULL || rap->pos == rap->len)
+    return 0;
+  return ramfsd_seek(fd,0,SEEK_CUR);
+}
+
+/*
+ * send_recv -- sends the request in msgbuff and waits for the reply
+ * in the same buffer. Returns the value in the reply, or -1 with
+ * errno set if the daemon reported an error.
+ */
+static int64_t send_recv(int msgsize) {
+  Msg_status_t status;
+  int64_t value;
+
+  msgbuffp->fd_req.tag = get_msg_tag();
+  msgsend(RAMFSD,(void*)msgbuffp,msgsize);
+  msgrecv(RAMFSD,(void*)msgbuffp,sizeof(ramfsd_msg_t),&status);
+  value = msgbuffp->resp.value;
+  if(value < 0) {
+    errno = (int)-value;
+    return -1;
+  }
+  return value;
+}
+
+/*
+ * send_recv_generic -- assumes a message has been set up to send in
+ * the msgbuff, sends it, then waits for a generic response and
+ * returns the value associated with it.
+ */
+static int send_recv_generic(int dpid,int msgsize) {
+  Msg_status_t status;
+  generic_dresp_t *replyp;
+
+  msgsend(dpid,(void*)msgbuffp,msgsize);
+  replyp = (generic_dresp_t*)msgbuffp;
+  msgrecv(dpid,(void*)replyp,sizeof(generic_dresp_t),&status);
+  return respvalue(replyp);
+}
@@ -0,0 +1,121 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * ramfsd_utils.c -- the ramfsd utilities shared by both the daemon
+ * and any program that communicates with it. Utilities that are used
+ * to communcate with daemon, but not used by the daemon itself are
+ * placed in ramfsd_if.c.
+ */
+#include <stdio.h>		/* fprintf */
+#include <stdint.h>		/* uint8_t */
+#include <sbin/ramfsd.h>	/* daemon interface */
+
+/* 
+ * ramfsd_print_req -- a function that logs every type of request
+ * message used by the daemon in a human readable format -- every
+ * message used by the daemon must have an entry in this functions
+ * switch statement.
+ */
+void ramfsd_print_req(FILE *logp,char *op,ramfsd_msg_t *msgp) {
+
+  fprintf(logp,"%s: ",op);
+  /* print the message in a readable format */
+  switch(msgtype(msgp)) {
+  case DINIT:
+    fprintf(logp,"[init]\n");	/* init daemon */
+    break;
+  case DPING:			/* ping */
+    fprintf(logp,"[ping]\n");	
+    break;
+  case DQUIT:			/* quit */
+    fprintf(logp,"[quit]\n");	
+    break;
+  case RAMFSD_OPEN:
+    fprintf(logp,"[open,%s,0x%x]\n",msgp->path_req.path,msgp->path_req.flags);
+    break;
+  case RAMFSD_STAT:
+    fprintf(logp,"[stat,%s]\n",msgp->path_req.path);
+    break;
+  case RAMFSD_UNLINK:
+    fprintf(logp,"[unlink,%s]\n",msgp->path_req.path);
+    break;
+  case RAMFSD_CLOSE:
+    fprintf(logp,"[close,%d]\n",msgp->fd_req.fd);
+    break;
+  case RAMFSD_READ:
+    fprintf(logp,"[read,%d,%ld]\n",msgp->fd_req.fd,(long)msgp->fd_req.len);
+    break;
+  case RAMFSD_SEEK:
+    fprintf(logp,"[seek,%d,%ld,%d]\n",msgp->fd_req.fd,
+	    (long)msgp->fd_req.offset,msgp->fd_req.whence);
+    break;
+  case RAMFSD_FSTAT:
+    fprintf(logp,"[fstat,%d]\n",msgp->fd_req.fd);
+    break;
+  case RAMFSD_WRITE:
+    fprintf(logp,"[write,%d,%ld]\n",msgp->write_req.fd,(long)msgp->write_req.len);
+    break;
+  case RAMFSD_SHARE:
+    fprintf(logp,"[share,%d,%d]\n",msgp->share_req.fd,msgp->share_req.shm_id);
+    break;
+  case RAMFSD_READ_SHARED:
+    fprintf(logp,"[read shared,%d,%ld]\n",msgp->fd_req.fd,(long)msgp->fd_req.len);
+    break;
+  case RAMFSD_WRITE_SHARED:
+    fprintf(logp,"[write shared,%d,%ld]\n",msgp->fd_req.fd,(long)msgp->fd_req.len);
+    break;
+  default:			/* unknown */
+    fprintf(logp,"[unknown request: %d]\n",msgtype(msgp)); 
+    break;
+  }
+}
+
+/* 
+ * ramfsd_print_resp -- a function that logs every type of response
+ * message used by the daemon in a human readable format.
+ */
+void ramfsd_print_resp(FILE *logp,char *op,ramfsd_msg_t *msgp) {
+
+  fprintf(logp,"%s: ",op);
+  /* print the message in a readable format */
+  switch(msgtype(msgp)) {
+  case DINIT:
+    fprintf(logp,"[init,");	/* init daemon */
+    break;
+  case DPING:			/* ping */
+    fprintf(logp,"[ping,");	
+    break;
+  case DQUIT:			/* quit */
+    fprintf(logp,"[quit,");	
+    break;
+  default:			/* file operations */
+    fprintf(logp,"[%d,%ld]\n",msgtype(msgp),(long)msgp->resp.value); 
+    return;
+  }
+  if(respvalue(msgp)==DACK)
+    fprintf(logp,"ACK]\n");
+  else if(respvalue(msgp)==DNAK)
+    fprintf(logp,"NAK]\n");
+  else
+    fprintf(logp,"%d]\n",respvalue(msgp));
+}
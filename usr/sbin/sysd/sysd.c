@@ -102,7 +102,11 @@ int main(void) {
 #endif /* not STANDALONE */
 
   daemon_init(PIPED);   /* wait for piped to be ready */
+#ifdef STANDALONE
+  daemon_init(RAMFSD);  /* wait for ramfsd to be ready */
+#endif
 
+  boot_mark("sysd: start shell",FALSE); /* boot timeline: sysd is up */
 #ifdef STANDALONE
   if((pid=start_shell("slash"))<0) /* launch some shell */
       fprintf(stderr,"[sysd: unable to start slash]\n");
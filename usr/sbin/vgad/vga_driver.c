@@ -78,15 +78,63 @@ void vga_advance(int cols) {
 		row += 1;
 		col -= VGA_TEXT_COLS;
 	}
-	while(row >= VGA_TEXT_ROWS) {
-		vga_scroll(3);
-		row--;
+	if(row >= VGA_TEXT_ROWS) {
+		vga_scroll_rows(row - (VGA_TEXT_ROWS - 1), 3);
+		row = VGA_TEXT_ROWS - 1;
 		col = 0;
 	}
 
 	vga_setpos(row, col);
 }
 
+/*
+ * Draw len characters of buf, with the same handling of newlines and tabs
+ * as vga_newline/vga_tabline. The cursor is read and set once, and however
+ * many lines buf runs past the bottom the screen is scrolled once, before
+ * anything is drawn; characters that would scroll off are never drawn.
+ */
+void vga_puts(char *buf, int len, int color) {
+	int row, col, r, c, i, scroll;
+
+	/* Where the batch ends, counting rows below the screen */
+	vga_getpos(&row, &col);
+	for(i = 0, r = row, c = col; i < len; i++) {
+		if(buf[i] == '\n')
+			c = VGA_TEXT_COLS;
+		else if(buf[i] == '\t')
+			c += 8 - (c % 8);
+		else
+			c++;
+		if(c >= VGA_TEXT_COLS) {
+			r++;
+			c = 0;
+		}
+	}
+	scroll = 0;
+	if(r >= VGA_TEXT_ROWS) {
+		scroll = r - (VGA_TEXT_ROWS - 1);
+		vga_scroll_rows(scroll, color);
+	}
+
+	for(i = 0, r = row - scroll, c = col; i < len; i++) {
+		if(buf[i] == '\n')
+			c = VGA_TEXT_COLS;
+		else if(buf[i] == '\t')
+			c += 8 - (c % 8);
+		else {
+			if(r >= 0)
+				vga_screen[r*VGA_TEXT_COLS + c] = (color << 8) | (unsigned char)buf[i];
+			c++;
+		}
+		if(c >= VGA_TEXT_COLS) {
+			r++;
+			c = 0;
+		}
+	}
+
+	vga_setpos(r, c);
+}
+
 void vga_retreat(int cols) {
 	int row, col;
 	
@@ -168,13 +216,25 @@ void vga_tabline() {
 }
 
 void vga_scroll(int color) {
+    vga_scroll_rows(1, color);
+}
+
+/* 
+ * Scroll up rows lines in one pass over the screen, blanking the bottom.
+ * The boot loaders and hypervisor link this file too, so no memmove; 
+ * copying upwards is safe front to back.
+ */
+void vga_scroll_rows(int rows, int color) {
     unsigned short val;
-    int i;
+    int i, n;
 
     val = (color << 8) | ' ';
 
-    for(i = 0; i < (VGA_TEXT_ROWS-1) * VGA_TEXT_COLS; i++)
-        vga_screen[i] = vga_screen[i + VGA_TEXT_COLS];
+    if(rows > VGA_TEXT_ROWS)
+        rows = VGA_TEXT_ROWS;
+    n = (VGA_TEXT_ROWS - rows) * VGA_TEXT_COLS;
+    for(i = 0; i < n; i++)
+        vga_screen[i] = vga_screen[i + rows * VGA_TEXT_COLS];
     for(; i < VGA_TEXT_ROWS * VGA_TEXT_COLS; i++)
         vga_screen[i] = val;
 }
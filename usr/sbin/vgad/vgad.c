@@ -29,6 +29,7 @@
 #include <stdint.h>			/* For int types        */
 #include <syscall.h>
 #include <time.h>			/* For clockid_r	*/
+#include <signal.h>			/* kill(pid, 0)		*/
 #include <msg.h>			/* Message Passing API	*/
 
 #include <sbin/syspid.h>
@@ -42,12 +43,21 @@ static void vgad_init();
 static void vgad_putc   (Vgad_msg_t*, Msg_status_t*);
 static void vgad_retreat(Vgad_msg_t*, Msg_status_t*);
 static void vgad_puts   (Vgad_msg_t*, Msg_status_t*);
+static void vgad_ring_setup(Vgad_msg_t*, Msg_status_t*);
+static void vgad_ring_kick (Vgad_msg_t*, Msg_status_t*);
+static void vgad_ring_sync (Vgad_msg_t*, Msg_status_t*);
+static void vgad_ring_close(Vgad_msg_t*, Msg_status_t*);
 
 /* Helper functions */
 static void vgad_draw_char(char c);
+static void vgad_draw(char *buf, int len);
+static int vgad_ring_find(int pid);
+static void vgad_ring_free(int i);
+static int vgad_ring_reclaim();
+static void vgad_ring_drain(Vga_ring_t *ring);
 
 /* These numbers must match the syscall types in kmsg.h */
-#define VGA_MSGTYPE_MAX  2
+#define VGA_MSGTYPE_MAX  6
 #define VGA_NUM_MSGTYPES (VGA_MSGTYPE_MAX + 1)
 
 /* For handling bad messages */
@@ -56,7 +66,16 @@ static char err_str[] = "VGAD_ERR";
 #define ERR_STR_LEN 8
 
 static void (*func_array[VGA_NUM_MSGTYPES])(Vgad_msg_t*, Msg_status_t*) = 
-{ vgad_putc, vgad_retreat, vgad_puts };
+{ vgad_putc, vgad_retreat, vgad_puts, vgad_ring_setup, vgad_ring_kick,
+  vgad_ring_sync, vgad_ring_close };
+
+/* Console rings, see Vga_ring_t in vgad.h */
+typedef struct {
+  int pid;			/* owner, 0 if the slot is free */
+  Vga_ring_t *ring;
+} Vgad_ring_slot_t;
+
+static Vgad_ring_slot_t rings[VGA_RINGS];
 
 
 #ifdef SERIAL_OUT_USER
@@ -167,17 +186,80 @@ void vgad_retreat(Vgad_msg_t *msg, Msg_status_t *status) {
 static void vgad_puts(Vgad_msg_t *msg, Msg_status_t *status) {
   Puts_req_t *req;
   Puts_resp_t resp;
-  uint32_t i, len;
+  uint32_t len;
 
   req = (Puts_req_t *)msg;
   len = req->len;
-  for(i=0; i<len; i++)
-    vgad_draw_char((req->buf)[i]);
+  if(len > CHARBUF_SZ)
+    len = CHARBUF_SZ;
+  vgad_draw(req->buf, len);
   resp.type = VGA_PUTS;
   resp.ret = 0;
   msgsend(status->src, &resp, sizeof(Puts_resp_t));
 }
 
+static void vgad_ring_setup(Vgad_msg_t *msg, Msg_status_t *status) {
+  Ring_req_t *req;
+  Ring_resp_t resp;
+  Vga_ring_t *ring;
+  uint64_t size;
+  int i, owner;
+
+  req = (Ring_req_t *)msg;
+  resp.type = VGA_RING_SETUP;
+  resp.ret = -1;
+
+  /* a pid has one ring; a new one replaces what an exec'd pid left */
+  if((i = vgad_ring_find(status->src)) < 0)
+    if((i = vgad_ring_find(0)) < 0)
+      i = vgad_ring_reclaim();
+  if(i < 0)
+    goto vgad_ring_setup_out;
+  if(rings[i].ring != NULL)
+    vgad_ring_free(i);
+
+  ring = (Vga_ring_t *)shm_map_owner(req->shm_id, &size, &owner);
+  if(ring == NULL)
+    goto vgad_ring_setup_out;
+  if(owner != status->src || size < sizeof(Vga_ring_t)) {
+    shm_unmap(ring);
+    goto vgad_ring_setup_out;
+  }
+  rings[i].pid = status->src;
+  rings[i].ring = ring;
+  resp.ret = 0;
+
+ vgad_ring_setup_out:
+  msgsend(status->src, &resp, sizeof(Ring_resp_t));
+}
+
+static void vgad_ring_kick(Vgad_msg_t *msg, Msg_status_t *status) {
+  int i;
+
+  if((i = vgad_ring_find(status->src)) >= 0)
+    vgad_ring_drain(rings[i].ring);
+}
+
+static void vgad_ring_sync(Vgad_msg_t *msg, Msg_status_t *status) {
+  Ring_resp_t resp;
+  int i;
+
+  resp.type = VGA_RING_SYNC;
+  resp.ret = -1;
+  if((i = vgad_ring_find(status->src)) >= 0) {
+    vgad_ring_drain(rings[i].ring);
+    resp.ret = 0;
+  }
+  msgsend(status->src, &resp, sizeof(Ring_resp_t));
+}
+
+static void vgad_ring_close(Vgad_msg_t *msg, Msg_status_t *status) {
+  int i;
+
+  if((i = vgad_ring_find(status->src)) >= 0)
+    vgad_ring_free(i);
+}
+
 void vgad_invalid(Vgad_msg_t *msg, Msg_status_t *status) {
   int i;
   for(i=0; i<ERR_STR_LEN; i++)
@@ -186,6 +268,73 @@ void vgad_invalid(Vgad_msg_t *msg, Msg_status_t *status) {
 
 /* Private Helper Functions */
 
+/* The slot pid's ring is in, or -1; vgad_ring_find(0) finds a free slot */
+static int vgad_ring_find(int pid) {
+  int i;
+
+  for(i = 0; i < VGA_RINGS; i++)
+    if(rings[i].pid == pid)
+      return i;
+  return -1;
+}
+
+/* Draw what is left in slot i and give it up */
+static void vgad_ring_free(int i) {
+  vgad_ring_drain(rings[i].ring);
+  shm_unmap(rings[i].ring);
+  rings[i].ring = NULL;
+  rings[i].pid = 0;
+}
+
+/*
+ * Exit does not tell us, so when every slot is taken, free those whose
+ * pid is gone. Returns a free slot, or -1.
+ */
+static int vgad_ring_reclaim() {
+  int i;
+
+  for(i = 0; i < VGA_RINGS; i++)
+    if(rings[i].pid != 0 && kill(rings[i].pid, 0) < 0)
+      vgad_ring_free(i);
+  return vgad_ring_find(0);
+}
+
+/*
+ * Draw everything up to head. kicked is cleared before head is read, so
+ * anything the owner writes after the read comes with a fresh kick.
+ */
+static void vgad_ring_drain(Vga_ring_t *ring) {
+  uint32_t head, tail, idx, n;
+
+  ring->kicked = 0;
+  __sync_synchronize();
+  head = ring->head;
+  tail = ring->tail;
+  if(head - tail > VGA_RING_SIZE)	/* corrupt; drop it */
+    tail = head - VGA_RING_SIZE;
+  while(tail != head) {
+    idx = tail % VGA_RING_SIZE;
+    n = head - tail;
+    if(n > VGA_RING_SIZE - idx)
+      n = VGA_RING_SIZE - idx;
+    vgad_draw(&(ring->data[idx]), n);
+    tail += n;
+  }
+  __sync_synchronize();
+  ring->tail = tail;
+}
+
+/* Draw a batch: one cursor update and at most one scroll */
+static void vgad_draw(char *buf, int len) {
+#ifdef SERIAL_OUT_USER
+  int i;
+
+  for(i = 0; i < len; i++)
+    write_serial(buf[i]);
+#endif	/* SERIAL_OUT_USER */
+  vga_puts(buf, len, STD_VGA_COLOR);
+}
+
 static void vgad_draw_char(char c) {
   
   if((c) == '\n'){
@@ -8,6 +8,7 @@
 #include <syscall.h>
 #include <stdio.h>
 #include <sbin/sysd.h>
+#include <console.h>
 
 _VOID
 _DEFUN (_exit, (rc),
@@ -18,6 +19,7 @@ _DEFUN (_exit, (rc),
   Msg_status_t status;
   int pid;
 
+  console_close();
   req.type = SC_EXIT;
   req.exit_sig = rc;
   msgsend(SYS, &req, sizeof(Exit_req_t));
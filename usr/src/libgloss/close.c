@@ -21,6 +21,7 @@
 #include <sbin/nfsd.h>		/* nfsd_close */
 #include <sbin/sysd.h>		/* is_fileid */
 #include <sbin/piped.h>
+#include <sbin/ramfsd.h>	/* ramfsd_close */
 
 /*
  * close -- Use libnfs to close the file on the NFS server 
@@ -44,6 +45,9 @@ _DEFUN (close ,(fd),
 #if ( !defined(STANDALONE) )
   else if(is_fileid(fd)) 
     ret=nfsd_close(NFSD,fd);	/* close the file */
+#else
+  else if(is_fileid(fd)) 
+    ret=ramfsd_close(fd);	/* close the file */
 #endif
 #ifndef STANDALONE
   else if(is_sockid(fd)) {
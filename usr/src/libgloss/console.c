@@ -0,0 +1,158 @@
+/*
+ * console.c -- stdout and stderr through a ring shared with vgad
+ *
+ * The first write to a stdio fd that goes to vgad sets up a Vga_ring_t (see
+ * sbin/vgad.h); after that a write() is a copy into the ring, and vgad is
+ * kicked once a line is complete, once VGA_RING_FLUSH bytes are waiting,
+ * or when we are about to block -- and then only if it is not already on
+ * its way. stderr is kicked on every write.
+ */
+#include <string.h>
+#include <msg.h>
+#include <syscall.h>
+#include <console.h>
+#include <sbin/syspid.h>
+#include <sbin/vgad.h>
+
+static Vga_ring_t *ring;
+static int ring_refused;	/* vgad had no room for us; use VGA_PUTS */
+static uint32_t ring_flushed;	/* head when vgad was last told about it */
+static int stdio_pid[3];	/* getstdio(fd), 0 until asked */
+
+static int console_pid(int fd) {
+  if(stdio_pid[fd] == 0)
+    stdio_pid[fd] = getstdio(fd);
+  return stdio_pid[fd];
+}
+
+static Vga_ring_t *ring_get(void) {
+  Ring_req_t req;
+  Ring_resp_t resp;
+  Msg_status_t status;
+  Vga_ring_t *r;
+  int grant, id;
+
+  if(ring != NULL || ring_refused)
+    return ring;
+
+  grant = VGAD;
+  r = (Vga_ring_t *)shm_create(sizeof(Vga_ring_t), &grant, 1, &id);
+  if(r == NULL) {
+    ring_refused = 1;
+    return NULL;
+  }
+  r->head = r->tail = r->kicked = 0;
+
+  req.type = VGA_RING_SETUP;
+  req.shm_id = id;
+  msgsend(VGAD, &req, sizeof(Ring_req_t));
+  msgrecv(VGAD, &resp, sizeof(Ring_resp_t), &status);
+  if(resp.ret < 0) {
+    shm_unmap(r);
+    ring_refused = 1;
+    return NULL;
+  }
+  ring = r;
+  ring_flushed = 0;
+  return ring;
+}
+
+/* Tell vgad there is something to draw, unless a kick is already queued */
+static void ring_kick(void) {
+  Ring_req_t req;
+
+  __sync_synchronize();		/* head before kicked; see vgad_ring_drain */
+  ring_flushed = ring->head;
+  if(ring->kicked)
+    return;
+  ring->kicked = 1;
+  req.type = VGA_RING_KICK;
+  msgsend(VGAD, &req, sizeof(Ring_req_t));
+}
+
+/* Have vgad draw everything; -1 if it has lost track of the ring */
+static int ring_sync(void) {
+  Ring_req_t req;
+  Ring_resp_t resp;
+  Msg_status_t status;
+
+  ring_flushed = ring->head;
+  req.type = VGA_RING_SYNC;
+  msgsend(VGAD, &req, sizeof(Ring_req_t));
+  msgrecv(VGAD, &resp, sizeof(Ring_resp_t), &status);
+  if(resp.ret < 0) {
+    shm_unmap(ring);
+    ring = NULL;
+    ring_refused = 1;
+  }
+  return resp.ret;
+}
+
+/*
+ * Copy buf into the ring. Returns how many bytes it took, which is short
+ * of nbytes only if there is no ring; the caller sends the rest.
+ */
+int console_write(int fd, char *buf, int nbytes) {
+  uint32_t room, idx, first;
+  int done, n;
+
+  if(console_pid(fd) != VGAD || ring_get() == NULL)
+    return 0;
+
+  for(done = 0; done < nbytes; done += n) {
+    room = VGA_RING_SIZE - (ring->head - ring->tail);
+    if(room == 0) {
+      if(ring_sync() < 0)
+	return done;
+      continue;
+    }
+    n = nbytes - done;
+    if((uint32_t)n > room)
+      n = room;
+    idx = ring->head % VGA_RING_SIZE;
+    first = VGA_RING_SIZE - idx;
+    if(first > (uint32_t)n)
+      first = n;
+    memcpy(&(ring->data[idx]), buf + done, first);
+    memcpy(ring->data, buf + done + first, n - first);
+    __sync_synchronize();
+    ring->head += n;
+  }
+
+  if(fd == 2 || memchr(buf, '\n', nbytes) != NULL ||
+     ring->head - ring_flushed >= VGA_RING_FLUSH)
+    ring_kick();
+  return done;
+}
+
+/* Make sure vgad will draw what has been written; does not wait */
+void console_flush(void) {
+  if(ring != NULL && ring->head != ring_flushed)
+    ring_kick();
+}
+
+/* Wait until vgad has drawn what has been written */
+void console_sync(void) {
+  if(ring != NULL && ring->head != ring->tail)
+    ring_sync();
+}
+
+/* In a new child: the ring is the parent's, so start over */
+void console_forked(void) {
+  if(ring != NULL)
+    shm_unmap(ring);
+  ring = NULL;
+  ring_refused = 0;
+}
+
+/* Before exit or exec: vgad draws what is left and drops the ring */
+void console_close(void) {
+  Ring_req_t req;
+
+  if(ring == NULL)
+    return;
+  req.type = VGA_RING_CLOSE;
+  msgsend(VGAD, &req, sizeof(Ring_req_t));
+  shm_unmap(ring);
+  ring = NULL;
+}
@@ -11,6 +11,7 @@
 #include <sys/stat.h>
 #include <malloc.h>
 #include <sys/fcntl.h>
+#include <console.h>
 
 #include <sbin/nfsd.h>
 
@@ -95,6 +96,7 @@ _DEFUN (execve, (name, argv, env),
     return -1;
 #endif
   /* tell the kernel to replace this code */
+  console_close();
   msgsend(SYS, &req, sizeof(Exec_req_t));
   /* return here only if kernel failed to do exec */
   msgrecv(SYS, &resp, sizeof(Exec_resp_t), &status);
@@ -4,6 +4,8 @@
 #include <msg.h>	/* userland */
 #include <time.h>
 #include <syscall.h>
+#include <console.h>
+#include <sbin/ramfsd.h>	/* ramfsd_forked */
 
 int
 _DEFUN (fork, (),
@@ -17,7 +19,12 @@ _DEFUN (fork, (),
 
 	Msg_status_t status;
 	req.type = SC_FORK;
+	console_sync();		/* our output comes before the child's */
 	msgsend(SYS,&req,sizeof(Fork_req_t));
 	msgrecv(SYS,&resp,sizeof(Fork_resp_t),&status);
+	if(resp.ret == 0) {
+		console_forked();
+		ramfsd_forked();
+	}
 	return resp.ret;
 }
@@ -16,6 +16,7 @@
 #include <_ansi.h>
 #include <_syslist.h>
 #include <math.h>
+#include <sbin/ramfsd.h>	/* ramfsd_fstat, is_fileid */
 
 /*
  * fstat -- Since we have no file system, we just return an error.
@@ -25,6 +26,10 @@ _DEFUN (fstat, (fd, buf),
        int fd _AND
        struct stat *buf)
 {
+#ifdef STANDALONE
+	if(is_fileid(fd))
+		return ramfsd_fstat(fd,buf);
+#endif
 	buf->st_mode = S_IFCHR;	/* Always pretend to be a tty */
 	buf->st_blksize = 0;
 	return 3;
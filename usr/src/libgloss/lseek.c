@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sbin/nfsd.h>
+#include <sbin/ramfsd.h>
 
 /*
  * lseek --  
@@ -16,7 +17,13 @@ _DEFUN (lseek, (file,  offset, whence),
 {
   off_t ret;
 
+#if ( !defined(STANDALONE) )
   ret = nfsd_seek(NFSD,file,(uint64_t)offset,whence);
+#else
+  ret = -1;
+  if(is_fileid(file))
+    ret = (off_t)ramfsd_seek(file,(int64_t)offset,whence);
+#endif
   return ret;
 }
 
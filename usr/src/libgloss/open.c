@@ -13,8 +13,10 @@
  * they apply.
  */
 #include <stdarg.h>
+#include <string.h>		/* strcmp */
 #include <sbin/nfsd.h>		/* nfsd_open */
 #include <sbin/sysd.h>		/* sysd_fileid */
+#include <sbin/ramfsd.h>	/* ramfsd_open */
 /*
  * open -- Use libnfs to open a file descriptor on an NFS server.
  */
@@ -36,6 +38,10 @@ _DEFUN (open, (buf, flags, ...),
   if(strcmp(buf,"stdout")!=0 && strcmp(buf,"stdin")!=0 && strcmp(buf,"stderr")!=0) {
     ret = nfsd_open(NFSD,buf,mode);
   }
+#else
+  if(strcmp(buf,"stdout")!=0 && strcmp(buf,"stdin")!=0 && strcmp(buf,"stderr")!=0) {
+    ret = ramfsd_open(buf,flags);
+  }
 #endif
   return ret;
 }
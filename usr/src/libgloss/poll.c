@@ -1,30 +1,201 @@
 #include <poll.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stddef.h>		/* offsetof */
+#include <unistd.h>		/* usleep */
 #include <msg.h>
+#include <syscall.h>
+#include <limits.h>
 #include <sys/socket.h>
-#include <netdb.h>	
+#include <netdb.h>
+#include <redirect.h>
+#include <console.h>
+#include <sbin/kbd.h>
 #include <sbin/netd.h>
+#include <sbin/nfsd.h>		/* is_fileid */
+#include <sbin/piped.h>
+#include <sbin/pollev.h>
+
+/*
+ * poll() -- the daemons that own the fds do the watching, see
+ * sbin/pollev.h. Each keeps the set of fds we last gave it, so the fds
+ * are sent only when they change. The daemons post an event per ready
+ * fd to the kernel, which answers our wait with them, or when the
+ * timeout runs out. Nothing scans the fds while we sleep, a wake up
+ * costs the daemon only the watches on the fd that became ready, and
+ * we receive only from SYS.
+ */
+
+/* the daemons that can watch fds, and their arm message types */
+typedef struct {
+  int pid;
+  int arm;
+} Poll_daemon_t;
+
+#define POLL_NETD  0
+#define POLL_PIPED 1
+#define POLL_KBD   2
+#define POLL_NDAEMONS 3
+
+static const Poll_daemon_t poll_daemons[POLL_NDAEMONS] = {
+  { NETD,  NET_POLL   },
+  { PIPED, PIPED_POLL },
+  { KBD,   KEYB_POLL  },
+};
+
+/* the set each daemon has for us; a forked child has none yet */
+typedef struct {
+  int owner;			/* getpid() when it was sent */
+  int nfds;
+  int max;
+  Pollev_fd_t *fds;
+} Poll_set_t;
+
+static Poll_set_t poll_sets[POLL_NDAEMONS];
+
+/* which daemon watches fd, -1 if we can answer ourselves */
+static int poll_owner(int fd) {
+  if(fd == 0)
+    return POLL_KBD;
+  if(is_sockid(fd))
+    return POLL_NETD;
+  if(is_pipeid(fd))
+    return POLL_PIPED;
+  return -1;
+}
+
+/* revents of an fd no daemon watches */
+static short poll_local(int fd, short events) {
+  if(fd == 1 || fd == 2)
+    return events & POLLOUT;	/* the console never blocks */
+  if(is_fileid(fd))
+    return events & (POLLIN | POLLOUT);
+  return POLLNVAL;
+}
+
+static void poll_flush(int d, Pollev_req_t *req) {
+  msgsend(poll_daemons[d].pid, req,
+	  offsetof(Pollev_req_t, fds) + req->nfds * sizeof(Pollev_fd_t));
+}
+
+/*
+ * Arm daemon d for the fds it owns: the fds themselves, POLLEV_MAXFDS
+ * at a time, if they are not the set it already has; else a message
+ * with none. Returns the number of messages sent, 0 if d owns no fds.
+ */
+static int poll_arm(int d, unsigned int tag, struct pollfd *fds, int *rfd, int nfds) {
+  Poll_set_t *set;
+  Pollev_req_t req;
+  Pollev_fd_t *nfd;
+  int i, n, same, sent;
+
+  set = &poll_sets[d];
+  same = (set->owner == getpid());
+  for(i = 0, n = 0; i < nfds; i++) {
+    if(poll_owner(rfd[i]) != d)
+      continue;
+    if(n == set->max) {
+      if((nfd = realloc(set->fds, sizeof(Pollev_fd_t) * (n ? 2 * n : 8))) == NULL) {
+	set->owner = 0;		/* half overwritten; send it all next time */
+	return 0;
+      }
+      set->fds = nfd;
+      set->max = n ? 2 * n : 8;
+    }
+    if(n >= set->nfds || set->fds[n].fd != rfd[i] || set->fds[n].events != fds[i].events)
+      same = 0;
+    set->fds[n].fd = rfd[i];
+    set->fds[n].events = fds[i].events;
+    n++;
+  }
+  if(n == 0)
+    return 0;			/* it keeps the old set, unused until asked */
+  if(n != set->nfds)
+    same = 0;
+  set->nfds = n;
+  set->owner = getpid();
+
+  req.type = poll_daemons[d].arm;
+  req.tag = tag;
+  req.nfds = 0;
+  if(same) {
+    req.flags = 0;
+    poll_flush(d, &req);
+    return 1;
+  }
+  for(i = 0, sent = 0; i < n; i += req.nfds, sent++) {
+    req.flags = sent ? POLLEV_ADD : POLLEV_SET;
+    req.nfds = (n - i < POLLEV_MAXFDS) ? n - i : POLLEV_MAXFDS;
+    memcpy(req.fds, &set->fds[i], req.nfds * sizeof(Pollev_fd_t));
+    poll_flush(d, &req);
+  }
+  return sent;
+}
+
+/* record an event; returns 1 if it made a new fd ready */
+static int poll_event(Poll_event_t *ev, struct pollfd *fds, int *rfd, int nfds) {
+  int i, n;
+
+  for(i = 0, n = 0; i < nfds; i++) {
+    if(rfd[i] != ev->fd)
+      continue;
+    if(!fds[i].revents)
+      n++;
+    fds[i].revents |= ev->revents & (fds[i].events | POLLERR | POLLHUP | POLLNVAL);
+  }
+  return n;
+}
 
 int poll(struct pollfd *fds, int nfds, int timeout) {
-	Net_poll_t req;
-	Msg_status_t status;
-	int i;
-
-	/* Zero REVENTS. */
-	for(i = 0; i < nfds; i++) {
-		fds[i].revents = 0;
-	}
-
-	/* Set up the message. */
-	memset(&req, 0, sizeof(Net_poll_t));
-	req.type = NET_POLL;
-	memcpy(req.fds, fds, sizeof(struct pollfd) * nfds);
-	req.numfds = nfds;
-	req.timeout = timeout;
-	msgsend(NETD, &req, sizeof(Net_poll_t));
-
-	/* Use msgrecv to block until the poll ends. */
-	msgrecv(NETD, &req, sizeof(Net_poll_t), &status);
-	memcpy(fds, req.fds, sizeof(struct pollfd) * nfds);
-	return req.rval;
+  Poll_req_t req;
+  Poll_resp_t resp;
+  Msg_status_t status;
+  int *rfd;			/* fds after redirection */
+  int i, d, ready, armed;
+  unsigned int tag;
+
+  if(nfds < 0 || (rfd = malloc(sizeof(int) * (nfds ? nfds : 1))) == NULL)
+    return -1;
+
+  console_flush();
+  tag = get_msg_tag();
+  ready = 0;
+  for(i = 0; i < nfds; i++) {
+    fds[i].revents = 0;
+    rfd[i] = apply_redirect(fds[i].fd);
+    if(poll_owner(rfd[i]) < 0 && (fds[i].revents = poll_local(rfd[i], fds[i].events)))
+      ready++;
+  }
+
+  /* Name this poll() to the kernel before any event for it is posted. */
+  req.type = SC_POLL;
+  req.tag = tag;
+  req.op = POLL_BEGIN;
+  msgsend(SYS, &req, sizeof(Poll_req_t));
+
+  /* Hand the fds to their daemons. */
+  for(d = 0, armed = 0; d < POLL_NDAEMONS; d++)
+    armed += poll_arm(d, tag, fds, rfd, nfds);
+
+  if(!armed) {
+    if(!ready && timeout > 0)
+      usleep(timeout);		/* nothing to wait on but the clock (ms) */
+    free(rfd);
+    return ready;
+  }
+
+  /* Wait for the events, or the timeout; don't wait if we have one. */
+  req.op = POLL_WAIT;
+  req.timeout = ready ? 0 : timeout;
+  req.owed = armed;
+  msgsend(SYS, &req, sizeof(Poll_req_t));
+  do
+    msgrecv(SYS, &resp, sizeof(Poll_resp_t), &status);
+  while(resp.type != SC_POLL || resp.tag != tag);
+
+  for(i = 0; i < resp.ret_val; i++)
+    ready += poll_event(&resp.ev[i], fds, rfd, nfds);
+
+  free(rfd);
+  return ready;
 }
@@ -6,10 +6,12 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <redirect.h>
+#include <console.h>
 #include <sbin/kbd.h>
 #include <sbin/netd.h>
 #include <sbin/nfsd.h>		/* nfsd_read(...) */
 #include <sbin/piped.h>
+#include <sbin/ramfsd.h>	/* ramfsd_read(...) */
 
 /*
  * read  
@@ -26,14 +28,19 @@ _DEFUN (read, (fd, buf, nbytes),
   fd = apply_redirect(fd);
 
   ret=0;
-  if(fd==0)
+  if(fd==0) {
+    console_sync();		/* the prompt before the echo */
     ret = getstr(buf,nbytes);
+  }
 
 #if ( !defined(STANDALONE) )
   else if(is_fileid(fd))
     ret=nfsd_read(NFSD,buf,(uint64_t)nbytes,fd);
   else if(is_sockid(fd))
     ret=-1;			/* error */
+#else
+  else if(is_fileid(fd))
+    ret=ramfsd_read(fd,buf,(uint64_t)nbytes);
 #endif
 
   else if ( is_pipeid(fd) )
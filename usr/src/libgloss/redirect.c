@@ -1,7 +1,18 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <utils/hash.h>
 
+/* 
+ * The redirections are kept in the environment as well, as a list of 
+ * "filedes2=filedes;" pairs, so that they survive execve -- that is how a 
+ * shell hands a pipe to the commands of a pipeline.
+ */
+#define REDIRECT_ENV "BEAR_REDIRECT"
+#define REDIRECT_ENV_LEN 256
+
 static hashtable_t *redirect_table;
+static int redirect_loaded;	/* environment has been checked */
 
 struct redirect_entry {
   int filedes ;
@@ -10,6 +21,8 @@ struct redirect_entry {
 
 typedef struct redirect_entry redirect_t;
 
+static int redirect_add(int filedes, int filedes2);
+
 static int redirect_init(void) {
 
   redirect_table = hopen(150); 
@@ -20,12 +33,35 @@ static int redirect_init(void) {
   return 0;
 }
 
+/* pick up the redirections a parent set up before execve */
+static void redirect_load(void) {
+
+  char *p, *end;
+  int filedes, filedes2;
+
+  redirect_loaded = 1;
+  if ( !(p = getenv(REDIRECT_ENV)) )
+    return;
+
+  while ( *p ) {
+    filedes2 = (int)strtol(p, &end, 10);
+    if ( end == p || *end != '=' )
+      return;
+    p = end + 1;
+    filedes = (int)strtol(p, &end, 10);
+    if ( end == p || *end != ';' )
+      return;
+    p = end + 1;
+    redirect_add(filedes, filedes2);
+  }
+}
+
 static int search_fn(void *elementp, const void *searchkeyp) {
 
   return ( ((redirect_t*)elementp)->filedes2 == *(int*)searchkeyp );
 }
 
-int dup2(int filedes, int filedes2) {
+static int redirect_add(int filedes, int filedes2) {
 
   redirect_t *entry;
 
@@ -34,6 +70,31 @@ int dup2(int filedes, int filedes2) {
       return -1;
   }
 
+  /* a later dup2 of the same descriptor replaces the earlier one */
+  if ( (entry = (redirect_t*)hremove(redirect_table, search_fn, 
+				     (char*)&filedes2, sizeof(int))) )
+    free(entry);
+
+  entry = (redirect_t*)malloc(sizeof(redirect_t));
+  if ( !entry ) 
+    return -1;
+
+  entry->filedes  = filedes ;
+  entry->filedes2 = filedes2; 
+  
+  hput(redirect_table, (void*)entry, (char*)&(entry->filedes2), sizeof(int));
+
+  return filedes2;
+}
+
+int dup2(int filedes, int filedes2) {
+
+  char env[REDIRECT_ENV_LEN];
+  char *old;
+
+  if ( !redirect_loaded )
+    redirect_load();
+
   if ( filedes == filedes2 ) 
     return -1;
 
@@ -44,20 +105,24 @@ int dup2(int filedes, int filedes2) {
      of the deamons could reassign it which we don't want... */
   //close(filedes2);
 
-  entry = (redirect_t*)malloc(sizeof(redirect_t));
-  if ( !entry ) 
+  if ( redirect_add(filedes, filedes2) < 0 )
     return -1;
 
-  entry->filedes  = filedes ;
-  entry->filedes2 = filedes2; 
-  
-  hput(redirect_table, (void*)entry, (char*)&(entry->filedes2), sizeof(int));
+  /* remember it across execve */
+  old = getenv(REDIRECT_ENV);
+  snprintf(env, REDIRECT_ENV_LEN, "%s%d=%d;", old ? old : "", filedes2, filedes);
+  setenv(REDIRECT_ENV, env, 1);
+
+  return filedes2;
 }
 
 int apply_redirect(int filedes) {
 
   redirect_t *entry;
 
+  if ( !redirect_loaded )
+    redirect_load();
+
   if ( !redirect_table ) 
     return filedes;
 
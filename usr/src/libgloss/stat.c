@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sbin/nfsd.h>
+#include <sbin/ramfsd.h>
 
 /*
  * stat -- Since we have no file system, we just return an error.
@@ -15,6 +16,10 @@ _DEFUN (stat, (path, buf),
 	const char *path _AND
 	struct stat *buf)
 {
+#if ( !defined(STANDALONE) )
   struct stat *statp;
   return nfsd_stat(NFSD,path,&statp);
+#else
+  return ramfsd_stat(path,buf);
+#endif
 }
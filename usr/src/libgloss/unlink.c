@@ -3,6 +3,7 @@
  */
 #include "_ansi.h"
 #include <sbin/nfsd.h>
+#include <sbin/ramfsd.h>
 
 /*
  * unlink
@@ -11,7 +12,11 @@ int
 _DEFUN (unlink, (path),
         char * path)
 {
+#if ( !defined(STANDALONE) )
   return nfsd_unlink(NFSD,path);
+#else
+  return ramfsd_unlink(path);
+#endif
   //return -1;
 }
 
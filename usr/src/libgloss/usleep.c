@@ -2,6 +2,7 @@
 #include <msg.h>	/* For msgsend */
 #include <syscall.h>	/* For SYS */
 #include <stdlib.h>	/* For EXIT_SUCCESS and EXIT_FAILURE */
+#include <console.h>
 
 /* Sleeps for the given number of milliseconds. */
 int usleep(useconds_t ms) {
@@ -11,6 +12,7 @@ int usleep(useconds_t ms) {
 
         if (ms <= 0) return EXIT_FAILURE;
 
+        console_flush();
         req.type   = SC_USLEEP;
         req.slp_ms = ms;
         msgsend(SYS, &req, sizeof(Usleep_req_t));
@@ -2,20 +2,24 @@
  * write.c -- write bytes to an output
  */
 #include <stdio.h>		/* printf */
+#include <string.h>		/* memcpy */
 #include <limits.h>		/* INT_MAX */
 #include <sys/socket.h>		/* netd support */
 #include <netdb.h>		/* netd support */
 #include <redirect.h>
+#include <console.h>
 #include <sbin/netd.h>		/* is_sockid */
 #include <sbin/vgad.h>		/* Puts_xxx */
 #include <sbin/nfsd.h>		/* nfsd_write */
 #include <sbin/piped.h>
+#include <sbin/ramfsd.h>	/* ramfsd_write */
 #include <sbin/daemon_msg_types.h>
 
 /*
- * write -- write bytes to the serial port. Ignore fd, since
- *          stdout and stderr are the same. Since we have no filesystem,
- *          open will only return an error.
+ * write -- write bytes to the console, a file, or a pipe. stdout and
+ *          stderr go through the ring shared with vgad when there is one
+ *          (console.c), otherwise as VGA_PUTS messages to whoever our
+ *          stdio is.
  */
 
 static Puts_req_t req;
@@ -23,17 +27,19 @@ static Puts_req_t req;
 static inline int writeln(int pid, char *buf, int bytes) {
   Puts_resp_t resp;
   Msg_status_t status;
-  int i,ret;
+  int done, n;
 
   req.type = VGA_PUTS;
-  if(bytes>CHARBUF_SZ)		/* truncate if writing more than 1K */
-    bytes=CHARBUF_SZ;
-  req.len=bytes;
-  for (i = 0; i < bytes; i++,buf++)
-    req.buf[i]=*buf;
-  msgsend(pid,&req,sizeof(int)+sizeof(uint32_t)+bytes);
-  msgrecv(pid,&resp,sizeof(Puts_resp_t),&status);
-  ret = bytes;
+  for(done = 0; done < bytes; done += n) {
+    n = bytes - done;
+    if(n > CHARBUF_SZ)
+      n = CHARBUF_SZ;
+    req.len = n;
+    memcpy(req.buf, buf + done, n);
+    msgsend(pid,&req,sizeof(int)+sizeof(uint32_t)+n);
+    msgrecv(pid,&resp,sizeof(Puts_resp_t),&status);
+  }
+  return bytes;
 }
 
 int 
@@ -42,16 +48,20 @@ _DEFUN (write, (fd,buf, nbytes),
 	char *buf _AND
 	int nbytes)
 {
-  int i,ret,cnt,pid;
-  char *buffp,*p;
-  Msg_status_t status;
+  int ret,pid;
+
+  /* apply any redirection */
+  fd = apply_redirect(fd);
 
   /* write to stdout or stderr */
   ret=-1;			  /* assume failure  */
   if((fd==1) || (fd==2)) {	  /* stdout or stderr */
     /* CANNOT USE sysd_if here */
-    pid = getstdio(fd);
-    ret=writeln(pid,buf,nbytes);
+    ret = console_write(fd,buf,nbytes);
+    if(ret < nbytes) {
+      pid = getstdio(fd);
+      ret += writeln(pid,buf+ret,nbytes-ret);
+    }
   }
 #if ( !defined(STANDALONE) )
   else if(is_fileid(fd)) {
@@ -59,6 +69,9 @@ _DEFUN (write, (fd,buf, nbytes),
   }
   else if(is_sockid(fd))
     ret=-1;
+#else
+  else if(is_fileid(fd))
+    ret=ramfsd_write(fd,buf,(uint64_t)nbytes);
 #endif	/* STANDALONE */
   else if(is_pipeid(fd))
     ret = pipe_write(buf, (uint64_t)nbytes, fd);
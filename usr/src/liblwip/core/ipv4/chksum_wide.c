@@ -0,0 +1,149 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/******************************************************************************
+ * Filename: chksum_wide.c
+ *
+ * Description:
+ *  The Internet checksum (RFC 1071) a 64-bit word at a time. The sum of 
+ *  16-bit words can be taken over wider words and folded at the end, so the
+ *  main loops add 64 bytes per pass with one add-with-carry chain, and 
+ *  chksum_wide_copy does the same while it copies, so tcp_write touches the
+ *  data once rather than twice (LWIP_CHECKSUM_ON_COPY in lwipopts.h).
+ *
+ *  The loops are inline assembly so that they run at the same speed however
+ *  the caller is compiled. They use only general purpose registers: the 
+ *  kernel does not save SSE state across a context switch, or enable AVX, 
+ *  so the vector units are not available to user processes.
+ *
+ *  Words are summed from the start of the data, wherever it sits; x86 does
+ *  not mind unaligned loads.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <sbin/lwip/chksum_wide.h>
+
+/* Fold a 64-bit sum of 16-bit words down to 16 bits */
+static uint16_t chksum_fold(uint64_t sum) {
+  sum = (sum & 0xffffffffULL) + (sum >> 32);
+  sum = (sum & 0xffffffffULL) + (sum >> 32);
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t)sum;
+}
+
+/* The last 0-7 bytes; len is even-aligned with the start of the data */
+static uint64_t chksum_tail(uint64_t sum, const uint8_t *p, int len) {
+
+  if (len & 4) {
+    sum += *(const uint32_t *)p;
+    p += 4;
+  }
+  if (len & 2) {
+    sum += *(const uint16_t *)p;
+    p += 2;
+  }
+  if (len & 1)
+    sum += *p;
+  return sum;
+}
+
+uint16_t chksum_wide(const void *data, int len) {
+  const uint8_t *p = (const uint8_t *)data;
+  uint64_t sum = 0;
+
+  while (len >= 64) {
+    asm("addq  0(%[p]), %[sum]  \n\t"
+	"adcq  8(%[p]), %[sum]  \n\t"
+	"adcq 16(%[p]), %[sum]  \n\t"
+	"adcq 24(%[p]), %[sum]  \n\t"
+	"adcq 32(%[p]), %[sum]  \n\t"
+	"adcq 40(%[p]), %[sum]  \n\t"
+	"adcq 48(%[p]), %[sum]  \n\t"
+	"adcq 56(%[p]), %[sum]  \n\t"
+	"adcq $0, %[sum]"
+	: [sum] "+r" (sum)
+	: [p] "r" (p), "m" (*(const uint8_t (*)[64])p)
+	: "cc");
+    p += 64;
+    len -= 64;
+  }
+  while (len >= 8) {
+    asm("addq (%[p]), %[sum]  \n\t"
+	"adcq $0, %[sum]"
+	: [sum] "+r" (sum)
+	: [p] "r" (p), "m" (*(const uint64_t *)p)
+	: "cc");
+    p += 8;
+    len -= 8;
+  }
+
+  /* the tail adds at most 0xffffffff + 0xffff + 0xff; fold first */
+  sum = chksum_fold(sum);
+  return chksum_fold(chksum_tail(sum, p, len));
+}
+
+uint16_t chksum_wide_copy(void *dst, const void *src, int len) {
+  const uint8_t *s = (const uint8_t *)src;
+  uint8_t *d = (uint8_t *)dst;
+  uint64_t sum = 0;
+  int i;
+
+  while (len >= 32) {
+    asm("movq  0(%[s]), %%r8    \n\t"
+	"movq  8(%[s]), %%r9    \n\t"
+	"movq 16(%[s]), %%r10   \n\t"
+	"movq 24(%[s]), %%r11   \n\t"
+	"movq %%r8,   0(%[d])   \n\t"
+	"movq %%r9,   8(%[d])   \n\t"
+	"movq %%r10, 16(%[d])   \n\t"
+	"movq %%r11, 24(%[d])   \n\t"
+	"addq %%r8,  %[sum]     \n\t"
+	"adcq %%r9,  %[sum]     \n\t"
+	"adcq %%r10, %[sum]     \n\t"
+	"adcq %%r11, %[sum]     \n\t"
+	"adcq $0, %[sum]"
+	: [sum] "+r" (sum), "=m" (*(uint8_t (*)[32])d)
+	: [s] "r" (s), [d] "r" (d), "m" (*(const uint8_t (*)[32])s)
+	: "r8", "r9", "r10", "r11", "cc");
+    s += 32;
+    d += 32;
+    len -= 32;
+  }
+  while (len >= 8) {
+    *(uint64_t *)d = *(const uint64_t *)s;
+    asm("addq %[w], %[sum]  \n\t"
+	"adcq $0, %[sum]"
+	: [sum] "+r" (sum)
+	: [w] "r" (*(const uint64_t *)s)
+	: "cc");
+    s += 8;
+    d += 8;
+    len -= 8;
+  }
+  for (i = 0; i < len; i++)
+    d[i] = s[i];
+
+  sum = chksum_fold(sum);
+  return chksum_fold(chksum_tail(sum, s, len));
+}
@@ -52,7 +52,7 @@
  * #define LWIP_CHKSUM <your_checksum_routine> 
  *
  * Or you can select from the implementations below by defining
- * LWIP_CHKSUM_ALGORITHM to 1, 2 or 3.
+ * LWIP_CHKSUM_ALGORITHM to 1, 2, 3 or 4 (Bear, see chksum_wide.c).
  */
 
 #ifndef LWIP_CHKSUM
@@ -256,6 +256,14 @@ lwip_standard_chksum(void *dataptr, int len)
 }
 #endif
 
+#if (LWIP_CHKSUM_ALGORITHM == 4) /* Bear: 64-bit words, see chksum_wide.c */
+static u16_t
+lwip_standard_chksum(void *dataptr, int len)
+{
+  return chksum_wide(dataptr, len);
+}
+#endif
+
 /* inet_chksum_pseudo:
  *
  * Calculates the pseudo Internet checksum used by TCP and UDP for a pbuf chain.
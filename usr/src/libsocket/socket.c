@@ -39,6 +39,34 @@
 
 #include <sbin/netd.h>		/* network daemon interface */
 
+/* The replies from netd have a field named errno; reach errno itself
+   through __errno() instead */
+#include <errno.h>
+#undef errno
+
+/*
+ * Bulk buffers, see Net_sbuf_t in netd.h. A socket gets one the first time
+ * it sends or receives more than fits in one message. Close goes through 
+ * libgloss and never tells us, so when the table is full a slot whose 
+ * receive ring is empty is taken over; netd lets a socket register a new
+ * region in place of the old one. A slot with a NULL sbuf remembers that 
+ * netd refused the socket (it is not TCP).
+ */
+#define SOCKET_SBUF_NR 8
+
+typedef struct {
+	int sockfd;		/* 0 if the slot is free */
+	Net_sbuf_t *sbuf;
+} Socket_sbuf_t;
+
+static Socket_sbuf_t sbufs[SOCKET_SBUF_NR];
+static int sbuf_victim;
+
+static Socket_sbuf_t *sbuf_lookup(int sockfd, int create);
+static ssize_t sbuf_send(Socket_sbuf_t *sb, const void *buf, size_t len, 
+			 int flags);
+static ssize_t sbuf_recv(Socket_sbuf_t *sb, void *buf, size_t len, int flags);
+
 int socket(int domain, int type, int protocol) {
 	Net_socket_req_t req;
 	Net_socket_resp_t resp;
@@ -160,10 +188,16 @@ ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
 	Net_send_req_t req;
 	Net_send_resp_t resp;
 	Msg_status_t status;
+	Socket_sbuf_t *sb;
 	int sendlen, num_messages, i, initial_len;
 	size_t remainder;
 	ssize_t bytes_sent;
 
+	/* Big sends go through the bulk buffers */
+	sb = sbuf_lookup(sockfd, len > SOCKET_SNDBUF_MAX);
+	if (sb != NULL && sb->sbuf != NULL)
+		return sbuf_send(sb, buf, len, flags);
+
 	num_messages=1;
 	remainder=0;
 	initial_len=0;
@@ -294,8 +328,17 @@ ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
 	Net_recv_req_t req;
 	Net_recv_resp_t resp;
 	Msg_status_t status;
+	Socket_sbuf_t *sb;
 	int recvlen;
 
+	/* 
+	 * Once a socket has bulk buffers every recv must use them, since 
+	 * data may already be waiting in the ring.
+	 */
+	sb = sbuf_lookup(sockfd, len > SOCKET_SNDBUF_MAX);
+	if (sb != NULL && sb->sbuf != NULL)
+		return sbuf_recv(sb, buf, len, flags);
+
 	req.type = NET_RECV;
 	req.sockfd = sockfd;
 	req.len = len;
@@ -313,6 +356,140 @@ ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
 	return resp.hdr.ret;
 }
 
+/* Find the bulk buffers for sockfd, and maybe set them up */
+static Socket_sbuf_t *sbuf_lookup(int sockfd, int create) {
+	Net_sbuf_setup_req_t req;
+	Net_sbuf_resp_t resp;
+	Msg_status_t status;
+	Socket_sbuf_t *sb;
+	Net_sbuf_t *old;
+	int i, grant, id;
+
+	sb = NULL;
+	for (i = 0; i < SOCKET_SBUF_NR; i++) {
+		if (sbufs[i].sockfd == sockfd)
+			return &sbufs[i];
+		if (sb == NULL && sbufs[i].sockfd == 0)
+			sb = &sbufs[i];
+	}
+	if (!create)
+		return NULL;
+
+	/* Table full: take over a slot with nothing waiting in it */
+	for (i = 0; sb == NULL && i < SOCKET_SBUF_NR; i++) {
+		old = sbufs[sbuf_victim].sbuf;
+		if (old == NULL || old->rcv.head == old->rcv.tail)
+			sb = &sbufs[sbuf_victim];
+		sbuf_victim = (sbuf_victim + 1) % SOCKET_SBUF_NR;
+	}
+	if (sb == NULL)
+		return NULL;
+	if (sb->sbuf != NULL)
+		shm_unmap(sb->sbuf);
+
+	sb->sockfd = sockfd;
+	grant = NETD;
+	sb->sbuf = (Net_sbuf_t *)shm_create(sizeof(Net_sbuf_t), &grant, 1, &id);
+	if (sb->sbuf == NULL)
+		return sb;
+	sb->sbuf->snd.head = sb->sbuf->snd.tail = 0;
+	sb->sbuf->rcv.head = sb->sbuf->rcv.tail = 0;
+
+	req.type = NET_SBUF_SETUP;
+	req.sockfd = sockfd;
+	req.shm_id = id;
+	msgsend(NETD, &req, sizeof(Net_sbuf_setup_req_t));
+	msgrecv(NETD, &resp, sizeof(Net_sbuf_resp_t), &status);
+	if (resp.ret < 0) {
+		shm_unmap(sb->sbuf);
+		sb->sbuf = NULL;
+	}
+	return sb;
+}
+
+/* 
+ * Copy up to a ring's worth into snd and ring once per fill. netd has 
+ * taken everything it is going to by the time it replies, so the ring
+ * starts each round empty.
+ */
+static ssize_t sbuf_send(Socket_sbuf_t *sb, const void *buf, size_t len, 
+			 int flags) {
+	Net_sbuf_req_t req;
+	Net_sbuf_resp_t resp;
+	Msg_status_t status;
+	Net_sring_t *ring;
+	size_t done, n, idx, first;
+
+	ring = &(sb->sbuf->snd);
+	for (done = 0; done < len; done += resp.ret) {
+		n = len - done;
+		if (n > NET_SBUF_SIZE)
+			n = NET_SBUF_SIZE;
+		idx = ring->head % NET_SBUF_SIZE;
+		first = NET_SBUF_SIZE - idx;
+		if (first > n)
+			first = n;
+		memcpy(&(ring->data[idx]), (uint8_t *)buf + done, first);
+		memcpy(ring->data, (uint8_t *)buf + done + first, n - first);
+		ring->head += n;
+
+		req.type = NET_SBUF_SEND;
+		req.sockfd = sb->sockfd;
+		req.len = n;
+		req.flags = flags;
+		msgsend(NETD, &req, sizeof(Net_sbuf_req_t));
+		msgrecv(NETD, &resp, sizeof(Net_sbuf_resp_t), &status);
+
+		/* drop anything netd did not take */
+		ring->head = ring->tail;
+
+		if (resp.ret < 0) {
+			if (done > 0)
+				return done;
+			*__errno() = resp.errno;
+			return -1;
+		}
+		if ((size_t)resp.ret < n)	/* nonblocking, and lwIP is full */
+			return done + resp.ret;
+	}
+
+	return done;
+}
+
+/* Serve recv from rcv, asking netd to fill it when it is empty */
+static ssize_t sbuf_recv(Socket_sbuf_t *sb, void *buf, size_t len, int flags) {
+	Net_sbuf_req_t req;
+	Net_sbuf_resp_t resp;
+	Msg_status_t status;
+	Net_sring_t *ring;
+	size_t n, idx, first;
+
+	ring = &(sb->sbuf->rcv);
+	if (ring->head == ring->tail) {
+		req.type = NET_SBUF_RECV;
+		req.sockfd = sb->sockfd;
+		req.len = len;
+		req.flags = flags;
+		msgsend(NETD, &req, sizeof(Net_sbuf_req_t));
+		msgrecv(NETD, &resp, sizeof(Net_sbuf_resp_t), &status);
+		if (resp.ret <= 0)
+			return resp.ret;
+	}
+
+	n = ring->head - ring->tail;
+	if (n > len)
+		n = len;
+	idx = ring->tail % NET_SBUF_SIZE;
+	first = NET_SBUF_SIZE - idx;
+	if (first > n)
+		first = n;
+	memcpy(buf, &(ring->data[idx]), first);
+	memcpy((uint8_t *)buf + first, ring->data, n - first);
+	if ((flags & MSG_PEEK) == 0)
+		ring->tail += n;
+	return n;
+}
+
 struct hostent *gethostbyname(const char *name) {
 	return NULL;
 }
@@ -168,6 +168,228 @@ void redirect(int inpid,int outpid,int errpid) {
   msgrecv(SYS, &resp, sizeof(redirect_resp_t), &status);
 }
 
+static void *shm_do_create(uint64_t size, int flags, int *grants, int ngrants,
+			   int *id, uint64_t *paddr) {
+  Shm_create_req_t req;
+  Shm_resp_t resp;
+  Msg_status_t status;
+  int i;
+
+  if(ngrants < 0 || ngrants > SHM_MAX_GRANTS)
+    return NULL;
+  req.type = SC_SHM_CREATE;
+  req.size = size;
+  req.flags = flags;
+  req.ngrants = ngrants;
+  for(i=0; i<ngrants; i++)
+    req.grants[i] = grants[i];
+  msgsend(SYS, &req, sizeof(Shm_create_req_t));
+  msgrecv(SYS, &resp, sizeof(Shm_resp_t), &status);
+  if(resp.ret < 0)
+    return NULL;
+  *id = resp.id;
+  if(paddr != NULL)
+    *paddr = resp.paddr;
+  return resp.vaddr;
+}
+
+/* 
+ * Create a shared memory region of at least size bytes, mapped into the 
+ * caller; the pids in grants may map it too. Returns where it is mapped and 
+ * the region id in *id, or NULL on failure.
+ */
+void *shm_create(uint64_t size, int *grants, int ngrants, int *id) {
+  return shm_do_create(size, 0, grants, ngrants, id, NULL);
+}
+
+/* 
+ * As shm_create, but the region is physically contiguous so that a device 
+ * can DMA into it; its physical address goes in *paddr.
+ */
+void *shm_create_dma(uint64_t size, int *grants, int ngrants, int *id, 
+		     uint64_t *paddr) {
+  return shm_do_create(size, SHM_CONTIG, grants, ngrants, id, paddr);
+}
+
+/* Map a region created by another process; its size goes in *size */
+void *shm_map(int id, uint64_t *size) {
+  return shm_map_owner(id, size, NULL);
+}
+
+/* As shm_map, and the pid that created the region goes in *owner */
+void *shm_map_owner(int id, uint64_t *size, int *owner) {
+  Shm_map_req_t req;
+  Shm_resp_t resp;
+  Msg_status_t status;
+
+  req.type = SC_SHM_MAP;
+  req.id = id;
+  msgsend(SYS, &req, sizeof(Shm_map_req_t));
+  msgrecv(SYS, &resp, sizeof(Shm_resp_t), &status);
+  if(resp.ret < 0)
+    return NULL;
+  if(size != NULL)
+    *size = resp.size;
+  if(owner != NULL)
+    *owner = resp.owner;
+  return resp.vaddr;
+}
+
+/* Unmap a region; it is freed when the last process lets go of it */
+int shm_unmap(void *addr) {
+  Shm_unmap_req_t req;
+  Shm_resp_t resp;
+  Msg_status_t status;
+
+  req.type = SC_SHM_UNMAP;
+  req.vaddr = addr;
+  msgsend(SYS, &req, sizeof(Shm_unmap_req_t));
+  msgrecv(SYS, &resp, sizeof(Shm_resp_t), &status);
+  return resp.ret;
+}
+
+/* 
+ * Let pid map region id as well; the caller must be allowed to map it. 
+ * Returns -1 if it is not, or if the region has no room for another grant.
+ */
+int shm_grant(int id, int pid) {
+  Shm_grant_req_t req;
+  Shm_resp_t resp;
+  Msg_status_t status;
+
+  req.type = SC_SHM_GRANT;
+  req.id = id;
+  req.pid = pid;
+  msgsend(SYS, &req, sizeof(Shm_grant_req_t));
+  msgrecv(SYS, &resp, sizeof(Shm_resp_t), &status);
+  return resp.ret;
+}
+
+/* 
+ * A daemon tells pid's poll() ptag that fd is ready for revents, see
+ * sbin/pollev.h. Returns -1 if pid is gone, or if the caller is not netd,
+ * piped or kbd.
+ */
+int poll_post(int pid, unsigned int ptag, int fd, short revents) {
+  Poll_post_req_t req;
+  Poll_post_resp_t resp;
+  Msg_status_t status;
+
+  req.type = SC_POLLPOST;
+  req.pid = pid;
+  req.ptag = ptag;
+  req.ev.fd = fd;
+  req.ev.revents = revents;
+  msgsend(SYS, &req, sizeof(Poll_post_req_t));
+  msgrecv(SYS, &resp, sizeof(Poll_post_resp_t), &status);
+  return resp.ret_val;
+}
+
+/* 
+ * Add a mark to the boot timeline: a phase called name starts now. If last
+ * is set, boot is over instead, and the timeline is closed. Returns -1 once
+ * it is closed.
+ */
+int boot_mark(char *name, int last) {
+  Boottime_req_t req;
+  Boottime_resp_t resp;
+  Msg_status_t status;
+
+  req.type = SC_BOOTTIME;
+  req.op = last ? BOOTTIME_OP_CLOSE : BOOTTIME_OP_MARK;
+  strncpy(req.name, name, MAX_BOOTTIME_NAME - 1);
+  req.name[MAX_BOOTTIME_NAME - 1] = '\0';
+  msgsend(SYS, &req, sizeof(Boottime_req_t));
+  msgrecv(SYS, &resp, sizeof(Boottime_resp_t), &status);
+  return resp.ret;
+}
+
+/* Get the boot timeline */
+int boot_timeline(Boottime_resp_t *resp) {
+  Boottime_req_t req;
+  Msg_status_t status;
+
+  req.type = SC_BOOTTIME;
+  req.op = BOOTTIME_OP_GET;
+  req.name[0] = '\0';
+  msgsend(SYS, &req, sizeof(Boottime_req_t));
+  msgrecv(SYS, resp, sizeof(Boottime_resp_t), &status);
+  return resp->ret;
+}
+
+/* Turn the kernel and hypervisor tracepoints on or off */
+int trace_enable(int on) {
+  Trace_req_t req;
+  Trace_resp_t resp;
+  Msg_status_t status;
+
+  req.type = SC_TRACE;
+  req.op = on ? TRACE_OP_ON : TRACE_OP_OFF;
+  req.src = 0;
+  msgsend(SYS, &req, sizeof(Trace_req_t));
+  msgrecv(SYS, &resp, sizeof(Trace_resp_t), &status);
+  return resp.ret;
+}
+
+/* Take the next trace records from src; returns how many, 0 when done */
+int trace_read(int src, Trace_resp_t *resp) {
+  Trace_req_t req;
+  Msg_status_t status;
+
+  req.type = SC_TRACE;
+  req.op = TRACE_OP_READ;
+  req.src = src;
+  msgsend(SYS, &req, sizeof(Trace_req_t));
+  msgrecv(SYS, resp, sizeof(Trace_resp_t), &status);
+  return resp->ret < 0 ? resp->ret : resp->n;
+}
+
+/* Start the profiler; returns the event it samples on, or -1 */
+int prof_start(int event, uint64_t period) {
+  Prof_req_t req;
+  Prof_resp_t resp;
+  Msg_status_t status;
+
+  req.type = SC_PROF;
+  req.op = PROF_OP_START;
+  req.event = event;
+  req.period = period;
+  req.first = 0;
+  msgsend(SYS, &req, sizeof(Prof_req_t));
+  msgrecv(SYS, &resp, sizeof(Prof_resp_t), &status);
+  return resp.ret;
+}
+
+int prof_stop() {
+  Prof_req_t req;
+  Prof_resp_t resp;
+  Msg_status_t status;
+
+  req.type = SC_PROF;
+  req.op = PROF_OP_STOP;
+  req.event = 0;
+  req.period = 0;
+  req.first = 0;
+  msgsend(SYS, &req, sizeof(Prof_req_t));
+  msgrecv(SYS, &resp, sizeof(Prof_resp_t), &status);
+  return resp.ret;
+}
+
+/* The profile from line first on; returns how many lines came back */
+int prof_read(int first, Prof_resp_t *resp) {
+  Prof_req_t req;
+  Msg_status_t status;
+
+  req.type = SC_PROF;
+  req.op = PROF_OP_READ;
+  req.event = 0;
+  req.period = 0;
+  req.first = first;
+  msgsend(SYS, &req, sizeof(Prof_req_t));
+  msgrecv(SYS, resp, sizeof(Prof_resp_t), &status);
+  return resp->ret < 0 ? resp->ret : resp->n;
+}
+
 
 /*******************************************************************************
  **** SERVER-LEVEL SYSCALLS ****************************************************
@@ -185,6 +407,32 @@ uint16_t* map_vga_mem() {
   return resp.vaddr;
 }
 
+void *map_ramdisk(uint64_t *size, uint64_t *fs_offset) {
+  Ramdisk_req_t req;
+  Ramdisk_resp_t resp;
+  Msg_status_t status;
+  req.type = SC_RAMDISK;
+  req.op = RAMDISK_OP_MAP;
+  msgsend(SYS,&req,sizeof(Ramdisk_req_t));
+  msgrecv(SYS,&resp,sizeof(Ramdisk_resp_t),&status);
+  if(resp.ret<0)
+    return NULL;
+  *size = resp.size;
+  *fs_offset = resp.fs_offset;
+  return resp.virt_addr;
+}
+
+int sync_ramdisk() {
+  Ramdisk_req_t req;
+  Ramdisk_resp_t resp;
+  Msg_status_t status;
+  req.type = SC_RAMDISK;
+  req.op = RAMDISK_OP_SYNC;
+  msgsend(SYS,&req,sizeof(Ramdisk_req_t));
+  msgrecv(SYS,&resp,sizeof(Ramdisk_resp_t),&status);
+  return resp.ret;
+}
+
 void reboot() {
   Reboot_req_t req;
   Reboot_resp_t resp;
@@ -0,0 +1,62 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * boottime.c -- print the boot timeline: when each phase of the boot 
+ * started and how long it took, from the MBR to the first shell prompt
+ *
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <stdint.h>
+#include <syscall.h>
+
+int main(int argc, char *argv[]) {
+  static Boottime_resp_t resp;
+  uint64_t per_us, start;
+  int i;
+
+  if(argc!=1) {
+    printf("Usage: boottime\n");
+    exit(EXIT_FAILURE);
+  }
+  if(boot_timeline(&resp)<0 || resp.entries==0) {
+    printf("No boot timeline\n");
+    exit(EXIT_FAILURE);
+  }
+  per_us = resp.tsc_hz / 1000000;
+  if(per_us==0) {
+    printf("TSC frequency unknown, times are in cycles\n");
+    per_us = 1;
+  }
+  printf("%-24s %12s %12s\n", "PHASE", "START(us)", "TOOK(us)");
+  for(i=0; i<resp.entries; i++) {
+    start = (resp.tsc[i] - resp.tsc[0]) / per_us;
+    if(i+1<resp.entries)
+      printf("%-24s %12lu %12lu\n", resp.name[i], (unsigned long)start,
+	     (unsigned long)((resp.tsc[i+1] - resp.tsc[i]) / per_us));
+    else
+      printf("%-24s %12lu %12s\n", resp.name[i], (unsigned long)start,
+	     resp.closed ? "" : "(booting)");
+  }
+  return(EXIT_SUCCESS);
+}
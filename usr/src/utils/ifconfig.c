@@ -25,19 +25,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <msg.h>
-#include <errno.h>
-
-/* ifconfig */
-typedef struct {
-        int type;
-        char interface[4];
-				int number;
-}Ifconfig_req_t;
-
-typedef struct {
-        int type;
-        int ret;
-}Ifconfig_resp_t;
+#include <sys/socket.h>
+#include <netdb.h>
+#include <sbin/netd.h>		/* Ifconfig_req_t */
+#include <sbin/e1000.h>		/* E1000_STATS */
 
 int main(int argc, char *argv[])
 {
@@ -50,10 +41,17 @@ int main(int argc, char *argv[])
 	char name[3];
 	int i,j;
   if(argc>2) {
-    printf("Usage: ifconfig [interface]\n");
+    printf("Usage: ifconfig [interface | -s]\n");
     exit(EXIT_FAILURE);
   }
 
+	/* -s: the e1000 driver prints its interrupt and poll counters */
+	if(argc==2 && strcmp(argv[1], "-s")==0){
+		req.type = E1000_STATS;
+		msgsend( E1000D, &req, sizeof(int) );
+		exit(EXIT_SUCCESS);
+	}
+
 	if(argc==1){
 	  strncpy( req.interface, "\0", 3 );
 	}
@@ -92,7 +90,7 @@ int main(int argc, char *argv[])
 	}
 	strncpy(req.interface, name, 3);
   req.number = interface;
-	req.type = 5; //NET_IFCONFIG;
+	req.type = NET_IFCONFIG;
   dst = NETD;
   msgsend( dst, &req, sizeof(Ifconfig_req_t) );
   msgrecv( dst, &resp, sizeof(Ifconfig_resp_t), &status );
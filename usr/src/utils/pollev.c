@@ -0,0 +1,174 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/* 
+ * pollev.c -- the daemon half of poll(), see sbin/pollev.h
+ *
+ * Each watched object keeps a queue of Pollev_watch_t. Readiness
+ * changes only look at the watches on the object that changed. The
+ * interest sets are kept here, one per process.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <utils/queue.h>
+#include <sbin/pollev.h>
+
+/* the fds a process polls on */
+typedef struct {
+  int pid;
+  int nfds;
+  int max;
+  Pollev_fd_t *fds;
+} interest_t;
+
+typedef struct {
+  int pid;
+  int fd;
+} watch_key_t;
+
+static queue_t *interests;
+
+static int interest_search(void *ep, const void *keyp) {
+  return ((interest_t*)ep)->pid == *(const int*)keyp;
+}
+
+static int watch_search(void *ep, const void *keyp) {
+  Pollev_watch_t *wp;
+  const watch_key_t *kp;
+
+  wp = (Pollev_watch_t*)ep;
+  kp = (const watch_key_t*)keyp;
+  return (wp->pid == kp->pid && wp->fd == kp->fd);
+}
+
+/* the revents a watch is woken for */
+static short watch_mask(Pollev_watch_t *wp) {
+  return wp->events | POLLERR | POLLHUP | POLLNVAL;
+}
+
+static int ready_search(void *ep, const void *keyp) {
+  return (watch_mask((Pollev_watch_t*)ep) & *(const short*)keyp) != 0;
+}
+
+static void forget(int pid) {
+  interest_t *ip;
+
+  if ( interests && (ip = (interest_t*)qremove(interests, interest_search, &pid)) ) {
+    free(ip->fds);
+    free(ip);
+  }
+}
+
+/*
+ * Bring pid's set up to date with an arm; returns the fds to look at
+ * now, nfds of them. Those are the fds sent, or the whole set when
+ * none were. NULL and 0 if there are none, or no memory for them.
+ */
+Pollev_fd_t *pollev_interest(int pid, Pollev_req_t *req, int *nfdsp) {
+  interest_t *ip;
+  Pollev_fd_t *fds;
+  int nfds, first;
+
+  *nfdsp = 0;
+  nfds = ( req->nfds < POLLEV_MAXFDS ? req->nfds : POLLEV_MAXFDS );
+  if ( !interests && (interests = qopen()) == NULL )
+    return NULL;
+  ip = (interest_t*)qsearch(interests, interest_search, &pid);
+  if ( !(req->flags & (POLLEV_SET|POLLEV_ADD)) ) {
+    if ( ip == NULL )
+      return NULL;
+    *nfdsp = ip->nfds;
+    return ip->fds;
+  }
+
+  if ( ip == NULL ) {
+    if ( (ip = (interest_t*)calloc(1, sizeof(interest_t))) == NULL )
+      return NULL;
+    ip->pid = pid;
+    qput(interests, ip);
+  }
+  first = ( req->flags & POLLEV_SET ) ? 0 : ip->nfds;
+  if ( first + nfds > ip->max ) {
+    if ( (fds = realloc(ip->fds, (first + nfds) * sizeof(Pollev_fd_t))) == NULL ) {
+      forget(pid);
+      return NULL;
+    }
+    ip->fds = fds;
+    ip->max = first + nfds;
+  }
+  memcpy(ip->fds + first, req->fds, nfds * sizeof(Pollev_fd_t));
+  ip->nfds = first + nfds;
+  *nfdsp = nfds;
+  return ip->fds + first;
+}
+
+/* tell pid's poll() that fd is ready; -1 if pid is gone */
+int pollev_post(int pid, unsigned int tag, int fd, short revents) {
+  if ( poll_post(pid, tag, fd, revents) < 0 ) {
+    forget(pid);
+    return -1;
+  }
+  return 0;
+}
+
+/* watch fd for pid's poll(), in place of an older watch; 0, or -1 if
+   out of memory */
+int pollev_watch(queue_t *wq, int pid, unsigned int tag, int fd, short events) {
+  Pollev_watch_t *wp;
+  watch_key_t key;
+
+  key.pid = pid;
+  key.fd = fd;
+  if ( (wp = (Pollev_watch_t*)qremove(wq, watch_search, &key)) == NULL &&
+       (wp = (Pollev_watch_t*)malloc(sizeof(Pollev_watch_t))) == NULL )
+    return -1;
+  wp->pid = pid;
+  wp->tag = tag;
+  wp->fd = fd;
+  wp->events = events;
+  qput(wq, wp);
+  return 0;
+}
+
+/* 
+ * The object behind wq became ready for revents: post an event for every
+ * watch that asked for one of them and drop it. Errors and hangups are
+ * reported whether they were asked for or not, as poll() requires. The
+ * kernel drops the events of poll()s that are over.
+ */
+void pollev_notify(queue_t *wq, short revents) {
+  Pollev_watch_t *wp;
+
+  while ( (wp = (Pollev_watch_t*)qremove(wq, ready_search, &revents)) != NULL ) {
+    pollev_post(wp->pid, wp->tag, wp->fd, revents & watch_mask(wp));
+    free(wp);
+  }
+}
+
+/* drop every watch, e.g. when the object goes away */
+void pollev_clear(queue_t *wq) {
+  void *wp;
+
+  while ( (wp = qget(wq)) != NULL )
+    free(wp);
+}
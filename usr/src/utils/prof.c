@@ -0,0 +1,126 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab;
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * prof.c -- start and stop the sampling profiler, or print the flat
+ * profile it has: a line for each function a process was sampled in,
+ * with the samples taken in the kernel on its behalf as "[kernel]". A
+ * line without a function name is an address with no symbol.
+ *
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+
+static const char *events[] = { "cycles", "instructions", "llc-misses",
+				"timer" };
+
+static void usage() {
+  printf("Usage: prof start [cycles|instructions|llc-misses|timer] [period]\n");
+  printf("       prof stop\n");
+  printf("       prof dump [lines]\n");
+  exit(EXIT_FAILURE);
+}
+
+static int start(int argc, char *argv[]) {
+  uint64_t period;
+  int ev, got;
+
+  ev = PROF_EV_CYCLES;
+  period = 0;
+  if(argc > 2) {
+    for(ev=0; ev<=PROF_EV_TIMER; ev++)
+      if(!strcmp(argv[2], events[ev]))
+	break;
+    if(ev > PROF_EV_TIMER)
+      usage();
+  }
+  if(argc > 3)
+    period = strtoull(argv[3], NULL, 0);
+  if((got = prof_start(ev, period)) < 0) {
+    printf("prof: the profiler is running\n");
+    return EXIT_FAILURE;
+  }
+  if(got != ev)
+    printf("prof: no PMU for %s, sampling on the timer\n", events[ev]);
+  else
+    printf("prof: sampling on %s\n", events[got]);
+  return EXIT_SUCCESS;
+}
+
+static int dump(int max) {
+  static Prof_resp_t resp;
+  Prof_line_t *l;
+  int first, i, n;
+
+  first = 0;
+  while(first < max && (n = prof_read(first, &resp)) > 0) {
+    if(first == 0) {
+      printf("prof: %lu samples on %s every %lu, %lu dropped, %d lines\n",
+	     (unsigned long)resp.samples, events[resp.event],
+	     (unsigned long)resp.period, (unsigned long)resp.dropped,
+	     resp.lines);
+      printf("%7s %8s %5s %-16s %s\n", "%", "samples", "pid", "process",
+	     "function");
+    }
+    for(i=0; i<n && first<max; i++, first++) {
+      l = &resp.line[i];
+      printf("%6.2f%% %8lu %5d %-16s ",
+	     resp.samples ? 100.0 * l->count / resp.samples : 0.0,
+	     (unsigned long)l->count, l->pid, l->proc);
+      if(l->func[0])
+	printf("%s\n", l->func);
+      else
+	printf("0x%lx\n", (unsigned long)l->addr);
+    }
+  }
+  if(first == 0)
+    printf("prof: no samples\n");
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+
+  if(argc < 2)
+    usage();
+  if(!strcmp(argv[1], "start")) {
+    if(argc > 4)
+      usage();
+    return start(argc, argv);
+  }
+  if(!strcmp(argv[1], "stop")) {
+    if(argc != 2)
+      usage();
+    if(prof_stop() < 0)
+      printf("prof: the profiler is not running\n");
+    return EXIT_SUCCESS;
+  }
+  if(!strcmp(argv[1], "dump")) {
+    if(argc > 3)
+      usage();
+    return dump(argc == 3 ? atoi(argv[2]) : 1000000);
+  }
+  usage();
+  return EXIT_FAILURE;
+}
@@ -105,6 +105,7 @@ int main(int argc,char *argv[]) {
   setenv("LOGNAME",LOGSTR,OVERWRITE);
   setenv("PWD",getenv("HOME"),OVERWRITE);
   statdir(getenv("PWD"));
+  boot_mark("shell: prompt",TRUE);	/* the first prompt ends the boot */
 
   while(1) {			/* forever */
     prompt();
@@ -31,6 +31,7 @@
  *     pwd, printenv, kill, exit   -- basic commands
  *     : tests [-l] -- run regression tests, -l = run indefinately
  *     <cmd> [&]    -- execute cmd, & = in background (NOTE: space between cmd and &)
+ *     <cmd> | <cmd> -- run both, first one's stdout into second one's stdin
  *
  * AVAILABLE COMMANDS (in /randisk):
  *     ps [-as]  -- a=all, s=silent (ie only to serial out)
@@ -72,6 +73,7 @@ extern char **environ;
 
 /* private functions */
 static int execute_cmd(char *cmdp);
+static int execute_pipeline(char *argv1[], char *argv2[]);
 static int buildin_cmd(int argc, char *argv[]);
 static void clearline(char line[]);
 static int parse_args(char *line, char *argv[]);
@@ -96,6 +98,7 @@ int main(int argc,char *argv[]) {
   setenv("LOGNAME",LOGSTR,OVERWRITE);
   setenv("PWD",getenv("HOME"),OVERWRITE);
 
+  boot_mark("slash: prompt",TRUE);	/* the first prompt ends the boot */
   while(1) {			/* forever */
     printf("$ ");		/* prompt */
     fflush(stdout);
@@ -124,7 +127,7 @@ int main(int argc,char *argv[]) {
 static int execute_cmd(char *cmdp) {
   char cmd[MAXLINE]; 		/* local copy of cmd */
   char *argv[MAXARGS];		/* argv for cmd */
-  int pid,endpid,status,argc,foreground,res;		
+  int pid,endpid,status,argc,foreground,res,i;		
   
   strcpy(cmd,cmdp);		      /* make a local copy of cmd */
   if((argc=parse_args(cmd,argv))==0) { /* parse the copy */
@@ -137,6 +140,11 @@ static int execute_cmd(char *cmdp) {
     argc--;				  /* remove & */
   }
   argv[argc]=NULL;			  /* argv null terminated */
+  for(i=1; i<argc-1; i++)		  /* pipeline? */
+    if(streq(argv[i],"|")) {
+      argv[i]=NULL;
+      return execute_pipeline(argv,&argv[i+1]);
+    }
   res=EXIT_SUCCESS;		/* assume command succeeds */
   if(!buildin_cmd(argc,argv)) {	/* built into shell? */
     pid=fork();			/* create a new process */
@@ -164,6 +172,41 @@ static int execute_cmd(char *cmdp) {
   return res;			/* return last known result */
 }
 
+/*
+ * Execute cmd1 | cmd2 in the foreground. The shell keeps the write end of
+ * the pipe open until cmd1 exits, then closes it so cmd2 sees end of file.
+ */
+static int execute_pipeline(char *argv1[], char *argv2[]) {
+  int fd[2],pid1,pid2,status;
+
+  if(pipe(fd)!=0) {
+    printf("Unable to create pipe\n");
+    return EXIT_FAILURE;
+  }
+  if((pid1=fork())==0) {	/* writer: stdout into the pipe */
+    dup2(fd[1],1);
+    execve(argv1[0],argv1,environ);
+    printf(" command not found\n");
+    exit(EXIT_FAILURE);
+  }
+  if((pid2=fork())==0) {	/* reader: stdin from the pipe */
+    dup2(fd[0],0);
+    execve(argv2[0],argv2,environ);
+    printf(" command not found\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid1<0 || pid2<0) 
+    printf("Unable to fork command\n");
+  if(pid1>0)
+    waitpid(pid1,&status,WUNTRACED);
+  close(fd[1]);			/* end of file for the reader */
+  status=EXIT_FAILURE;
+  if(pid2>0)
+    waitpid(pid2,&status,WUNTRACED);
+  close(fd[0]);
+  return (pid1>0 && pid2>0) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
+
 static int buildin_cmd(int argc,char *argv[]) {
   int res,pid;		/* true if cmd built in, else false */
 
@@ -260,6 +303,9 @@ static void tests(int times) {
     //test("thash 10000");
     //    test("tshash 10000");
     test("tpiped");
+    test("tpipebw w 4096 4096 | tpipebw r");
+    test("tshm");
+    test("tconsole");
     time2 = readtsc() - time1;
     printf("[Script took %lu cycles]\n", time2);
   } while(times==FOREVER);
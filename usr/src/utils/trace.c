@@ -0,0 +1,130 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab;
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * trace.c -- turn the kernel and hypervisor tracepoints on or off, or dump
+ * the records they left. A dump goes to a file as a Ktrace_dump_t and the
+ * records (sys/ktrace.h), or to the console as the same bytes in hex, a
+ * "ktrace:" line each, to be picked out of the serial log. Either is read
+ * by tools/ktrace/ktrace2json.
+ *
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+
+static void usage() {
+  printf("Usage: trace on|off|dump [file]\n");
+  exit(EXIT_FAILURE);
+}
+
+static void print_hex(void *p, int len) {
+  unsigned char *b = p;
+  int i;
+
+  printf("ktrace: ");
+  for(i=0; i<len; i++)
+    printf("%02x", b[i]);
+  printf("\n");
+}
+
+/* Every record there is, kernel then hypervisor */
+static Ktrace_rec_t *collect(Ktrace_dump_t *hdr) {
+  static Trace_resp_t resp;
+  Ktrace_rec_t *recs, *more;
+  int src, n, max;
+
+  memset(hdr, 0, sizeof(Ktrace_dump_t));
+  hdr->magic = KTRACE_DUMP_MAGIC;
+  hdr->recsz = sizeof(Ktrace_rec_t);
+  max = 1024;
+  if((recs = malloc(max * sizeof(Ktrace_rec_t))) == NULL)
+    return NULL;
+  for(src=KTRACE_SRC_KERNEL; src<=KTRACE_SRC_HYPV; src++)
+    while((n = trace_read(src, &resp)) >= 0) {
+      hdr->tsc_hz = resp.tsc_hz;
+      hdr->lost += resp.lost;
+      if(n == 0)
+	break;
+      if(hdr->nrecs + n > max) {
+	max *= 2;
+	if((more = realloc(recs, max * sizeof(Ktrace_rec_t))) == NULL)
+	  break;
+	recs = more;
+      }
+      memcpy(&recs[hdr->nrecs], resp.recs, n * sizeof(Ktrace_rec_t));
+      hdr->nrecs += n;
+    }
+  return recs;
+}
+
+int main(int argc, char *argv[]) {
+  Ktrace_dump_t hdr;
+  Ktrace_rec_t *recs;
+  FILE *f;
+  uint64_t i;
+  int was_on;
+
+  if(argc<2 || argc>3)
+    usage();
+  if(!strcmp(argv[1], "on") || !strcmp(argv[1], "off")) {
+    if(argc!=2)
+      usage();
+    if(trace_enable(!strcmp(argv[1], "on"))<0) {
+      printf("trace: the system was built without KTRACE\n");
+      exit(EXIT_FAILURE);
+    }
+    return(EXIT_SUCCESS);
+  }
+  if(strcmp(argv[1], "dump"))
+    usage();
+
+  /* the rings fill as fast as they are read while tracing is on */
+  was_on = trace_enable(0);
+  recs = collect(&hdr);
+  if(was_on > 0)
+    trace_enable(1);
+  if(recs == NULL) {
+    printf("trace: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  if(argc==3) {
+    if((f = fopen(argv[2], "w")) == NULL) {
+      printf("trace: cannot open %s\n", argv[2]);
+      exit(EXIT_FAILURE);
+    }
+    fwrite(&hdr, sizeof(Ktrace_dump_t), 1, f);
+    fwrite(recs, sizeof(Ktrace_rec_t), hdr.nrecs, f);
+    fclose(f);
+  }
+  else {
+    print_hex(&hdr, sizeof(Ktrace_dump_t));
+    for(i=0; i<hdr.nrecs; i++)
+      print_hex(&recs[i], sizeof(Ktrace_rec_t));
+  }
+  printf("trace: %lu records, %lu lost\n", (unsigned long)hdr.nrecs,
+	 (unsigned long)hdr.lost);
+  free(recs);
+  return(EXIT_SUCCESS);
+}
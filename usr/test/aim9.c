@@ -24,6 +24,9 @@ static unsigned iteration_count = 10000000;
 
 #define MAX_AIM9_ITERATIONS 100
 
+/* Message ping-pong round trips */
+#define MSG_ROUND_TRIPS 10000
+
 /* FUNCTIONS
  *
  */
@@ -41,6 +44,7 @@ void main(int argc, char *argv[]) {
 
   void fork_test()
   void exec_test()
+  void msg_test()
 */
 
 static inline uint64_t readtsc() {
@@ -201,6 +205,46 @@ static void exec_test()
   printf( "Time  : %d sec.\n\n", time_diff_sec );
 }
 
+/* 
+ * Message ping-pong between two processes. Every message is a switch to the
+ * other address space, so this is the test that shows what the TLB keeps
+ * across a context switch.
+ */
+static void msg_test()
+{
+  int i, parent, child, status;
+  uint64_t ping, cnt_before, cnt_after;
+  Msg_status_t mstatus;
+
+  printf( "Benchmarking MSG\n" );
+  parent = getpid();
+  child = fork();
+  if( child == 0 )
+    {
+      for( i=0; i<MSG_ROUND_TRIPS; i++ )
+	{
+	  msgrecv( parent, &ping, sizeof(ping), &mstatus );
+	  msgsend( parent, &ping, sizeof(ping) );
+	}
+      exit(0);
+    }
+
+  cnt_before = readtsc();
+  for( i=0; i<MSG_ROUND_TRIPS; i++ )
+    {
+      ping = i;
+      msgsend( child, &ping, sizeof(ping) );
+      msgrecv( child, &ping, sizeof(ping), &mstatus );
+    }
+  cnt_after = readtsc();
+  waitpid( child, &status, 0 );
+
+  printf( " ==> MSG <== \n" );
+  printf( "Round trips: %d\n", MSG_ROUND_TRIPS );
+  printf( "MSG Cycles: %lu (%lu per round trip)\n", (cnt_after - cnt_before),
+	  (cnt_after - cnt_before) / MSG_ROUND_TRIPS );
+}
+
 static void add_long()
 {
   int n;                            /* internal loop variable */
@@ -742,6 +786,11 @@ int aim9_tests(void)
   printf( "Time: %d sec \n", (int)(after_div.tv_sec - before_div.tv_sec) );
   printf( "DIV Cycles: %lu\n", (cnt_after_div - cnt_before_div) );
 
+  /*
+   * Benchmark message passing
+   */
+  msg_test();
+
   cnt_after_global = readtsc();
   clock_gettime( CLOCK_MONOTONIC, &after_global );
 
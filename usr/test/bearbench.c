@@ -0,0 +1,473 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * bearbench.c -- microbenchmarks of the kernel's paths:
+ *
+ *     bearbench [-r reps] [-s scale] [-p pairs] [test ...]
+ *
+ * The tests are null, msg, ctxsw, fork, exec, sbrk, pipe, timer and
+ * kmalloc; all of them if none is named. Each measurement is run reps
+ * times (default 5) and the median is reported, one line each:
+ *
+ *     bearbench: <name> <value> <unit>
+ *
+ * between a "bearbench: begin" and a "bearbench: end" line, for
+ * scripts/runbench to pick out of the serial log. Values in ns and us
+ * are better lower, those in KB/s better higher. -s multiplies the
+ * iterations; -p is the most ping-pong pairs run at once (default 4).
+ *
+ * The scheduler has one ready queue, so a pair lands on whichever cores
+ * are free: msg runs 1, 2, 4 .. pairs of them together rather than
+ * pinning them. ctxsw passes a token round a ring of more processes than
+ * there are cores. kmalloc sends messages to itself: the kernel copies
+ * each into a buffer it kmallocs, and frees it on the receive.
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <string.h>
+#include <unistd.h>		/* fork/execve/sbrk/usleep */
+#include <sys/wait.h>		/* waitpid */
+#include <stdint.h>
+#include <syscall.h>		/* get_core/boot_timeline */
+#include <msg.h>		/* msgsend/msgrecv */
+#include <sbin/piped.h>		/* pipe */
+
+#define BENCH_REPS  5
+#define BENCH_MAXREPS 31
+#define BENCH_PAIRS 4
+#define BENCH_MAXPAIRS 64
+#define BENCH_RING  16		/* processes passing the ctxsw token */
+#define BENCH_MAXMSG 16384
+#define PAGE 4096
+
+/* Messages between the benchmark's processes */
+#define BENCH_GO     1
+#define BENCH_QUIT   2
+#define BENCH_DATA   3
+#define BENCH_RESULT 4
+
+typedef struct {
+  int type;
+  int ok;
+  uint64_t cycles;
+} Bench_msg_t;
+
+/* Cycles that n operations took, 0 if they failed */
+typedef uint64_t (*Bench_fn_t)(int n, int a, int b);
+
+extern char **environ;
+
+static uint64_t tsc_hz;
+static int reps = BENCH_REPS;
+static int scale = 1;
+static int maxpairs = BENCH_PAIRS;
+static char *self;
+static int failures;
+
+static uint8_t buf[BENCH_MAXMSG];
+
+static inline uint64_t readtsc() {
+  uint32_t lo, hi;
+  asm volatile("rdtscp" : "=a"(lo), "=d"(hi) :: "rcx" );
+  return (uint64_t)(lo) | ((uint64_t)(hi) << 32);
+}
+
+static void usage(void) {
+  printf("Usage: bearbench [-r reps] [-s scale] [-p pairs] [test ...]\n");
+  printf("       tests: null msg ctxsw fork exec sbrk pipe timer kmalloc\n");
+  exit(EXIT_FAILURE);
+}
+
+static uint64_t median(uint64_t *v, int n) {
+  uint64_t t;
+  int i, j;
+
+  for(i=1; i<n; i++) {
+    t = v[i];
+    for(j=i; j>0 && v[j-1]>t; j--)
+      v[j] = v[j-1];
+    v[j] = t;
+  }
+  return v[n/2];
+}
+
+/*
+ * Run fn reps times over n operations and report the median: the time
+ * of one operation in ns, or with rate set, n bytes moved in KB/s.
+ */
+static void run(const char *name, Bench_fn_t fn, int n, int a, int b, 
+		int rate) {
+  uint64_t v[BENCH_MAXREPS], cycles;
+  int i;
+
+  fflush(stdout);
+  for(i=0; i<reps; i++) {
+    if((cycles = fn(n, a, b)) == 0) {
+      printf("bearbench: %s failed\n", name);
+      failures++;
+      return;
+    }
+    if(rate)
+      v[i] = (uint64_t)n * tsc_hz / 1024 / cycles;
+    else
+      v[i] = cycles * 1000 / (tsc_hz / 1000000) / n;	/* no overflow */
+  }
+  printf("bearbench: %-24s %10llu %s\n", name, 
+	 (unsigned long long)median(v, reps), rate ? "KB/s" : "ns");
+}
+
+/* The cheapest round trip to the kernel */
+static uint64_t null_syscall(int n, int a, int b) {
+  uint64_t t;
+  int i;
+
+  t = readtsc();
+  for(i=0; i<n; i++)
+    get_core();
+  return readtsc() - t;
+}
+
+static void echo_server(void) {
+  Msg_status_t status;
+
+  while(1) {
+    msgrecv(ANY, buf, BENCH_MAXMSG, &status);
+    if(((Bench_msg_t *)buf)->type == BENCH_QUIT)
+      _exit(EXIT_SUCCESS);
+    msgsend(status.src, buf, status.bytes_rcvd);
+  }
+}
+
+static void ping_client(int server, int parent, int n, int size) {
+  Bench_msg_t *m, res;
+  Msg_status_t status;
+  uint64_t t;
+  int i;
+
+  msgrecv(parent, &res, sizeof(Bench_msg_t), &status); /* go */
+  m = (Bench_msg_t *)buf;
+  t = readtsc();
+  for(i=0; i<n; i++) {
+    m->type = BENCH_DATA;
+    msgsend(server, buf, size);
+    msgrecv(server, buf, size, &status);
+  }
+  res.type = BENCH_RESULT;
+  res.cycles = readtsc() - t;
+  res.ok = 1;
+  msgsend(parent, &res, sizeof(Bench_msg_t));
+  _exit(EXIT_SUCCESS);
+}
+
+/* pairs clients each make n round trips of size bytes to a server of
+ * their own, all at once; the mean of their times */
+static uint64_t msg_pingpong(int n, int pairs, int size) {
+  int srv[BENCH_MAXPAIRS], cli[BENCH_MAXPAIRS];
+  Bench_msg_t m;
+  Msg_status_t status;
+  uint64_t total;
+  int i, parent, ok;
+
+  parent = getpid();
+  for(i=0; i<pairs; i++) {
+    if((srv[i] = fork()) == 0)
+      echo_server();
+    if((cli[i] = fork()) == 0)
+      ping_client(srv[i], parent, n, size);
+  }
+  m.type = BENCH_GO;
+  for(i=0; i<pairs; i++)
+    msgsend(cli[i], &m, sizeof(Bench_msg_t));
+  total = 0;
+  ok = 1;
+  for(i=0; i<pairs; i++) {
+    msgrecv(cli[i], &m, sizeof(Bench_msg_t), &status);
+    if(m.type != BENCH_RESULT || !m.ok)
+      ok = 0;
+    total += m.cycles;
+  }
+  m.type = BENCH_QUIT;
+  for(i=0; i<pairs; i++) {
+    msgsend(srv[i], &m, sizeof(Bench_msg_t));
+    waitpid(srv[i], NULL, 0);
+    waitpid(cli[i], NULL, 0);
+  }
+  return ok ? total / pairs : 0;
+}
+
+/* n laps of a token round the parent and procs children; per hop */
+static uint64_t ctxsw_ring(int n, int procs, int unused) {
+  int pids[BENCH_RING];
+  Bench_msg_t m;
+  Msg_status_t status;
+  uint64_t t;
+  int i, next;
+
+  next = getpid();
+  for(i=procs-1; i>=0; i--) {
+    if((pids[i] = fork()) == 0) {
+      do {
+	msgrecv(ANY, &m, sizeof(Bench_msg_t), &status);
+	msgsend(next, &m, sizeof(Bench_msg_t));
+      } while(m.type != BENCH_QUIT);
+      _exit(EXIT_SUCCESS);
+    }
+    next = pids[i];
+  }
+  m.type = BENCH_DATA;
+  t = readtsc();
+  for(i=0; i<n; i++) {
+    msgsend(next, &m, sizeof(Bench_msg_t));
+    msgrecv(ANY, &m, sizeof(Bench_msg_t), &status);
+  }
+  t = readtsc() - t;
+  m.type = BENCH_QUIT;
+  msgsend(next, &m, sizeof(Bench_msg_t));
+  msgrecv(ANY, &m, sizeof(Bench_msg_t), &status);
+  for(i=0; i<procs; i++)
+    waitpid(pids[i], NULL, 0);
+  return t / (procs + 1);
+}
+
+static uint64_t fork_exit(int n, int a, int b) {
+  uint64_t t;
+  int i, pid;
+
+  t = readtsc();
+  for(i=0; i<n; i++) {
+    if((pid = fork()) == 0)
+      _exit(EXIT_SUCCESS);
+    if(pid < 0 || waitpid(pid, NULL, 0) != pid)
+      return 0;
+  }
+  return readtsc() - t;
+}
+
+/* Each child execs this program, which exits at once */
+static uint64_t fork_exec(int n, int a, int b) {
+  char *argv[3];
+  uint64_t t;
+  int i, pid, status;
+
+  argv[0] = self;
+  argv[1] = "-x";
+  argv[2] = NULL;
+  t = readtsc();
+  for(i=0; i<n; i++) {
+    if((pid = fork()) == 0) {
+      execve(self, argv, environ);
+      _exit(EXIT_FAILURE);
+    }
+    if(pid < 0 || waitpid(pid, &status, 0) != pid ||
+       WEXITSTATUS(status) != EXIT_SUCCESS)
+      return 0;
+  }
+  return readtsc() - t;
+}
+
+/* Growing the heap by n pages */
+static uint64_t sbrk_pages(int n, int a, int b) {
+  uint64_t t;
+
+  t = readtsc();
+  sbrk(n * PAGE);
+  return readtsc() - t;
+}
+
+/* The first touch of n pages the heap has just grown by */
+static uint64_t touch_pages(int n, int a, int b) {
+  volatile char *p;
+  uint64_t t;
+  int i;
+
+  p = sbrk(n * PAGE);
+  t = readtsc();
+  for(i=0; i<n; i++)
+    p[i * PAGE] = 1;
+  return readtsc() - t;
+}
+
+/* 
+ * n bytes from a child to its parent through piped, bsize at a time. The
+ * clock starts when the first read returns, so the fork is not counted;
+ * the time for the rest is scaled up to n.
+ */
+static uint64_t pipe_bw(int n, int bsize, int b) {
+  int fd[2], pid, status, ret, len, first;
+  uint64_t t;
+
+  if(pipe(fd))
+    return 0;
+  if((pid = fork()) == 0) {
+    memset(buf, 'b', bsize);
+    for(len=0; len<n; len+=ret)
+      if((ret = write(fd[1], buf, bsize)) != bsize)
+	_exit(EXIT_FAILURE);
+    close(fd[1]);
+    _exit(EXIT_SUCCESS);
+  }
+  t = 0;
+  if((first = len = read(fd[0], buf, bsize)) > 0) {
+    t = readtsc();
+    while((ret = read(fd[0], buf, bsize)) > 0)
+      len += ret;
+    t = readtsc() - t;
+  }
+  else
+    ret = first;
+  waitpid(pid, &status, 0);
+  close(fd[0]);
+  close(fd[1]);
+  if(ret < 0 || len != n || len == first || WEXITSTATUS(status) != EXIT_SUCCESS)
+    return 0;
+  return t * n / (n - first);
+}
+
+static uint64_t sleep_ms(int n, int ms, int b) {
+  uint64_t t;
+  int i;
+
+  t = readtsc();
+  for(i=0; i<n; i++)
+    usleep(ms);
+  return readtsc() - t;
+}
+
+/* How far past ms a usleep(ms) wakes */
+static void timer(const char *name, int n, int ms) {
+  uint64_t v[BENCH_MAXREPS], us;
+  int i;
+
+  for(i=0; i<reps; i++) {
+    us = sleep_ms(n, ms, 0) / (tsc_hz / 1000000) / n;
+    v[i] = (us > ms * 1000) ? us - ms * 1000 : ms * 1000 - us;
+  }
+  printf("bearbench: %-24s %10llu us\n", name, 
+	 (unsigned long long)median(v, reps));
+}
+
+/* A message to itself: a kmalloc and a kfree of size bytes in the kernel */
+static uint64_t kmalloc_churn(int n, int size, int b) {
+  Msg_status_t status;
+  uint64_t t;
+  int i, me;
+
+  me = getpid();
+  ((Bench_msg_t *)buf)->type = BENCH_DATA;
+  t = readtsc();
+  for(i=0; i<n; i++) {
+    msgsend(me, buf, size);
+    msgrecv(me, buf, size, &status);
+  }
+  return readtsc() - t;
+}
+
+/* The TSC rate from the boot timeline, or by the clock if it has none */
+static uint64_t get_tsc_hz(void) {
+  static Boottime_resp_t resp;
+  uint64_t t;
+
+  if(boot_timeline(&resp) >= 0 && resp.tsc_hz)
+    return resp.tsc_hz;
+  t = readtsc();
+  usleep(100);
+  return (readtsc() - t) * 10;
+}
+
+static int wanted(int argc, char *argv[], int first, const char *test) {
+  int i;
+
+  if(first == argc)
+    return 1;
+  for(i=first; i<argc; i++)
+    if(!strcmp(argv[i], test))
+      return 1;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  static const int sizes[] = { 8, 256, 4096, BENCH_MAXMSG };
+  static const int blocks[] = { 1024, 4096, 16384 };
+  static const int churn[] = { 64, 1024, BENCH_MAXMSG };
+  char name[64];
+  int i, pairs, first;
+
+  if(argc==2 && !strcmp(argv[1], "-x"))	/* fork_exec's child */
+    return(EXIT_SUCCESS);
+  self = argv[0];
+  for(first=1; first<argc && argv[first][0]=='-'; first+=2) {
+    if(first+1 == argc)
+      usage();
+    if(!strcmp(argv[first], "-r"))
+      reps = atoi(argv[first+1]);
+    else if(!strcmp(argv[first], "-s"))
+      scale = atoi(argv[first+1]);
+    else if(!strcmp(argv[first], "-p"))
+      maxpairs = atoi(argv[first+1]);
+    else
+      usage();
+  }
+  if(reps<1 || reps>BENCH_MAXREPS || scale<1 || maxpairs<1 ||
+     maxpairs>BENCH_MAXPAIRS)
+    usage();
+
+  tsc_hz = get_tsc_hz();
+  printf("bearbench: begin reps=%d scale=%d tsc_hz=%llu\n", reps, scale,
+	 (unsigned long long)tsc_hz);
+
+  if(wanted(argc, argv, first, "null"))
+    run("null_syscall", null_syscall, 2000 * scale, 0, 0, 0);
+  if(wanted(argc, argv, first, "msg"))
+    for(pairs=1; pairs<=maxpairs; pairs*=2)
+      for(i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+	sprintf(name, "msg_rtt_%db_%dp", sizes[i], pairs);
+	run(name, msg_pingpong, 1000 * scale, pairs, sizes[i], 0);
+      }
+  if(wanted(argc, argv, first, "ctxsw"))
+    run("ctxsw_ring", ctxsw_ring, 200 * scale, BENCH_RING, 0, 0);
+  if(wanted(argc, argv, first, "fork"))
+    run("fork_exit_wait", fork_exit, 50 * scale, 0, 0, 0);
+  if(wanted(argc, argv, first, "exec"))
+    run("fork_exec_wait", fork_exec, 20 * scale, 0, 0, 0);
+  if(wanted(argc, argv, first, "sbrk")) {
+    run("sbrk_page", sbrk_pages, 256 * scale, 0, 0, 0);
+    run("touch_page", touch_pages, 256 * scale, 0, 0, 0);
+  }
+  if(wanted(argc, argv, first, "pipe"))
+    for(i=0; i<sizeof(blocks)/sizeof(blocks[0]); i++) {
+      sprintf(name, "pipe_bw_%db", blocks[i]);
+      run(name, pipe_bw, 1024 * 1024 * scale, blocks[i], 0, 1);
+    }
+  if(wanted(argc, argv, first, "timer")) {
+    timer("usleep_1ms_err", 20 * scale, 1);
+    timer("usleep_10ms_err", 10 * scale, 10);
+  }
+  if(wanted(argc, argv, first, "kmalloc"))
+    for(i=0; i<sizeof(churn)/sizeof(churn[0]); i++) {
+      sprintf(name, "kmalloc_churn_%db", churn[i]);
+      run(name, kmalloc_churn, 2000 * scale, churn[i], 0, 0);
+    }
+
+  printf("bearbench: end failures=%d\n", failures);
+  return(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
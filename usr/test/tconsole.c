@@ -0,0 +1,102 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * tconsole.c -- console output rate:
+ *
+ *     tconsole [lines] [length]
+ *
+ * Prints lines of length characters twice: once as a VGA_PUTS round trip to
+ * vgad per line, the way write() used to, and once through printf, which
+ * goes by the console ring. Reports lines per second for each.
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <string.h>
+#include <time.h>		/* struct timespec */
+#include <stdint.h>
+#include <msg.h>
+#include <syscall.h>		/* clock_gettime */
+#include <console.h>		/* console_sync */
+#include <sbin/syspid.h>
+#include <sbin/vgad.h>
+
+/* fixes discrepancy between kernel and user */
+#define CLOCK_MONOTONIC 1
+
+static Puts_req_t req;
+
+static uint64_t usec_since(struct timespec *start) {
+  struct timespec end;
+  uint64_t usec;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  usec = (uint64_t)(end.tv_sec - start->tv_sec)*1000000 +
+    (end.tv_nsec - start->tv_nsec)/1000;
+  return usec ? usec : 1;
+}
+
+int main(int argc, char *argv[]) {
+  Puts_resp_t resp;
+  Msg_status_t status;
+  struct timespec start;
+  uint64_t msg_usec, ring_usec;
+  int lines, len, i;
+  char line[CHARBUF_SZ];
+
+  lines = (argc > 1) ? atoi(argv[1]) : 2000;
+  len = (argc > 2) ? atoi(argv[2]) : 60;
+  if(argc > 3 || lines <= 0 || len <= 0 || len >= CHARBUF_SZ) {
+    fprintf(stderr,"Usage: tconsole [lines] [length]\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(line,'c',len-1);
+  line[len-1] = '\n';
+  line[len] = '\0';
+
+  /* a message and a reply per line */
+  fflush(stdout);
+  console_sync();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < lines; i++) {
+    req.type = VGA_PUTS;
+    req.len = len;
+    memcpy(req.buf, line, len);
+    msgsend(VGAD, &req, sizeof(int)+sizeof(uint32_t)+len);
+    msgrecv(VGAD, &resp, sizeof(Puts_resp_t), &status);
+  }
+  msg_usec = usec_since(&start);
+
+  /* stdio and the console ring, until vgad has drawn the last line */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < lines; i++)
+    printf("%s", line);
+  fflush(stdout);
+  console_sync();
+  ring_usec = usec_since(&start);
+
+  printf("tconsole: %d lines of %d: messages %llu lines/s, ring %llu lines/s\n",
+	 lines, len,
+	 (unsigned long long)lines*1000000/msg_usec,
+	 (unsigned long long)lines*1000000/ring_usec);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,89 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/*
+ * texec.c -- exec benchmark: fork and exec a program n times, waiting for 
+ * each to finish, and report execs per second. Run "ps" afterwards to see
+ * the kernel's file lookup cache hit rate on the serial line.
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <unistd.h>		/* fork/execve */
+#include <sys/wait.h>		/* waitpid */
+#include <time.h>		/* struct timespec */
+#include <syscall.h>		/* clock_gettime */
+#include <stdint.h>
+
+/* fixes discrepancy between kernel and user */
+#define CLOCK_MONOTONIC 1	
+
+extern char **environ;
+
+static inline uint64_t readtsc() {
+  uint32_t lo, hi;
+  asm volatile("rdtscp" : "=a"(lo), "=d"(hi) :: "rcx" );
+  return (uint64_t)(lo) | ((uint64_t)(hi) << 32);
+}
+
+int main(int argc, char *argv[]) {
+  struct timespec start, end;
+  char *cargv[2];
+  int i, n, pid, status;
+  uint64_t usec, tsc;
+
+  if(argc<2 || argc>3 || (n=atoi(argv[1]))<=0) {
+    printf("Usage: texec <itterations> [program]\n");
+    exit(EXIT_FAILURE);
+  }
+  cargv[0] = (argc==3) ? argv[2] : "dot";
+  cargv[1] = NULL;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  tsc = readtsc();
+  for(i=0; i<n; i++) {
+    pid=fork();
+    switch(pid) {
+    case -1:
+      printf("[Unable to fork]\n");
+      exit(EXIT_FAILURE);
+    case 0:			/* child */
+      execve(cargv[0],cargv,environ);
+      printf("[Unable to execute: %s]\n",cargv[0]);
+      exit(EXIT_FAILURE);
+    default:			/* parent */
+      if(waitpid(pid,&status,0)!=pid) {
+	printf("[waitpid failed on pass %d]\n",i);
+	exit(EXIT_FAILURE);
+      }
+    }
+  }
+  tsc = readtsc() - tsc;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  usec = (uint64_t)(end.tv_sec - start.tv_sec)*1000000 + 
+    (end.tv_nsec - start.tv_nsec)/1000;
+  printf("\ntexec: %d execs of %s in %llu usec, %llu usec/exec, %llu cycles/exec\n",
+	 n, cargv[0], (unsigned long long)usec, (unsigned long long)(usec/n),
+	 (unsigned long long)(tsc/n));
+  return(EXIT_SUCCESS);
+}
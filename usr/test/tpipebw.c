@@ -0,0 +1,101 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab;
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * tpipebw.c -- shell pipeline throughput:
+ *
+ *     tpipebw w <KB> [blocksize] | tpipebw r [blocksize]
+ *
+ * The writer sends KB kilobytes down its stdout, the reader drains its
+ * stdin to end of file and reports the rate.
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <string.h>
+#include <unistd.h>		/* read/write */
+#include <time.h>		/* struct timespec */
+#include <syscall.h>		/* clock_gettime */
+#include <stdint.h>
+
+/* fixes discrepancy between kernel and user */
+#define CLOCK_MONOTONIC 1
+
+#define MAXBLK 65536
+
+static char buf[MAXBLK];
+
+static void usage(void) {
+  fprintf(stderr,"Usage: tpipebw w <KB> [blocksize] | tpipebw r [blocksize]\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  struct timespec start, end;
+  uint64_t len, total, usec;
+  int bsize, ret;
+
+  if(argc<2)
+    usage();
+
+  if(strcmp(argv[1],"w")==0) {	/* writer */
+    if(argc<3 || argc>4)
+      usage();
+    total = (uint64_t)atoi(argv[2]) * 1024;
+    bsize = (argc==4) ? atoi(argv[3]) : 4096;
+    if(bsize<=0 || bsize>MAXBLK)
+      usage();
+    memset(buf,'p',bsize);
+    for(len=0; len<total; len+=ret)
+      if((ret=write(1,buf,(total-len < bsize) ? total-len : bsize)) <= 0) {
+	fprintf(stderr,"[tpipebw: write failed]\n");
+	exit(EXIT_FAILURE);
+      }
+    exit(EXIT_SUCCESS);
+  }
+
+  if(strcmp(argv[1],"r")==0) {	/* reader */
+    if(argc>3)
+      usage();
+    bsize = (argc==3) ? atoi(argv[2]) : MAXBLK;
+    if(bsize<=0 || bsize>MAXBLK)
+      usage();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(len=0; (ret=read(0,buf,bsize)) > 0; len+=ret)
+      ;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if(ret<0 || len==0) {
+      printf("[tpipebw: read failed after %llu bytes]\n",(unsigned long long)len);
+      exit(EXIT_FAILURE);
+    }
+    usec = (uint64_t)(end.tv_sec - start.tv_sec)*1000000 +
+      (end.tv_nsec - start.tv_nsec)/1000;
+    if(usec==0)
+      usec = 1;
+    printf("tpipebw: %llu KB in %llu usec, %llu KB/s\n",
+	   (unsigned long long)(len/1024), (unsigned long long)usec,
+	   (unsigned long long)(len*1000000/1024/usec));
+    exit(EXIT_SUCCESS);
+  }
+
+  usage();
+  return EXIT_FAILURE;
+}
@@ -37,6 +37,7 @@
 #include <string.h>		/* strsep */
 #include <newlib.h>
 #include <stdint.h>
+#include <time.h>		/* clock_gettime */
 
 #include <sys/wait.h>		/* waitpid */
 
@@ -46,7 +47,13 @@
 #include <utils/tutils.h>	/* start_daemon */
 #include <utils/bool.h>		/* TRUE/FALSE */
 
+/* fixes discrepancy between kernel and user */
+#define CLOCK_MONOTONIC 1	
+
+#define BW_BYTES (4*1024*1024)	/* moved per block size by pipe_bandwidth */
+
 static int pipe_test(void);
+static int pipe_bandwidth(int bsize);
 
 /* 
  * tpiped -- Regression test for a piped.  Sends an INIT message,
@@ -69,6 +76,12 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  if ( pipe_bandwidth(512) || pipe_bandwidth(4096) || 
+       pipe_bandwidth(16384) ) {
+    printf("PIPED Bandwidth Failure.\n");
+    exit(EXIT_FAILURE);
+  }
+
   close(filedes[0]);
   close(filedes[1]);
 
@@ -300,3 +313,58 @@ static int pipe_test(void) {
 
   return 0;
 }
+
+/*
+ * Move BW_BYTES from a child to the parent through a pipe, bsize bytes 
+ * per write and read, and report the rate.
+ */
+static int pipe_bandwidth(int bsize) {
+
+  int fd[2], pid, status, ret;
+  uint64_t len, usec;
+  struct timespec start, end;
+  char *buf;
+
+  if ( !(buf = (char*)malloc(bsize)) || pipe(fd) ) {
+    printf("pipe_bandwidth: setup failed\n");
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if ( (pid = fork()) == 0 ) { /* child, write then close, exit */
+    memset(buf, 'b', bsize);
+    for ( len = 0; len < BW_BYTES; len += ret )
+      if ( (ret = write(fd[1], buf, bsize)) != bsize )
+	exit(EXIT_FAILURE);
+    close(fd[1]);
+    exit(EXIT_SUCCESS);
+  }
+
+  /* parent, read until end of file */
+  for ( len = 0; (ret = read(fd[0], buf, bsize)) > 0; len += ret )
+    if ( buf[0] != 'b' || buf[ret-1] != 'b' ) {
+      printf("pipe_bandwidth: unexpected data\n");
+      return -1;
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  waitpid(pid, &status, 0);
+  close(fd[0]);
+  free(buf);
+
+  if ( ret < 0 || len != BW_BYTES || WEXITSTATUS(status) != 0 ) {
+    printf("pipe_bandwidth: moved %llu of %d bytes\n", 
+	   (unsigned long long)len, BW_BYTES);
+    return -1;
+  }
+
+  usec = (uint64_t)(end.tv_sec - start.tv_sec)*1000000 + 
+    (end.tv_nsec - start.tv_nsec)/1000;
+  if ( usec == 0 )
+    usec = 1;
+  printf("tpiped: %5d byte writes, %llu KB/s\n", bsize, 
+	 (unsigned long long)(len*1000000/1024/usec));
+
+  return 0;
+}
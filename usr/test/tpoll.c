@@ -0,0 +1,128 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * tpoll.c -- poll() cost with many idle sockets:
+ *
+ *     tpoll [idle] [rounds]
+ *
+ * Opens idle UDP sockets that never see traffic and one active socket on
+ * the loopback interface. Each round sends a datagram to the active 
+ * socket, polls and reads it back; first polling the active socket 
+ * alone, then together with all the idle ones. With the daemons 
+ * watching the fds the two should cost about the same. Defaults: 1000
+ * idle sockets, 1000 rounds.
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <string.h>
+#include <unistd.h>		/* close */
+#include <time.h>		/* struct timespec */
+#include <syscall.h>		/* clock_gettime */
+#include <stdint.h>
+#include <poll.h>
+#include <sys/socket.h>		/* socket calls */
+#include <arpa/inet.h>		/* htons & inet_aton */
+
+/* fixes discrepancy between kernel and user */
+#define CLOCK_MONOTONIC 1
+
+#define PORT 7007
+
+static struct pollfd *fds;
+
+/* usec per round of send, poll over the first nfds fds, recv */
+static uint64_t rounds(int tx, int rx, struct sockaddr_in *to, int nfds, int n) {
+  struct timespec start, end;
+  char c;
+  int i, ret;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < n; i++) {
+    c = (char)i;
+    if(sendto(tx, &c, 1, 0, (struct sockaddr *)to, sizeof(*to)) != 1) {
+      printf("[tpoll: sendto failed]\n");
+      exit(EXIT_FAILURE);
+    }
+    if((ret = poll(fds, nfds, 1000)) != 1 || fds[0].revents != POLLIN) {
+      printf("[tpoll: poll returned %d, revents 0x%x]\n", ret, fds[0].revents);
+      exit(EXIT_FAILURE);
+    }
+    if(recvfrom(rx, &c, 1, 0, NULL, NULL) != 1 || c != (char)i) {
+      printf("[tpoll: recvfrom failed]\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return ((uint64_t)(end.tv_sec - start.tv_sec)*1000000 +
+	  (end.tv_nsec - start.tv_nsec)/1000) / n;
+}
+
+int main(int argc, char *argv[]) {
+  struct sockaddr_in addr;
+  int tx, rx, i, idle, n;
+  uint64_t alone, all;
+
+  idle = (argc > 1) ? atoi(argv[1]) : 1000;
+  n = (argc > 2) ? atoi(argv[2]) : 1000;
+  if(argc > 3 || idle < 0 || n <= 0) {
+    printf("Usage: tpoll [idle] [rounds]\n");
+    exit(EXIT_FAILURE);
+  }
+  if((fds = malloc(sizeof(struct pollfd) * (idle + 1))) == NULL) {
+    printf("[tpoll: out of memory]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port   = htons(PORT);
+  inet_aton("127.0.0.1", &(addr.sin_addr));
+  if((rx = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+     (tx = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+     bind(rx, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    printf("[tpoll: can't set up the active socket]\n");
+    exit(EXIT_FAILURE);
+  }
+  fds[0].fd = rx;
+  fds[0].events = POLLIN;
+
+  for(i = 1; i <= idle; i++) {
+    if((fds[i].fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+      printf("[tpoll: only %d idle sockets]\n", i - 1);
+      exit(EXIT_FAILURE);
+    }
+    fds[i].events = POLLIN;
+  }
+
+  alone = rounds(tx, rx, &addr, 1, n);
+  all = rounds(tx, rx, &addr, idle + 1, n);
+  printf("tpoll: %d rounds, %llu usec/round with 1 fd, %llu usec/round with %d fds\n",
+	 n, (unsigned long long)alone, (unsigned long long)all, idle + 1);
+
+  for(i = 0; i <= idle; i++)
+    close(fds[i].fd);
+  close(tx);
+  free(fds);
+  exit(EXIT_SUCCESS);
+}
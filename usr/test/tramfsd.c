@@ -0,0 +1,151 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * tramfsd.c -- ramfsd test and benchmark: write a file through ramfsd,
+ * check it reads back, then time sequential and random reads of it at
+ * several block sizes.
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <string.h>
+#include <unistd.h>		/* read/write/lseek */
+#include <fcntl.h>		/* open */
+#include <sys/stat.h>		/* stat */
+#include <time.h>		/* struct timespec */
+#include <syscall.h>		/* clock_gettime */
+#include <stdint.h>
+
+/* fixes discrepancy between kernel and user */
+#define CLOCK_MONOTONIC 1	
+
+#define FNAME   "tramfsd.dat"
+#define MAXBLK  16384
+
+static int blksizes[] = { 512, 4096, 16384 };
+#define NBLKSIZES (sizeof(blksizes)/sizeof(int))
+
+static char buf[MAXBLK];
+
+static uint64_t now_usec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+/* byte i of the file */
+static char pattern(uint64_t i) {
+  return (char)((i*7 + (i>>9)) & 0xFF);
+}
+
+static void fail(char *what) {
+  printf("[tramfsd: %s failed]\n",what);
+  unlink(FNAME);
+  exit(EXIT_FAILURE);
+}
+
+static void report(char *kind, int bsize, int nops, uint64_t bytes, uint64_t usec) {
+  if(usec==0)
+    usec = 1;
+  printf("tramfsd: %-10s %5d byte blocks: %5d reads, %4llu KB/s, %llu usec/read\n",
+	 kind, bsize, nops, (unsigned long long)(bytes*1000000/1024/usec),
+	 (unsigned long long)(usec/nops));
+}
+
+int main(int argc, char *argv[]) {
+  int fd, i, b, n, bsize, nblks;
+  uint64_t fsize, off, usec, bytes;
+  struct stat st;
+
+  fsize = (argc==2) ? atoi(argv[1]) : 1024*1024;
+  if(argc>2 || fsize<MAXBLK) {
+    printf("Usage: tramfsd [filesize >= %d]\n",MAXBLK);
+    exit(EXIT_FAILURE);
+  }
+  fsize -= fsize % MAXBLK;
+
+  /* write it */
+  if((fd = open(FNAME, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+    fail("open for write");
+  for(off=0; off<fsize; off+=MAXBLK) {
+    for(i=0; i<MAXBLK; i++)
+      buf[i] = pattern(off+i);
+    if(write(fd, buf, MAXBLK) != MAXBLK)
+      fail("write");
+  }
+  close(fd);
+
+  if(stat(FNAME, &st) < 0 || st.st_size != fsize)
+    fail("stat");
+
+  /* check it, a small block at a time */
+  if((fd = open(FNAME, O_RDONLY)) < 0)
+    fail("open for read");
+  for(off=0; off<fsize; off+=n) {
+    if((n = read(fd, buf, 100)) <= 0)
+      fail("read back");
+    for(i=0; i<n; i++)
+      if(buf[i] != pattern(off+i))
+	fail("compare");
+  }
+  if(read(fd, buf, 100) != 0)
+    fail("read at end of file");
+
+  /* sequential reads */
+  for(b=0; b<NBLKSIZES; b++) {
+    bsize = blksizes[b];
+    lseek(fd, 0, SEEK_SET);
+    bytes = 0;
+    usec = now_usec();
+    for(i=0; (n = read(fd, buf, bsize)) > 0; i++)
+      bytes += n;
+    usec = now_usec() - usec;
+    if(bytes != fsize)
+      fail("sequential read");
+    report("sequential", bsize, i, bytes, usec);
+  }
+
+  /* random reads, aligned to the block size */
+  srand(1);
+  for(b=0; b<NBLKSIZES; b++) {
+    bsize = blksizes[b];
+    nblks = fsize / bsize;
+    bytes = 0;
+    usec = now_usec();
+    for(i=0; i<nblks; i++) {
+      off = (uint64_t)(rand() % nblks) * bsize;
+      if(lseek(fd, off, SEEK_SET) != off || read(fd, buf, bsize) != bsize)
+	fail("random read");
+      bytes += bsize;
+    }
+    usec = now_usec() - usec;
+    if(buf[0] != pattern(off))
+      fail("random compare");
+    report("random", bsize, nblks, bytes, usec);
+  }
+  close(fd);
+
+  if(unlink(FNAME) < 0 || stat(FNAME, &st) == 0)
+    fail("unlink");
+  printf("tramfsd: passed\n");
+  return(EXIT_SUCCESS);
+}
@@ -0,0 +1,244 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab; 
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy 
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights 
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ copies of the Software, and to permit persons to whom the Software is 
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * tshm.c -- test shared memory regions (shm_create/shm_map/shm_unmap):
+ * regions are zeroed, shared with children, only mapped by the pids they 
+ * are granted to, and a ring in a region moves bulk data between processes.
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <string.h>
+#include <unistd.h>		/* fork/usleep */
+#include <stdint.h>
+#include <time.h>		/* struct timespec */
+#include <syscall.h>		/* shm_create/shm_map/shm_unmap/shm_grant */
+#include <sys/wait.h>		/* waitpid */
+
+/* fixes discrepancy between kernel and user */
+#define CLOCK_MONOTONIC 1	
+
+#define BW_BYTES (4*1024*1024)	/* moved per block size by shm_bandwidth */
+#define RING_SIZE (64*1024)
+#define SPIN_TRIES 1000		/* polls of the ring before sleeping */
+
+#define barrier() asm volatile("" ::: "memory")
+
+/* single producer, single consumer ring */
+typedef struct {
+  volatile uint64_t head;	/* bytes put */
+  volatile uint64_t tail;	/* bytes taken */
+  char data[RING_SIZE];
+} ring_t;
+
+/* hands region ids from parent to child in shm_grants */
+typedef struct {
+  volatile int ready;
+  volatile int granted;
+  volatile int denied;
+  volatile int asked;		/* child was denied; parent grants it now */
+  volatile int late;
+} ctl_t;
+
+static int shm_basic(void) {
+  int id, pid, status, i;
+  uint64_t size;
+  char *p;
+
+  if ( (p = (char*)shm_create(65536, NULL, 0, &id)) == NULL ) {
+    printf("shm_basic: create failed\n");
+    return -1;
+  }
+  for ( i = 0; i < 65536; i++ )
+    if ( p[i] != 0 ) {
+      printf("shm_basic: region not zeroed\n");
+      return -1;
+    }
+
+  if ( (pid = fork()) == 0 ) {	/* child shares the region */
+    memset(p, 's', 65536);
+    exit(EXIT_SUCCESS);
+  }
+  waitpid(pid, &status, 0);
+  if ( WEXITSTATUS(status) != 0 || p[0] != 's' || p[65535] != 's' ) {
+    printf("shm_basic: child write not seen\n");
+    return -1;
+  }
+
+  /* the creator may map it twice */
+  if ( shm_map(id, &size) == NULL || size != 65536 ) {
+    printf("shm_basic: map by creator failed\n");
+    return -1;
+  }
+  if ( shm_unmap(p) != 0 || shm_unmap(p) == 0 ) {
+    printf("shm_basic: unmap failed\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int shm_grants(void) {
+  int id, aid, bid, pid, status;
+  ctl_t *ctl;
+  char *a, *b, *cp;
+  uint64_t size;
+
+  if ( (ctl = (ctl_t*)shm_create(sizeof(ctl_t), NULL, 0, &id)) == NULL ) {
+    printf("shm_grants: create failed\n");
+    return -1;
+  }
+
+  if ( (pid = fork()) == 0 ) {	/* child: wait for the ids, try them */
+    while ( !ctl->ready )
+      usleep(1);
+    if ( (cp = (char*)shm_map(ctl->granted, &size)) != NULL )
+      cp[0] = 'g';
+    if ( cp == NULL || shm_map(ctl->denied, &size) != NULL ) {
+      ctl->asked = 1;		/* do not leave the parent waiting */
+      exit(EXIT_FAILURE);
+    }
+    ctl->asked = 1;
+    while ( !ctl->late )
+      usleep(1);
+    if ( (cp = (char*)shm_map(ctl->denied, &size)) == NULL )
+      exit(EXIT_FAILURE);
+    cp[0] = 'l';
+    exit(EXIT_SUCCESS);
+  }
+
+  if ( (a = (char*)shm_create(4096, &pid, 1, &aid)) == NULL ||
+       (b = (char*)shm_create(4096, NULL, 0, &bid)) == NULL ) {
+    printf("shm_grants: create failed\n");
+    return -1;
+  }
+  ctl->granted = aid;
+  ctl->denied = bid;
+  barrier();
+  ctl->ready = 1;
+
+  /* a grant added after the region was created */
+  while ( !ctl->asked )
+    usleep(1);
+  if ( shm_grant(bid, pid) != 0 ) {
+    printf("shm_grants: grant failed\n");
+    return -1;
+  }
+  ctl->late = 1;
+
+  waitpid(pid, &status, 0);
+  if ( WEXITSTATUS(status) != 0 || a[0] != 'g' || b[0] != 'l' ) {
+    printf("shm_grants: grants not honoured\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int shm_bandwidth(int bsize) {
+  int id, pid, status, n, spins;
+  uint64_t len, usec, off;
+  struct timespec start, end;
+  ring_t *r;
+  char *buf;
+
+  if ( !(buf = (char*)malloc(bsize)) || 
+       !(r = (ring_t*)shm_create(sizeof(ring_t), NULL, 0, &id)) ) {
+    printf("shm_bandwidth: setup failed\n");
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if ( (pid = fork()) == 0 ) {	/* child, produce */
+    memset(buf, 'r', bsize);
+    for ( len = 0; len < BW_BYTES; len += n ) {
+      for ( spins = 0; r->head - r->tail == RING_SIZE; spins++ )
+	if ( spins > SPIN_TRIES )
+	  usleep(1);
+      n = RING_SIZE - (r->head - r->tail);
+      if ( n > bsize )
+	n = bsize;
+      off = r->head % RING_SIZE;
+      if ( off + n > RING_SIZE )
+	n = RING_SIZE - off;
+      memcpy(&r->data[off], buf, n);
+      barrier();
+      r->head += n;
+    }
+    exit(EXIT_SUCCESS);
+  }
+
+  /* parent, consume */
+  for ( len = 0; len < BW_BYTES; len += n ) {
+    for ( spins = 0; r->head == r->tail; spins++ )
+      if ( spins > SPIN_TRIES )
+	usleep(1);
+    n = r->head - r->tail;
+    if ( n > bsize )
+      n = bsize;
+    off = r->tail % RING_SIZE;
+    if ( off + n > RING_SIZE )
+      n = RING_SIZE - off;
+    memcpy(buf, &r->data[off], n);
+    barrier();
+    r->tail += n;
+    if ( buf[0] != 'r' || buf[n-1] != 'r' ) {
+      printf("shm_bandwidth: unexpected data\n");
+      return -1;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  waitpid(pid, &status, 0);
+  shm_unmap(r);
+  free(buf);
+
+  if ( WEXITSTATUS(status) != 0 ) {
+    printf("shm_bandwidth: producer failed\n");
+    return -1;
+  }
+
+  usec = (uint64_t)(end.tv_sec - start.tv_sec)*1000000 + 
+    (end.tv_nsec - start.tv_nsec)/1000;
+  if ( usec == 0 )
+    usec = 1;
+  printf("tshm: %5d byte copies, %llu KB/s\n", bsize, 
+	 (unsigned long long)(len*1000000/1024/usec));
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+  if ( shm_basic() || shm_grants() ) {
+    printf("SHM Test Failure.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if ( shm_bandwidth(512) || shm_bandwidth(4096) || 
+       shm_bandwidth(16384) ) {
+    printf("SHM Bandwidth Failure.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("SHM Test Success.\n");
+  exit(EXIT_SUCCESS);
+}
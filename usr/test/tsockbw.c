@@ -0,0 +1,125 @@
+/*
+ Copyright <2017> <Scaleable and Concurrent Systems Lab;
+                   Thayer School of Engineering at Dartmouth College>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+/*
+ * tsockbw.c -- TCP throughput against a sink/source on the host:
+ *
+ *     tsockbw s <ip> <port> <KB> [blocksize]   send KB kilobytes
+ *     tsockbw r <ip> <port> [blocksize]        receive to end of file
+ *
+ * Under qemu user networking (scripts/runqemu -net user) the host is 
+ * 10.0.2.2; run "nc -l 5001 > /dev/null" there to sink, or 
+ * "head -c 64M /dev/zero | nc -l 5001" to source. Blocks bigger than 
+ * SOCKET_SNDBUF_MAX go through the shared bulk socket buffers.
+ */
+#include <stdlib.h>		/* EXIT_FAILURE/EXIT_SUCCESS */
+#include <stdio.h>		/* printf */
+#include <string.h>
+#include <unistd.h>		/* close */
+#include <time.h>		/* struct timespec */
+#include <syscall.h>		/* clock_gettime */
+#include <stdint.h>
+#include <sys/socket.h>		/* socket calls */
+#include <arpa/inet.h>		/* htons & inet_aton */
+
+/* fixes discrepancy between kernel and user */
+#define CLOCK_MONOTONIC 1
+
+#define MAXBLK (256*1024)
+
+static char buf[MAXBLK];
+
+static void usage(void) {
+  printf("Usage: tsockbw s <ip> <port> <KB> [blocksize]\n");
+  printf("       tsockbw r <ip> <port> [blocksize]\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  struct sockaddr_in servaddr;
+  struct timespec start, end;
+  uint64_t len, total, usec;
+  int sock, bsize, ret, sending;
+
+  if(argc<4)
+    usage();
+  if(strcmp(argv[1],"s")==0) {
+    if(argc<5 || argc>6)
+      usage();
+    sending = 1;
+    total = (uint64_t)atoi(argv[4]) * 1024;
+    bsize = (argc==6) ? atoi(argv[5]) : 65536;
+  }
+  else if(strcmp(argv[1],"r")==0) {
+    if(argc>5)
+      usage();
+    sending = 0;
+    total = 0;
+    bsize = (argc==5) ? atoi(argv[4]) : 65536;
+  }
+  else
+    usage();
+  if(bsize<=0 || bsize>MAXBLK)
+    usage();
+
+  memset(&servaddr, 0, sizeof(servaddr));
+  servaddr.sin_family = AF_INET;
+  servaddr.sin_port   = htons(atoi(argv[3]));
+  if(inet_aton(argv[2],&(servaddr.sin_addr)) <= 0)
+    usage();
+  if((sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+    printf("[tsockbw: socket failed]\n");
+    exit(EXIT_FAILURE);
+  }
+  if(connect(sock,(struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
+    printf("[tsockbw: connect failed]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if(sending) {
+    memset(buf,'s',bsize);
+    for(len=0; len<total; len+=ret)
+      if((ret=send(sock,buf,(total-len < bsize) ? total-len : bsize,0)) <= 0)
+	break;
+  }
+  else {
+    for(len=0; (ret=recv(sock,buf,bsize,0)) > 0; len+=ret)
+      ;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  close(sock);
+
+  if(ret<0 || len==0) {
+    printf("[tsockbw: %s failed after %llu bytes]\n", sending ? "send" : "recv",
+	   (unsigned long long)len);
+    exit(EXIT_FAILURE);
+  }
+  usec = (uint64_t)(end.tv_sec - start.tv_sec)*1000000 +
+    (end.tv_nsec - start.tv_nsec)/1000;
+  if(usec==0)
+    usec = 1;
+  printf("tsockbw: %s %llu KB in %llu usec, %llu KB/s\n", 
+	 sending ? "sent" : "received", (unsigned long long)(len/1024), 
+	 (unsigned long long)usec, (unsigned long long)(len*1000000/1024/usec));
+  exit(EXIT_SUCCESS);
+}